@@ -11,19 +11,48 @@
 
 #include "eth.h"
 #include "ipv4.h"
+#include "net_stack.h"
 
-/* int arp_resolve(eth_iface_t * iface,ipv4_addr_t ip_addr,mac_addr_t mac_addr);
+/* Valor del campo Type en un paquete ARP para que sea ethernet */
+#define ARP_ETH_TYPE 0x0806
+
+/* Valores de los campos hw_type y proto_type de un paquete ARP sobre
+   Ethernet que pregunta por direcciones IPv4 */
+#define ARP_HW_TYPE_ETHERNET 0x0001
+#define ARP_PROTO_TYPE_IPv4 0x0800
+
+/* Valor del campo Code (op_code) en un paquete ARP pata que sea request*/
+#define ARP_REQ_CODE 0x0001
+/* Valor del campo Code (op_code) en un paquete ARP pata que sea reply*/
+#define ARP_REP_CODE 0x0002
+/* Tamaño de un paquete ARP */
+#define ARP_MSG_SIZE 28
+
+/* Esta es la estructura de un paquete ARP */
+typedef struct arp_pkt_t{
+	uint16_t hw_type;			       // Tipo de dirección de hardware
+	uint16_t proto_type;		     // Tipo de dirección de software
+	uint8_t hw_size;			       // Longitud de la dirección de hardware
+	uint8_t proto_size;			     // Longitud de la direccion de software
+	uint16_t op_code;			       //  Codigo de la operacion (Request o reply)
+	mac_addr_t src_hw_addr; 	   // Dirección de hardware de origen
+	ipv4_addr_t src_proto_addr;	 // Direccion IP de origen
+	mac_addr_t dst_hw_addr;		   // Dirección de hardware de destino (La MAC que deseamos saber)
+	ipv4_addr_t dst_proto_addr;  // Direccion IP de destino (por la que preguntamos la MAC)
+} arp_pkt ;
+
+/* int arp_resolve(net_stack_t * stack, eth_iface_t * iface,ipv4_addr_t ip_addr,mac_addr_t mac_addr);
  *
  * DESCRIPCIÓN:
  *   Esta función resuelve la query de arp basada en la IP que se le entregue
  *   nos devuelve la MAC asociada.
- *   Esta función usa funciones subordinadas para ejecutar algunas funciones
- *   estra como uso de caché o reintento de arp-request. 
  *   Primero se mira si esta en cache
  *    Si esta: se usa
  *    Si esta caducada: se usa arp unicast
  *    No esta: se hace broadcast
- *   Segundo: si dió error primero se hace un segundo intento en broadcast directamente
+ *   Si ya hay un ARP REQUEST en curso para esa IP no se envía otro, sólo se
+ *   espera su respuesta. Tras no responder, la IP no se vuelve a preguntar
+ *   durante un tiempo que se dobla con cada fallo consecutivo.
  *
  * PARÁMETROS:
  *   'iface': Puntero a la estructura del manejador del interfaz ethernet.
@@ -35,47 +64,212 @@
  *   La función devuelve '0' si todo ha ido bien.
  *
  * ERRORES:
- *   La función devuelve '-1' si se ha producido algún error.
+ *   La función devuelve '-1' si se ha producido algún error o la IP no responde.
  */
 
-int arp_resolve(eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr);
+int arp_resolve(net_stack_t * stack, eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr);
+
+/* int arp_resolve_async(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, ipv4_addr_t my_ipv4_addr, mac_addr_t mac_addr,
+ *                       uint16_t type, unsigned char * packet, int packet_len);
+ *
+ * DESCRIPCIÓN:
+ *   Versión no bloqueante de 'arp_resolve()'. Si la MAC está en la caché se
+ *   devuelve inmediatamente. Si no, el paquete se copia en la cola del vecino,
+ *   se envía un ARP REQUEST (sólo si no había ya uno en curso) y se retorna
+ *   sin esperar. Los paquetes encolados se envían al recibir el ARP REPLY
+ *   desde 'arp_input()', o se descartan al agotarse los reintentos en
+ *   'arp_pending_timers()'.
+ *
+ * PARÁMETROS:
+ *   'iface': Interfaz por el que se enviará el paquete.
+ *   'ip_addr': Direccion IP por la que se pregunta.
+ *   'my_ipv4_addr': Nuestra direccion IP.
+ *   'mac_addr': Direccion MAC encontrada, si estaba en la caché.
+ *   'type': Tipo Ethernet con el que se enviará el paquete encolado.
+ *   'packet': Datos de la trama a encolar. Puede ser 'NULL' para lanzar la
+ *             resolución sin encolar nada.
+ *   'packet_len': Longitud de 'packet'.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si la MAC estaba en la caché (se copia en 'mac_addr').
+ *   '1' si el paquete se ha encolado a la espera de la resolución.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el paquete se ha descartado, porque la cola
+ *   del vecino o la tabla de resoluciones en curso estaban llenas, o porque
+ *   la IP no respondió hace poco y aún no se puede volver a preguntar.
+ */
+int arp_resolve_async(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, ipv4_addr_t my_ipv4_addr, mac_addr_t mac_addr,
+                      uint16_t type, unsigned char * packet, int packet_len);
 
-/* int arp_rslv(eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr,unsigned int timeout,unsigned int unicast);
-  *
-  * DESCRIPCIÓN:
-  *   Esta función resuelve la query de arp basada en la IP que se le entregue
-  *   nos devuelve la MAC asociada
-  *
-  * PARÁMETROS:
-  *   'iface': Puntero a la estructura del manejador del interfaz ethernet.
-  *	 'ip_addr': Direccion IP por la que se pregunta.
-  *	 'my_ipv4_addr: Nuetsra direccion IP'
-  *   'mac_addr': Direccion MAC que se encuentra.
-  *   'timeout' : Tiempo limite para recibir el paquete
-  *
-  * VALOR DEVUELTO:
-  *   La función devuelve '0' si todo ha ido bien.
-  *
-  * ERRORES:
-  *   La función devuelve '-1' si se ha producido algún error.
-  */
+/* void arp_input(net_stack_t * stack, eth_iface_t * iface, mac_addr_t src, unsigned char * payload, int payload_len, ipv4_addr_t my_ipv4_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Procesa una trama ARP recibida (p.ej. desde el manejador del interfaz,
+ *   ver 'eth_set_handler()').
+ *   Responde a los ARP REQUEST que preguntan por nuestra IP. Aprende o
+ *   refresca la MAC del emisor de las peticiones y respuestas dirigidas a
+ *   nuestra IP, de los ARP gratuitos y de las respuestas a resoluciones en
+ *   curso (enviando entonces los paquetes encolados).
+ *
+ * PARÁMETROS:
+ *   'iface': Interfaz por el que se ha recibido la trama.
+ *   'src': MAC origen de la trama.
+ *   'payload': Mensaje ARP recibido.
+ *   'payload_len': Longitud del mensaje ARP.
+ *   'my_ipv4_addr': Nuestra dirección IP, o NULL para sólo aprender.
+ */
+void arp_input(net_stack_t * stack, eth_iface_t * iface, mac_addr_t src, unsigned char * payload, int payload_len, ipv4_addr_t my_ipv4_addr);
 
-int arp_rslv(eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr,unsigned int timeout,unsigned int unicast);
+/* void arp_learn(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, mac_addr_t mac_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Guarda (o refresca) en la caché de 'iface' que 'ip_addr' está en
+ *   'mac_addr', p.ej. al recibir un paquete IP de un vecino, y envía los
+ *   paquetes que estuvieran encolados a la espera de resolver esa dirección
+ *   por ese interfaz.
+ */
+void arp_learn(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, mac_addr_t mac_addr);
+
+/* int arp_announce(eth_iface_t * iface, ipv4_addr_t my_ipv4_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Envía un ARP gratuito anunciando que 'my_ipv4_addr' está en la MAC
+ *   del interfaz, para que los vecinos no tengan que preguntar por ella.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha enviado el anuncio.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar.
+ */
+int arp_announce(eth_iface_t * iface, ipv4_addr_t my_ipv4_addr);
+
+/* int arp_reply(eth_iface_t * iface, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip);
+ *
+ * DESCRIPCIÓN:
+ *   Envía un ARP REPLY a 'dst_mac'/'dst_ip' indicando que 'src_ip' está en
+ *   'src_mac'. 'src_mac' es nuestra MAC salvo cuando se responde en nombre
+ *   de otro equipo (entradas estáticas o proxy ARP).
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha enviado el ARP REPLY.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar.
+ */
+int arp_reply(eth_iface_t * iface, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip);
+
+/* void arp_reply_build(arp_pkt * packet, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip);
+ *
+ * DESCRIPCIÓN:
+ *   Rellena 'packet' con el mismo ARP REPLY que enviaría 'arp_reply()', sin
+ *   enviarlo, para poder mandar varias respuestas juntas con
+ *   'eth_send_batch()'.
+ */
+void arp_reply_build(arp_pkt * packet, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip);
+
+/* long int arp_pending_timeout(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el tiempo que falta para el siguiente reintento de alguna
+ *   resolución asíncrona en curso. Quien espere tramas debe llamar a
+ *   'arp_pending_timers()' cuando venza.
+ *
+ * VALOR DEVUELTO:
+ *   Milisegundos hasta el siguiente reintento, o '-1' si no hay ninguna
+ *   resolución en curso.
+ */
+long int arp_pending_timeout(net_stack_t * stack);
+
+/* void arp_pending_timers(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Procesa las resoluciones asíncronas cuyo temporizador ha vencido: vuelve
+ *   a enviar el ARP REQUEST por broadcast o, si ya se han hecho todos los
+ *   intentos, descarta los paquetes encolados.
+ */
+void arp_pending_timers(net_stack_t * stack);
+
+/* int arp_pending_count(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de resoluciones asíncronas en curso.
+ */
+int arp_pending_count(net_stack_t * stack);
+
+/* int arp_pending_queued(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de paquetes encolados a la espera de que se resuelva
+ *   la MAC de su destino.
+ */
+int arp_pending_queued(net_stack_t * stack);
+
+/* int arp_pending_wait(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t my_ipv4_addr, long int timeout);
+ *
+ * DESCRIPCIÓN:
+ *   Espera hasta 'timeout' ms a que se completen todas las resoluciones en
+ *   curso por 'iface' (p.ej. varias lanzadas seguidas con
+ *   'arp_resolve_async()' sin paquete), procesando las tramas ARP que
+ *   lleguen y los reintentos.
+ *
+ * VALOR DEVUELTO:
+ *   Número de resoluciones por 'iface' que siguen en curso al volver.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la recepción en el interfaz.
+ */
+int arp_pending_wait(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t my_ipv4_addr, long int timeout);
+
+/* unsigned int arp_dropped(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de paquetes descartados hasta ahora porque no se pudo
+ *   resolver la MAC de su destino.
+ */
+unsigned int arp_dropped(net_stack_t * stack);
+
+/* int arp_init(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Reserva el estado ARP de la pila, con la caché vacía. Lo hace
+ *   'net_stack_create()'.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha reservado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no hay memoria.
+ */
+int arp_init(net_stack_t * stack);
+
+/* void arp_close(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Descarta los paquetes que esperaban una resolución y libera el estado
+ *   ARP de la pila. Lo hace 'net_stack_destroy()'.
+ */
+void arp_close(net_stack_t * stack);
 
-/* void cache_init();
+/* void cache_init(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
- *   Esta función pone a cero el array de la cache
+ *   Esta función pone a cero el array de la cache, junto a las resoluciones
+ *   en curso (descartando sus paquetes) y la caché negativa, p.ej. porque se
+ *   han cerrado los interfaces.
  */
-void cache_init();
+void cache_init(net_stack_t * stack);
 
 
-/* int cache_add(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+/* int cache_add(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *
  * DESCRIPCIÓN:
- *   Esta funcion añade una mac a un espacio vacío del array. 
+ *   Esta funcion añade una mac a un espacio vacío del array. Si la IP ya
+ *   estaba en la cache, actualiza su MAC y su timestamp.
  *
  * PARÁMETROS:
+ *   'iface': Interfaz por el que se llega a 'ip_addr'.
  *   'ip_addr': Direccion IP que se quiere guardar.
  *   'mac_addr': Direccion MAC que se quiere guaradar.
  *
@@ -83,15 +277,16 @@ void cache_init();
  *   La función devuelve '0' si todo ha ido bien.
  *
  */
-int cache_add(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+int cache_add(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
 
-/* int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+/* int cache_resolve(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *
  * DESCRIPCIÓN:
  *   Resuelve una dirección MAC dando una dirección IP dentro de la caché ARP
  *   Esta funcion hace de arp_resolve pero dentro de la propia caché
  *
  * PARÁMETROS:
+ *   'iface': Interfaz por el que se llega a 'ip_addr'.
  *   'ip_addr': Direccion IP por la que se pregunta.
  *   'mac_addr': Direccion MAC que se quiere.
  *
@@ -102,9 +297,9 @@ int cache_add(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *   Si la encuenta y es antigua, devuelve -1 y borra la direccion
  *   Si no la encuentra, devuelve -2
  */
-int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+int cache_resolve(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
 
-/* int cache_get_older();
+/* int cache_get_older(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
  *   Recorre los indices de la caché para ver cual es el mas antiguo.
@@ -112,15 +307,16 @@ int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  * VALOR DEVUELTO:
  *   Devuelve el indice de la entrada mas antigua
  */
-int cache_get_older();
+int cache_get_older(net_stack_t * stack);
 
-/* int cache_add_empty(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+/* int cache_add_empty(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *
  * DESCRIPCIÓN:
  *   Si encuentra un slot vacío en la caché (viendo que el timestamp sea 0), 
  *   inserta la entrada arp_cache en ella. Sino devuelve fallo -1
  *
  * PARÁMETROS:
+ *   'iface': Interfaz por el que se llega a 'ip_addr'.
  *   'ip_addr': Direccion IP que se quiere insertar.
  *   'mac_addr': Direccion MAC que se quiere insertar.
  *
@@ -130,9 +326,9 @@ int cache_get_older();
  * ERRORES:
  *   Si ha habido fallos, devuelve -1, por ejemplo falta de estacio
  */
-int cache_add_empty(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+int cache_add_empty(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
 
-/* int cache_show();
+/* int cache_show(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
  *   Muestra los valores que hay en la cache ahora mismo
@@ -140,6 +336,6 @@ int cache_add_empty(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  * VALOR DEVUELTO:
  *  Si todo es correcto, devuelve 0.
  */
-int cache_show();
+int cache_show(net_stack_t * stack);
 
 #endif /* _ARP_H */
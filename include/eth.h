@@ -2,6 +2,9 @@
 #define _ETH_H
 
 #include <stdint.h>
+#include <sys/uio.h>
+#include "reactor.h"
+#include "pkt.h"
 
 /* Tamaño en bytes de las direcciones MAC (48 bits == 6 bytes) */
 #define MAC_ADDR_SIZE 6
@@ -19,6 +22,42 @@ extern mac_addr_t MAC_BCAST_ADDR;
    ser accedida directamente, sino a través de las funciones de esta librería. */
 typedef struct eth_iface eth_iface_t;
 
+/* Captura de tramas a ficheros pcap-ng (ver "eth_capture.h") */
+typedef struct eth_capture eth_capture_t;
+
+/* Número máximo de manejadores de protocolo registrados en un interfaz */
+#define ETH_HANDLERS_MAX 4
+/* Número máximo de protocolos con cola de recepción en un interfaz */
+#define ETH_QUEUES_MAX 4
+/* Número máximo de tramas guardadas en la cola de cada protocolo */
+#define ETH_QUEUE_LENGTH 32
+/* Número máximo de tramas que se pasan juntas al interfaz "crudo" en
+   'eth_send_batch()' y 'eth_recv_batch()'. Los lotes mayores se trocean. */
+#define ETH_BATCH_MAX 32
+/* Número máximo de trozos de datos en 'eth_sendv()' */
+#define ETH_IOV_MAX 8
+/* Modos de reparto de 'eth_open_fanout()' */
+#define ETH_FANOUT_HASH 0
+#define ETH_FANOUT_CPU 1
+
+/* Trama de un lote de 'eth_send_batch()' o 'eth_recv_batch()' */
+typedef struct eth_batch_frame {
+  mac_addr_t addr;          /* MAC destino al enviar, MAC origen al recibir */
+  unsigned char * payload;  /* Datos de la trama */
+  int payload_len;          /* Longitud de los datos. Al recibir, tamaño del
+                               buffer 'payload' en la entrada y longitud de
+                               los datos recibidos en la salida. */
+} eth_batch_frame_t;
+
+/* Función que procesa una trama recibida de un protocolo concreto. Recibe la
+   dirección MAC origen y los datos de la trama, además del argumento 'arg'
+   indicado al registrarla con 'eth_set_handler()'. Los datos pueden estar
+   en el anillo de recepción y sólo son válidos durante la llamada: el
+   manejador no debe recibir tramas del mismo interfaz mientras los use. */
+typedef void (*eth_handler_t)
+( eth_iface_t * iface, mac_addr_t src, unsigned char * payload,
+  int payload_len, void * arg );
+
 
 /* eth_iface_t * eth_open ( char* ifname );
  *
@@ -45,6 +84,29 @@ typedef struct eth_iface eth_iface_t;
 eth_iface_t * eth_open ( char* ifname );
 
 
+/* eth_iface_t * eth_open_fanout ( char* ifname, int group_id, int mode );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_open()', pero el interfaz se une al grupo PACKET_FANOUT
+ *   'group_id' (ver 'rawiface_open_fanout()'): las tramas recibidas se
+ *   reparten entre todos los interfaces abiertos con el mismo grupo, en vez
+ *   de llegar a todos ellos. Ver también 'eth_fanout_open()'.
+ *
+ * PARÁMETROS:
+ *   'ifname': Nombre de la interfaz Ethernet.
+ * 'group_id': Identificador del grupo (0-65535).
+ *     'mode': 'ETH_FANOUT_HASH' (por flujo) o 'ETH_FANOUT_CPU' (por la CPU
+ *             que recibió la trama).
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la interfaz Ethernet inicializada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+eth_iface_t * eth_open_fanout ( char* ifname, int group_id, int mode );
+
+
 /* char * eth_getname ( eth_iface_t * iface );
  * 
  * DESCRIPCIÓN:
@@ -113,6 +175,112 @@ int eth_send
   mac_addr_t dst, uint16_t type, unsigned char * payload, int payload_len );
 
 
+/* int eth_sendv
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+ *   const struct iovec * iov, int iovcnt );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_send()', pero los datos se indican en 'iovcnt' trozos
+ *   (hasta 'ETH_IOV_MAX') que se envían con la cabecera Ethernet mediante
+ *   scatter/gather ('rawnet_sendv()'), sin copiarlos a una trama contigua.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes de datos que han podido ser enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_sendv
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+  const struct iovec * iov, int iovcnt );
+
+
+/* int eth_send_buf
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * buf );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_send()', pero la cabecera Ethernet se escribe en el
+ *   espacio reservado de 'buf', delante de los datos, y la trama sale de ahí
+ *   sin copiarse. Al volver, 'buf' incluye la cabecera.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes de datos que han podido ser enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error o no queda
+ *   espacio reservado.
+ */
+int eth_send_buf
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * buf );
+
+
+/* int eth_flush ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Si la interfaz se abrió como "mmap:<nombre>", 'eth_send()' sólo deja la
+ *   trama en el anillo de transmisión. Esta función las envía todas de golpe.
+ *   'eth_recv()', 'eth_poll()' y 'eth_close()' lo hacen automáticamente.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas enviadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_flush ( eth_iface_t * iface );
+
+
+/* int eth_send_batch
+ * ( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[], int count );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envía 'count' tramas del mismo 'Tipo' con una sola llamada
+ *   al sistema por cada 'ETH_BATCH_MAX' tramas. Cada trama lleva su propia
+ *   dirección MAC destino ('frames[i].addr').
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *     'type': Valor del campo 'Tipo' de las tramas a enviar.
+ *   'frames': Array con el destino y los datos de cada trama.
+ *    'count': Número de tramas a enviar.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas enviadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar ninguna trama, o si
+ *   alguna supera 'ETH_MTU' bytes (y entonces no se envía ninguna).
+ */
+int eth_send_batch
+( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[], int count );
+
+
+/* int eth_send_buf_batch
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+ *   pkt_buf_t * bufs[], int count );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_send_batch()' para 'count' tramas hacia 'dst', pero con
+ *   los datos en buffers 'pkt_buf_t', como en 'eth_send_buf()': la cabecera
+ *   Ethernet se escribe delante de los datos de cada uno y las tramas salen
+ *   de ahí sin copiarse. Al volver, los buffers incluyen la cabecera.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas enviadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar ninguna trama, o si
+ *   alguna supera 'ETH_MTU' bytes o no tiene espacio reservado para la
+ *   cabecera (y entonces no se envía ninguna).
+ */
+int eth_send_buf_batch
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+  pkt_buf_t * bufs[], int count );
+
+
 /* int eth_recv 
  * ( eth_iface_t * iface, 
  *   mac_addr_t src, uint16_t type, unsigned char buffer[], long int timeout );
@@ -122,6 +290,11 @@ int eth_send
  *   interfaz Ethernet indicada. La operación puede esperar indefinidamente o
  *   un tiempo limitando dependiento del parámetro 'timeout'.
  *
+ *   Las tramas de otros tipos que se reciban mientras tanto no se pierden:
+ *   se entregan al manejador de su protocolo ('eth_set_handler()') o se
+ *   guardan en su cola ('eth_register()') para la siguiente llamada a esta
+ *   función con ese tipo.
+ *
  *   Esta función sólo permite recibir paquetes de una única interfaz. Si desea
  *   escuchar varias interfaces Ethernet simultaneamente, utilice la función
  *   'eth_poll()'.
@@ -136,7 +309,7 @@ int eth_send
  *             memoria indicada, que debe estar reservada previamente.
  *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
  *             recibir. 
- *             Las tramas con un valor 'type' diferente serán descartadas.
+ *             Las tramas con un valor 'type' diferente no se devuelven.
  *   'buffer': Array donde se almacenarán los datos de la trama recibida.
  *  'buf_len': Longitud del 'buffer' dónde se almacenarán los datos de la trama
  *             recibida. Si se reciben más datos de los que caben el en 'buffer'
@@ -159,6 +332,70 @@ int eth_recv
   int buf_len, long int timeout );
 
 
+/* int eth_recv_view
+ * ( eth_iface_t * iface, mac_addr_t src, uint16_t type, pkt_view_t * view,
+ *   long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_recv()', pero sin copiar los datos: 'view' queda sobre la
+ *   trama recibida ('rawnet_recv_zerocopy()') con la cabecera Ethernet ya
+ *   consumida, de modo que sus datos son los de la capa superior.
+ *
+ *   La vista sólo es válida hasta la siguiente recepción por 'iface' (ver
+ *   "pkt.h").
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *      'src': Dirección MAC del equipo que envió la trama.
+ *     'type': Valor del campo 'Tipo' de la trama que se desea recibir.
+ *     'view': Vista donde se devolverá la trama recibida.
+ *  'timeout': Igual que en 'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud en bytes de los datos de la trama recibida, o '0' si ha
+ *   expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv_view
+( eth_iface_t * iface, mac_addr_t src, uint16_t type, pkt_view_t * view,
+  long int timeout );
+
+
+/* int eth_recv_batch
+ * ( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[],
+ *   int count, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_recv()', pero en cuanto llega la primera trama del 'Tipo'
+ *   indicado recoge también, sin esperar, las que ya estén disponibles,
+ *   hasta un máximo de 'count'. Las tramas de otros tipos se tratan igual
+ *   que en 'eth_recv()'.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *     'type': Valor del campo 'Tipo' de las tramas que se desea recibir.
+ *   'frames': Array donde se devolverá la MAC origen y los datos de cada
+ *             trama. 'payload' y 'payload_len' deben indicar el buffer de
+ *             cada trama y su tamaño; 'payload_len' se sustituye por la
+ *             longitud de los datos recibidos (que puede ser mayor).
+ *    'count': Número máximo de tramas a recibir.
+ *  'timeout': Tiempo en milisegundos que debe esperarse a la primera trama.
+ *             Un número negativo indicará que debe esperarse
+ *             indefinidamente, y un '0' que no debe esperarse.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas recibidas, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv_batch
+( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[],
+  int count, long int timeout );
+
+
 /* int eth_poll 
  * ( eth_iface_t * ifaces[], int ifnum, long int timeout );
  *
@@ -192,6 +429,190 @@ int eth_poll
 ( eth_iface_t * ifaces[], int ifnum, long int timeout );
 
 
+/* int eth_process ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee, sin esperar, todas las tramas que ya haya recibido el
+ *   interfaz y entrega cada una al manejador de su tipo ('eth_set_handler()'),
+ *   o la guarda en su cola si el tipo no tiene manejador. Es la forma de
+ *   recibir cuando el interfaz está en un bucle de eventos ('eth_reactor_add()').
+ *
+ *   Si el interfaz tiene anillo de recepción ("mmap:<ifname>") u otro
+ *   backend, los manejadores reciben cada trama en su sitio, sin copiarla.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas procesadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_process ( eth_iface_t * iface );
+
+
+/* int eth_reactor_add ( reactor_t * reactor, eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra el interfaz en el bucle de eventos 'reactor', que
+ *   llamará a 'eth_process()' cada vez que lleguen tramas. Las tramas se
+ *   entregan a los manejadores de 'eth_set_handler()'.
+ *
+ * PARÁMETROS:
+ *   'reactor': Manejador del bucle de eventos.
+ *     'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el interfaz se ha registrado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_reactor_add ( reactor_t * reactor, eth_iface_t * iface );
+
+
+/* int eth_set_handler
+ * ( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra un manejador para las tramas con el 'Tipo'
+ *   indicado. Cuando 'eth_recv()' reciba una trama dirigida a nosotros cuyo
+ *   tipo no sea el que se está esperando, en lugar de descartarla se la
+ *   entregará al manejador registrado para ese tipo.
+ *
+ *   Si ya había un manejador para ese tipo se sustituye. Un 'handler' 'NULL'
+ *   elimina el manejador registrado.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *      'type': Valor del campo 'Tipo' de las tramas a procesar.
+ *   'handler': Función que procesará las tramas de ese tipo.
+ *       'arg': Argumento que se pasará a 'handler' junto a cada trama.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el manejador se ha registrado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL' o si ya hay
+ *   'ETH_HANDLERS_MAX' manejadores registrados.
+ */
+int eth_set_handler
+( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg );
+
+
+/* int eth_register ( eth_iface_t * iface, uint16_t type );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea la cola de recepción del protocolo 'type'. Las tramas
+ *   de ese tipo que se reciban mientras 'eth_recv()' espera tramas de otro
+ *   tipo se guardan en ella (hasta 'ETH_QUEUE_LENGTH' tramas) en lugar de
+ *   descartarse, y se entregarán en la siguiente llamada a 'eth_recv()' con
+ *   ese tipo.
+ *
+ *   'eth_recv()' registra automáticamente el tipo que recibe, pero conviene
+ *   registrarlo al abrir el protocolo para no perder las tramas que lleguen
+ *   antes de la primera recepción.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *    'type': Valor del campo 'Tipo' de las tramas a guardar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la cola se ha creado o ya existía.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL', si ya hay
+ *   'ETH_QUEUES_MAX' colas o si no hay memoria para la cola.
+ */
+int eth_register ( eth_iface_t * iface, uint16_t type );
+
+
+/* int eth_filter_ipv4_port ( eth_iface_t * iface, uint8_t protocol, uint16_t port );
+ *
+ * DESCRIPCIÓN:
+ *   El interfaz instala en el kernel un filtro BPF que sólo deja pasar las
+ *   tramas dirigidas a nuestra MAC (o multicast/difusión) de los tipos con
+ *   manejador o cola. Esta función lo restringe además para que de las
+ *   tramas IPv4 sólo lleguen los paquetes sin fragmentar del 'protocol'
+ *   indicado (UDP o TCP) con puerto destino 'port'. Con 'port' igual a 0 se
+ *   vuelven a aceptar todos los paquetes IPv4.
+ *
+ * PARÁMETROS:
+ *      'iface': Manejador de la interfaz Ethernet.
+ *   'protocol': Protocolo IPv4 (p.ej. 17 para UDP).
+ *       'port': Puerto destino.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha instalado el filtro.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido instalar. Las tramas se
+ *   siguen filtrando igualmente en 'eth_recv()' y las capas superiores.
+ */
+int eth_filter_ipv4_port ( eth_iface_t * iface, uint8_t protocol, uint16_t port );
+
+
+/* int eth_set_timestamps ( eth_iface_t * iface, int enable );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa (o desactiva) la marca de tiempo de llegada de las
+ *   tramas (ver 'rawiface_set_timestamps()'). Con ella activada, las vistas
+ *   de 'eth_recv_view()' y de las capas superiores la llevan en 'stamp', y
+ *   'eth_get_timestamp()' devuelve la de la última trama entregada.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'enable': 1 para activarla, 0 para desactivarla.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_set_timestamps ( eth_iface_t * iface, int enable );
+
+
+/* int eth_get_timestamp ( eth_iface_t * iface, struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve en 'stamp' el instante (CLOCK_REALTIME) en que el
+ *   kernel recibió la última trama entregada por el interfaz: la que ha
+ *   devuelto 'eth_recv()' o la que se está procesando en un manejador
+ *   ('eth_set_handler()').
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la trama tiene marca de tiempo.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no la tiene (p.ej. si las marcas no están
+ *   activadas).
+ */
+int eth_get_timestamp ( eth_iface_t * iface, struct timespec * stamp );
+
+
+/* int eth_set_capture ( eth_iface_t * iface, eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función hace que todas las tramas que el interfaz envíe o reciba
+ *   (antes de descartar las de otras MAC) se copien en la captura 'capture'
+ *   ('eth_capture_open()'). Con 'capture' 'NULL' se deja de capturar.
+ *   Sin captura, enviar y recibir no cuesta nada más.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *   'capture': Captura, o 'NULL'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_set_capture ( eth_iface_t * iface, eth_capture_t * capture );
+
+
 /* int eth_close ( eth_iface_t * iface );
  * 
  * DESCRIPCIÓN:
@@ -0,0 +1,164 @@
+#ifndef _ETH_CAPTURE_H
+#define _ETH_CAPTURE_H
+
+#include "eth.h"
+
+#include <time.h>
+#include <sys/uio.h>
+
+/* Captura de tramas a ficheros pcap-ng. Los interfaces Ethernet con una
+   captura ('eth_set_capture()') copian cada trama enviada o recibida en un
+   anillo en memoria, sin bloqueos ni llamadas al sistema, y un hilo propio
+   de la captura las vacía a disco. Si el hilo no da abasto, las tramas que
+   no caben en el anillo se pierden (y se cuentan), pero el envío y la
+   recepción nunca esperan.
+
+   Varios interfaces, en el mismo hilo o en hilos distintos, pueden
+   compartir una captura: cada uno aparece como un interfaz del fichero.
+
+   El manejador de la captura ('eth_capture_t', declarado en "eth.h") es una
+   estructura opaca que no debe ser accedida directamente, sino a través de
+   las funciones de esta librería. */
+
+/* Número de tramas que caben en el anillo (potencia de 2) */
+#define ETH_CAPTURE_RING_SLOTS 4096
+/* Bytes que se guardan, como máximo, de cada trama (la trama completa) */
+#define ETH_CAPTURE_SNAPLEN_MAX (14 + ETH_MTU)
+/* Número máximo de interfaces de una captura */
+#define ETH_CAPTURE_IFACES_MAX 16
+/* Número máximo de ficheros de la rotación */
+#define ETH_CAPTURE_FILES_MAX 1000
+/* Sentido de una trama (opción 'epb_flags' de pcap-ng) */
+#define ETH_CAPTURE_IN 1
+#define ETH_CAPTURE_OUT 2
+
+/* Estadísticas de una captura */
+typedef struct eth_capture_stats {
+  unsigned long frames;   /* Tramas escritas */
+  unsigned long dropped;  /* Tramas perdidas por tener el anillo lleno */
+  unsigned long bytes;    /* Bytes escritos, en todos los ficheros */
+  unsigned long files;    /* Ficheros abiertos (rotaciones + 1) */
+  unsigned long errors;   /* Errores de escritura */
+} eth_capture_stats_t;
+
+
+/* eth_capture_t * eth_capture_open
+ * ( char * path, int snaplen, long int file_size, int files );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una captura que escribe en 'path' y arranca su hilo.
+ *   No captura nada hasta asociarla a algún interfaz con
+ *   'eth_set_capture()'.
+ *
+ *   Con 'file_size' mayor que 0, al llegar a ese tamaño se pasa al
+ *   siguiente fichero: "<path>.0", "<path>.1"... hasta "<path>.<files-1>",
+ *   y se vuelve a empezar sobrescribiendo el más antiguo. Cada fichero es
+ *   una captura pcap-ng completa.
+ *
+ *   La memoria del manejador devuelto debe ser liberada con la función
+ *   'eth_capture_close()'.
+ *
+ * PARÁMETROS:
+ *      'path': Nombre del fichero (o prefijo de los ficheros) de captura.
+ *   'snaplen': Bytes que se guardan de cada trama (1-'ETH_CAPTURE_SNAPLEN_MAX'),
+ *              o 0 para guardarlas completas. Cuanto menor, menos cuesta
+ *              copiarlas y más caben en el anillo.
+ * 'file_size': Tamaño en bytes a partir del cual se rota, o 0 para escribir
+ *              siempre en 'path'.
+ *     'files': Número de ficheros de la rotación (1-'ETH_CAPTURE_FILES_MAX').
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la captura.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+eth_capture_t * eth_capture_open
+( char * path, int snaplen, long int file_size, int files );
+
+
+/* int eth_capture_set_filter
+ * ( eth_capture_t * capture, uint16_t type, uint8_t protocol, uint16_t port );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función limita la captura a las tramas de 'Tipo' 'type' y, dentro
+ *   de IPv4, a las del protocolo 'protocol' con puerto origen o destino
+ *   'port' (sólo UDP y TCP). Un 0 en cualquiera de ellos no filtra por ese
+ *   campo. Se comprueba antes de copiar la trama: lo que no pasa el filtro
+ *   no ocupa el anillo.
+ *
+ *   Hay que llamarla antes de asociar la captura a los interfaces.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado el filtro.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si 'capture' es 'NULL'.
+ */
+int eth_capture_set_filter
+( eth_capture_t * capture, uint16_t type, uint8_t protocol, uint16_t port );
+
+
+/* int eth_capture_stats ( eth_capture_t * capture, eth_capture_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas de la captura. Se pueden
+ *   consultar mientras se captura.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se han copiado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si 'capture' es 'NULL'.
+ */
+int eth_capture_stats ( eth_capture_t * capture, eth_capture_stats_t * stats );
+
+
+/* int eth_capture_close ( eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función detiene el hilo de la captura después de escribir las
+ *   tramas que queden en el anillo, cierra el fichero y libera la captura.
+ *   Los interfaces deben haberse cerrado o desasociado antes
+ *   ('eth_set_capture()' con 'NULL').
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se han escrito todas las tramas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ha habido algún error de escritura.
+ */
+int eth_capture_close ( eth_capture_t * capture );
+
+
+/* Funciones para "eth.c": no deben usarse directamente, sino a través de
+   'eth_set_capture()'. */
+
+/* int eth_capture_add_iface ( eth_capture_t * capture, char * ifname );
+ *
+ * DESCRIPCIÓN:
+ *   Añade el interfaz 'ifname' a los de la captura.
+ *
+ * VALOR DEVUELTO:
+ *   El identificador del interfaz en los ficheros.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ya hay 'ETH_CAPTURE_IFACES_MAX' interfaces.
+ */
+int eth_capture_add_iface ( eth_capture_t * capture, char * ifname );
+
+
+/* void eth_capture_frame
+ * ( eth_capture_t * capture, int iface_id, int direction,
+ *   const struct iovec * iov, int iovcnt, const struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Copia en el anillo la trama formada por los 'iovcnt' trozos de 'iov',
+ *   si pasa el filtro. Si 'stamp' es 'NULL' o cero se usa la hora actual.
+ *   Puede llamarse desde varios hilos a la vez.
+ */
+void eth_capture_frame
+( eth_capture_t * capture, int iface_id, int direction,
+  const struct iovec * iov, int iovcnt, const struct timespec * stamp );
+
+#endif /* _ETH_CAPTURE_H */
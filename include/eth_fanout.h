@@ -0,0 +1,124 @@
+#ifndef _ETH_FANOUT_H
+#define _ETH_FANOUT_H
+
+#include "eth.h"
+
+/* Recepción en varios hilos. Se abren N interfaces Ethernet sobre la misma
+   interfaz, unidos a un grupo PACKET_FANOUT ('eth_open_fanout()'), y cada
+   uno lo atiende un hilo propio ("trabajador") con sus propios buffers y
+   estadísticas. El kernel reparte las tramas entre ellos, manteniendo cada
+   flujo (o cada CPU) en el mismo trabajador.
+
+   Los manejadores de cada trabajador ('eth_set_handler()' sobre el interfaz
+   de 'eth_fanout_iface()') se ejecutan en su hilo: no deben tocar estado
+   compartido con otros trabajadores sin protegerlo.
+
+   Esta es una estructura opaca que no debe ser accedida directamente, sino a
+   través de las funciones de esta librería. */
+typedef struct eth_fanout eth_fanout_t;
+
+/* Número máximo de trabajadores de un grupo */
+#define ETH_FANOUT_WORKERS_MAX 64
+
+/* Estadísticas de un trabajador */
+typedef struct eth_fanout_stats {
+  unsigned long frames;   /* Tramas entregadas a los manejadores */
+  unsigned long wakeups;  /* Veces que ha despertado con tramas que leer */
+  unsigned long errors;   /* Errores al esperar o procesar tramas */
+} eth_fanout_stats_t;
+
+
+/* eth_fanout_t * eth_fanout_open ( char * ifname, int workers, int mode );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función abre 'workers' interfaces Ethernet sobre 'ifname', unidos a
+ *   un nuevo grupo PACKET_FANOUT. Los trabajadores no empiezan a recibir
+ *   hasta llamar a 'eth_fanout_start()', después de registrar sus
+ *   manejadores.
+ *
+ *   Sobre un dispositivo TAP multicola ("tap:<ifname>") cada trabajador es
+ *   una cola del dispositivo, y sólo se admite 'ETH_FANOUT_HASH'.
+ *
+ *   La memoria del manejador devuelto debe ser liberada con la función
+ *   'eth_fanout_close()'.
+ *
+ * PARÁMETROS:
+ *   'ifname': Nombre de la interfaz Ethernet.
+ *  'workers': Número de trabajadores (1-'ETH_FANOUT_WORKERS_MAX').
+ *     'mode': 'ETH_FANOUT_HASH' (por flujo) o 'ETH_FANOUT_CPU' (por la CPU
+ *             que recibió la trama).
+ *
+ * VALOR DEVUELTO:
+ *   Manejador del grupo de trabajadores.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+eth_fanout_t * eth_fanout_open ( char * ifname, int workers, int mode );
+
+
+/* eth_iface_t * eth_fanout_iface ( eth_fanout_t * fanout, int worker );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el interfaz Ethernet del trabajador 'worker', para
+ *   registrar en él sus manejadores con 'eth_set_handler()' o enviar tramas
+ *   desde su hilo.
+ *
+ * VALOR DEVUELTO:
+ *   El interfaz del trabajador.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no existe ese trabajador.
+ */
+eth_iface_t * eth_fanout_iface ( eth_fanout_t * fanout, int worker );
+
+
+/* int eth_fanout_start ( eth_fanout_t * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función arranca un hilo por trabajador. Cada hilo se fija a una CPU
+ *   (el trabajador 'i' a la CPU 'i', si existe) y procesa con
+ *   'eth_process()' las tramas de su interfaz hasta 'eth_fanout_close()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se han arrancado todos los hilos.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error (los hilos ya
+ *   arrancados siguen funcionando).
+ */
+int eth_fanout_start ( eth_fanout_t * fanout );
+
+
+/* int eth_fanout_stats
+ * ( eth_fanout_t * fanout, int worker, eth_fanout_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas del trabajador 'worker'.
+ *   Se pueden consultar mientras los trabajadores funcionan.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si existe el trabajador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no existe ese trabajador.
+ */
+int eth_fanout_stats
+( eth_fanout_t * fanout, int worker, eth_fanout_stats_t * stats );
+
+
+/* int eth_fanout_close ( eth_fanout_t * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función detiene los trabajadores, espera a que terminen sus hilos y
+ *   cierra sus interfaces.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cerrado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_fanout_close ( eth_fanout_t * fanout );
+
+#endif /* _ETH_FANOUT_H */
@@ -18,11 +18,25 @@ extern ipv4_addr_t IPv4_ZERO_ADDR;
 extern ipv4_addr_t IPv4_MULTICAST_ADDR;
 
 /* Logitud máxmima del nombre de un interfaz de red */
-#define IFACE_NAME_MAX_LENGTH 32
+#define IFACE_NAME_MAX_LENGTH 128
+/* Número máximo de interfaces de la capa IPv4 */
+#define IPv4_IFACES_MAX 8
+/* Número máximo de direcciones (principal y secundarias) de un interfaz */
+#define IPv4_IFACE_ADDRS_MAX 8
 
 #include "ipv4_config.h"
 #include "ipv4_route_table.h"
 #include "arp.h"
+#include "net_stack.h"
+
+/* Número máximo de protocolos con manejador ('ipv4_set_handler()') */
+#define IPv4_HANDLERS_MAX 4
+
+/* Función que procesa un paquete IPv4 dirigido a nosotros de un protocolo
+   concreto. Recibe la IP origen y los datos del paquete, además del argumento
+   'arg' indicado al registrarla con 'ipv4_set_handler()'. */
+typedef void (*ipv4_handler_t)
+( ipv4_addr_t src_addr, unsigned char * payload, int payload_len, void * arg );
 
 
 
@@ -88,14 +102,22 @@ int ipv4_str_addr ( char* str, ipv4_addr_t addr );
 uint16_t ipv4_checksum ( unsigned char * data, int len );
 
 /*
- * int ipv4_open(char *config, char *rtable);
+ * int ipv4_open(net_stack_t * stack, char *config, char *rtable);
  *
  * DESCRIPCIÓN:
- *   Esta función abre una conexion IPv4 para enviar paquetes.
+ *   Esta función abre una conexion IPv4 para enviar paquetes. Si la pila ya
+ *   tenía IPv4 abierto, se cierra antes.
  *
  * PARÁMETROS:
- *   'config': Puntero al file donde esta guardada la configuracion
- *   'rtable': Puntero al file donde esta guardada la routing table
+ *    'stack': Pila creada con 'net_stack_create()'.
+ *   'config': Puntero al file donde esta guardada la configuracion (uno o
+ *             varios interfaces, cada uno con sus direcciones, ver
+ *             'ipv4_config_read_ifaces()'), o "netlink:<interfaz>[,<interfaz>...]"
+ *             para tomar las IPs y máscaras de esos interfaces del kernel
+ *   'rtable': Puntero al file donde esta guardada la routing table, o
+ *             "netlink" para copiar las rutas del kernel por esos interfaces.
+ *             El interfaz de cada ruta tiene que ser uno de los configurados.
+ *             Si algo viene del kernel, su tabla de vecinos llena la caché ARP.
  * VALOR DEVUELTO:
  *   El valor es '0' si la conexion ipv4 ha sido abierta correctamente.
  *
@@ -104,27 +126,149 @@ uint16_t ipv4_checksum ( unsigned char * data, int len );
  *	 La función devuelve -2 si no ha podido leer el archivo de la routing table
  *	 La función devuelve -3 si no ha podido abrir la interfaz de eth
  */
-int ipv4_open(char *config, char *rtable);
+int ipv4_open(net_stack_t * stack, char *config, char *rtable);
 
 /*
- * int ipv4_close();
+ * int ipv4_close(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
- *   Esta función cierra una conexion IPv4.
+ *   Esta función cierra una conexion IPv4 y vacía la caché ARP de la pila.
  *
  * VALOR DEVUELTO:
  *   El valor es '0' si la conexion ipv4 ha sido cerrada correctamente.
  *
  * ERRORES:
- *   La función devuelve -1 si no ha podido cerrar la interfaz eth
+ *   La función devuelve -1 si no ha podido cerrar la interfaz eth o si la
+ *   pila no tenía IPv4 abierto
+ */
+int ipv4_close(net_stack_t * stack);
+
+/*
+ * int ipv4_arp_prewarm(net_stack_t * stack, ipv4_addr_t next_hop);
+ *
+ * DESCRIPCIÓN:
+ *   Lanza (sin esperar) la resolución ARP de un siguiente salto de nuestra
+ *   subred, para que su MAC esté en la caché antes de que haga falta.
+ *   'ipv4_open()' ya lo hace con todos los gateways de la tabla de rutas.
+ *
+ * VALOR DEVUELTO:
+ *   '1' si se ha lanzado la resolución, '0' si no hace falta (ya está en la
+ *   caché o no es un vecino de nuestra subred).
+ *
+ * ERRORES:
+ *   Devuelve -1 si la IP no puede resolverse ahora.
+ */
+int ipv4_arp_prewarm(net_stack_t * stack, ipv4_addr_t next_hop);
+
+/*
+ * int ipv4_filter_port(net_stack_t * stack, uint8_t protocol, uint16_t port);
+ *
+ * DESCRIPCIÓN:
+ *   Pide al kernel que de los paquetes IPv4 sólo nos entregue los del
+ *   'protocol' indicado con puerto destino 'port' (ver 'eth_filter_ipv4_port()').
+ *   El resto de protocolos ya no llegarán a 'ipv4_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha instalado el filtro.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha podido instalar (se sigue filtrando en 'ipv4_recv()').
+ */
+int ipv4_filter_port(net_stack_t * stack, uint8_t protocol, uint16_t port);
+
+/*
+ * int ipv4_set_handler(net_stack_t * stack, uint8_t protocol, ipv4_handler_t handler, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Registra 'handler' para los paquetes del 'protocol' indicado dirigidos a
+ *   nosotros (o multicast). Se le llamará desde el bucle de eventos
+ *   ('ipv4_reactor_add()') y también cuando 'ipv4_recv()' reciba paquetes de
+ *   ese protocolo mientras espera los de otro. Un 'handler' 'NULL' elimina
+ *   el manejador. Hay que llamarla después de 'ipv4_open()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el manejador se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o ya hay IPv4_HANDLERS_MAX
+ *   manejadores.
+ */
+int ipv4_set_handler(net_stack_t * stack, uint8_t protocol, ipv4_handler_t handler, void * arg);
+
+/*
+ * int ipv4_reactor_add(net_stack_t * stack, reactor_t * reactor);
+ *
+ * DESCRIPCIÓN:
+ *   Registra todos los interfaces en el bucle de eventos 'reactor', junto a un
+ *   temporizador que reintenta las resoluciones ARP pendientes (sólo se
+ *   programa cuando hay alguna) y vacía los anillos de transmisión antes de
+ *   cada espera del bucle. Los paquetes recibidos se entregan a los
+ *   manejadores de 'ipv4_set_handler()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o falla el registro.
  */
-int ipv4_close();
+int ipv4_reactor_add(net_stack_t * stack, reactor_t * reactor);
 
 /*
- * int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len );
+ * int ipv4_set_timestamps(net_stack_t * stack, int enable);
  *
  * DESCRIPCIÓN:
- *   Esta función envia un paquete IPv4.
+ *   Activa (o desactiva) la marca de tiempo de llegada de los paquetes (ver
+ *   'eth_set_timestamps()'). Las vistas de 'ipv4_recv_view()' la llevan en
+ *   'stamp' y 'ipv4_get_timestamp()' devuelve la del último paquete.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o no se puede cambiar.
+ */
+int ipv4_set_timestamps(net_stack_t * stack, int enable);
+
+/*
+ * int ipv4_set_capture(net_stack_t * stack, eth_capture_t * capture);
+ *
+ * DESCRIPCIÓN:
+ *   Copia en la captura 'capture' ('eth_capture_open()') las tramas que
+ *   envíen o reciban todos los interfaces de la pila, cada uno como un
+ *   interfaz del fichero pcap-ng (ver 'eth_set_capture()'). Con 'capture'
+ *   'NULL' se deja de capturar; hay que hacerlo, o cerrar IPv4, antes de
+ *   'eth_capture_close()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o no se puede cambiar.
+ */
+int ipv4_set_capture(net_stack_t * stack, eth_capture_t * capture);
+
+/*
+ * int ipv4_get_timestamp(net_stack_t * stack, struct timespec * stamp);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve en 'stamp' el instante (CLOCK_REALTIME) en que el kernel recibió
+ *   el último paquete entregado: el que ha devuelto 'ipv4_recv()' o el que
+ *   se está procesando en un manejador ('ipv4_set_handler()').
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el paquete tiene marca de tiempo.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no la tiene.
+ */
+int ipv4_get_timestamp(net_stack_t * stack, struct timespec * stamp);
+
+/*
+ * int ipv4_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envia un paquete IPv4. La difusión y el multicast sin ruta
+ *   salen por todos los interfaces, cada uno con su IP origen.
  *
  * PARÁMETROS:
  *   'dst_addr': Ip destino
@@ -133,20 +277,83 @@ int ipv4_close();
  * 	 'payload_len': Tamaño de los datos a enviar
  *
  * VALOR DEVUELTO:
- * 		Devuelve 0 si el paquete ha sido creado, arp_resolve y enviado por ethernet correctamente
+ * 		Devuelve 0 si el paquete ha sido creado y enviado por ethernet correctamente, o si
+ * 		ha quedado encolado a la espera de resolver la MAC del siguiente salto.
  *
  *
  * ERRORES:
- *		Devuelve -1, si hay problemas con arp_resolve
+ *		Devuelve -1, si hay problemas con arp_resolve_async
  *		Devuelve -2, si hay problemas con eth_send
  */
-int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len );
+int ipv4_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len );
 
 /*
- * int ipv4_recv(ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout );
+ * int ipv4_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * buf);
  *
  * DESCRIPCIÓN:
- *   Esta función recibe un paquete IPv4.
+ *   Igual que 'ipv4_send()', pero los datos ya están en 'buf': la cabecera
+ *   IPv4 (y después la Ethernet) se escribe delante, en su espacio
+ *   reservado, sin copiar los datos.
+ *
+ * VALOR DEVUELTO:
+ * 		Igual que 'ipv4_send()'.
+ *
+ * ERRORES:
+ *		Igual que 'ipv4_send()'. Devuelve -1 si no queda espacio reservado.
+ */
+int ipv4_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * buf);
+
+/*
+ * int ipv4_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, unsigned char * payloads[], int payload_lens[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Envía 'count' paquetes IPv4 al mismo destino con una sola resolución
+ *   del siguiente salto y un único 'eth_send_buf_batch()'. Los datos de
+ *   cada paquete se copian una sola vez (ver 'ipv4_send_buf_batch()').
+ *
+ * PARÁMETROS:
+ *   'dst_addr': Ip destino
+ *   'protocol': Protocolo utilizado
+ *	 'payloads': Array con los datos de cada paquete
+ * 	 'payload_lens': Tamaño de los datos de cada paquete
+ * 	 'count': Número de paquetes
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve el número de paquetes enviados, o encolados a la espera de
+ * 		resolver la MAC del siguiente salto. Si es menor que 'count' el resto
+ * 		se ha descartado (por ejemplo, por tener llena la cola del vecino).
+ *
+ * ERRORES:
+ *		Devuelve -1, si hay problemas con arp_resolve_async, sin memoria o si
+ *		algún paquete supera la MTU IPv4 (1480 bytes): no se envía ninguno.
+ *		También si no se ha podido enviar ni encolar ninguno.
+ *		Devuelve -2, si una difusión no ha salido por todos los interfaces
+ */
+int ipv4_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, unsigned char * payloads[], int payload_lens[], int count);
+
+/*
+ * int ipv4_send_buf_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * bufs[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'ipv4_send_batch()', pero los datos ya están en 'bufs', como
+ *   en 'ipv4_send_buf()': las cabeceras IPv4 y Ethernet se escriben delante
+ *   de los de cada paquete, en su espacio reservado, sin copiarlos.
+ *
+ * VALOR DEVUELTO:
+ * 		Igual que 'ipv4_send_batch()'.
+ *
+ * ERRORES:
+ *		Igual que 'ipv4_send_batch()'. Devuelve -1 si algún buffer no tiene
+ *		espacio reservado.
+ */
+int ipv4_send_buf_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * bufs[], int count);
+
+/*
+ * int ipv4_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función recibe un paquete IPv4 por cualquiera de los interfaces,
+ *   dirigido a cualquiera de sus direcciones (o multicast).
  *
  * PARÁMETROS:
  *   'src_addr': Ip source, nuestra IP
@@ -161,32 +368,58 @@ int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, in
  * ERRORES:
  *	 devuelve '-1' si hay un problema con la interfaz
  */
-int ipv4_recv(ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout );
+int ipv4_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout );
 
 /*
- * int ip_resolve(eth_iface_t * eth_if, ipv4_addr_t src_ip_addr, ipv4_addr_t dst_ip_addr,mac_addr_t dst_mac_addr){
+ * int ipv4_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, pkt_view_t * view, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'ipv4_recv()', pero sin copiar los datos: 'view' queda sobre
+ *   la trama recibida, con 'l3_offset' apuntando a la cabecera IPv4 y los
+ *   datos limitados a la longitud indicada en ella. Sólo es válida hasta la
+ *   siguiente recepción (ver "pkt.h").
+ *
+ * VALOR DEVUELTO:
+ *   El tamaño de los datos del paquete, o '0' si ha expirado el timeout.
+ *
+ * ERRORES:
+ *	 devuelve '-1' si hay un problema con la interfaz
+ */
+int ipv4_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, pkt_view_t * view, long int timeout );
+
+/*
+ * int ip_resolve(net_stack_t * stack, ipv4_addr_t dst_ip_addr, eth_iface_t ** eth_if, mac_addr_t dst_mac_addr,
+ *                unsigned char * packet, int packet_len);
  *
  * DESCRIPCIÓN:
  *   Esta función se encarga del routing y de encontrar la mac asociada a la IP del siguiente salto.
+ *	 La tabla de rutas decide el interfaz de salida; la difusión y el multicast sin ruta
+ *	 salen por el primer interfaz ('ipv4_send()' los envía antes por todos). La IP origen del paquete es la dirección de ese interfaz
+ *	 de la subred del siguiente salto (o su principal), y se escribe en 'packet' con el checksum.
  *	 Distingue si es una IP multicast o no:
  *		Si es multicast: Calcula la MAC multicast
  *		Si no es multicast: Busca en la tabla de rutas
  *			Si el gateway es 0.0.0.0 -> Envia a la MAC de destino.
  *			Si el gateway no es 0.0.0.0 -> Envia a la MAC del siguiente salto
+ *	 Si la MAC del siguiente salto no está en la caché ARP del interfaz no se espera a
+ *	 resolverla: el paquete se encola en el vecino y se enviará cuando llegue el ARP REPLY.
  *
  * PARÁMETROS:
- *   'eth_if': Interfaz que usamos
- *   'src_ip_addr': Nuetra IP
  *	 'dst_ip_addr': IP a donde queremos enviar el datagrama
- * 	 'mac_addr_t': MAC que queremos averiguar
+ *   'eth_if': Donde se devuelve el interfaz de salida
+ * 	 'dst_mac_addr': MAC que queremos averiguar
+ *	 'packet': Paquete IPv4 con la cabecera rellena salvo la IP origen y el checksum
+ *	 'packet_len': Longitud del paquete
  *
  * VALOR DEVUELTO:
- *   payload_len - IPv4_HEADER_SIZE = tamaño de los datos de info sin el header de IPv4
+ *   0 si se conoce la MAC del siguiente salto (se copia en 'dst_mac_addr')
+ *   1 si el paquete se ha encolado a la espera de la respuesta ARP
  *
  * ERRORES:
- *	 devuelve '-1' si ARP no ha sido capaz de encontrar dicha IP
+ *	 devuelve '-1' si no hay ruta o si el paquete se ha tenido que descartar
  */
 
-int ip_resolve(eth_iface_t * eth_if, ipv4_addr_t src_ip_addr, ipv4_addr_t dst_ip_addr,mac_addr_t dst_mac_addr);
+int ip_resolve(net_stack_t * stack, ipv4_addr_t dst_ip_addr, eth_iface_t ** eth_if, mac_addr_t dst_mac_addr,
+               unsigned char * packet, int packet_len);
 
 #endif /* _IPv4_H */
@@ -4,6 +4,15 @@
 #include "ipv4.h"
 #include <stdio.h>
 
+/* Configuración de un interfaz: su nombre y sus direcciones, la principal
+   primero */
+typedef struct ipv4_config_iface {
+  char ifname[IFACE_NAME_MAX_LENGTH];
+  int addrs_num;
+  ipv4_addr_t addrs[IPv4_IFACE_ADDRS_MAX];
+  ipv4_addr_t netmasks[IPv4_IFACE_ADDRS_MAX];
+} ipv4_config_iface_t;
+
 /* int ipv4_config_read
  * ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask );
  *
@@ -36,4 +45,41 @@
 int ipv4_config_read
 ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask );
 
+
+/* int ipv4_config_read_ifaces
+ * ( char* filename, ipv4_config_iface_t ifaces[], int max );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee el fichero de configuración IPv4 especificado, que
+ *   puede configurar varios interfaces:
+ *
+ *     Interface eth0
+ *     IPv4Address 10.0.0.2
+ *     SubnetMask 255.255.255.0
+ *     IPv4Address 10.0.5.2
+ *     SubnetMask 255.255.255.0
+ *     Interface eth1
+ *     IPv4Address 10.1.0.2
+ *     SubnetMask 255.255.0.0
+ *
+ *   Cada línea 'Interface' empieza un interfaz nuevo, y las líneas
+ *   'IPv4Address' y 'SubnetMask' que la siguen son suyas: la primera
+ *   dirección es la principal y el resto secundarias. La máscara n-ésima
+ *   de un interfaz es la de su dirección n-ésima.
+ *
+ * PARÁMETROS:
+ *    'filename': Nombre del fichero de configuración que se desea leer.
+ *      'ifaces': Array donde se copiarán los interfaces leidos.
+ *         'max': Número de elementos del array 'ifaces'.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de interfaces leidos.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error al leer el
+ *   fichero de configuración.
+ */
+int ipv4_config_read_ifaces
+( char* filename, ipv4_config_iface_t ifaces[], int max );
+
 #endif /* _IPv4_CONFIG_H*/
@@ -0,0 +1,99 @@
+#ifndef _IPv4_NETLINK_H
+#define _IPv4_NETLINK_H
+
+#include "ipv4.h"
+#include "ipv4_route_table.h"
+
+/* Prefijo del fichero de configuración para leerla del kernel: "netlink:eth0" o
+   "netlink:eth0,eth1" para varios interfaces */
+#define IPv4_NETLINK_PREFIX "netlink:"
+
+/* int ipv4_netlink_read_addr
+ * ( char* ifname, ipv4_addr_t addr, ipv4_addr_t netmask );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETADDR por rtnetlink) la primera
+ *   dirección IPv4 configurada en el interfaz 'ifname' y su máscara de
+ *   subred. Sustituye a 'ipv4_config_read()' sin leer ningún fichero.
+ *
+ * PARÁMETROS:
+ *    'ifname': Nombre del interfaz.
+ *      'addr': Variable donde se copiará la dirección IPv4 del interfaz.
+ *   'netmask': Variable donde se copiará la máscara de subred.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha obtenido la dirección.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta o el interfaz no tiene
+ *   ninguna dirección IPv4.
+ */
+int ipv4_netlink_read_addr
+( char* ifname, ipv4_addr_t addr, ipv4_addr_t netmask );
+
+/* int ipv4_netlink_read_addrs
+ * ( char* ifname, ipv4_addr_t addrs[], ipv4_addr_t netmasks[], int max );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'ipv4_netlink_read_addr()', pero devuelve hasta 'max'
+ *   direcciones del interfaz: la primaria primero y después las secundarias.
+ *
+ * PARÁMETROS:
+ *     'ifname': Nombre del interfaz.
+ *      'addrs': Array donde se copiarán las direcciones IPv4.
+ *   'netmasks': Array donde se copiará la máscara de cada dirección.
+ *        'max': Número de elementos de los arrays.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de direcciones obtenidas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta o el interfaz no tiene
+ *   ninguna dirección IPv4.
+ */
+int ipv4_netlink_read_addrs
+( char* ifname, ipv4_addr_t addrs[], ipv4_addr_t netmasks[], int max );
+
+/* int ipv4_netlink_read_routes ( char* ifname, ipv4_route_table_t * table );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETROUTE) las rutas IPv4 unicast de la
+ *   tabla principal que salen por 'ifname' y las añade a 'table'. Sustituye
+ *   a 'ipv4_route_table_read()'.
+ *
+ * PARÁMETROS:
+ *   'ifname': Nombre del interfaz.
+ *    'table': Tabla de rutas donde se añadirán las rutas leidas.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de rutas añadidas a la tabla.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta.
+ */
+int ipv4_netlink_read_routes ( char* ifname, ipv4_route_table_t * table );
+
+/* int ipv4_netlink_read_neighbours ( net_stack_t * stack, char* ifname,
+ *                                    eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETNEIGH) su tabla de vecinos IPv4 del
+ *   interfaz 'ifname' y guarda en la caché ARP de 'iface' de la pila 'stack'
+ *   las entradas válidas (alcanzables, caducadas pendientes de confirmar o
+ *   permanentes).
+ *
+ * PARÁMETROS:
+ *    'stack': Pila cuya caché ARP se llena.
+ *   'ifname': Nombre del interfaz.
+ *    'iface': Interfaz Ethernet abierto sobre 'ifname'.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de vecinos añadidos a la caché ARP.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta.
+ */
+int ipv4_netlink_read_neighbours ( net_stack_t * stack, char* ifname,
+                                   eth_iface_t * iface );
+
+#endif /* _IPv4_NETLINK_H */
@@ -6,7 +6,7 @@
 #include <stdio.h>
 
 /* Logitud máxmima del nombre de un interfaz de red */
-#define IFACE_NAME_MAX_LENGTH 32
+#define IFACE_NAME_MAX_LENGTH 128
 
 
 /* Esta estructura almacena la información básica sobre la ruta a una subred.
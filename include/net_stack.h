@@ -0,0 +1,46 @@
+#ifndef _NET_STACK_H
+#define _NET_STACK_H
+
+/* Pila de protocolos ARP/IPv4/UDP. Todo el estado de cada capa (caché ARP,
+   interfaces, direcciones, tabla de rutas, puerto UDP, manejadores...) está
+   en la pila, que se pasa a todas las funciones 'arp_*', 'ipv4_*' y 'udp_*'
+   que lo usan. Así puede haber varias pilas independientes en un mismo
+   proceso (una por VRF, por núcleo o por router simulado), cada una en su
+   propio hilo.
+
+   Una misma pila no debe usarse desde varios hilos a la vez.
+
+   Esta es una estructura opaca que no debe ser accedida directamente, sino a
+   través de las funciones de esta librería. */
+typedef struct net_stack net_stack_t;
+
+
+/* net_stack_t * net_stack_create ();
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una pila vacía, con la caché ARP vacía y sin ningún
+ *   interfaz abierto. La memoria de la pila devuelta debe ser liberada con la
+ *   función 'net_stack_destroy()'.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la pila.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+net_stack_t * net_stack_create ();
+
+
+/* void net_stack_destroy ( net_stack_t * stack );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera la pila. Las capas que sigan abiertas se cierran
+ *   antes ('ipv4_close()'), y se descartan los paquetes que estuvieran
+ *   esperando una resolución ARP.
+ *
+ * PARÁMETROS:
+ *   'stack': Manejador de la pila.
+ */
+void net_stack_destroy ( net_stack_t * stack );
+
+#endif /* _NET_STACK_H */
@@ -0,0 +1,16 @@
+#ifndef _NET_STACK_STATE_H
+#define _NET_STACK_STATE_H
+
+#include "net_stack.h"
+
+/* Estructura de la pila, sólo para las capas ("arp.c", "ipv4.c", "udp.c" y
+   "net_stack.c"): las aplicaciones no usan esta cabecera, sino el manejador
+   opaco 'net_stack_t'. Cada capa guarda aquí su estado, que sólo ella
+   conoce. La capa ARP se crea con la pila; IPv4 y UDP al abrirlas. */
+struct net_stack {
+  struct arp_state * arp;    /* Caché ARP y resoluciones en curso ("arp.c") */
+  struct ipv4_state * ipv4;  /* Interfaces, direcciones y rutas ("ipv4.c") */
+  struct udp_state * udp;    /* Puerto y manejador ("udp.c") */
+};
+
+#endif /* _NET_STACK_STATE_H */
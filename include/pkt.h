@@ -0,0 +1,125 @@
+#ifndef _PKT_H
+#define _PKT_H
+
+#include <time.h>
+
+/* Vista de un paquete recibido. En lugar de copiar los datos de cada capa a
+   un buffer propio, todas las capas comparten la trama tal y como la dejó
+   'rawnet_recv_zerocopy()' y cada una avanza la vista sobre su cabecera
+   ('pkt_view_pull()'), anotando dónde empieza.
+
+   La vista sólo es válida hasta la siguiente recepción por la misma interfaz
+   (incluidas las que se hagan al enviar, por ejemplo para resolver una
+   dirección con ARP). Si hay que conservar los datos, deben copiarse. */
+typedef struct pkt_view {
+  unsigned char * frame; /* Comienzo de la trama Ethernet */
+  int frame_len;         /* Bytes de la trama */
+  int l3_offset;         /* Cabecera de red dentro de la trama, o -1 */
+  int l4_offset;         /* Cabecera de transporte dentro de la trama, o -1 */
+  int data_offset;       /* Datos de la capa actual dentro de la trama */
+  int data_len;          /* Bytes de datos de la capa actual */
+  struct timespec stamp; /* Llegada de la trama, o cero si no se conoce (ver
+                            'eth_set_timestamps()') */
+} pkt_view_t;
+
+/* Espacio que un 'pkt_buf_t' reserva delante de los datos para las
+   cabeceras Ethernet (14 bytes), IPv4 (20) y UDP (8) */
+#define PKT_HEADROOM 64
+/* Máximo de datos de un 'pkt_buf_t' tras su espacio reservado */
+#define PKT_DATA_MAX 1500
+
+/* Buffer de un paquete a enviar. La aplicación escribe sus datos una sola
+   vez ('pkt_buf_put()') y cada capa, al bajar, añade su cabecera delante
+   ('pkt_buf_push()') en el espacio reservado, sin copiar lo que ya había. */
+typedef struct pkt_buf {
+  unsigned char * data; /* Comienzo del paquete (la última cabecera añadida) */
+  int len;              /* Bytes del paquete desde 'data' */
+  unsigned char buffer[PKT_HEADROOM + PKT_DATA_MAX];
+} pkt_buf_t;
+
+
+/* void pkt_view_init
+ * ( pkt_view_t * view, unsigned char * frame, int frame_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicializa 'view' sobre la trama completa 'frame', sin
+ *   ninguna cabecera procesada todavía.
+ */
+void pkt_view_init ( pkt_view_t * view, unsigned char * frame, int frame_len );
+
+
+/* unsigned char * pkt_view_data ( pkt_view_t * view );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve un puntero a los datos de la capa actual, dentro
+ *   de la trama. Hay 'view->data_len' bytes accesibles.
+ */
+unsigned char * pkt_view_data ( pkt_view_t * view );
+
+
+/* unsigned char * pkt_view_pull ( pkt_view_t * view, int header_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función consume una cabecera de 'header_len' bytes al comienzo de
+ *   los datos de la capa actual: los datos pasan a ser los de la capa
+ *   superior.
+ *
+ * VALOR DEVUELTO:
+ *   Un puntero a la cabecera consumida.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' (y no modifica la vista) si los datos son más
+ *   cortos que la cabecera.
+ */
+unsigned char * pkt_view_pull ( pkt_view_t * view, int header_len );
+
+
+/* void pkt_view_trim ( pkt_view_t * view, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función limita los datos de la capa actual a 'len' bytes, para
+ *   descartar el relleno que pueda haber tras ellos (por ejemplo, el de las
+ *   tramas Ethernet mínimas). Si ya hay menos de 'len' bytes no hace nada.
+ */
+void pkt_view_trim ( pkt_view_t * view, int len );
+
+
+/* void pkt_buf_init ( pkt_buf_t * buf );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función vacía 'buf', dejando 'PKT_HEADROOM' bytes libres delante
+ *   para las cabeceras.
+ */
+void pkt_buf_init ( pkt_buf_t * buf );
+
+
+/* unsigned char * pkt_buf_put ( pkt_buf_t * buf, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade 'len' bytes al final del paquete, para que la
+ *   aplicación escriba en ellos sus datos.
+ *
+ * VALOR DEVUELTO:
+ *   Un puntero a los bytes añadidos.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no caben.
+ */
+unsigned char * pkt_buf_put ( pkt_buf_t * buf, int len );
+
+
+/* unsigned char * pkt_buf_push ( pkt_buf_t * buf, int header_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade una cabecera de 'header_len' bytes delante del
+ *   paquete, en el espacio reservado.
+ *
+ * VALOR DEVUELTO:
+ *   Un puntero a la cabecera, que el llamante debe rellenar.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si ya no queda espacio reservado.
+ */
+unsigned char * pkt_buf_push ( pkt_buf_t * buf, int header_len );
+
+#endif /* _PKT_H */
@@ -21,6 +21,13 @@
 
 typedef struct rawiface rawiface_t;
 
+/* Instrucción de un filtro BPF clásico, definida en <linux/filter.h> */
+struct sock_filter;
+/* Trozo de un paquete para 'rawnet_sendv()', definido en <sys/uio.h> */
+struct iovec;
+/* Instante de llegada de un paquete, definido en <time.h> */
+struct timespec;
+
 /* Tamaño máximo de una dirección hardware */
 #define HW_ADDR_MAX_SIZE 8
 
@@ -33,6 +40,45 @@ typedef struct rawiface rawiface_t;
  *   La memoria del manejador de interfaz devuelto debe ser liberada con la
  *   función 'rawiface_close()'.
  *
+ *   Si el nombre empieza por "mmap:" (p.ej. "mmap:eth0") los paquetes se
+ *   reciben a través de un anillo TPACKET_V3 compartido con el kernel, que
+ *   evita una llamada al sistema y una copia por paquete.
+ *
+ *   Si empieza por "xdp:" (p.ej. "xdp:eth0") se usa un socket AF_XDP: un
+ *   programa XDP entrega al socket sólo las tramas ARP e IPv4 dirigidas a
+ *   la interfaz y el resto sigue hacia el kernel. Se instala en modo nativo
+ *   si el driver lo admite y si no en modo genérico (SKB). Sólo se usa la
+ *   primera cola de recepción de la interfaz.
+ *
+ *   Si empieza por "uring:" (p.ej. "uring:eth0") el socket se maneja con un
+ *   io_uring: una única recepción 'multishot' sobre buffers compartidos con
+ *   el kernel, y envíos encolados que salen juntos en la siguiente llamada
+ *   al sistema, junto con la recogida de los paquetes recibidos.
+ *
+ *   Si empieza por "pcap:" no se usa ninguna interfaz de red: los paquetes
+ *   recibidos se leen de un fichero de captura pcap al ritmo con el que se
+ *   capturaron, sin necesidad de privilegios. Tras el fichero se pueden
+ *   indicar, separadas por comas, las opciones "out=<fichero>" (guarda los
+ *   paquetes enviados en otro fichero pcap; si no, se descartan), "fast"
+ *   (entrega los paquetes tan rápido como se leen) y "mac=<dirección>"
+ *   (dirección hardware de la interfaz, la del equipo donde se tomó la
+ *   captura). Por ejemplo "pcap:rip.pcap,out=tx.pcap,fast".
+ *
+ *   Si empieza por "tap:" (p.ej. "tap:tap0") los paquetes se leen y se
+ *   escriben en un dispositivo TAP, cuyo otro extremo es el kernel, sin
+ *   necesidad de CAP_NET_RAW si el dispositivo ya existe y pertenece al
+ *   usuario. Si es multicola, cada apertura es una cola más entre las que
+ *   el kernel reparte los flujos. La dirección hardware de la interfaz es
+ *   la del dispositivo con el último byte cambiado, o la de la opción
+ *   "mac=<dirección>" (p.ej. "tap:tap0,mac=02:00:00:00:00:02").
+ *
+ *   Si empieza por "shm:" (p.ej. "shm:r1-r2") la interfaz es un extremo de
+ *   un enlace punto a punto en memoria compartida, sin interfaz del kernel:
+ *   la primera interfaz que se abre con ese nombre, en este proceso o en
+ *   otro, toma un extremo y la segunda el otro. Así se pueden conectar
+ *   muchas pilas en una misma máquina. La dirección hardware se deriva del
+ *   nombre del enlace, salvo que se indique "mac=<dirección>".
+ *
  * PARÁMETROS:
  *   'ifname' : Cadena de texto con el nombre de la interfaz hardware que se
  *              desea inicializar.
@@ -51,6 +97,44 @@ typedef struct rawiface rawiface_t;
 rawiface_t * rawiface_open ( char* ifname );
 
 
+/* Modos de reparto de 'rawiface_open_fanout()' */
+#define RAWNET_FANOUT_HASH 0  /* Por flujo (direcciones y puertos) */
+#define RAWNET_FANOUT_CPU 1   /* Por la CPU que ha recibido el paquete */
+
+/* rawiface_t * rawiface_open_fanout ( char* ifname, int group_id, int mode );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawiface_open()', pero el socket se une al grupo PACKET_FANOUT
+ *   'group_id' de la interfaz: los paquetes recibidos se reparten entre todos
+ *   los sockets del grupo en lugar de llegar a cada uno de ellos. Abriendo N
+ *   interfaces con el mismo grupo se puede recibir desde N hilos.
+ *
+ *   Con 'RAWNET_FANOUT_HASH' todos los paquetes de un mismo flujo (también
+ *   los fragmentos IP) llegan al mismo socket. Con 'RAWNET_FANOUT_CPU' llegan
+ *   al socket correspondiente a la CPU en la que los ha recibido el kernel.
+ *
+ *   No está disponible con los backends "xdp:" ni "pcap:". Con "tap:" no se
+ *   usa PACKET_FANOUT: si el dispositivo es multicola, cada interfaz abierta
+ *   es una cola y el kernel ya reparte los flujos entre ellas
+ *   ('RAWNET_FANOUT_HASH', el único modo admitido; 'group_id' se ignora).
+ *
+ * PARÁMETROS:
+ *   'ifname' : Nombre de la interfaz, como en 'rawiface_open()'.
+ * 'group_id' : Identificador del grupo (0-65535), el mismo en todos los
+ *              sockets que se reparten los paquetes.
+ *     'mode' : 'RAWNET_FANOUT_HASH' o 'RAWNET_FANOUT_CPU'.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la interfaz hardware inicializada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+rawiface_t * rawiface_open_fanout ( char* ifname, int group_id, int mode );
+
+
 /* char* rawiface_getname ( rawiface_t * iface );
  *
  * DESCRIPCIÓN:
@@ -71,6 +155,27 @@ rawiface_t * rawiface_open ( char* ifname );
 char* rawiface_getname ( rawiface_t * iface );
 
 
+/* int rawiface_getfd ( rawiface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el descriptor del socket de la interfaz, que está
+ *   siempre en modo no bloqueante, para poder esperar paquetes con
+ *   'poll()' o 'epoll()' junto a otros descriptores. Cuando esté listo hay
+ *   que leer con 'rawnet_recv()' (o similares) y timeout 0 hasta que no
+ *   queden paquetes.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor del socket.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL'.
+ */
+int rawiface_getfd ( rawiface_t * iface );
+
+
 /* int rawiface_getaddr ( rawiface_t * iface, char addr[] );
  *
  * DESCRIPCIÓN:
@@ -118,12 +223,106 @@ int rawiface_getaddr ( rawiface_t * iface, unsigned char addr[] );
 int rawiface_getmtu ( rawiface_t * iface );
 
 
+/* int rawiface_is_zerocopy ( rawiface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función indica si 'rawnet_recv_zerocopy()' entrega los paquetes en
+ *   su sitio, sin copiarlos: en el anillo de "mmap:<ifname>" o en la memoria
+ *   de un backend. Con el socket normal cada paquete se copia a un buffer
+ *   de la interfaz, y es mejor recibirlos por lotes ('rawnet_recv_batch()').
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   1 si los paquetes se reciben sin copiarlos, 0 si no.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL'.
+ */
+int rawiface_is_zerocopy ( rawiface_t * iface );
+
+
+/* int rawiface_set_timestamps ( rawiface_t * iface, int enable );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa (o desactiva) la marca de tiempo de llegada de los
+ *   paquetes recibidos, que se consulta después con
+ *   'rawiface_get_timestamp()' o se obtiene con 'rawnet_recv_batch_ts()'.
+ *
+ *   En el socket normal el kernel marca cada paquete al recibirlo
+ *   (SO_TIMESTAMPNS), igual que en el anillo de "mmap:<ifname>". Los
+ *   backends "xdp:" y "uring:" no reciben esa marca del kernel: se usa el
+ *   instante en que la librería recoge el paquete. Con "pcap:" se usa la
+ *   marca guardada en el fichero para cada paquete.
+ *
+ *   Las marcas usan el reloj CLOCK_REALTIME.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz.
+ *   'enable': 1 para activarla, 0 para desactivarla.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawiface_set_timestamps ( rawiface_t * iface, int enable );
+
+
+/* int rawiface_get_timestamp ( rawiface_t * iface, struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve en 'stamp' el instante de llegada del último
+ *   paquete devuelto por 'rawnet_recv()' o 'rawnet_recv_zerocopy()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si hay marca de tiempo.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si las marcas no están activadas
+ *   ('rawiface_set_timestamps()') o el último paquete no la tenía.
+ */
+int rawiface_get_timestamp ( rawiface_t * iface, struct timespec * stamp );
+
+
+/* int rawnet_set_filter
+ * ( rawiface_t * iface, struct sock_filter * code, int code_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función instala en el kernel un filtro BPF clásico en el socket de
+ *   la interfaz, de forma que sólo llegan a 'rawnet_recv()' los paquetes que
+ *   acepte el programa. Sustituye al filtro anterior, si lo había.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz.
+ *     'code': Instrucciones del programa BPF (ver <linux/filter.h>). Si es
+ *             'NULL' se elimina el filtro.
+ * 'code_len': Número de instrucciones de 'code'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el filtro se ha instalado (o eliminado) correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_set_filter
+( rawiface_t * iface, struct sock_filter * code, int code_len );
+
+
 /* int rawnet_send
  * ( rawiface_t * iface, unsigned char * packet, int flen );
  *
  * DESCRIPCIÓN:
  *   Esta función permite enviar un paquete a través de la interfaz indicada.
  *
+ *   Si la interfaz se abrió como "mmap:<ifname>" el paquete sólo se copia al
+ *   anillo de transmisión y sale al llamar a 'rawnet_flush()' (o al recibir).
  *
  * PARÁMETROS:
  *    'iface': Manejador de la interfaz por la que se quiere enviar el paquete.
@@ -137,6 +336,8 @@ int rawiface_getmtu ( rawiface_t * iface );
  *   El número de bytes que han podido ser enviados.
  *
  * ERRORES:
+ *   La función devuelve '-2' si el anillo de transmisión está lleno: hay que
+ *   llamar a 'rawnet_flush()' y volver a intentarlo.
  *   La función devuelve '-1' si se ha producido algún error.
  *   La descripción completa del error puede obtenerse a través de la función
  *   'rawnet_strerror()'.
@@ -144,6 +345,80 @@ int rawiface_getmtu ( rawiface_t * iface );
 int rawnet_send ( rawiface_t * iface, unsigned char * packet, int pkt_len );
 
 
+/* int rawnet_sendv
+ * ( rawiface_t * iface, const struct iovec * iov, int iovcnt );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawnet_send()', pero el paquete se indica en 'iovcnt' trozos
+ *   ('sendmsg()' con scatter/gather), por ejemplo una cabecera y unos datos
+ *   que están en memorias distintas, sin tener que juntarlos antes.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se quiere enviar el paquete.
+ *      'iov': Trozos del paquete, en orden, empezando por la cabecera de
+ *             nivel 2.
+ *   'iovcnt': Número de trozos.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes que han podido ser enviados.
+ *
+ * ERRORES:
+ *   Igual que 'rawnet_send()'.
+ */
+int rawnet_sendv
+( rawiface_t * iface, const struct iovec * iov, int iovcnt );
+
+
+/* int rawnet_flush ( rawiface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Envía con una única llamada al sistema todos los paquetes copiados al
+ *   anillo de transmisión por 'rawnet_send()' y espera a que salgan. Sólo
+ *   tiene efecto si la interfaz se abrió como "mmap:<ifname>".
+ *   'rawnet_recv()', 'rawnet_poll()' y 'rawiface_close()' también vacían el
+ *   anillo antes de esperar.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   El número de paquetes enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_flush ( rawiface_t * iface );
+
+
+/* int rawnet_send_batch
+ * ( rawiface_t * iface, unsigned char * packets[], int pkt_lens[], int count );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envía 'count' paquetes por la interfaz indicada con una
+ *   sola llamada al sistema ('sendmmsg()'), o con un único vaciado del anillo
+ *   de transmisión si la interfaz se abrió como "mmap:<ifname>".
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se quieren enviar.
+ *  'packets': Array con los paquetes a enviar, incluyendo las cabeceras de
+ *             nivel 2 y superiores.
+ * 'pkt_lens': Longitud en bytes de cada paquete.
+ *    'count': Número de paquetes.
+ *
+ * VALOR DEVUELTO:
+ *   El número de paquetes enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar ningún paquete.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_send_batch
+( rawiface_t * iface, unsigned char * packets[], int pkt_lens[], int count );
+
+
 /* int rawnet_recv
  * ( rawiface_t * iface, unsigned char buffer[], int buf_len, long int timeout );
  *
@@ -186,6 +461,94 @@ int rawnet_recv
 ( rawiface_t * iface, unsigned char buffer[], int buf_len, long int timeout );
 
 
+/* int rawnet_recv_zerocopy
+ * ( rawiface_t * iface, unsigned char ** frame, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawnet_recv()', pero sin copiar el paquete: devuelve en
+ *   'frame' un puntero a él, dentro del anillo compartido con el kernel si la
+ *   interfaz se abrió como "mmap:<ifname>".
+ *
+ *   El paquete sólo es válido hasta la siguiente llamada a 'rawnet_recv()' o
+ *   'rawnet_recv_zerocopy()' sobre la misma interfaz.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se desea recibir un paquete.
+ *    'frame': Puntero donde se devolverá la dirección del paquete recibido.
+ *  'timeout': Igual que en 'rawnet_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes accesibles en 'frame', o '0' si ha expirado el
+ *   temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_recv_zerocopy
+( rawiface_t * iface, unsigned char ** frame, long int timeout );
+
+
+/* int rawnet_recv_batch
+ * ( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+ *   int pkt_lens[], int count, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera como 'rawnet_recv()' a que llegue un paquete y
+ *   recoge con una sola llamada al sistema ('recvmmsg()') hasta 'count'
+ *   paquetes que ya estén disponibles, sin esperar a los demás.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se desea recibir.
+ *  'buffers': Array de 'count' buffers donde se copiarán los paquetes.
+ *  'buf_len': Longitud de cada buffer en bytes.
+ * 'pkt_lens': Longitud de cada paquete recibido, que puede ser mayor que
+ *             'buf_len' (igual que en 'rawnet_recv()').
+ *    'count': Número máximo de paquetes a recibir.
+ *  'timeout': Tiempo en milisegundos que debe esperarse al primer paquete.
+ *             Un número negativo indicará que debe esperarse
+ *             indefinidamente, y un '0' que no debe esperarse.
+ *
+ * VALOR DEVUELTO:
+ *   El número de paquetes recibidos, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_recv_batch
+( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+  int pkt_lens[], int count, long int timeout );
+
+
+/* int rawnet_recv_batch_ts
+ * ( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+ *   int pkt_lens[], struct timespec * stamps, int count, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawnet_recv_batch()', pero además devuelve en 'stamps' el
+ *   instante de llegada de cada paquete (ver 'rawiface_set_timestamps()').
+ *   Los paquetes sin marca de tiempo la tienen a cero.
+ *
+ * PARÁMETROS:
+ *   'stamps': Array de 'count' marcas de tiempo, o NULL si no interesan.
+ *   El resto, igual que en 'rawnet_recv_batch()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de paquetes recibidos, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_recv_batch_ts
+( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+  int pkt_lens[], struct timespec * stamps, int count, long int timeout );
+
+
 /* int rawnet_poll
  * ( rawiface_t * ifaces[], int ifnum, long int timeout );
  *
@@ -245,17 +608,32 @@ int rawiface_close ( rawiface_t * iface );
  *
  * DESCRIPCIÓN:
  *   Esta función devuelve el último mensaje de error generado por alguna
- *   función de esta librería.
+ *   función de esta librería en el hilo que la llama. Cada hilo tiene su
+ *   propio estado de error.
  *
  *   Hay funciones que no actualizan este mensaje de error, consulte la
  *   definición de la función.
  *
  * VALOR DEVUELTO:
  *   Cadena de texto con los detalles del último error producido por esta
- *   librería.
+ *   librería. Es válida hasta la siguiente llamada a esta función desde el
+ *   mismo hilo.
  */
 char* rawnet_strerror();
 
 
+/* int rawnet_errno();
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el código 'errno' del último error generado por
+ *   alguna función de esta librería en el hilo que la llama.
+ *
+ * VALOR DEVUELTO:
+ *   El código 'errno' del último error, o 0 si no se ha producido ningún
+ *   error o éste no se debió a una llamada al sistema.
+ */
+int rawnet_errno();
+
+
 
 #endif /* _RAW_NET_H */
@@ -0,0 +1,111 @@
+#ifndef _RAWNET_BACKEND_H
+#define _RAWNET_BACKEND_H
+
+#include <sys/uio.h>
+#include <time.h>
+
+/* Backends alternativos al socket AF_PACKET de rawnet. Las aplicaciones no
+   usan esta interfaz: el backend se elige con el prefijo del nombre de la
+   interfaz en 'rawiface_open()' (por ejemplo "xdp:eth0") y a partir de ahí
+   todas las funciones 'rawiface_*()' y 'rawnet_*()' lo usan a él.
+
+   Las funciones de un backend indican sus errores con 'rawnet_seterror()'. */
+struct rawnet_backend {
+  /* Prefijo del nombre de la interfaz que selecciona el backend */
+  const char * prefix;
+
+  /* 1 si el backend mueve las tramas por el socket AF_PACKET de rawnet (que
+     entonces recibe todos los protocolos y admite 'rawnet_set_filter()'),
+     0 si sólo se usa para los ioctl() y no recibe nada */
+  int packet_socket;
+
+  /* 1 si rawnet debe abrir su socket AF_PACKET sobre una interfaz de red
+     del sistema; 0 si el backend no lo necesita, porque no hay tal interfaz
+     (p.ej. un fichero) o la maneja él mismo (p.ej. un TAP): 'open' recibe
+     entonces todo lo que sigue al prefijo, sin índice ni socket (-1), y la
+     dirección y la MTU las dan 'getaddr' y 'getmtu' */
+  int system_iface;
+
+  /* 1 si cada 'open' de la misma interfaz es una cola más entre las que el
+     kernel reparte los paquetes por flujo, con lo que 'rawiface_open_fanout()'
+     no necesita PACKET_FANOUT */
+  int multiqueue;
+
+  /* Abre el backend sobre la interfaz 'ifname' (con índice 'ifindex'), cuyo
+     socket AF_PACKET es 'socket_fd'. Devuelve su estado, que se pasa al
+     resto de funciones, o NULL. */
+  void * (*open) ( const char * ifname, int ifindex, int socket_fd );
+
+  /* Descriptor que se puede esperar con poll()/epoll() (POLLIN) */
+  int (*getfd) ( void * state );
+
+  /* Espera hasta 'timeout' ms (negativo: indefinidamente) al siguiente
+     paquete y devuelve en 'frame' un puntero a él, válido hasta la siguiente
+     llamada, y en 'pkt_len' su longitud original. Devuelve los bytes
+     accesibles en 'frame', 0 si ha expirado el temporizador o -1. */
+  int (*recv) ( void * state, unsigned char ** frame, int * pkt_len,
+                long int timeout );
+
+  /* Deja un paquete, en 'iovcnt' trozos, listo para enviar. Devuelve su
+     longitud, -2 si no hay sitio hasta que salgan los anteriores o -1. */
+  int (*sendv) ( void * state, const struct iovec * iov, int iovcnt );
+
+  /* Pide que salgan los paquetes pendientes, sin esperar. Devuelve cuántos
+     había o -1. */
+  int (*flush) ( void * state );
+
+  /* Libera todos los recursos del backend */
+  void (*close) ( void * state );
+
+  /* Sólo si 'system_iface' es 0 (si no, pueden ser NULL): copia en 'addr'
+     la dirección hardware y devuelve su longitud, o -1 */
+  int (*getaddr) ( void * state, unsigned char addr[] );
+
+  /* Sólo si 'system_iface' es 0: devuelve la MTU, o -1 */
+  int (*getmtu) ( void * state );
+
+  /* Puede ser NULL: copia en 'stamp' el instante de llegada del último
+     paquete de 'recv', si el backend lo conoce (p.ej. el guardado en un
+     fichero), y devuelve 0. Si no, rawnet usa el instante en que lo recoge */
+  int (*getstamp) ( void * state, struct timespec * stamp );
+};
+
+
+/* void rawnet_seterror ( const char * format, ... );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función establece el mensaje que devolverá 'rawnet_strerror()',
+ *   con el mismo formato que 'printf()'.
+ */
+void rawnet_seterror ( const char * format, ... );
+
+
+/* int rawnet_parse_mac ( const char * str, unsigned char mac[] );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee una dirección Ethernet con el formato
+ *   "xx:xx:xx:xx:xx:xx" (p.ej. de las opciones "mac=" de los backends).
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la dirección es correcta, o -1.
+ */
+int rawnet_parse_mac ( const char * str, unsigned char mac[] );
+
+
+/* Backend AF_XDP ("xdp:<ifname>"), en rawnet_xdp.c */
+extern const struct rawnet_backend rawnet_xdp_backend;
+
+/* Backend io_uring ("uring:<ifname>"), en rawnet_uring.c */
+extern const struct rawnet_backend rawnet_uring_backend;
+
+/* Ficheros de captura ("pcap:<fichero>[,<opción>...]"), en rawnet_pcap.c */
+extern const struct rawnet_backend rawnet_pcap_backend;
+
+/* Dispositivos TAP ("tap:<ifname>[,mac=<dirección>]"), en rawnet_tap.c */
+extern const struct rawnet_backend rawnet_tap_backend;
+
+/* Enlaces en memoria compartida ("shm:<enlace>[,mac=<dirección>]"), en
+   rawnet_shm.c */
+extern const struct rawnet_backend rawnet_shm_backend;
+
+#endif /* _RAWNET_BACKEND_H */
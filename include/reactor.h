@@ -0,0 +1,215 @@
+#ifndef _REACTOR_H
+#define _REACTOR_H
+
+/* Bucle de eventos ("reactor") basado en epoll. Un único hilo espera a la
+   vez en todos los descriptores (interfaces, temporizadores, ...) y llama a
+   la función registrada para cada uno que esté listo, en lugar de bloquearse
+   en una recepción concreta.
+
+   Esta es una estructura opaca que no debe ser accedida directamente, sino a
+   través de las funciones de esta librería. */
+typedef struct reactor reactor_t;
+
+/* Número máximo de eventos que se atienden en cada vuelta del bucle */
+#define REACTOR_EVENTS_MAX 64
+
+/* Función que atiende un descriptor listo para leer, o un temporizador que
+   ha expirado. Recibe el descriptor (o el identificador del temporizador) y
+   el argumento 'arg' indicado al registrarla. */
+typedef void (*reactor_handler_t) ( reactor_t * reactor, int fd, void * arg );
+
+
+/* reactor_t * reactor_create ();
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un bucle de eventos vacío. La memoria del manejador
+ *   devuelto debe ser liberada con la función 'reactor_destroy()'.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador del bucle de eventos.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+reactor_t * reactor_create ();
+
+
+/* int reactor_add_fd
+ * ( reactor_t * reactor, int fd, reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra el descriptor 'fd' para que se llame a 'handler'
+ *   cada vez que tenga datos para leer. El descriptor debe estar en modo no
+ *   bloqueante y 'handler' debe leer todo lo que haya disponible.
+ *
+ * PARÁMETROS:
+ *   'reactor': Manejador del bucle de eventos.
+ *        'fd': Descriptor a vigilar.
+ *   'handler': Función que atenderá el descriptor.
+ *       'arg': Argumento que se pasará a 'handler'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el descriptor se ha registrado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_add_fd
+( reactor_t * reactor, int fd, reactor_handler_t handler, void * arg );
+
+
+/* int reactor_del_fd ( reactor_t * reactor, int fd );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función deja de vigilar el descriptor 'fd'. Se puede llamar desde
+ *   cualquier manejador, incluido el del propio descriptor.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el descriptor se ha eliminado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el descriptor no estaba registrado.
+ */
+int reactor_del_fd ( reactor_t * reactor, int fd );
+
+
+/* int reactor_add_timer
+ * ( reactor_t * reactor, long int timeout, long int period,
+ *   reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un temporizador (timerfd) que llamará a 'handler'
+ *   dentro de 'timeout' milisegundos y, si 'period' es mayor que 0, cada
+ *   'period' milisegundos a partir de entonces.
+ *
+ * PARÁMETROS:
+ *   'reactor': Manejador del bucle de eventos.
+ *   'timeout': Milisegundos hasta la primera expiración. Un número negativo
+ *              crea el temporizador parado (ver 'reactor_set_timer()').
+ *    'period': Periodo en milisegundos, o 0 si sólo debe expirar una vez.
+ *   'handler': Función que se llamará al expirar.
+ *       'arg': Argumento que se pasará a 'handler'.
+ *
+ * VALOR DEVUELTO:
+ *   El identificador del temporizador, para 'reactor_set_timer()' y
+ *   'reactor_del_timer()'.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_add_timer
+( reactor_t * reactor, long int timeout, long int period,
+  reactor_handler_t handler, void * arg );
+
+
+/* int reactor_set_timer
+ * ( reactor_t * reactor, int timer, long int timeout, long int period );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función vuelve a programar el temporizador 'timer', igual que al
+ *   crearlo. Un 'timeout' negativo lo para.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el temporizador se ha programado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_set_timer
+( reactor_t * reactor, int timer, long int timeout, long int period );
+
+
+/* int reactor_del_timer ( reactor_t * reactor, int timer );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina el temporizador 'timer'. Se puede llamar desde
+ *   cualquier manejador.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el temporizador se ha eliminado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el temporizador no existe.
+ */
+int reactor_del_timer ( reactor_t * reactor, int timer );
+
+
+/* int reactor_add_prepare
+ * ( reactor_t * reactor, reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra 'handler' para que se le llame (con 'fd' -1) al
+ *   comienzo de cada vuelta del bucle, antes de esperar: por ejemplo, para
+ *   enviar lo que los manejadores de la vuelta anterior hayan dejado en un
+ *   anillo de transmisión, o para programar un temporizador sólo cuando
+ *   haga falta.
+ *
+ * PARÁMETROS:
+ *   'reactor': Manejador del bucle de eventos.
+ *   'handler': Función que se llamará en cada vuelta.
+ *       'arg': Argumento que se pasará a 'handler'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la función se ha registrado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_add_prepare
+( reactor_t * reactor, reactor_handler_t handler, void * arg );
+
+
+/* int reactor_run ( reactor_t * reactor, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera hasta 'timeout' milisegundos a que algún descriptor
+ *   o temporizador esté listo y llama a los manejadores de todos los que lo
+ *   estén (hasta 'REACTOR_EVENTS_MAX').
+ *
+ * PARÁMETROS:
+ *   'reactor': Manejador del bucle de eventos.
+ *   'timeout': Tiempo máximo de espera en milisegundos. Un número negativo
+ *              indicará que debe esperarse indefinidamente.
+ *
+ * VALOR DEVUELTO:
+ *   El número de eventos atendidos, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_run ( reactor_t * reactor, long int timeout );
+
+
+/* int reactor_loop ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función atiende eventos indefinidamente, hasta que algún manejador
+ *   (o una señal) llame a 'reactor_stop()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 cuando se ha parado el bucle con 'reactor_stop()'.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_loop ( reactor_t * reactor );
+
+
+/* void reactor_stop ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función hace que 'reactor_loop()' termine al acabar la vuelta
+ *   actual. Se puede llamar desde un manejador de señal.
+ */
+void reactor_stop ( reactor_t * reactor );
+
+
+/* void reactor_destroy ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina el bucle de eventos y todos sus temporizadores. Los
+ *   descriptores registrados con 'reactor_add_fd()' no se cierran.
+ */
+void reactor_destroy ( reactor_t * reactor );
+
+#endif /* _REACTOR_H */
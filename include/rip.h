@@ -25,6 +25,14 @@
 
 #define UDP_RCV_TIMEOUT -1
 
+/* Si vale 1, el servidor marca la llegada de cada mensaje y muestra cuánto
+   tarda cada etapa: espera en cola (llegada al kernel -> rip_input()),
+   actualización de la tabla y envío del triggered update. Está desactivado
+   por defecto; se activa compilando con -DRIP_LATENCY=1 */
+#ifndef RIP_LATENCY
+#define RIP_LATENCY 0
+#endif
+
 /*Estructura de una entrada RIPv2*/
 typedef struct ripv2_entry {
     uint16_t addr_id;                                                           //2 bytes
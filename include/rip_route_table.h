@@ -7,7 +7,7 @@
 #include <timerms.h>
 
 /* Logitud máxmima del nombre de un interfaz de red */
-#define IFACE_NAME_MAX_LENGTH 32
+#define IFACE_NAME_MAX_LENGTH 128
 #define RIPv2_ROUTE_TABLE_SIZE 256 /* Número de entradas máximo de la tabla de rutas IPv4 */
 
 #define RIPv2_UPDATE 30000//30 secs
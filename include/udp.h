@@ -15,9 +15,15 @@
 /*1500 Eth - 20 IP - 8 header UDP = 1472*/
 #define UDP_MAX_LENGTH 1472
 
+/* Función que procesa un datagrama UDP recibido en nuestro puerto. Recibe la
+   IP y el puerto origen y los datos, además del argumento 'arg' indicado al
+   registrarla con 'udp_set_handler()'. */
+typedef void (*udp_handler_t)
+( ipv4_addr_t src_addr, uint16_t src_port, unsigned char * payload, int payload_len, void * arg );
+
 
 /*
- * int udp_open(char *config, char *rtable,uint16_t port);
+ * int udp_open(net_stack_t * stack, char *config, char *rtable,uint16_t port);
  *
  * DESCRIPCIÓN:
  *   Esta función abre una conexion UDP para enviar paquetes.
@@ -32,10 +38,10 @@
  * ERRORES:
  *   La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
  */
-int udp_open(char *config, char *rtable,uint16_t port);
+int udp_open(net_stack_t * stack, char *config, char *rtable,uint16_t port);
 
 /*
- * int udp_close();
+ * int udp_close(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
  *   Esta función cierra una conexion UDP.
@@ -46,10 +52,10 @@ int udp_open(char *config, char *rtable,uint16_t port);
  * ERRORES:
  *   La función devuelve -1 si no ha podido cerrar la interfaz eth o ipv4.
  */
-int udp_close();
+int udp_close(net_stack_t * stack);
 
 /*
- * int udp_send(ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len);
+ * int udp_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len);
  *
  * DESCRIPCIÓN:
  *   Esta función envia un paquete UDP.
@@ -66,10 +72,52 @@ int udp_close();
  * ERRORES:
  *		La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
  */
-int udp_send(ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len );
+int udp_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len );
+
+/*
+ * int udp_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, pkt_buf_t * buf);
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'udp_send()', pero la aplicación ya ha escrito sus datos en
+ *   'buf' ('pkt_buf_init()' y 'pkt_buf_put()'): cada capa añade su cabecera
+ *   delante en el espacio reservado y los datos no se copian.
+ *
+ * VALOR DEVUELTO:
+ * 		Igual que 'udp_send()'.
+ *
+ * ERRORES:
+ *		Igual que 'udp_send()'.
+ */
+int udp_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, pkt_buf_t * buf);
+
+/*
+ * int udp_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, unsigned char * payloads[], int payload_lens[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Envía 'count' datagramas UDP al mismo destino y puerto de una vez
+ *   (con 'ipv4_send_buf_batch()'). Los datos de cada uno se copian una sola
+ *   vez a un 'pkt_buf_t' y las cabeceras se añaden delante, en su sitio.
+ *
+ * PARÁMETROS:
+ *   'dst_addr': Ip destino
+ *   'port': Puerto destino
+ *	 'payloads': Array con los datos de cada datagrama
+ * 	 'payload_lens': Tamaño de los datos de cada datagrama
+ * 	 'count': Número de datagramas
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve el número de datagramas enviados o encolados a la espera del
+ * 		ARP REPLY (ver 'ipv4_send_batch()'); si es menor que 'count' el resto
+ * 		se ha descartado.
+ *
+ * ERRORES:
+ *		Devuelve un valor negativo si algo no ha ocurrido como lo esperado
+ *		Devuelve -1 si algún paquete supera UDP_MAX_LENGTH (y no envía ninguno)
+ */
+int udp_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, unsigned char * payloads[], int payload_lens[], int count);
 
 /*
- * int udp_recv(ipv4_addr_t src_addr, uint16_t port, unsigned char * buffer, int buffer_len, long int timeout )
+ * int udp_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t port, unsigned char * buffer, int buffer_len, long int timeout )
  *
  * DESCRIPCIÓN:
  *   Esta función recibe un paquete UDP.
@@ -88,10 +136,90 @@ int udp_send(ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int pa
  *	 devuelve '-1' si hay un problema con la interfaz
  *   Devuelve '0' si no se ha recibido nada de payload
  */
-int udp_recv(ipv4_addr_t src_addr, uint16_t *port, unsigned char * buffer, int buffer_len, long int timeout );
+int udp_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t *port, unsigned char * buffer, int buffer_len, long int timeout );
+
+/*
+ * int udp_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t *port, pkt_view_t * view, long int timeout )
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'udp_recv()', pero sin copiar los datos: 'view' queda sobre la
+ *   trama recibida, con 'l3_offset' y 'l4_offset' apuntando a las cabeceras
+ *   IPv4 y UDP y los datos en 'pkt_view_data()'. Sólo es válida hasta la
+ *   siguiente recepción (ver "pkt.h").
+ *
+ * VALOR DEVUELTO:
+ *   El tamaño de los datos del datagrama, o '0' si ha expirado el timeout.
+ *
+ * ERRORES:
+ *	 devuelve '-1' si hay un problema con la interfaz
+ */
+int udp_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t *port, pkt_view_t * view, long int timeout );
+
+/*
+ * int udp_set_handler(net_stack_t * stack, udp_handler_t handler, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Registra 'handler' para los datagramas que lleguen a nuestro puerto
+ *   mientras se atiende el bucle de eventos ('udp_reactor_add()'). Un
+ *   'handler' 'NULL' lo elimina. Hay que llamarla después de 'udp_open()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el manejador se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto la conexion.
+ */
+int udp_set_handler(net_stack_t * stack, udp_handler_t handler, void * arg);
+
+/*
+ * int udp_reactor_add(net_stack_t * stack, reactor_t * reactor);
+ *
+ * DESCRIPCIÓN:
+ *   Registra la conexion en el bucle de eventos 'reactor' (ver
+ *   'ipv4_reactor_add()').
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si falla el registro.
+ */
+int udp_reactor_add(net_stack_t * stack, reactor_t * reactor);
+
+/*
+ * int udp_set_timestamps(net_stack_t * stack, int enable);
+ *
+ * DESCRIPCIÓN:
+ *   Activa (o desactiva) la marca de tiempo de llegada de los datagramas
+ *   (ver 'ipv4_set_timestamps()'). Las vistas de 'udp_recv_view()' la llevan
+ *   en 'stamp' y 'udp_get_timestamp()' devuelve la del último datagrama.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o no se puede cambiar.
+ */
+int udp_set_timestamps(net_stack_t * stack, int enable);
+
+/*
+ * int udp_get_timestamp(net_stack_t * stack, struct timespec * stamp);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve en 'stamp' el instante (CLOCK_REALTIME) en que el kernel recibió
+ *   el último datagrama entregado: el que ha devuelto 'udp_recv()' o el que
+ *   se está procesando en el manejador ('udp_set_handler()').
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el datagrama tiene marca de tiempo.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no la tiene.
+ */
+int udp_get_timestamp(net_stack_t * stack, struct timespec * stamp);
 
 /*
-* int get_rnd_port()
+* int get_rnd_port(net_stack_t * stack)
 *
 * DESCRIPCION
 *   Genera un puerto aleatorio (un numero entre 1025 y MAX_RAND_PORT)
@@ -99,6 +227,6 @@ int udp_recv(ipv4_addr_t src_addr, uint16_t *port, unsigned char * buffer, int b
 * VALOR DEVUELTO
 *   Devuelve el valor generado
 */
-int get_rnd_port();
+int get_rnd_port(net_stack_t * stack);
 
 #endif /* _UDP_H */
@@ -1,4 +1,5 @@
 #include "arp.h"
+#include "net_stack_state.h"
 
 /* Tamaño de una IPv4 (32 bits == 4 bytes). */
 //#define IPv4_ADDR_SIZE 4 // define DUPLICADO por eso esta comentado
@@ -8,66 +9,245 @@
 /*Para rellenar el tipo de direccion software (proto_type) del paquete ARP*/
 #define IPv4_ETH_TYPE 0x0800
 
-/* Valor del campo Type en un paquete ARP para que sea ethernet */
-#define ARP_ETH_TYPE 0x0806
-/* Valor del campo Code (op_code) en un paquete ARP pata que sea request*/
-#define ARP_REQ_CODE 0x0001
-/* Valor del campo Code (op_code) en un paquete ARP pata que sea reply*/
-#define ARP_REP_CODE 0x0002
-/* Tamaño de un paquete ARP */
-#define ARP_MSG_SIZE 28
 
 #define FIRST_ATTEMPT_TIMEOUT 2000  //Primer intento, 2 segundos  
 #define SECOND_ATTEMPT_TIMEOUT 3000  //Segundo itento, 3 segundos
-#define UNICAST_REQUEST 1
-#define BROADCAST_REQUEST 0
+
+/* Numero máximo de vecinos con una resolución ARP asíncrona en curso */
+#define ARP_PENDING_LENGTH 16
+/* Numero máximo de paquetes encolados por cada vecino pendiente de resolver */
+#define ARP_PENDING_QUEUE_LENGTH 8
+/* Numero de ARP REQUEST enviados antes de descartar los paquetes encolados */
+#define ARP_PENDING_ATTEMPTS 2
+/* Numero máximo de IPs recordadas como inalcanzables (caché negativa) */
+#define ARP_FAILED_LENGTH 16
+/* Tiempo sin volver a preguntar por una IP tras el primer fallo; se dobla en
+   cada fallo consecutivo hasta ARP_HOLDDOWN_MAX */
+#define ARP_HOLDDOWN_MIN 1000
+#define ARP_HOLDDOWN_MAX 60000
 
 /* Numero máximo de entradas ARP*/
-#define CACHE_LENGTH 2
+#define CACHE_LENGTH 64
 /* Tiempo de vida de  una entrada en la cache ARP */
-#define CACHE_TTL 5  //5 segundos dura una entrada en la cache, si se reusa se pone el timer a 0
+#define CACHE_TTL 60  //60 segundos dura una entrada en la cache, cada ARP o paquete IP del vecino la refresca
 
 /* estructura de una entrada de la cache ARP */
 typedef struct arp_entry{
+  eth_iface_t * iface;         //Interfaz por el que se llega al vecino: cada interfaz tiene su caché
   ipv4_addr_t ip_addr;
   mac_addr_t mac_addr;
   time_t last_time;            //Para indicar cuanto tiempo lleva la entrada en la tabla, es un TIME STAM NO UN TIMER
 } arp_entry_t;
 
-/* Esta es la estructura de un paquete ARP */
-typedef struct arp_pkt_t{
-	uint16_t hw_type;			       // Tipo de dirección de hardware
-	uint16_t proto_type;		     // Tipo de dirección de software
-	uint8_t hw_size;			       // Longitud de la dirección de hardware
-	uint8_t proto_size;			     // Longitud de la direccion de software
-	uint16_t op_code;			       //  Codigo de la operacion (Request o reply)
-	mac_addr_t src_hw_addr; 	   // Dirección de hardware de origen
-	ipv4_addr_t src_proto_addr;	 // Direccion IP de origen
-	mac_addr_t dst_hw_addr;		   // Dirección de hardware de destino (La MAC que deseamos saber)
-	ipv4_addr_t dst_proto_addr;  // Direccion IP de destino (por la que preguntamos la MAC)
-} arp_pkt ;
-
-
-/*Variable globales*/
-int recv_bytes;                         // Bytes recibidos
-mac_addr_t src_mac;                     // MAC desde donde se envía la respuesta
-unsigned char inbuffer[ETH_MTU];        // Buffer de entrada
-timerms_t timer;                        //Definicion del timer de espera a respuesta
-unsigned char cache_initialized = 0;
-arp_entry_t cache_table[CACHE_LENGTH];  // Inicializacion de la Cache ARP (array de estructuras)
-
-/* int arp_resolve(eth_iface_t * iface,ipv4_addr_t ip_addr,mac_addr_t mac_addr);
+/* Paquete encolado a la espera de que se resuelva la MAC de su destino */
+typedef struct arp_queued_pkt {
+  uint16_t type;               // Tipo Ethernet con el que se enviará
+  int len;                     // Longitud de los datos
+  unsigned char * data;        // Copia de los datos (reservada con malloc)
+} arp_queued_pkt_t;
+
+/* Resolución ARP asíncrona en curso. Los paquetes dirigidos a 'ip_addr' se
+   encolan aquí hasta que llegue el ARP REPLY o se agoten los reintentos */
+typedef struct arp_pending {
+  eth_iface_t * iface;         // Interfaz por el que se resuelve (NULL = libre)
+  ipv4_addr_t ip_addr;         // IP que se está resolviendo
+  ipv4_addr_t my_ipv4_addr;    // Nuestra IP, para los reintentos
+  int attempts;                // ARP REQUEST enviados hasta ahora
+  timerms_t timer;             // Vence cuando hay que reintentar
+  int pkts_num;                // Paquetes encolados
+  arp_queued_pkt_t pkts[ARP_PENDING_QUEUE_LENGTH];
+} arp_pending_t;
+
+/* IP que no ha respondido: no se vuelve a preguntar por ella hasta que venza 'holddown' */
+typedef struct arp_failed {
+  int failures;                // Fallos consecutivos (0 = entrada libre)
+  eth_iface_t * iface;
+  ipv4_addr_t ip_addr;
+  timerms_t holddown;
+} arp_failed_t;
+
+
+/* Estado ARP de una pila (ver "net_stack_state.h"): la caché, las
+   resoluciones en curso y la caché negativa de todos sus interfaces */
+struct arp_state {
+  mac_addr_t src_mac;                     // MAC desde donde se envía la respuesta
+  unsigned char inbuffer[ETH_MTU];        // Buffer de entrada
+  arp_entry_t cache_table[CACHE_LENGTH];  // Cache ARP (array de estructuras)
+  arp_pending_t pending_table[ARP_PENDING_LENGTH]; // Resoluciones asíncronas en curso
+  arp_failed_t failed_table[ARP_FAILED_LENGTH];     // IPs que no han respondido (caché negativa)
+  unsigned int dropped_pkts;              // Paquetes descartados por no poder resolver su destino
+};
+
+/* int arp_send_request(eth_iface_t * iface, ipv4_addr_t ip_addr, ipv4_addr_t my_ipv4_addr, mac_addr_t dst_mac);
+ *
+ * DESCRIPCIÓN:
+ *   Envía un ARP REQUEST preguntando por 'ip_addr' a la MAC 'dst_mac', que
+ *   será la de difusión salvo cuando se refresca una entrada caducada.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha enviado el ARP REQUEST.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar.
+ */
+static int arp_send_request(eth_iface_t * iface, ipv4_addr_t ip_addr, ipv4_addr_t my_ipv4_addr, mac_addr_t dst_mac){
+  arp_pkt req_packet;
+
+  req_packet.hw_type = htons(ETHER_ETH_TYPE);
+  req_packet.proto_type = htons(IPv4_ETH_TYPE);
+  req_packet.hw_size= MAC_ADDR_SIZE;
+  req_packet.proto_size = IPv4_ADDR_SIZE;
+  req_packet.op_code = htons(ARP_REQ_CODE);
+  bzero(req_packet.dst_hw_addr,MAC_ADDR_SIZE); //La MAC de la IP por la que preguntamos ha de ir a 0 para que se rellene
+  memcpy(req_packet.dst_proto_addr,ip_addr,IPv4_ADDR_SIZE);
+  eth_getaddr(iface,req_packet.src_hw_addr);   //Nuestra MAC
+  memcpy(req_packet.src_proto_addr,my_ipv4_addr,IPv4_ADDR_SIZE);
+
+  if(eth_send(iface,dst_mac,ARP_ETH_TYPE,(unsigned char *) &req_packet, ARP_MSG_SIZE) < 0) {
+    printf("eth_send: No se ha podido enviar el paquete\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* void arp_reply_build(arp_pkt * packet, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip);
+ *
+ * DESCRIPCIÓN:
+ *   Rellena 'packet' con un ARP REPLY que indica a 'dst_mac'/'dst_ip' que
+ *   'src_ip' está en 'src_mac'.
+ */
+void arp_reply_build(arp_pkt * packet, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip){
+  packet->hw_type = htons(ETHER_ETH_TYPE);
+  packet->proto_type = htons(IPv4_ETH_TYPE);
+  packet->hw_size= MAC_ADDR_SIZE;
+  packet->proto_size = IPv4_ADDR_SIZE;
+  packet->op_code = htons(ARP_REP_CODE);
+  memcpy(packet->dst_hw_addr,dst_mac,MAC_ADDR_SIZE);
+  memcpy(packet->dst_proto_addr,dst_ip,IPv4_ADDR_SIZE);
+  memcpy(packet->src_hw_addr,src_mac,MAC_ADDR_SIZE);
+  memcpy(packet->src_proto_addr,src_ip,IPv4_ADDR_SIZE);
+}
+
+/* int arp_reply(eth_iface_t * iface, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip);
+ *
+ * DESCRIPCIÓN:
+ *   Envía un ARP REPLY a 'dst_mac'/'dst_ip' indicando que 'src_ip' está en
+ *   'src_mac' (nuestra MAC, o la de otro equipo si respondemos por él).
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha enviado el ARP REPLY.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar.
+ */
+int arp_reply(eth_iface_t * iface, mac_addr_t dst_mac, ipv4_addr_t dst_ip, mac_addr_t src_mac, ipv4_addr_t src_ip){
+  arp_pkt rep_packet;
+  arp_reply_build(&rep_packet, dst_mac, dst_ip, src_mac, src_ip);
+
+  if(eth_send(iface,dst_mac,ARP_ETH_TYPE,(unsigned char *) &rep_packet, ARP_MSG_SIZE) < 0) {
+    printf("eth_send: No se ha podido enviar el paquete\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* arp_pending_t * arp_pending_find(struct arp_state * arp, eth_iface_t * iface, ipv4_addr_t ip_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Busca la resolución asíncrona en curso para 'ip_addr' por 'iface'.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero a la resolución en curso, o 'NULL' si no hay ninguna.
+ */
+static arp_pending_t * arp_pending_find(struct arp_state * arp, eth_iface_t * iface, ipv4_addr_t ip_addr){
+  int i;
+  for(i=0; i<ARP_PENDING_LENGTH; i++){
+    if(arp->pending_table[i].iface == iface && memcmp(arp->pending_table[i].ip_addr, ip_addr, IPv4_ADDR_SIZE)==0){
+      return &arp->pending_table[i];
+    }
+  }
+  return NULL;
+}
+
+/* void arp_pending_release(arp_pending_t * pending);
+ *
+ * DESCRIPCIÓN:
+ *   Libera los paquetes encolados (sin enviarlos) y deja el hueco libre.
+ */
+static void arp_pending_release(arp_pending_t * pending){
+  int i;
+  for(i=0; i<pending->pkts_num; i++){
+    free(pending->pkts[i].data);
+  }
+  bzero(pending, sizeof(arp_pending_t));
+}
+
+/* arp_failed_t * arp_failed_find(struct arp_state * arp, eth_iface_t * iface, ipv4_addr_t ip_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve la entrada de la caché negativa de 'ip_addr' en 'iface', o NULL.
+ */
+static arp_failed_t * arp_failed_find(struct arp_state * arp, eth_iface_t * iface, ipv4_addr_t ip_addr){
+  int i;
+  for(i=0; i<ARP_FAILED_LENGTH; i++){
+    if(arp->failed_table[i].failures > 0 && arp->failed_table[i].iface == iface && memcmp(arp->failed_table[i].ip_addr, ip_addr, IPv4_ADDR_SIZE) == 0){
+      return &arp->failed_table[i];
+    }
+  }
+  return NULL;
+}
+
+/* void arp_failed_add(struct arp_state * arp, eth_iface_t * iface, ipv4_addr_t ip_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Apunta un fallo más de 'ip_addr' y no se vuelve a preguntar por ella
+ *   durante ARP_HOLDDOWN_MIN * 2^(fallos-1) ms, como mucho ARP_HOLDDOWN_MAX.
+ *   Si la tabla está llena se reutiliza la entrada cuya espera vence antes.
+ */
+static void arp_failed_add(struct arp_state * arp, eth_iface_t * iface, ipv4_addr_t ip_addr){
+  arp_failed_t * failed = arp_failed_find(arp, iface, ip_addr);
+  if(failed == NULL){
+    int i;
+    for(i=0; i<ARP_FAILED_LENGTH; i++){
+      if(arp->failed_table[i].failures == 0){
+        failed = &arp->failed_table[i];
+        break;
+      }
+      if(failed == NULL || timerms_left(&arp->failed_table[i].holddown) < timerms_left(&failed->holddown)){
+        failed = &arp->failed_table[i];
+      }
+    }
+    failed->failures = 0;
+    failed->iface = iface;
+    memcpy(failed->ip_addr, ip_addr, IPv4_ADDR_SIZE);
+  }
+
+  long int holddown = ARP_HOLDDOWN_MIN;
+  int i;
+  for(i=0; i<failed->failures && holddown < ARP_HOLDDOWN_MAX; i++){
+    holddown *= 2;
+  }
+  if(holddown > ARP_HOLDDOWN_MAX){
+    holddown = ARP_HOLDDOWN_MAX;
+  }
+  failed->failures++;
+  timerms_reset(&failed->holddown, holddown);
+}
+
+
+/* int arp_resolve(net_stack_t * stack, eth_iface_t * iface,ipv4_addr_t ip_addr,mac_addr_t mac_addr);
  *
  * DESCRIPCIÓN:
  *   Esta función resuelve la query de arp basada en la IP que se le entregue
  *   nos devuelve la MAC asociada.
- *   Esta función usa funciones subordinadas para ejecutar algunas funciones
- *   estra como uso de caché o reintento de arp-request. 
  *   Primero se mira si esta en cache
  *    Si esta: se usa
  *    Si esta caducada: se usa arp unicast
  *    No esta: se hace broadcast
- *   Segundo: si dió error primero se hace un segundo intento en broadcast directamente
+ *   La petición se comparte con 'arp_resolve_async()': si ya hay una en curso
+ *   para esa IP no se envía otra, sólo se espera a su respuesta, y los
+ *   reintentos los hace 'arp_pending_timers()'. Si la IP no respondió hace
+ *   poco, se falla directamente sin preguntar (caché negativa).
  *
  * PARÁMETROS:
  *   'iface': Puntero a la estructura del manejador del interfaz ethernet.
@@ -82,141 +262,452 @@ arp_entry_t cache_table[CACHE_LENGTH];  // Inicializacion de la Cache ARP (array
  *   La función devuelve '-1' si se ha producido algún error.
  */
 
- int arp_resolve(eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr){
-   int result = 0;
+ int arp_resolve(net_stack_t * stack, eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr){
+   struct arp_state * arp = stack->arp;
 
-   /*0. Inicializacion de la Cache ARP*/
-   cache_init();                 // Ponemos la cache a 0
-   cache_show();                 // Mostramos la cache (DEBUG)
+   /*0. Mostramos la cache (DEBUG)*/
+   cache_show(stack);
 
-   /*1. Comprobamos si ya existe una entrada valida en la cache ARP*/
-   int cache = cache_resolve(mac_addr,ip_addr);
-
-   if(cache==0){
-     return 0; // Si se ha encontrado una entrada válida en la cache, salimos. Porque ya tenemos la MAC asociada
-   }
-   if(cache==-1){ //-1 = estaba la entrada en la cache pero era antigua. Hacemos un primer intento por unicast
-     result = arp_rslv(iface,ip_addr,my_ipv4_addr,mac_addr,FIRST_ATTEMPT_TIMEOUT,UNICAST_REQUEST);
-   }
-   if(cache==-2){ //-2= no estaba la entrada en la cache. Hacemos un segundo intento por broadcast
-     result = arp_rslv(iface,ip_addr,my_ipv4_addr,mac_addr,FIRST_ATTEMPT_TIMEOUT,BROADCAST_REQUEST);
+   /*1. Miramos la cache y, si no está, enviamos el ARP REQUEST (o nos unimos al que ya haya)*/
+   int result = arp_resolve_async(stack, iface,ip_addr,my_ipv4_addr,mac_addr,0,NULL,0);
+   if(result <= 0){
+     return result; // 0 = estaba en la cache, -1 = no se puede preguntar ahora
    }
 
+   /*2. Esperamos hasta que se resuelva o se agoten los reintentos*/
+   while(arp_pending_find(arp, iface, ip_addr) != NULL){
+     int recv_bytes = eth_recv(iface,arp->src_mac,ARP_ETH_TYPE,arp->inbuffer,ETH_MTU,arp_pending_timeout(stack));
+     if(recv_bytes < 0){
+       return -1;
+     }
+     if(recv_bytes == 0){
+       arp_pending_timers(stack);  //Reintento o fallo definitivo
+     }else{
+       arp_input(stack, iface,arp->src_mac,arp->inbuffer,recv_bytes,my_ipv4_addr); //Aprendemos de cualquier ARP que nos llegue
+     }
+   }
 
-   if(result != 0) { //Si con el primer timer da fallo se intenta una segunda vez por broadcast directamente
-     printf("eth_send: Reintentando ARP REQUEST\n");
-     result = arp_rslv(iface,ip_addr,my_ipv4_addr,mac_addr,SECOND_ATTEMPT_TIMEOUT,BROADCAST_REQUEST);
+   /*3. Si se ha resuelto, la MAC está en la cache*/
+   if(cache_resolve(stack, iface,mac_addr,ip_addr) != 0){
+     return -1;
    }
+   cache_show(stack);                 //Mostramos nuesra nueva cache con la entrada añadida
+   return 0;
+ }
 
-   return result;
+/* int arp_resolve_async(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, ipv4_addr_t my_ipv4_addr, mac_addr_t mac_addr,
+ *                       uint16_t type, unsigned char * packet, int packet_len);
+ *
+ * DESCRIPCIÓN:
+ *   Versión no bloqueante de 'arp_resolve()'. Si la MAC está en la caché se
+ *   devuelve inmediatamente. Si no, el paquete se copia en la cola del vecino,
+ *   se envía un ARP REQUEST (sólo si no había ya uno en curso) y se retorna
+ *   sin esperar. Los paquetes encolados se envían al recibir el ARP REPLY
+ *   desde 'arp_input()', o se descartan al agotarse los reintentos en
+ *   'arp_pending_timers()'.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si la MAC estaba en la caché (se copia en 'mac_addr').
+ *   '1' si el paquete se ha encolado a la espera de la resolución.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el paquete se ha descartado, porque la cola
+ *   del vecino o la tabla de resoluciones en curso estaban llenas, o porque
+ *   la IP no respondió hace poco y aún no se puede volver a preguntar.
+ */
+int arp_resolve_async(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, ipv4_addr_t my_ipv4_addr, mac_addr_t mac_addr,
+                      uint16_t type, unsigned char * packet, int packet_len){
+  struct arp_state * arp = stack->arp;
+  arp_pending_t * pending = arp_pending_find(arp, iface, ip_addr);
+  if(pending == NULL){
+    int cache = cache_resolve(stack, iface,mac_addr,ip_addr);
+    if(cache == 0){
+      return 0;
+    }
 
- }
+    /* Si no respondió hace poco, no volvemos a preguntar hasta que venza la espera */
+    arp_failed_t * failed = arp_failed_find(arp, iface, ip_addr);
+    if(failed != NULL && timerms_left(&failed->holddown) != 0){
+      if(packet != NULL){
+        arp->dropped_pkts++;
+      }
+      return -1;
+    }
 
- /* int arp_rslv(eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr,unsigned int timeout,unsigned int unicast);
-  *
-  * DESCRIPCIÓN:
-  *   Esta función resuelve la query de arp basada en la IP que se le entregue
-  *   nos devuelve la MAC asociada
-  *
-  * PARÁMETROS:
-  *   'iface': Puntero a la estructura del manejador del interfaz ethernet.
-  *	 'ip_addr': Direccion IP por la que se pregunta.
-  *	 'my_ipv4_addr: Nuetsra direccion IP'
-  *   'mac_addr': Direccion MAC que se encuentra.
-  *   'timeout' : Tiempo limite para recibir el paquete
-  *
-  * VALOR DEVUELTO:
-  *   La función devuelve '0' si todo ha ido bien.
-  *
-  * ERRORES:
-  *   La función devuelve '-1' si se ha producido algún error.
-  */
-
-  int arp_rslv(eth_iface_t * iface,ipv4_addr_t ip_addr,ipv4_addr_t my_ipv4_addr,mac_addr_t mac_addr,unsigned int timeout,unsigned int unicast){
-    
-    /*2. Declaramos y rellenamos el paquete ARP REQUEST*/
-    int err = 0;
-    //Declaramos el paquete
-  	arp_pkt req_packet; 	    //Nombre de la estructura del arp paket que vamos a usar para la request (req_packet)
-  	arp_pkt *reply_packet; 	  // Puntero al paquete de reply
-
-  	//Rellenamos el paquete de request
-  	req_packet.hw_type = htons(ETHER_ETH_TYPE);
-  	req_packet.proto_type = htons(IPv4_ETH_TYPE);
-  	req_packet.hw_size= MAC_ADDR_SIZE;
-  	req_packet.proto_size = IPv4_ADDR_SIZE;
-  	req_packet.op_code = htons(ARP_REQ_CODE);
-  	bzero(req_packet.dst_hw_addr,MAC_ADDR_SIZE); //La MAC de la IP por la que preguntamos ha de ir a 0 para que se rellene
-  	memcpy(req_packet.dst_proto_addr,ip_addr,IPv4_ADDR_SIZE); // Ip que quiero buscar la copiamos en el espacio asignado para IP dst
-  	mac_addr_t mac_addr_src; //Nuestra MAC
-  	eth_getaddr(iface,mac_addr_src); //Esta funcion nos copia en iface la interface asociada a la mac nuestra que usaremos
-  	memcpy(req_packet.src_hw_addr,mac_addr_src,MAC_ADDR_SIZE); // Nuestra MAC la copiamos en el apartado de MAC source del paquete ARP
-  	memcpy(req_packet.src_proto_addr,my_ipv4_addr,IPv4_ADDR_SIZE); // Nuestra Ip la copiamos en el espacio asignado para IP dst
-
-
-    /*3. Enviamos el paquete ARP REQUEST*/
-
-      //Enviamos el paquete con eth_send por broadcast/unicast
-      if(unicast){// el bit de unicast lo heredamos de arp_resolve
-        err = eth_send(iface,mac_addr,ARP_ETH_TYPE,(unsigned char *) &req_packet, ARP_MSG_SIZE);
+    /* Buscamos un hueco libre para la nueva resolución */
+    int i;
+    for(i=0; i<ARP_PENDING_LENGTH; i++){
+      if(arp->pending_table[i].iface == NULL){
+        pending = &arp->pending_table[i];
+        break;
       }
-      else{//si no es unicast es broadcast
-        err = eth_send(iface,MAC_BCAST_ADDR,ARP_ETH_TYPE,(unsigned char *) &req_packet, ARP_MSG_SIZE);
+    }
+    if(pending == NULL){
+      printf("arp_resolve_async: Demasiadas resoluciones ARP en curso\n");
+      arp->dropped_pkts++;
+      return -1;
+    }
+
+    pending->iface = iface;
+    memcpy(pending->ip_addr, ip_addr, IPv4_ADDR_SIZE);
+    memcpy(pending->my_ipv4_addr, my_ipv4_addr, IPv4_ADDR_SIZE);
+    pending->attempts = 1;
+    pending->pkts_num = 0;
+    timerms_reset(&pending->timer, FIRST_ATTEMPT_TIMEOUT);
+
+    /* Si la entrada estaba caducada se refresca por unicast, como en arp_resolve() */
+    if(cache == -1){
+      arp_send_request(iface, ip_addr, my_ipv4_addr, mac_addr);
+    }else{
+      arp_send_request(iface, ip_addr, my_ipv4_addr, MAC_BCAST_ADDR);
+    }
+  }
+
+  if(packet == NULL){
+    return 1;
+  }
+
+  if(pending->pkts_num == ARP_PENDING_QUEUE_LENGTH){
+    printf("arp_resolve_async: Cola del vecino llena, descartando paquete\n");
+    arp->dropped_pkts++;
+    return -1;
+  }
+
+  arp_queued_pkt_t * pkt = &pending->pkts[pending->pkts_num];
+  pkt->data = malloc(packet_len);
+  if(pkt->data == NULL){
+    arp->dropped_pkts++;
+    return -1;
+  }
+  memcpy(pkt->data, packet, packet_len);
+  pkt->len = packet_len;
+  pkt->type = type;
+  pending->pkts_num++;
+
+  return 1;
+}
+
+/* void arp_input(net_stack_t * stack, eth_iface_t * iface, mac_addr_t src, unsigned char * payload, int payload_len, ipv4_addr_t my_ipv4_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Procesa una trama ARP recibida (p.ej. desde el manejador del interfaz,
+ *   ver 'eth_set_handler()').
+ *   Responde a los ARP REQUEST que preguntan por nuestra IP y aprovecha cada
+ *   mensaje para aprender o refrescar la MAC de su emisor:
+ *    - Respuestas y peticiones dirigidas a nuestra IP.
+ *    - ARP gratuitos (IP origen == IP destino), que anuncian un cambio de MAC.
+ *    - Respuestas a una resolución en curso, enviando los paquetes encolados.
+ *
+ * PARÁMETROS:
+ *   'iface': Interfaz por el que se ha recibido la trama.
+ *   'src': MAC origen de la trama.
+ *   'payload': Mensaje ARP recibido.
+ *   'payload_len': Longitud del mensaje ARP.
+ *   'my_ipv4_addr': Nuestra dirección IP, o NULL para sólo aprender.
+ */
+void arp_input(net_stack_t * stack, eth_iface_t * iface, mac_addr_t src, unsigned char * payload, int payload_len, ipv4_addr_t my_ipv4_addr){
+  struct arp_state * arp = stack->arp;
+
+  if(payload_len < ARP_MSG_SIZE){
+    return;
+  }
+
+  arp_pkt * packet = (arp_pkt *) payload;
+  if(ntohs(packet->hw_type) != ETHER_ETH_TYPE || ntohs(packet->proto_type) != IPv4_ETH_TYPE){
+    return;
+  }
+
+  /* Las sondas ARP (IP origen 0.0.0.0) y nuestros propios anuncios no enseñan nada */
+  if(memcmp(packet->src_proto_addr, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE) == 0){
+    return;
+  }
+  if(my_ipv4_addr != NULL && memcmp(packet->src_proto_addr, my_ipv4_addr, IPv4_ADDR_SIZE) == 0){
+    return;
+  }
+
+  int is_for_me = (my_ipv4_addr != NULL) && (memcmp(packet->dst_proto_addr, my_ipv4_addr, IPv4_ADDR_SIZE) == 0);
+  int is_gratuitous = (memcmp(packet->src_proto_addr, packet->dst_proto_addr, IPv4_ADDR_SIZE) == 0);
+  int is_pending = (arp_pending_find(arp, iface, packet->src_proto_addr) != NULL);
+
+  if(is_for_me || is_gratuitous || is_pending){
+    arp_learn(stack, iface, packet->src_proto_addr, packet->src_hw_addr);
+  }
+
+  /* Si nos preguntan por nuestra IP, respondemos directamente al que pregunta */
+  if(is_for_me && ntohs(packet->op_code) == ARP_REQ_CODE){
+    mac_addr_t my_mac;
+    eth_getaddr(iface, my_mac);
+    arp_reply(iface, packet->src_hw_addr, packet->src_proto_addr, my_mac, my_ipv4_addr);
+  }
+}
+
+/* int arp_announce(eth_iface_t * iface, ipv4_addr_t my_ipv4_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Envía un ARP gratuito (un ARP REQUEST por broadcast en el que la IP
+ *   origen y destino son la nuestra) para que los vecinos aprendan o
+ *   actualicen nuestra MAC sin tener que preguntar por ella.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha enviado el anuncio.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar.
+ */
+int arp_announce(eth_iface_t * iface, ipv4_addr_t my_ipv4_addr){
+  return arp_send_request(iface, my_ipv4_addr, my_ipv4_addr, MAC_BCAST_ADDR);
+}
+
+/* void arp_learn(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, mac_addr_t mac_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Guarda (o refresca) la asociación IP -> MAC en la caché de 'iface' y
+ *   envía los paquetes que estaban encolados a la espera de resolver 'ip_addr'
+ *   por ese interfaz.
+ */
+void arp_learn(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t ip_addr, mac_addr_t mac_addr){
+  struct arp_state * arp = stack->arp;
+  cache_add(stack, iface, mac_addr, ip_addr);
+
+  /* Vuelve a estar alcanzable: se olvidan sus fallos anteriores */
+  arp_failed_t * failed = arp_failed_find(arp, iface, ip_addr);
+  if(failed != NULL){
+    bzero(failed, sizeof(arp_failed_t));
+  }
+
+  arp_pending_t * pending = arp_pending_find(arp, iface, ip_addr);
+  if(pending == NULL){
+    return;
+  }
+
+  int i;
+  for(i=0; i<pending->pkts_num; i++){
+    arp_queued_pkt_t * pkt = &pending->pkts[i];
+    if(eth_send(pending->iface, mac_addr, pkt->type, pkt->data, pkt->len) < 0){
+      arp->dropped_pkts++;
+    }
+  }
+  arp_pending_release(pending);
+}
+
+/* long int arp_pending_timeout(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el tiempo que falta para el siguiente reintento de alguna
+ *   resolución asíncrona en curso. Quien espere tramas debe llamar a
+ *   'arp_pending_timers()' cuando venza.
+ *
+ * VALOR DEVUELTO:
+ *   Milisegundos hasta el siguiente reintento, o '-1' si no hay ninguna
+ *   resolución en curso.
+ */
+long int arp_pending_timeout(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
+  long int timeout = -1;
+  int i;
+  for(i=0; i<ARP_PENDING_LENGTH; i++){
+    if(arp->pending_table[i].iface != NULL){
+      long int left = timerms_left(&arp->pending_table[i].timer);
+      if(timeout < 0 || left < timeout){
+        timeout = left;
       }
+    }
+  }
+  return timeout;
+}
 
-    	if(err < 0) {
-    		return -1;
-    		printf("eth_send: No se ha podido enviar el paquete\n");
-    	}
+/* void arp_pending_timers(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Procesa las resoluciones asíncronas cuyo temporizador ha vencido: vuelve
+ *   a enviar el ARP REQUEST por broadcast o, si ya se han hecho todos los
+ *   intentos, descarta los paquetes encolados y apunta la IP en la caché
+ *   negativa.
+ */
+void arp_pending_timers(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
+  int i;
+  for(i=0; i<ARP_PENDING_LENGTH; i++){
+    arp_pending_t * pending = &arp->pending_table[i];
+    if(pending->iface == NULL || timerms_left(&pending->timer) != 0){
+      continue;
+    }
 
-      timerms_reset(&timer, timeout);   //Ponemos el primer temporizador para que la escucha no sea eterna. Lo ponemos al valor de FIRST o SECOND timer
+    if(pending->attempts < ARP_PENDING_ATTEMPTS){
+      printf("eth_send: Reintentando ARP REQUEST\n");
+      pending->attempts++;
+      timerms_reset(&pending->timer, SECOND_ATTEMPT_TIMEOUT);
+      arp_send_request(pending->iface, pending->ip_addr, pending->my_ipv4_addr, MAC_BCAST_ADDR);
+    }else{
+      char ip_str[IPv4_STR_MAX_LENGTH];
+      ipv4_addr_str(pending->ip_addr, ip_str);
+      printf("arp_pending_timers: Imposible resolver la IP %s, descartando %d paquetes\n", ip_str, pending->pkts_num);
+      arp->dropped_pkts += pending->pkts_num;
+      arp_failed_add(arp, pending->iface, pending->ip_addr);
+      arp_pending_release(pending);
+    }
+  }
+}
 
-      do{ //Este do-while dejará de actuar cuando ip_addr sea == que la IP source del paquete reply
+/* int arp_pending_iface_count(struct arp_state * arp, eth_iface_t * iface);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de resoluciones asíncronas en curso por 'iface', o
+ *   por cualquier interfaz si es 'NULL'.
+ */
+static int arp_pending_iface_count(struct arp_state * arp, eth_iface_t * iface){
+  int count = 0;
+  int i;
+  for(i=0; i<ARP_PENDING_LENGTH; i++){
+    if(arp->pending_table[i].iface != NULL && (iface == NULL || arp->pending_table[i].iface == iface)){
+      count++;
+    }
+  }
+  return count;
+}
 
-        /*4. Ponemos el primer timer de escucha*/
-        long int timeleft = timerms_left(&timer);                                    //Calcula el tiempo restante del timer
-        recv_bytes = eth_recv(iface,src_mac,ARP_ETH_TYPE,inbuffer,ETH_MTU,timeleft); //Si el time left llega a '0' se cierra el socket de escucha
+/* int arp_pending_count(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de resoluciones asíncronas en curso.
+ */
+int arp_pending_count(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
+  return arp_pending_iface_count(arp, NULL);
+}
 
-        if(recv_bytes == 0){
-          printf("eth_send: timeout\n");
-          return -1;
-        }
-        /* 5. Si hemos recibido respuesta extraemos del reply packet la MAC deseada*/
-        if(recv_bytes>0){
-          reply_packet = NULL;
-          reply_packet = (struct arp_pkt_t *) inbuffer;  //casting del paquete a la estruc arp
-          memcpy(mac_addr, reply_packet->src_hw_addr,MAC_ADDR_SIZE); //nos guardamos la MAC
+/* int arp_pending_queued(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de paquetes encolados a la espera de que se resuelva
+ *   la MAC de su destino (las resoluciones sin paquetes no cuentan).
+ */
+int arp_pending_queued(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
+  int count = 0;
+  int i;
+  for(i=0; i<ARP_PENDING_LENGTH; i++){
+    if(arp->pending_table[i].iface != NULL){
+      count += arp->pending_table[i].pkts_num;
+    }
+  }
+  return count;
+}
 
-        }
+/* int arp_pending_wait(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t my_ipv4_addr, long int timeout);
+ *
+ * DESCRIPCIÓN:
+ *   Espera hasta 'timeout' ms a que se completen todas las resoluciones en
+ *   curso por 'iface', procesando las tramas ARP que lleguen y los
+ *   reintentos. Sirve para lanzar varias resoluciones seguidas con
+ *   'arp_resolve_async()' y esperarlas todas a la vez.
+ *
+ * VALOR DEVUELTO:
+ *   Número de resoluciones por 'iface' que siguen en curso al volver (siguen
+ *   reintentándose en 'arp_pending_timers()').
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la recepción en el interfaz.
+ */
+int arp_pending_wait(net_stack_t * stack, eth_iface_t * iface, ipv4_addr_t my_ipv4_addr, long int timeout){
+  struct arp_state * arp = stack->arp;
+  timerms_t deadline;
+  timerms_reset(&deadline, timeout);
+
+  while(arp_pending_iface_count(arp, iface) > 0){
+    long int timeleft = timerms_left(&deadline);
+    if(timeleft == 0){
+      break;
+    }
+    long int arp_timeleft = arp_pending_timeout(stack);
+    if(timeleft < 0 || arp_timeleft < timeleft){
+      timeleft = arp_timeleft;
+    }
 
-        //El siguiente while mira que la ip que nos manda el paquete sea la misma de la que pedimo la MAC y que sea un paquete reply
-      }while(!((memcmp(reply_packet->src_proto_addr, ip_addr, IPv4_ADDR_SIZE)==0) & (ntohs(reply_packet->op_code)== ARP_REP_CODE)));
+    int recv_bytes = eth_recv(iface,arp->src_mac,ARP_ETH_TYPE,arp->inbuffer,ETH_MTU,timeleft);
+    if(recv_bytes < 0){
+      return -1;
+    }
+    if(recv_bytes == 0){
+      arp_pending_timers(stack);
+    }else{
+      arp_input(stack, iface,arp->src_mac,arp->inbuffer,recv_bytes,my_ipv4_addr);
+    }
+  }
+  return arp_pending_iface_count(arp, iface);
+}
 
-      /*6. Guardamos datos y enseñamos*/
-      cache_add(mac_addr,ip_addr);  //Guardamos la entrada en la caché
-      cache_show();                 //Mostramos nuesra nueva cache con la entrada añadida
-  	return 0; //OK return '0'
+/* unsigned int arp_dropped(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el número de paquetes descartados hasta ahora porque no se pudo
+ *   resolver la MAC de su destino.
+ */
+unsigned int arp_dropped(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
+  return arp->dropped_pkts;
+}
+
+/* int arp_init(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Reserva el estado ARP de la pila, con la caché vacía.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha reservado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no hay memoria.
+ */
+int arp_init(net_stack_t * stack){
+  stack->arp = calloc(1, sizeof(struct arp_state));
+  if(stack->arp == NULL){
+    fprintf(stderr, "ARP.C --> arp_init(): ERROR en calloc()\n");
+    return -1;
   }
+  return 0;
+}
+
+/* void arp_close(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Descarta los paquetes que esperaban una resolución y libera el estado
+ *   ARP de la pila.
+ */
+void arp_close(net_stack_t * stack){
+  if(stack->arp == NULL){
+    return;
+  }
+  cache_init(stack);
+  free(stack->arp);
+  stack->arp = NULL;
+}
 
-/* void cache_init();
+/* void cache_init(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
- *   Esta función pone a cero el array de la cache
+ *   Esta función pone a cero el array de la cache, junto a las resoluciones
+ *   en curso (descartando sus paquetes) y la caché negativa, p.ej. porque se
+ *   han cerrado los interfaces.
  */
-void cache_init(){
-  if(!cache_initialized){                                   //Si la cache no esta iniciada
-    bzero(cache_table, sizeof(arp_entry_t)*CACHE_LENGTH);   //Rellena de zeros todas las estructuras contenidas en la cache
-    cache_initialized = 1;                                  // Marcamos la caché como inicializada
+void cache_init(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
+  int i;
+  for(i=0; i<ARP_PENDING_LENGTH; i++){
+    arp_pending_release(&arp->pending_table[i]);
   }
+  bzero(arp->cache_table, sizeof(arp_entry_t)*CACHE_LENGTH);   //Rellena de zeros todas las estructuras contenidas en la cache
+  bzero(arp->failed_table, sizeof(arp_failed_t)*ARP_FAILED_LENGTH);
 }
 
-/* int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+/* int cache_resolve(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *
  * DESCRIPCIÓN:
  *   Resuelve una dirección MAC dando una dirección IP dentro de la caché ARP
  *   Esta funcion hace de arp_resolve pero dentro de la propia caché
  *
  * PARÁMETROS:
+ *   'iface': Interfaz por el que se llega a 'ip_addr'.
  *   'ip_addr': Direccion IP por la que se pregunta.
  *   'mac_addr': Direccion MAC que se quiere.
  *
@@ -227,20 +718,21 @@ void cache_init(){
  *   Si la encuenta y es antigua, devuelve -1 y borra la direccion
  *   Si no la encuentra, devuelve -2
  */
-int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr){
+int cache_resolve(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr){
+  struct arp_state * arp = stack->arp;
   unsigned int index = 0;
   for(index = 0; index<CACHE_LENGTH; index++){                             //Recorre los indices de la cache
-    if(memcmp(cache_table[index].ip_addr, ip_addr, IPv4_ADDR_SIZE)==0){   //compara la IP guardada con la deseada
+    if(arp->cache_table[index].iface == iface && memcmp(arp->cache_table[index].ip_addr, ip_addr, IPv4_ADDR_SIZE)==0){   //compara la IP guardada con la deseada
       time_t nowtime = time(NULL);                                        //Guarda en nowtime el TIMESTAMP actual
 
       //Aqui comparamos el timestamp de cuando la guardamos con el timestamp actual
-      if(difftime(nowtime, cache_table[index].last_time) > CACHE_TTL){    //Si ha pasado mas tiempo del TTL
-          memcpy(mac_addr, cache_table[index].mac_addr,MAC_ADDR_SIZE);
-          bzero(&cache_table[index], sizeof(arp_entry_t));                //Borramos ese espacio de la cache y lo ponemos el struct cero
+      if(difftime(nowtime, arp->cache_table[index].last_time) > CACHE_TTL){    //Si ha pasado mas tiempo del TTL
+          memcpy(mac_addr, arp->cache_table[index].mac_addr,MAC_ADDR_SIZE);
+          bzero(&arp->cache_table[index], sizeof(arp_entry_t));                //Borramos ese espacio de la cache y lo ponemos el struct cero
           return -1;                                                      //Devuleve -1 para proceder a hacer arp_resolve
       }
       else{                                                               //Si el TTL no ha caducado
-        memcpy(mac_addr, cache_table[index].mac_addr,MAC_ADDR_SIZE);      //Copia la MAC
+        memcpy(mac_addr, arp->cache_table[index].mac_addr,MAC_ADDR_SIZE);      //Copia la MAC
         return 0;
       }
     }
@@ -248,12 +740,14 @@ int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr){
   return -2; //Devuelve -2 procede a arp_resolve
 }
 
-/* int cache_add(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+/* int cache_add(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *
  * DESCRIPCIÓN:
- *   Esta funcion añade una mac a un espacio vacío del array. 
+ *   Esta funcion añade una mac a un espacio vacío del array. Si la IP ya
+ *   estaba en la cache, actualiza su MAC y su timestamp.
  *
  * PARÁMETROS:
+ *   'iface': Interfaz por el que se llega a 'ip_addr'.
  *   'ip_addr': Direccion IP que se quiere guardar.
  *   'mac_addr': Direccion MAC que se quiere guaradar.
  *
@@ -261,26 +755,37 @@ int cache_resolve(mac_addr_t mac_addr,ipv4_addr_t ip_addr){
  *   La función devuelve '0' si todo ha ido bien.
  *
  */
-int cache_add(mac_addr_t mac_addr, ipv4_addr_t ip_addr){
+int cache_add(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr, ipv4_addr_t ip_addr){
+  struct arp_state * arp = stack->arp;
   int err = 0;
-  err = cache_add_empty(mac_addr, ip_addr);                               //Intentamos guaradar la entrada en cache
+  unsigned int index = 0;
+  for(index = 0; index<CACHE_LENGTH; index++){                             //Si ya estaba, se actualiza
+    if(arp->cache_table[index].last_time!=0 && arp->cache_table[index].iface == iface && memcmp(arp->cache_table[index].ip_addr, ip_addr, IPv4_ADDR_SIZE)==0){
+      memcpy(arp->cache_table[index].mac_addr, mac_addr, MAC_ADDR_SIZE);
+      arp->cache_table[index].last_time = time(NULL);
+      return 0;
+    }
+  }
+  err = cache_add_empty(stack, iface, mac_addr, ip_addr);                               //Intentamos guaradar la entrada en cache
   if(err < 0){                                                            //Si devuleve <0 es que no habia sitio en la cache.
-    int older_index = cache_get_older();                                  //Busca el TIME STAMP mas antiguo
-    memcpy(cache_table[older_index].ip_addr, ip_addr, IPv4_ADDR_SIZE);    //Copiamos la IP
-    memcpy(cache_table[older_index].mac_addr, mac_addr, MAC_ADDR_SIZE);   //Copiamos la MAC
+    int older_index = cache_get_older(stack);                                  //Busca el TIME STAMP mas antiguo
+    arp->cache_table[older_index].iface = iface;
+    memcpy(arp->cache_table[older_index].ip_addr, ip_addr, IPv4_ADDR_SIZE);    //Copiamos la IP
+    memcpy(arp->cache_table[older_index].mac_addr, mac_addr, MAC_ADDR_SIZE);   //Copiamos la MAC
     time_t nowtime = time(NULL);                                          //Cogemos la time STAMP actual
-    memcpy(&cache_table[older_index].last_time, &nowtime, sizeof(time_t));//Copiamos la time STAMP actual en la entrada
+    memcpy(&arp->cache_table[older_index].last_time, &nowtime, sizeof(time_t));//Copiamos la time STAMP actual en la entrada
   }
   return 0;
 }
 
-/* int cache_add_empty(mac_addr_t mac_addr,ipv4_addr_t ip_addr);
+/* int cache_add_empty(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr,ipv4_addr_t ip_addr);
  *
  * DESCRIPCIÓN:
  *   Si encuentra un slot vacío en la caché (viendo que el timestamp sea 0), 
  *   inserta la entrada arp_cache en ella. Sino devuelve fallo -1
  *
  * PARÁMETROS:
+ *   'iface': Interfaz por el que se llega a 'ip_addr'.
  *   'ip_addr': Direccion IP que se quiere insertar.
  *   'mac_addr': Direccion MAC que se quiere insertar.
  *
@@ -290,21 +795,23 @@ int cache_add(mac_addr_t mac_addr, ipv4_addr_t ip_addr){
  * ERRORES:
  *   Si ha habido fallos, devuelve -1, por ejemplo falta de estacio
  */
-int cache_add_empty(mac_addr_t mac_addr, ipv4_addr_t ip_addr){
+int cache_add_empty(net_stack_t * stack, eth_iface_t * iface, mac_addr_t mac_addr, ipv4_addr_t ip_addr){
+  struct arp_state * arp = stack->arp;
   unsigned int index = 0;
   for(index =0; index<CACHE_LENGTH; index++){                                 //Recorre la cache
-    if(cache_table[index].last_time==0){                                  // Si la estructura está desocupada
-          memcpy(cache_table[index].ip_addr, ip_addr, IPv4_ADDR_SIZE);        //Copiamos la IP
-          memcpy(cache_table[index].mac_addr, mac_addr, MAC_ADDR_SIZE);       //Copiamos la MAC
+    if(arp->cache_table[index].last_time==0){                                  // Si la estructura está desocupada
+          arp->cache_table[index].iface = iface;
+          memcpy(arp->cache_table[index].ip_addr, ip_addr, IPv4_ADDR_SIZE);        //Copiamos la IP
+          memcpy(arp->cache_table[index].mac_addr, mac_addr, MAC_ADDR_SIZE);       //Copiamos la MAC
           time_t nowtime = time(NULL);                                        //Cogemos la time actual
-          memcpy(&cache_table[index].last_time, &nowtime, sizeof(time_t));    //Copiamos la time actual en la entrada
+          memcpy(&arp->cache_table[index].last_time, &nowtime, sizeof(time_t));    //Copiamos la time actual en la entrada
           return 0;
     }
   }
   return -1;
 }
 
-/* int cache_get_older();
+/* int cache_get_older(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
  *   Recorre los indices de la caché para ver cual es el mas antiguo.
@@ -312,14 +819,15 @@ int cache_add_empty(mac_addr_t mac_addr, ipv4_addr_t ip_addr){
  * VALOR DEVUELTO:
  *   Devuelve el indice de la entrada mas antigua
  */
-int cache_get_older(){
+int cache_get_older(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
   int older_index = 0;
   double older_lapse = 0;
 
   unsigned int index = 0;
   for(index =0; index<CACHE_LENGTH; index++){                                 //Recorre la cache
     time_t nowtime = time(NULL);                                              //Set time stamp actual
-    double time_difference = difftime(nowtime, cache_table[index].last_time); //Resta LA timestamp de NOW menos la de la entrada de la cahe
+    double time_difference = difftime(nowtime, arp->cache_table[index].last_time); //Resta LA timestamp de NOW menos la de la entrada de la cahe
     if(time_difference > older_lapse){                                        //Compara las horas y elige la mas antigua
       older_lapse = time_difference;
       older_index = index;
@@ -328,7 +836,7 @@ int cache_get_older(){
   return older_index; //Devuelve el indice de la entrada mas antigua
 }
 
-/* int cache_show();
+/* int cache_show(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
  *   Muestra los valores que hay en la cache ahora mismo
@@ -336,20 +844,19 @@ int cache_get_older(){
  * VALOR DEVUELTO:
  *  Si todo es correcto, devuelve 0.
  */
-int cache_show(){
+int cache_show(net_stack_t * stack){
+  struct arp_state * arp = stack->arp;
   unsigned int index = 0;
   printf("\nCache ARP Actual:\n");
-  printf("INDEX\tIP ADDRESS\tMAC ADDRESS\t\tLAST TIME CACHED\n");
+  printf("INDEX\tIFACE\tIP ADDRESS\tMAC ADDRESS\t\tLAST TIME CACHED\n");
   for(index =0; index<CACHE_LENGTH; index++){                                         //Recorre la cache
-    printf("%d/%d\t",index,CACHE_LENGTH);
-    if(cache_table[index].last_time==0){ //si la entrada tiene un timestamp a 0 significa que está vacia
-          printf(" EMPTY\t\tEMPTY\t\t\tEMPTY\n");
-    }else{
+    if(arp->cache_table[index].last_time!=0){ //si la entrada tiene un timestamp a 0 significa que está vacia, no se muestra
+        printf("%d/%d\t%s\t",index,CACHE_LENGTH,eth_getname(arp->cache_table[index].iface));
         char mac_str[MAC_STR_LENGTH];
-        mac_addr_str(cache_table[index].mac_addr, mac_str);
+        mac_addr_str(arp->cache_table[index].mac_addr, mac_str);
         char ip_str[IPv4_STR_MAX_LENGTH];
-        ipv4_addr_str(cache_table[index].ip_addr,ip_str);
-        printf("%s\t%s\t%f\n",ip_str,mac_str, (double) difftime(time(NULL), cache_table[index].last_time));
+        ipv4_addr_str(arp->cache_table[index].ip_addr,ip_str);
+        printf("%s\t%s\t%f\n",ip_str,mac_str, (double) difftime(time(NULL), arp->cache_table[index].last_time));
     }
   }
   return 0;
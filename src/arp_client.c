@@ -32,14 +32,19 @@ int main(int argc,char *argv[]){
 		printf("El argumento %s no es una IP válida\n",argv[1]);
 		return -1;
 	}
-	// Abre la interfaz
+	// Crea la pila (con su caché ARP) y abre la interfaz
+	net_stack_t * stack = net_stack_create();
+	if(stack == NULL){
+		return -1;
+	}
 	iface = eth_open(argv[1]);
 
 	//Hace ARP_resolve
-	int result = arp_resolve(iface,ip_addr,my_ip_addr,mac_addr);
+	int result = arp_resolve(stack,iface,ip_addr,my_ip_addr,mac_addr);
 
 	//Si no recibimos cerramos la interfaz eth
 	if(result != 0){
+		net_stack_destroy(stack);
 		eth_close(iface);
 		return -1;
 	}
@@ -48,6 +53,7 @@ int main(int argc,char *argv[]){
 		mac_addr_str ( mac_addr , mac_string );
 		printf("%s -> %s\n",ip_string, mac_string);
 	}
+	net_stack_destroy(stack);
 	eth_close(iface);//CErramos eth.
 	return 0;
 }
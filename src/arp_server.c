@@ -2,34 +2,61 @@
 #include <timerms.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
 #include <arpa/inet.h>	// Time htons etc etc
 #include "eth.h"
 #include "ipv4.h"
 #include "arp.h"
 
 /* Logitud máxmima del nombre de un interfaz de red */
-#define IFACE_NAME_MAX_LENGTH 32
-#define ARP_TABLE_SIZE 256 /* Número de entradas máximo de la tabla de rutas IPv4 */
+#define IFACE_NAME_MAX_LENGTH 128
+/* Numero de bits del hash de la tabla: 2^12 = 4096 cubetas */
+#define ARP_TABLE_BITS 12
+#define ARP_TABLE_BUCKETS (1 << ARP_TABLE_BITS)
+/* Numero máximo de peticiones que se leen (y respuestas que se envían) por ronda */
+#define ARP_SERVER_BATCH 64
+/* Valor de <mac> en el fichero para responder con nuestra propia MAC (proxy ARP) */
+#define ARP_PROXY_STR "proxy"
 
 ipv4_addr_t ip_addr;
 eth_iface_t *iface;
 
-typedef struct arp_table {
-  arp_entry_t * entries[ARP_TABLE_SIZE];
-} arp_table_t;
-
+/* Entrada de la tabla: 'ip_addr' está en 'mac_addr', o en nuestra MAC si es proxy */
 typedef struct arp_entry{
 	mac_addr_t mac_addr;
 	ipv4_addr_t ip_addr;
+	int proxy;
+	struct arp_entry * next;  // Siguiente entrada de la misma cubeta
 }arp_entry_t;
 
+/* Tabla hash (con listas por cubeta) de las IPs por las que respondemos */
+typedef struct arp_table {
+  arp_entry_t * buckets[ARP_TABLE_BUCKETS];
+  int entries_num;
+} arp_table_t;
 
-arp_entry_t * arp_create( ipv4_addr_t ip_addr, mac_addr_t mac_addr){
+volatile sig_atomic_t running = 1;
+
+/* Hash multiplicativo de Knuth sobre los 32 bits de la IP */
+static unsigned int arp_hash( ipv4_addr_t ip_addr ){
+  uint32_t key;
+  memcpy(&key, ip_addr, IPv4_ADDR_SIZE);
+  return (uint32_t) (key * 2654435761u) >> (32 - ARP_TABLE_BITS);
+}
+
+arp_entry_t * arp_create( ipv4_addr_t ip_addr, mac_addr_t mac_addr, int proxy ){
   arp_entry_t * entry = (arp_entry_t *) malloc(sizeof(struct arp_entry));
-  if ((ip_addr != NULL) && (mac_addr != NULL) ) {
+  if (entry != NULL) {
     memcpy(entry->ip_addr, ip_addr, IPv4_ADDR_SIZE);
-    memcpy(entry->mac_addr, mac_addr, MAC_ADDR_SIZE);
+    if (mac_addr != NULL) {
+      memcpy(entry->mac_addr, mac_addr, MAC_ADDR_SIZE);
+    } else {
+      memset(entry->mac_addr, 0, MAC_ADDR_SIZE);
+    }
+    entry->proxy = proxy;
+    entry->next = NULL;
   }
   return entry;
 }
@@ -38,9 +65,13 @@ void arp_print ( arp_entry_t * entry ){
   if (entry != NULL) {
     char ip_str[IPv4_STR_MAX_LENGTH];
     ipv4_addr_str(entry->ip_addr,ip_str);
-    char mac_str[MAC_STR_MAX_LENGTH];
-    mac_addr_str(entry->mac_addr,mac_str);
-    printf("%s\t%s\n",ip_str,mac_str);
+    if (entry->proxy) {
+      printf("%s\t%s\n",ip_str,ARP_PROXY_STR);
+    } else {
+      char mac_str[MAC_STR_LENGTH];
+      mac_addr_str(entry->mac_addr,mac_str);
+      printf("%s\t%s\n",ip_str,mac_str);
+    }
   }
 }
 
@@ -56,15 +87,15 @@ arp_entry_t* arp_read ( char* filename, int linenum, char * line )
   char ip_addr_str[256];
   char mac_addr_str[256];
 
-  /* Parse line: Format "<ip> <mask> <next_hop> <metric>\n" */
-  int params = sscanf(line, "%s %s\n",ip_addr_str, mac_addr_str);
+  /* Parse line: Format "<ip> <mac|proxy>\n" */
+  int params = sscanf(line, "%255s %255s\n",ip_addr_str, mac_addr_str);
   if (params != 2) {
     fprintf(stderr, "%s:%d: Invalid ARP Entry format: '%s' (%d params)\n",filename, linenum, line, params);
-    fprintf(stderr,"%s:%d:Format <ip> <mac>\n",filename, linenum);
+    fprintf(stderr,"%s:%d:Format <ip> <mac|%s>\n",filename, linenum, ARP_PROXY_STR);
     return NULL;
   }
 
-  /* Parse IPv4 route subnet address */
+  /* Parse IPv4 address */
   ipv4_addr_t ip_addr;
   int err = ipv4_str_addr(ip_addr_str, ip_addr);
   if (err == -1) {
@@ -72,105 +103,105 @@ arp_entry_t* arp_read ( char* filename, int linenum, char * line )
     return NULL;
   }
 
-  /* Parse MAC addr */
-  mac_addr_t mac_addr;
-  err = mac_str_addr(mac_addr_str, mac_addr);
-  if (err == -1) {
-    fprintf(stderr, "%s:%d: Invalid <mac> value: '%s'\n",
-	    filename, linenum, mask_str);
-    return NULL;
+  /* Parse MAC addr, or "proxy" to answer with our own MAC */
+  if (strcmp(mac_addr_str, ARP_PROXY_STR) == 0) {
+    entry = arp_create(ip_addr, NULL, 1);
+  } else {
+    mac_addr_t mac_addr;
+    err = mac_str_addr(mac_addr_str, mac_addr);
+    if (err == -1) {
+      fprintf(stderr, "%s:%d: Invalid <mac> value: '%s'\n",filename, linenum, mac_addr_str);
+      return NULL;
+    }
+    entry = arp_create(ip_addr, mac_addr, 0);
   }
 
-  /* Create new route with parsed parameters */
-  entry = arp_create( ip_addr, mac_addr);
-
-  if (route == NULL) {
-    fprintf(stderr, "%s:%d: Error creating the new route\n",filename, linenum);
+  if (entry == NULL) {
+    fprintf(stderr, "%s:%d: Error creating the new ARP entry\n",filename, linenum);
   }
-  return route;
+  return entry;
 }
 
 arp_table_t * arp_table_create(){
   arp_table_t * table = (arp_table_t *) malloc(sizeof(struct arp_table));
   if (table != NULL) {
     int i;
-    for (i=0; i<arp_TABLE_SIZE; i++) {
-      table->entries[i] = NULL;
+    for (i=0; i<ARP_TABLE_BUCKETS; i++) {
+      table->buckets[i] = NULL;
     }
+    table->entries_num = 0;
   }
   return table;
 }
 
-int arp_table_add ( arp_table_t * table, arp_entry_t * entry )
+arp_entry_t * arp_table_find( arp_table_t * table, ipv4_addr_t ip_addr)
 {
-  int route_index = -1;
+  if (table == NULL) {
+    return NULL;
+  }
 
-  if (table != NULL) {
-    /* Find an empty place in the route table */
-    int i;
-    for (i=0; i<ARP_TABLE_SIZE; i++) {
-      if (table->entries[i] == NULL) {
-        table->entries[i] = entry;
-        route_index = i;
-        break;
-      }
+  arp_entry_t * entry = table->buckets[arp_hash(ip_addr)];
+  while (entry != NULL) {
+    if (memcmp(entry->ip_addr, ip_addr, IPv4_ADDR_SIZE) == 0) {
+      return entry;
     }
+    entry = entry->next;
   }
-
-  return route_index;
+  return NULL;
 }
 
-arp_entry_t * arp_table_remove ( arp_table_t * table, int index )
+/* Añade la entrada a la tabla. Si la IP ya estaba, la nueva entrada la sustituye.
+   Devuelve '0' si se ha añadido o '-1' si la tabla o la entrada son NULL */
+int arp_table_add ( arp_table_t * table, arp_entry_t * entry )
 {
-  arp_entry_t * removed_route = NULL;
-  if ((table != NULL) && (index >= 0) && (index < ARP_TABLE_SIZE)) {
-    removed_entry = table->entries[index];
-    table->entries[index] = NULL;
+  if ((table == NULL) || (entry == NULL)) {
+    return -1;
   }
-  return removed_route;
-}
 
-arp_entry_t * arp_table_get ( arp_table_t * table, int index )
-{
-  arp_entry_t * route = NULL;
-  if ((table != NULL) && (index >= 0) && (index < ARP_TABLE_SIZE)) {
-    route = table->routes[index];
+  arp_entry_t ** link = &table->buckets[arp_hash(entry->ip_addr)];
+  while (*link != NULL) {
+    if (memcmp((*link)->ip_addr, entry->ip_addr, IPv4_ADDR_SIZE) == 0) {
+      arp_entry_t * old = *link;
+      entry->next = old->next;
+      *link = entry;
+      arp_free(old);
+      return 0;
+    }
+    link = &(*link)->next;
   }
-  return route;
+
+  entry->next = NULL;
+  *link = entry;
+  table->entries_num++;
+  return 0;
 }
 
-int arp_table_find( arp_table_t * table, ipv4_addr_t ip_addr)
+void arp_table_print ( arp_table_t * table )
 {
-  int route_index = -2;
-
   if (table != NULL) {
-    route_index = -1;
     int i;
-    for (i=0; i<ARP_TABLE_SIZE; i++) {
-      arp_entry_t * route_i = table->entries[i];
-      if (route_i != NULL) {
-        int same_addr = (memcmp(route_i->ip_addr, ip_addr, IPv4_ADDR_SIZE) == 0);
-        if (same_addr && same_mask) {
-          route_index = i;
-          break;
-        }
+    for (i=0; i<ARP_TABLE_BUCKETS; i++) {
+      arp_entry_t * entry = table->buckets[i];
+      while (entry != NULL) {
+        arp_print(entry);
+        entry = entry->next;
       }
     }
   }
-
-  return route_index;
 }
 
 void arp_table_free ( arp_table_t * table )
 {
   if (table != NULL) {
     int i;
-    for (i=0; i<ARP_TABLE_SIZE; i++) {
-      arp_entry_t * route_i = table->entries[i];
-      if (route_i != NULL) {
-        table->entries[i] = NULL;
-        arp_free(route_i);
+    for (i=0; i<ARP_TABLE_BUCKETS; i++) {
+      arp_entry_t * entry = table->buckets[i];
+      while (entry != NULL) {
+        arp_entry_t * next = entry->next;
+        arp_free(entry);
+        entry = next;
       }
+      table->buckets[i] = NULL;
     }
     free(table);
   }
@@ -178,11 +209,11 @@ void arp_table_free ( arp_table_t * table )
 
 int arp_table_read ( char * filename, arp_table_t * table )
 {
-  int read_routes = 0;
+  int read_entries = 0;
 
-  FILE * routes_file = fopen(filename, "r");
-  if (routes_file == NULL) {
-    fprintf(stderr, "Error opening input IPv4 Routes file \"%s\": %s.\n",filename, strerror(errno));
+  FILE * arp_file = fopen(filename, "r");
+  if (arp_file == NULL) {
+    fprintf(stderr, "Error opening input ARP file \"%s\": %s.\n",filename, strerror(errno));
     return -1;
   }
 
@@ -190,12 +221,12 @@ int arp_table_read ( char * filename, arp_table_t * table )
   char line_buf[1024];
   int err = 0;
 
-  while ((! feof(routes_file)) && (err==0)) {
+  while ((! feof(arp_file)) && (err==0)) {
 
     linenum++;
 
     /* Read next line of file */
-    char* line = fgets(line_buf, 1024, routes_file);
+    char* line = fgets(line_buf, 1024, arp_file);
     if (line == NULL) {
       break;
     }
@@ -206,60 +237,146 @@ int arp_table_read ( char * filename, arp_table_t * table )
       continue;
     }
 
-    /* Parse route from line */
-    arp_entry_t* new_route = arp_read(filename, linenum, line);
-    if (new_route == NULL) {
+    /* Parse entry from line */
+    arp_entry_t* new_entry = arp_read(filename, linenum, line);
+    if (new_entry == NULL) {
       err = -1;
       break;
     }
 
-    /* Add new route to Route Table */
-    if (table != NULL) {
-      err = arp_table_add(table, new_route);
-      if (err >= 0) {
-	       err = 0;
-	     read_routes++;
-      }
+    /* Add new entry to ARP Table */
+    err = arp_table_add(table, new_entry);
+    if (err >= 0) {
+      err = 0;
+      read_entries++;
     }
   } /* while() */
 
   if (err == -1) {
-    read_routes = -1;
+    read_entries = -1;
   }
 
-  /* Close IP Route Table file */
-  fclose(routes_file);
+  /* Close ARP Table file */
+  fclose(arp_file);
 
-  return read_routes;
+  return read_entries;
 }
 
-char mac_string[MAC_STR_LENGTH];
-char ip_string[IPv4_STR_MAX_LENGTH];
+static void arp_server_stop(int signum){
+  running = 0;
+}
 
 int main(int argc,char *argv[]){
 
-  arp_table_t arp_table = arp_table_create();
-
 	// Si no hay suficientes argumentos
-	if(argc != 4){
-		printf("Escriba %s [IF] [IP] [RIP_FILE]\n", argv[0]);
+	if(argc != 3 && argc != 4){
+		printf("Escriba %s [IF] [IP] [ARP_FILE]\n", argv[0]);
+		printf("  ARP_FILE: lineas '<ip> <mac>' (entrada estática) o '<ip> %s' (proxy ARP)\n", ARP_PROXY_STR);
 		return -1;
 	}
 	// Si la IP está mal
-  iface = eth_open(argv[1]);
 	if(ipv4_str_addr ( argv[2], ip_addr )){
-		printf("El argumento %s no es una IP válida\n",argv[1]);
+		printf("El argumento %s no es una IP válida\n",argv[2]);
 		return -1;
 	}
-  int len = arp_table_read(argv[3],arp_table);
-  if(len=0){
-    printf("No hay rutas en este fichero");
+
+  arp_table_t * arp_table = arp_table_create();
+  if(arp_table == NULL){
+    printf("No se ha podido crear la tabla ARP\n");
+    return -1;
+  }
+  if(argc == 4){
+    int len = arp_table_read(argv[3],arp_table);
+    if(len < 0){
+      arp_table_free(arp_table);
+      return -1;
+    }
+    printf("%d entradas ARP leidas de %s\n", len, argv[3]);
+    arp_table_print(arp_table);
+  }
+
+  iface = eth_open(argv[1]);
+  if(iface == NULL){
+    arp_table_free(arp_table);
     return -1;
   }
+  mac_addr_t my_mac;
+  eth_getaddr(iface, my_mac);
+
+  /* Ctrl+C interrumpe la espera (sin SA_RESTART) para cerrar limpiamente */
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = arp_server_stop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  unsigned char buffers[ARP_SERVER_BATCH][ETH_MTU];
+  eth_batch_frame_t requests_batch[ARP_SERVER_BATCH];
+  arp_pkt replies[ARP_SERVER_BATCH];
+  eth_batch_frame_t replies_batch[ARP_SERVER_BATCH];
+  unsigned long requests = 0;
+  unsigned long answered = 0;
+
+  while(running){
+    /* 1. Esperamos la primera petición y recogemos de golpe las que ya estén en el socket */
+    int i;
+    for(i=0; i<ARP_SERVER_BATCH; i++){
+      requests_batch[i].payload = buffers[i];
+      requests_batch[i].payload_len = ETH_MTU;
+    }
+    int received = eth_recv_batch(iface, ARP_ETH_TYPE, requests_batch, ARP_SERVER_BATCH, -1);
+    if(received <= 0){
+      continue;
+    }
 
-  while(1){
-    
+    int replies_num = 0;
+    for(i=0; i<received; i++){
+      if(requests_batch[i].payload_len < ARP_MSG_SIZE){
+        continue;
+      }
+      arp_pkt * packet = (arp_pkt *) buffers[i];
+      if(ntohs(packet->op_code) != ARP_REQ_CODE || packet->hw_size != MAC_ADDR_SIZE
+          || packet->proto_size != IPv4_ADDR_SIZE
+          || ntohs(packet->hw_type) != ARP_HW_TYPE_ETHERNET
+          || ntohs(packet->proto_type) != ARP_PROTO_TYPE_IPv4){
+        continue;
+      }
+      requests++;
+
+      /* 2. Buscamos la IP preguntada: la nuestra o una de la tabla (O(1)) */
+      unsigned char * reply_mac = my_mac;
+      if(memcmp(packet->dst_proto_addr, ip_addr, IPv4_ADDR_SIZE) != 0){
+        /* Los ARP gratuitos de otros equipos no se contestan */
+        if(memcmp(packet->dst_proto_addr, packet->src_proto_addr, IPv4_ADDR_SIZE) == 0){
+          continue;
+        }
+        arp_entry_t * entry = arp_table_find(arp_table, packet->dst_proto_addr);
+        if(entry == NULL){
+          continue;
+        }
+        if(!entry->proxy){
+          reply_mac = entry->mac_addr;
+        }
+      }
+      arp_reply_build(&replies[replies_num], packet->src_hw_addr, packet->src_proto_addr,
+                      reply_mac, packet->dst_proto_addr);
+      memcpy(replies_batch[replies_num].addr, packet->src_hw_addr, MAC_ADDR_SIZE);
+      replies_batch[replies_num].payload = (unsigned char *) &replies[replies_num];
+      replies_batch[replies_num].payload_len = ARP_MSG_SIZE;
+      replies_num++;
+    }
+
+    /* 3. Enviamos todas las respuestas de la ronda con una sola llamada al sistema */
+    if(replies_num > 0){
+      int sent = eth_send_batch(iface, ARP_ETH_TYPE, replies_batch, replies_num);
+      if(sent > 0){
+        answered += sent;
+      }
+    }
   }
+
+  printf("\n%lu ARP REQUEST recibidos, %lu ARP REPLY enviados\n", requests, answered);
 	eth_close(iface);//CErramos eth.
+  arp_table_free(arp_table);
 	return 0;
 }
@@ -1,11 +1,15 @@
 #include "eth.h"
+#include "eth_capture.h"
 #include <rawnet.h>
 #include <timerms.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <netinet/in.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
 
 /* Dirección MAC de difusión: FF:FF:FF:FF:FF:FF */
 mac_addr_t MAC_BCAST_ADDR = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
@@ -17,6 +21,27 @@ struct eth_iface {
                              lugar de consultar al interfaz "en crudo" para
                              evitar una llamada al sistema adcional cada vez
                              que se quiera enviar una trama. */
+  struct eth_handler {
+    uint16_t type;
+    eth_handler_t handler;
+    void * arg;
+  } handlers[ETH_HANDLERS_MAX]; /* Manejadores de otros protocolos, para no
+                                   descartar sus tramas mientras se espera
+                                   una trama de otro tipo. */
+  int handlers_num;
+  struct eth_queue * queues[ETH_QUEUES_MAX]; /* Colas de los protocolos que
+                                                reciben con 'eth_recv()' */
+  int queues_num;
+  uint8_t filter_proto;  /* Protocolo y puerto IPv4 que deja pasar el filtro */
+  uint16_t filter_port;  /* del kernel, o 0 para todos los paquetes IPv4 */
+  struct timespec rx_stamp; /* Llegada de la última trama entregada (la que
+                               se está procesando en un manejador), o cero */
+  eth_capture_t * capture;  /* Captura de las tramas ('eth_set_capture()'), */
+  int capture_id;           /* o NULL, e identificador del interfaz en ella */
+  int zerocopy;             /* Las tramas se reciben en su sitio (anillo o
+                               backend, ver 'rawiface_is_zerocopy()') */
+  unsigned char * rx_frames; /* Si no, 'ETH_BATCH_MAX' tramas donde reciben
+                                por lotes 'eth_process()' y 'eth_recv_batch()' */
 };
 
 /* Tamaño de la cabecera Ethernet (sin incluir el campo FCS) */
@@ -24,6 +49,40 @@ struct eth_iface {
 /* Tamaño máximo de una trama Ethernet (sin incluir el campo FCS) */
 #define ETH_FRAME_MAX_LENGTH (ETH_HEADER_SIZE + ETH_MTU)
 
+/* Filtrar en el kernel (filtro BPF) las tramas que nadie espera (1) o no (0) */
+#define ETH_KERNEL_FILTER 1
+/* Número máximo de instrucciones del filtro BPF */
+#define ETH_FILTER_MAX_LENGTH 64
+/* Bytes de cada trama aceptada que el filtro entrega (la trama completa) */
+#define ETH_FILTER_SNAPLEN 0x40000
+/* Tipo de las tramas IPv4, que se pueden filtrar por puerto */
+#define ETH_FILTER_IPv4_TYPE 0x0800
+
+/* Trama guardada en la cola de su protocolo */
+struct eth_queued_frame {
+  int frame_len;
+  struct timespec stamp;  /* Instante de llegada, o cero */
+  unsigned char frame[ETH_FRAME_MAX_LENGTH];
+};
+
+/* Cola circular de tramas de un protocolo. Guarda las tramas de ese tipo
+   que se reciben mientras se está esperando una trama de otro tipo, para
+   entregarlas en la siguiente llamada a 'eth_recv()' con ese tipo. */
+struct eth_queue {
+  uint16_t type;
+  int head;               /* Posición de la trama más antigua */
+  int count;              /* Número de tramas en la cola */
+  unsigned int dropped;   /* Tramas descartadas por tener la cola llena */
+  struct eth_queued_frame frames[ETH_QUEUE_LENGTH];
+};
+
+/* Cabecera de una trama Ethernet, sin los datos, para enviarla aparte */
+struct eth_header {
+  mac_addr_t dest_addr; /* Dirección MAC destino*/
+  mac_addr_t src_addr;  /* Dirección MAC origen */
+  uint16_t type;        /* Campo 'Tipo' */
+};
+
 /* Cabecera de una trama Ethernet */
 struct eth_frame {
   mac_addr_t dest_addr; /* Dirección MAC destino*/
@@ -38,6 +97,152 @@ struct eth_frame {
 };
 
 
+/* void eth_capture_in
+ * ( eth_iface_t * iface, unsigned char * frame, int frame_len,
+ *   struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Copia una trama recibida en la captura del interfaz, si tiene.
+ */
+static void eth_capture_in
+( eth_iface_t * iface, unsigned char * frame, int frame_len,
+  struct timespec * stamp )
+{
+  if (iface->capture != NULL) {
+    struct iovec iov = { frame, frame_len };
+    eth_capture_frame(iface->capture, iface->capture_id, ETH_CAPTURE_IN,
+                      &iov, 1, stamp);
+  }
+}
+
+
+/* int eth_filter_types ( eth_iface_t * iface, uint16_t types[] );
+ *
+ * DESCRIPCIÓN:
+ *   Copia en 'types' los tipos con manejador o cola, sin repetir, y
+ *   devuelve cuántos son.
+ */
+static int eth_filter_types ( eth_iface_t * iface, uint16_t types[] )
+{
+  int types_num = 0;
+  int i, j;
+  for (i=0; i<iface->handlers_num + iface->queues_num; i++) {
+    uint16_t type = (i < iface->handlers_num) ?
+      iface->handlers[i].type : iface->queues[i - iface->handlers_num]->type;
+    for (j=0; j<types_num && types[j] != type; j++);
+    if (j == types_num) {
+      types[types_num++] = type;
+    }
+  }
+  return types_num;
+}
+
+/* int eth_filter_update ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Instala en el socket del interfaz un filtro BPF que sólo deja pasar las
+ *   tramas entrantes dirigidas a nuestra MAC (o multicast/difusión) cuyo
+ *   tipo tiene manejador o cola. Si no hay ninguno registrado todavía se
+ *   aceptan todos los tipos. Con 'eth_filter_ipv4_port()' las tramas IPv4
+ *   se restringen además a un protocolo y puerto destino.
+ *
+ *   Las comprobaciones de 'eth_recv()' se mantienen, por lo que si no se
+ *   puede instalar el filtro todo sigue funcionando, sólo que más despacio.
+ */
+static int eth_filter_update ( eth_iface_t * iface )
+{
+#if ETH_KERNEL_FILTER
+  struct sock_filter code[ETH_FILTER_MAX_LENGTH];
+  uint16_t types[ETH_HANDLERS_MAX + ETH_QUEUES_MAX];
+  int types_num = eth_filter_types(iface, types);
+
+  unsigned char * mac = iface->mac_address;
+  uint32_t mac_hi = ((uint32_t) mac[0] << 24) | (mac[1] << 16) | (mac[2] << 8) | mac[3];
+  uint32_t mac_lo = (mac[4] << 8) | mac[5];
+  int filter_ipv4 = (iface->filter_port != 0);
+
+  /* Posición de cada bloque, para calcular los saltos (sólo hacia delante):
+     0-7 origen y MAC, 8 tipo, luego descartar, aceptar y el bloque IPv4 */
+  int types_pos = 8;
+  int drop = types_pos + 1 + types_num;
+  int accept = drop + 1;
+  int ipv4_pos = accept + 1;
+  if (types_num == 0) {
+    /* Nadie ha registrado tipos todavía: aceptar cualquiera */
+    accept = types_pos;
+    drop = types_pos + 1;
+  }
+
+  /* 1. Las tramas que envía este equipo no nos interesan */
+  code[0] = (struct sock_filter)
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE);
+  code[1] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, drop - 2, 0);
+
+  /* 2. MAC destino: multicast/difusión, o la nuestra */
+  code[2] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0);
+  code[3] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x01, types_pos - 4, 0);
+  code[4] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0);
+  code[5] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mac_hi, 0, drop - 6);
+  code[6] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4);
+  code[7] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mac_lo, 0, drop - 8);
+  int n = types_pos;
+
+  /* 3. Tipo: uno de los que tienen manejador o cola */
+  if (types_num > 0) {
+    code[n] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12);
+    n++;
+    int i;
+    for (i=0; i<types_num; i++) {
+      int target = accept;
+      if (filter_ipv4 && (types[i] == ETH_FILTER_IPv4_TYPE)) {
+        target = ipv4_pos;
+      }
+      code[n] = (struct sock_filter)
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, types[i], target - n - 1, 0);
+      n++;
+    }
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, ETH_FILTER_SNAPLEN);
+  } else {
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, ETH_FILTER_SNAPLEN);
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+  }
+
+  /* 4. IPv4: protocolo, sin fragmentar, y puerto destino */
+  if (filter_ipv4 && (types_num > 0)) {
+    code[n++] = (struct sock_filter)
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, ETH_HEADER_SIZE + 9);
+    code[n++] = (struct sock_filter)
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, iface->filter_proto, 0, 5);
+    code[n++] = (struct sock_filter)
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, ETH_HEADER_SIZE + 6);
+    code[n++] = (struct sock_filter)
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 3, 0);
+    code[n++] = (struct sock_filter)
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETH_HEADER_SIZE);
+    code[n++] = (struct sock_filter)
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, ETH_HEADER_SIZE + 2);
+    code[n++] = (struct sock_filter)
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, iface->filter_port, 1, 0);
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, ETH_FILTER_SNAPLEN);
+  }
+
+  if (rawnet_set_filter(iface->raw_iface, code, n) < 0) {
+    fprintf(stderr, "eth_filter_update(): ERROR en rawnet_set_filter(): %s\n",
+            rawnet_strerror());
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+static eth_iface_t * eth_iface_init ( rawiface_t * raw_iface );
+
 /* eth_iface_t * eth_open ( char* ifname );
  *
  * DESCRIPCIÓN:
@@ -61,6 +266,58 @@ struct eth_frame {
  *   La función devuelve 'NULL' si se ha producido algún error.
  */
 eth_iface_t * eth_open ( char* ifname )
+{
+  /* Abrir el interfaz "en crudo" subyacente */
+  rawiface_t * raw_iface = rawiface_open(ifname);
+  if (raw_iface == NULL) {
+    fprintf(stderr, "eth_open(): ERROR en rawiface_open(): %s\n",
+            rawnet_strerror());
+    return NULL;
+  }
+
+  return eth_iface_init(raw_iface);
+}
+
+
+/* eth_iface_t * eth_open_fanout ( char* ifname, int group_id, int mode );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_open()', pero el interfaz se une al grupo PACKET_FANOUT
+ *   'group_id' (ver 'rawiface_open_fanout()'): las tramas recibidas se
+ *   reparten entre todos los interfaces del grupo.
+ *
+ * PARÁMETROS:
+ *   'ifname': Nombre de la interfaz Ethernet.
+ * 'group_id': Identificador del grupo.
+ *     'mode': 'ETH_FANOUT_HASH' o 'ETH_FANOUT_CPU'.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la interfaz Ethernet inicializada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+eth_iface_t * eth_open_fanout ( char* ifname, int group_id, int mode )
+{
+  int raw_mode = (mode == ETH_FANOUT_CPU) ? RAWNET_FANOUT_CPU : RAWNET_FANOUT_HASH;
+  rawiface_t * raw_iface = rawiface_open_fanout(ifname, group_id, raw_mode);
+  if (raw_iface == NULL) {
+    fprintf(stderr, "eth_open_fanout(): ERROR en rawiface_open_fanout(): %s\n",
+            rawnet_strerror());
+    return NULL;
+  }
+
+  return eth_iface_init(raw_iface);
+}
+
+
+/* eth_iface_t * eth_iface_init ( rawiface_t * raw_iface );
+ *
+ * DESCRIPCIÓN:
+ *   Crea el manejador del interfaz Ethernet sobre el interfaz "en crudo" ya
+ *   abierto 'raw_iface'. Si falla, cierra 'raw_iface'.
+ */
+static eth_iface_t * eth_iface_init ( rawiface_t * raw_iface )
 {
   struct eth_iface * eth_iface;
 
@@ -68,14 +325,7 @@ eth_iface_t * eth_open ( char* ifname )
   eth_iface = malloc(sizeof(struct eth_iface));
   if (eth_iface == NULL) {
     fprintf(stderr, "eth_open(): ERROR en malloc()\n");
-    return NULL;
-  }
-
-  /* Abrir el interfaz "en crudo" subyacente */
-  rawiface_t * raw_iface = rawiface_open(ifname);
-  if (raw_iface == NULL) {
-    fprintf(stderr, "eth_open(): ERROR en rawiface_open(): %s\n",
-            rawnet_strerror());
+    rawiface_close(raw_iface);
     return NULL;
   }
   eth_iface->raw_iface = raw_iface;
@@ -83,6 +333,32 @@ eth_iface_t * eth_open ( char* ifname )
   /* Copiar la dirección MAC en el manejador */
   rawiface_getaddr(raw_iface, eth_iface->mac_address);
 
+  eth_iface->handlers_num = 0;
+  eth_iface->queues_num = 0;
+  eth_iface->filter_proto = 0;
+  eth_iface->filter_port = 0;
+  eth_iface->rx_stamp.tv_sec = 0;
+  eth_iface->rx_stamp.tv_nsec = 0;
+  eth_iface->capture = NULL;
+  eth_iface->capture_id = 0;
+
+  /* Sin anillo ni backend las tramas se reciben por lotes en un buffer del
+     interfaz, reservado una sola vez */
+  eth_iface->zerocopy = (rawiface_is_zerocopy(raw_iface) == 1);
+  eth_iface->rx_frames = NULL;
+  if (!eth_iface->zerocopy) {
+    eth_iface->rx_frames = malloc(ETH_BATCH_MAX * ETH_FRAME_MAX_LENGTH);
+    if (eth_iface->rx_frames == NULL) {
+      fprintf(stderr, "eth_open(): ERROR en malloc()\n");
+      rawiface_close(raw_iface);
+      free(eth_iface);
+      return NULL;
+    }
+  }
+
+  /* De momento sólo se descartan en el kernel las tramas para otras MAC */
+  eth_filter_update(eth_iface);
+
   return eth_iface;
 }
 
@@ -166,216 +442,1299 @@ int eth_send
 ( eth_iface_t * iface,
   mac_addr_t dst, uint16_t type, unsigned char * payload, int payload_len )
 {
-  int bytes_sent;
+  /* Los datos se envían desde donde están, sin copiarlos tras la cabecera */
+  struct iovec iov = { payload, payload_len };
 
-  /* Comprobar parámetros */
-  if (iface == NULL) {
-    fprintf(stderr, "eth_send(): ERROR: iface == NULL\n");
-    return -1;
-  }
+  return eth_sendv(iface, dst, type, &iov, 1);
+}
 
-  /* Crear la Trama Ethernet y rellenar todos los campos */
-  struct eth_frame eth_frame;
-  memcpy(eth_frame.dest_addr, dst, MAC_ADDR_SIZE);
-  memcpy(eth_frame.src_addr, iface->mac_address, MAC_ADDR_SIZE);
-  eth_frame.type = htons(type);
-  memcpy(eth_frame.payload, payload, payload_len);
-  int eth_frame_len = ETH_HEADER_SIZE + payload_len;
 
-  /* Imprimir trama Ethernet */
+/* void eth_send_print
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type, int payload_len );
+ *
+ * DESCRIPCIÓN:
+ *   Imprime la trama que se va a enviar.
+ */
+static void eth_send_print
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, int payload_len )
+{
   char* iface_name = eth_getname(iface);
   char mac_str[MAC_STR_LENGTH];
   mac_addr_str(dst, mac_str);
   printf("eth_send(type=0x%04x, payload[%d]) > %s/%s\n",
          type, payload_len, iface_name, mac_str);
+}
 
-  //print_pkt((unsigned char *) &eth_frame, eth_frame_len, ETH_HEADER_SIZE);
-
-  /* Enviar la trama Ethernet creada con rawnet_send() y comprobar errores */
-  bytes_sent = rawnet_send
-    (iface->raw_iface, (unsigned char *) &eth_frame, eth_frame_len);
-  if (bytes_sent == -1) {
-    fprintf(stderr, "eth_send(): ERROR en rawnet_send(): %s\n",
-            rawnet_strerror());
-    return -1;
-  }
 
-  /* Devolver el número de bytes de datos recibidos */
-  return (bytes_sent - ETH_HEADER_SIZE);
+/* void eth_header_fill
+ * ( eth_iface_t * iface, struct eth_header * header, mac_addr_t dst, uint16_t type );
+ *
+ * DESCRIPCIÓN:
+ *   Rellena la cabecera de una trama que sale por 'iface' hacia 'dst'.
+ */
+static void eth_header_fill
+( eth_iface_t * iface, struct eth_header * header, mac_addr_t dst, uint16_t type )
+{
+  memcpy(header->dest_addr, dst, MAC_ADDR_SIZE);
+  memcpy(header->src_addr, iface->mac_address, MAC_ADDR_SIZE);
+  header->type = htons(type);
 }
 
-/* int eth_recv
- * ( eth_iface_t * iface,
- *   mac_addr_t src, uint16_t type, unsigned char buffer[], long int timeout );
+
+/* int eth_sendv
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+ *   const struct iovec * iov, int iovcnt );
  *
  * DESCRIPCIÓN:
- *   Esta función permite obtener el siguiente paquete recibido por la
- *   interfaz Ethernet indicada. La operación puede esperar indefinidamente o
- *   un tiempo limitando dependiento del parámetro 'timeout'.
- *
- *   Esta función sólo permite recibir paquetes de una única interfaz. Si desea
- *   escuchar varias interfaces Ethernet simultaneamente, utilice la función
- *   'eth_poll()'.
+ *   Igual que 'eth_send()', pero los datos se indican en 'iovcnt' trozos que
+ *   se envían tras la cabecera Ethernet con 'rawnet_sendv()'.
  *
  * PARÁMETROS:
- *    'iface': Manejador de la interfaz Ethernet por la que se desea recibir
- *             un paquete.
- *             La interfaz debe haber sido inicializada con 'eth_open()'
- *             previamente.
- *      'src': Dirección MAC del equipo que envió la trama Ethernet recibida.
- *             Este es un parámetro de salida. La dirección se copiará en la
- *             memoria indicada, que debe estar reservada previamente.
- *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
- *             recibir.
- *             Las tramas con un valor 'type' diferente serán descartadas.
- *   'buffer': Array donde se almacenarán los datos de la trama recibida.
- *  'buf_len': Longitud del 'buffer' dónde se almacenarán los datos de la trama
- *             recibida. Si se reciben más datos de los que caben el en 'buffer'
- *             sólo se copiaran los primeros 'buf_len' bytes.
- *             datos.
- *  'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
- *             antes de retornar. Un número negativo indicará que debe
- *             esperarse indefinidamente, mientras que con un '0' la función
- *             retornará inmediatamente, se haya recibido o no una trama.
+ *    'iface': Manejador de la interfaz Ethernet.
+ *      'dst': Dirección MAC del equipo destino.
+ *     'type': Valor del campo 'Tipo' de la trama Ethernet a enviar.
+ *      'iov': Trozos de los datos, en orden.
+ *   'iovcnt': Número de trozos (hasta 'ETH_IOV_MAX').
  *
  * VALOR DEVUELTO:
- *   La longitud en bytes de los datos de la trama recibida (que puede
- *   ser mayor que 'buf_len'), o '0' si no se ha recibido ninguna
- *   trama porque ha expirado el temporizador.
+ *   El número de bytes de datos que han podido ser enviados.
  *
  * ERRORES:
  *   La función devuelve '-1' si se ha producido algún error.
  */
-int eth_recv
-( eth_iface_t * iface, mac_addr_t src, uint16_t type, unsigned char buffer[],
-  int buf_len, long int timeout )
+int eth_sendv
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+  const struct iovec * iov, int iovcnt )
 {
-  int payload_len;
+  int bytes_sent;
 
   /* Comprobar parámetros */
   if (iface == NULL) {
-    fprintf(stderr, "eth_recv(): ERROR: iface == NULL\n");
+    fprintf(stderr, "eth_sendv(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  if (iovcnt < 0 || iovcnt > ETH_IOV_MAX) {
+    fprintf(stderr, "eth_sendv(): ERROR: %d trozos (maximo %d)\n",
+            iovcnt, ETH_IOV_MAX);
     return -1;
   }
 
-  /* Inicializar temporizador para mantener timeout si se reciben tramas con
-     tipo incorrecto. */
-  timerms_t timer;
-  timerms_reset(&timer, timeout);
+  /* La cabecera va en su propio trozo, delante de los datos */
+  struct eth_header header;
+  eth_header_fill(iface, &header, dst, type);
 
-  int frame_len;
-  int eth_buf_len = ETH_HEADER_SIZE + buf_len;
-  unsigned char eth_buffer[eth_buf_len];
-  struct eth_frame * eth_frame_ptr = NULL;
-  int is_target_type;
-  int is_my_mac;
-  int is_multicast;
+  struct iovec frame_iov[ETH_IOV_MAX + 1];
+  frame_iov[0].iov_base = &header;
+  frame_iov[0].iov_len = ETH_HEADER_SIZE;
+  int payload_len = 0;
+  int i;
+  for (i=0; i<iovcnt; i++) {
+    frame_iov[i + 1] = iov[i];
+    payload_len += iov[i].iov_len;
+  }
 
-  do {
-    long int time_left = timerms_left(&timer);
+  /* Imprimir trama Ethernet */
+  eth_send_print(iface, dst, type, payload_len);
 
-    /* Recibir trama del interfaz Ethernet y procesar errores */
-    frame_len = rawnet_recv (iface->raw_iface, eth_buffer, eth_buf_len,
-                             time_left);
-    if (frame_len < 0) {
-      fprintf(stderr, "eth_recv(): ERROR en rawnet_recv(): %s\n", rawnet_strerror());
-      return -1;
-    } else if (frame_len == 0) {
-      /* Timeout! */
-      return 0;
-    } else if (frame_len < ETH_HEADER_SIZE) {
-      fprintf(stderr, "eth_recv(): Trama de tamaño invalido: %d bytes\n", frame_len);
-      continue;
+  /* Enviar la trama Ethernet con rawnet_sendv() y comprobar errores */
+  bytes_sent = rawnet_sendv(iface->raw_iface, frame_iov, iovcnt + 1);
+  if (bytes_sent == -2) {
+    /* Anillo de transmisión lleno: esperamos a que se vacíe y reintentamos */
+    if (rawnet_flush(iface->raw_iface) >= 0) {
+      bytes_sent = rawnet_sendv(iface->raw_iface, frame_iov, iovcnt + 1);
     }
-
-    /* Comprobar si es la trama que estamos buscando */
-    eth_frame_ptr = (struct eth_frame *) eth_buffer;
-    is_my_mac = (memcmp(eth_frame_ptr->dest_addr, iface->mac_address, MAC_ADDR_SIZE) == 0);
-    is_target_type = (ntohs(eth_frame_ptr->type) == type);
-    is_multicast = (eth_frame_ptr->dest_addr[0] & 0x01) == 0x01;//check que el primer octeto de la mac sea =0x01
-    //if(is_multicast) printf("ETH: MULTICAST RECEIVED\n");
-
-  } while ( ! ((is_my_mac || is_multicast) && is_target_type) );//comprueba que sea para mi ip o para multicast
-  /* Trama recibida con 'tipo' indicado. Copiar datos y dirección MAC origen */
-  //if(is_multicast) printf("ETH: MULTICAST RECEIVED\n");
-
-  memcpy(src, eth_frame_ptr->src_addr, MAC_ADDR_SIZE);
-  payload_len = frame_len - ETH_HEADER_SIZE;
-
-  if (buf_len > payload_len) {
-    buf_len = payload_len;
+  }
+  if (bytes_sent < 0) {
+    fprintf(stderr, "eth_sendv(): ERROR en rawnet_sendv(): %s\n",
+            rawnet_strerror());
+    return -1;
+  }
+  if (iface->capture != NULL) {
+    eth_capture_frame(iface->capture, iface->capture_id, ETH_CAPTURE_OUT,
+                      frame_iov, iovcnt + 1, NULL);
   }
 
-  memcpy(buffer, eth_frame_ptr->payload, buf_len);
-
-  return payload_len;
+  /* Devolver el número de bytes de datos enviados */
+  return (bytes_sent - ETH_HEADER_SIZE);
 }
 
 
-/* int eth_poll
- * ( eth_iface_t * ifaces[], int ifnum, long int timeout );
+/* int eth_send_buf
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * buf );
  *
  * DESCRIPCIÓN:
- *   Esta función permite esperar paquetes en múltiples interfaces Ethernet
- *   simultaneamente. Cuando alguna de las interfaces indicadas reciba una
- *   trama, la función devolverá la primera interfaz que tiene una trama
- *   listo para ser recibida mediante la funcion 'eth_recv()'.
- *
- *   Esta operación puede escuchar de los interfaces Ethernet indefinidamente
- *   o un tiempo limitado dependiento del parámetro 'timeout'.
+ *   Igual que 'eth_send()', pero la cabecera Ethernet se escribe en el
+ *   espacio reservado de 'buf' y la trama sale de ahí sin copiarse.
  *
  * PARÁMETROS:
- *  'ifaces': Array con los manejadores de interfaces Ethernet por los que se
- *            quiere recibir.
- *            Todos los interfaces deben haber sido inicializados con
- *            'eth_open()' previamente.
- *   'ifnum': Número de interfaces que aparecen en el array 'ifaces'.
- * 'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
- *            antes de retornar. Un número negativo indicará que debe
- *            esperarse indefinidamente.
+ *    'iface': Manejador de la interfaz Ethernet.
+ *      'dst': Dirección MAC del equipo destino.
+ *     'type': Valor del campo 'Tipo' de la trama Ethernet a enviar.
+ *      'buf': Paquete a enviar, con espacio reservado para la cabecera.
  *
  * VALOR DEVUELTO:
- *   El índice del primer interfaz [0, ifnum-1] que tiene una trama lista para
- *   ser recibida o '-2' si ha expirado el temporizador.
+ *   El número de bytes de datos que han podido ser enviados.
  *
  * ERRORES:
  *   La función devuelve '-1' si se ha producido algún error.
  */
-int eth_poll
-( eth_iface_t * ifaces[], int ifnum, long int timeout )
+int eth_send_buf
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * buf )
 {
-  int iface_index;
+  int bytes_sent;
 
-  /* Crear lista de interfaces hardware */
-  rawiface_t * raw_ifaces[ifnum];
-  int i;
-  for (i=0; i<ifnum; i++) {
-    raw_ifaces[i] = ifaces[i]->raw_iface;
+  /* Comprobar parámetros */
+  if (iface == NULL) {
+    fprintf(stderr, "eth_send_buf(): ERROR: iface == NULL\n");
+    return -1;
   }
 
-  /* Llamar a rawnet_poll() y procesar errores */
-  iface_index = rawnet_poll(raw_ifaces, ifnum, timeout);
-  if (iface_index == -1) {
-    fprintf(stderr, "eth_poll(): ERROR en rawnet_poll(): %s\n",
+  int payload_len = buf->len;
+  struct eth_header * header =
+    (struct eth_header *) pkt_buf_push(buf, ETH_HEADER_SIZE);
+  if (header == NULL) {
+    fprintf(stderr, "eth_send_buf(): ERROR: Sin espacio para la cabecera\n");
+    return -1;
+  }
+  eth_header_fill(iface, header, dst, type);
+
+  /* Imprimir trama Ethernet */
+  eth_send_print(iface, dst, type, payload_len);
+
+  bytes_sent = rawnet_send(iface->raw_iface, buf->data, buf->len);
+  if (bytes_sent == -2) {
+    /* Anillo de transmisión lleno: esperamos a que se vacíe y reintentamos */
+    if (rawnet_flush(iface->raw_iface) >= 0) {
+      bytes_sent = rawnet_send(iface->raw_iface, buf->data, buf->len);
+    }
+  }
+  if (bytes_sent < 0) {
+    fprintf(stderr, "eth_send_buf(): ERROR en rawnet_send(): %s\n",
             rawnet_strerror());
     return -1;
-  } else if (iface_index == -2) {
-    /* Timeout! */
-    return -2;
+  }
+  if (iface->capture != NULL) {
+    struct iovec iov = { buf->data, buf->len };
+    eth_capture_frame(iface->capture, iface->capture_id, ETH_CAPTURE_OUT,
+                      &iov, 1, NULL);
   }
 
-  return iface_index;
+  /* Devolver el número de bytes de datos enviados */
+  return (bytes_sent - ETH_HEADER_SIZE);
 }
 
-
-/* int eth_close ( eth_iface_t * iface );
+/* int eth_flush ( eth_iface_t * iface );
  *
  * DESCRIPCIÓN:
- *   Esta función cierra la interfaz Ethernet especificada y libera la memoria
- *   de su manejador.
- *
- * PARÁMETROS:
- *   'iface': Manejador de la interfaz Ethernet que se desea cerrar.
+ *   Esta función envía de golpe las tramas que 'eth_send()' ha dejado en el
+ *   anillo de transmisión (interfaces abiertas como "mmap:<nombre>").
+ *   'eth_recv()', 'eth_poll()' y 'eth_close()' lo hacen automáticamente.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas enviadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_flush ( eth_iface_t * iface )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_flush(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  int frames = rawnet_flush(iface->raw_iface);
+  if (frames < 0) {
+    fprintf(stderr, "eth_flush(): ERROR en rawnet_flush(): %s\n",
+            rawnet_strerror());
+    return -1;
+  }
+  return frames;
+}
+
+/* int eth_send_batch
+ * ( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[], int count );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envía 'count' tramas del mismo 'Tipo' con una sola llamada
+ *   al sistema ('rawnet_send_batch()') por cada 'ETH_BATCH_MAX' tramas.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *     'type': Valor del campo 'Tipo' de las tramas a enviar.
+ *   'frames': Array con el destino y los datos de cada trama.
+ *    'count': Número de tramas a enviar.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas enviadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar ninguna trama, o si
+ *   alguna supera 'ETH_MTU' bytes (y entonces no se envía ninguna).
+ */
+int eth_send_batch
+( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[], int count )
+{
+  /* Comprobar parámetros */
+  if (iface == NULL) {
+    fprintf(stderr, "eth_send_batch(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  int i;
+  for (i=0; i<count; i++) {
+    if ((frames[i].payload_len < 0) || (frames[i].payload_len > ETH_MTU)) {
+      fprintf(stderr, "eth_send_batch(): ERROR: trama %d demasiado grande "
+              "(%d bytes, maximo %d)\n", i, frames[i].payload_len, ETH_MTU);
+      return -1;
+    }
+  }
+
+  struct eth_frame eth_frames[ETH_BATCH_MAX];
+  unsigned char * packets[ETH_BATCH_MAX];
+  int packet_lens[ETH_BATCH_MAX];
+  int sent_total = 0;
+
+  while (sent_total < count) {
+    int batch_len = count - sent_total;
+    if (batch_len > ETH_BATCH_MAX) {
+      batch_len = ETH_BATCH_MAX;
+    }
+
+    /* Crear las tramas Ethernet del lote */
+    for (i=0; i<batch_len; i++) {
+      eth_batch_frame_t * frame = &frames[sent_total + i];
+      memcpy(eth_frames[i].dest_addr, frame->addr, MAC_ADDR_SIZE);
+      memcpy(eth_frames[i].src_addr, iface->mac_address, MAC_ADDR_SIZE);
+      eth_frames[i].type = htons(type);
+      memcpy(eth_frames[i].payload, frame->payload, frame->payload_len);
+      packets[i] = (unsigned char *) &eth_frames[i];
+      packet_lens[i] = ETH_HEADER_SIZE + frame->payload_len;
+    }
+
+    int sent = rawnet_send_batch(iface->raw_iface, packets, packet_lens, batch_len);
+    if (sent < 0) {
+      fprintf(stderr, "eth_send_batch(): ERROR en rawnet_send_batch(): %s\n",
+              rawnet_strerror());
+      break;
+    }
+    if (iface->capture != NULL) {
+      for (i=0; i<sent; i++) {
+        struct iovec iov = { packets[i], packet_lens[i] };
+        eth_capture_frame(iface->capture, iface->capture_id, ETH_CAPTURE_OUT,
+                          &iov, 1, NULL);
+      }
+    }
+    sent_total += sent;
+    if (sent < batch_len) {
+      break;
+    }
+  }
+
+  if (sent_total == 0 && count > 0) {
+    return -1;
+  }
+  return sent_total;
+}
+
+
+/* int eth_send_buf_batch
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+ *   pkt_buf_t * bufs[], int count );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envía 'count' tramas hacia 'dst' con una sola llamada al
+ *   sistema ('rawnet_send_batch()') por cada 'ETH_BATCH_MAX' tramas,
+ *   escribiendo la cabecera Ethernet en el espacio reservado de cada buffer.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *      'dst': Dirección MAC destino de todas las tramas.
+ *     'type': Valor del campo 'Tipo' de las tramas a enviar.
+ *     'bufs': Buffers con los datos de cada trama.
+ *    'count': Número de tramas a enviar.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas enviadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido enviar ninguna trama, o si
+ *   alguna es demasiado grande o no tiene espacio para la cabecera.
+ */
+int eth_send_buf_batch
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type,
+  pkt_buf_t * bufs[], int count )
+{
+  /* Comprobar parámetros */
+  if (iface == NULL) {
+    fprintf(stderr, "eth_send_buf_batch(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  int i;
+  for (i=0; i<count; i++) {
+    if (bufs[i]->len > ETH_MTU) {
+      fprintf(stderr, "eth_send_buf_batch(): ERROR: trama %d demasiado grande "
+              "(%d bytes, maximo %d)\n", i, bufs[i]->len, ETH_MTU);
+      return -1;
+    }
+    if (bufs[i]->data - bufs[i]->buffer < ETH_HEADER_SIZE) {
+      fprintf(stderr, "eth_send_buf_batch(): ERROR: Sin espacio para la "
+              "cabecera en la trama %d\n", i);
+      return -1;
+    }
+  }
+
+  /* Las cabeceras se escriben en su sitio: no se copia ningún dato */
+  for (i=0; i<count; i++) {
+    struct eth_header * header =
+      (struct eth_header *) pkt_buf_push(bufs[i], ETH_HEADER_SIZE);
+    eth_header_fill(iface, header, dst, type);
+  }
+
+  unsigned char * packets[ETH_BATCH_MAX];
+  int packet_lens[ETH_BATCH_MAX];
+  int sent_total = 0;
+
+  while (sent_total < count) {
+    int batch_len = count - sent_total;
+    if (batch_len > ETH_BATCH_MAX) {
+      batch_len = ETH_BATCH_MAX;
+    }
+    for (i=0; i<batch_len; i++) {
+      packets[i] = bufs[sent_total + i]->data;
+      packet_lens[i] = bufs[sent_total + i]->len;
+    }
+
+    int sent = rawnet_send_batch(iface->raw_iface, packets, packet_lens, batch_len);
+    if (sent < 0) {
+      fprintf(stderr, "eth_send_buf_batch(): ERROR en rawnet_send_batch(): %s\n",
+              rawnet_strerror());
+      break;
+    }
+    if (iface->capture != NULL) {
+      for (i=0; i<sent; i++) {
+        struct iovec iov = { packets[i], packet_lens[i] };
+        eth_capture_frame(iface->capture, iface->capture_id, ETH_CAPTURE_OUT,
+                          &iov, 1, NULL);
+      }
+    }
+    sent_total += sent;
+    if (sent < batch_len) {
+      break;
+    }
+  }
+
+  if (sent_total == 0 && count > 0) {
+    return -1;
+  }
+  return sent_total;
+}
+
+/* struct eth_queue * eth_queue_find ( eth_iface_t * iface, uint16_t type );
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve la cola del protocolo 'type', o 'NULL' si no tiene.
+ */
+static struct eth_queue * eth_queue_find ( eth_iface_t * iface, uint16_t type )
+{
+  int i;
+  for (i=0; i<iface->queues_num; i++) {
+    if (iface->queues[i]->type == type) {
+      return iface->queues[i];
+    }
+  }
+  return NULL;
+}
+
+/* void eth_dispatch ( eth_iface_t * iface, unsigned char * frame, int frame_len );
+ *
+ * DESCRIPCIÓN:
+ *   Reparte una trama dirigida a nosotros que no es del tipo que se está
+ *   esperando: se entrega al manejador registrado para su tipo o, si no lo
+ *   hay, se guarda en la cola de su protocolo. Si el tipo no tiene manejador
+ *   ni cola, nadie la espera y se descarta.
+ */
+static void eth_dispatch
+( eth_iface_t * iface, unsigned char * frame, int frame_len,
+  struct timespec * stamp )
+{
+  struct eth_frame * eth_frame_ptr = (struct eth_frame *) frame;
+  uint16_t type = ntohs(eth_frame_ptr->type);
+
+  /* El manejador puede consultarlo con 'eth_get_timestamp()' */
+  iface->rx_stamp = *stamp;
+
+  int i;
+  for (i=0; i<iface->handlers_num; i++) {
+    if (iface->handlers[i].type == type) {
+      iface->handlers[i].handler(iface, eth_frame_ptr->src_addr,
+                                 eth_frame_ptr->payload,
+                                 frame_len - ETH_HEADER_SIZE,
+                                 iface->handlers[i].arg);
+      return;
+    }
+  }
+
+  struct eth_queue * queue = eth_queue_find(iface, type);
+  if (queue == NULL) {
+    return;
+  }
+  if (queue->count == ETH_QUEUE_LENGTH) {
+    queue->dropped++;
+    return;
+  }
+
+  int tail = (queue->head + queue->count) % ETH_QUEUE_LENGTH;
+  if (frame_len > (int) sizeof(queue->frames[tail].frame)) {
+    frame_len = sizeof(queue->frames[tail].frame);
+  }
+  memcpy(queue->frames[tail].frame, frame, frame_len);
+  queue->frames[tail].frame_len = frame_len;
+  queue->frames[tail].stamp = *stamp;
+  queue->count++;
+}
+
+/* void eth_batch_copy
+ * ( eth_batch_frame_t * batch_frame, unsigned char * frame, int frame_len );
+ *
+ * DESCRIPCIÓN:
+ *   Copia la MAC origen y los datos de una trama recibida en la entrada
+ *   correspondiente del lote de 'eth_recv_batch()'.
+ */
+static void eth_batch_copy
+( eth_batch_frame_t * batch_frame, unsigned char * frame, int frame_len )
+{
+  struct eth_frame * eth_frame_ptr = (struct eth_frame *) frame;
+  int payload_len = frame_len - ETH_HEADER_SIZE;
+  int copy_len = batch_frame->payload_len;
+  if (copy_len > payload_len) {
+    copy_len = payload_len;
+  }
+
+  memcpy(batch_frame->addr, eth_frame_ptr->src_addr, MAC_ADDR_SIZE);
+  memcpy(batch_frame->payload, eth_frame_ptr->payload, copy_len);
+  batch_frame->payload_len = payload_len;
+}
+
+/* int eth_input
+ * ( eth_iface_t * iface, unsigned char * frame, int frame_len,
+ *   struct timespec * stamp, uint16_t type, eth_batch_frame_t * batch_frame );
+ *
+ * DESCRIPCIÓN:
+ *   Procesa una trama recibida por 'eth_process()' o 'eth_recv_batch()', sin
+ *   moverla de donde esté: si es del tipo 'type' y se indica 'batch_frame' la
+ *   copia en él y si no la entrega a su manejador o a su cola.
+ *
+ * VALOR DEVUELTO:
+ *   1 si se ha copiado en 'batch_frame', 0 si se ha entregado o guardado y
+ *   -1 si se ha descartado (tamaño inválido o dirigida a otra MAC).
+ */
+static int eth_input
+( eth_iface_t * iface, unsigned char * frame, int frame_len,
+  struct timespec * stamp, uint16_t type, eth_batch_frame_t * batch_frame )
+{
+  if (frame_len < ETH_HEADER_SIZE) {
+    return -1;
+  } else if (frame_len > ETH_FRAME_MAX_LENGTH) {
+    frame_len = ETH_FRAME_MAX_LENGTH;
+  }
+  eth_capture_in(iface, frame, frame_len, stamp);
+
+  struct eth_frame * eth_frame_ptr = (struct eth_frame *) frame;
+  int is_my_mac = (memcmp(eth_frame_ptr->dest_addr, iface->mac_address, MAC_ADDR_SIZE) == 0);
+  int is_multicast = (eth_frame_ptr->dest_addr[0] & 0x01) == 0x01;
+  if (!(is_my_mac || is_multicast)) {
+    return -1;
+  }
+
+  if ((batch_frame != NULL) && (ntohs(eth_frame_ptr->type) == type)) {
+    eth_batch_copy(batch_frame, frame, frame_len);
+    return 1;
+  }
+  /* Las tramas de otros protocolos van a su manejador o a su cola */
+  eth_dispatch(iface, frame, frame_len, stamp);
+  return 0;
+}
+
+/* int eth_recv_next
+ * ( eth_iface_t * iface, unsigned char ** frame, struct timespec * stamp,
+ *   long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Recibe la siguiente trama de un interfaz "zerocopy" sin copiarla. La
+ *   trama sólo es válida hasta la siguiente recepción en el interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud de la trama, 0 si ha expirado el temporizador o -1 si se ha
+ *   producido algún error.
+ */
+static int eth_recv_next
+( eth_iface_t * iface, unsigned char ** frame, struct timespec * stamp,
+  long int timeout )
+{
+  int frame_len = rawnet_recv_zerocopy(iface->raw_iface, frame, timeout);
+  if ((frame_len > 0) && (rawiface_get_timestamp(iface->raw_iface, stamp) < 0)) {
+    stamp->tv_sec = 0;
+    stamp->tv_nsec = 0;
+  }
+  return frame_len;
+}
+
+/* int eth_recv
+ * ( eth_iface_t * iface,
+ *   mac_addr_t src, uint16_t type, unsigned char buffer[], long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite obtener el siguiente paquete recibido por la
+ *   interfaz Ethernet indicada. La operación puede esperar indefinidamente o
+ *   un tiempo limitando dependiento del parámetro 'timeout'.
+ *
+ *   Las tramas de otros tipos que se reciban mientras tanto no se pierden:
+ *   se entregan al manejador de su protocolo ('eth_set_handler()') o se
+ *   guardan en su cola ('eth_register()') para la siguiente llamada a esta
+ *   función con ese tipo.
+ *
+ *   Esta función sólo permite recibir paquetes de una única interfaz. Si desea
+ *   escuchar varias interfaces Ethernet simultaneamente, utilice la función
+ *   'eth_poll()'.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet por la que se desea recibir
+ *             un paquete.
+ *             La interfaz debe haber sido inicializada con 'eth_open()'
+ *             previamente.
+ *      'src': Dirección MAC del equipo que envió la trama Ethernet recibida.
+ *             Este es un parámetro de salida. La dirección se copiará en la
+ *             memoria indicada, que debe estar reservada previamente.
+ *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
+ *             recibir.
+ *             Las tramas con un valor 'type' diferente no se devuelven.
+ *   'buffer': Array donde se almacenarán los datos de la trama recibida.
+ *  'buf_len': Longitud del 'buffer' dónde se almacenarán los datos de la trama
+ *             recibida. Si se reciben más datos de los que caben el en 'buffer'
+ *             sólo se copiaran los primeros 'buf_len' bytes.
+ *             datos.
+ *  'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
+ *             antes de retornar. Un número negativo indicará que debe
+ *             esperarse indefinidamente, mientras que con un '0' la función
+ *             retornará inmediatamente, se haya recibido o no una trama.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud en bytes de los datos de la trama recibida (que puede
+ *   ser mayor que 'buf_len'), o '0' si no se ha recibido ninguna
+ *   trama porque ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv
+( eth_iface_t * iface, mac_addr_t src, uint16_t type, unsigned char buffer[],
+  int buf_len, long int timeout )
+{
+  pkt_view_t view;
+
+  int payload_len = eth_recv_view(iface, src, type, &view, timeout);
+  if (payload_len <= 0) {
+    return payload_len;
+  }
+
+  if (buf_len > payload_len) {
+    buf_len = payload_len;
+  }
+
+  memcpy(buffer, pkt_view_data(&view), buf_len);
+
+  return payload_len;
+}
+
+
+/* int eth_recv_view
+ * ( eth_iface_t * iface, mac_addr_t src, uint16_t type, pkt_view_t * view,
+ *   long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_recv()', pero sin copiar los datos: 'view' queda sobre la
+ *   trama recibida con la cabecera Ethernet ya consumida. Si la trama estaba
+ *   en la cola del protocolo, la vista apunta a la cola; si no, al buffer de
+ *   'rawnet_recv_zerocopy()' (el anillo del kernel en modo "mmap:").
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *      'src': Dirección MAC del equipo que envió la trama.
+ *     'type': Valor del campo 'Tipo' de la trama que se desea recibir.
+ *     'view': Vista donde se devolverá la trama recibida.
+ *  'timeout': Igual que en 'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud en bytes de los datos de la trama recibida, o '0' si ha
+ *   expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv_view
+( eth_iface_t * iface, mac_addr_t src, uint16_t type, pkt_view_t * view,
+  long int timeout )
+{
+  /* Comprobar parámetros */
+  if (iface == NULL) {
+    fprintf(stderr, "eth_recv_view(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  /* Registrar el protocolo, para que sus tramas se guarden mientras otro
+     protocolo está esperando las suyas */
+  struct eth_queue * queue = eth_queue_find(iface, type);
+  if (queue == NULL) {
+    if (eth_register(iface, type) < 0) {
+      return -1;
+    }
+    queue = eth_queue_find(iface, type);
+  }
+
+  /* Inicializar temporizador para mantener timeout si se reciben tramas con
+     tipo incorrecto. */
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  int frame_len;
+  unsigned char * frame = NULL;
+  struct eth_frame * eth_frame_ptr = NULL;
+  struct timespec stamp;
+  int is_target_type;
+  int is_my_mac;
+  int is_multicast;
+
+  do {
+    /* Primero se entregan las tramas que llegaron mientras se esperaba otro
+       protocolo */
+    if (queue->count > 0) {
+      frame = queue->frames[queue->head].frame;
+      frame_len = queue->frames[queue->head].frame_len;
+      stamp = queue->frames[queue->head].stamp;
+      queue->head = (queue->head + 1) % ETH_QUEUE_LENGTH;
+      queue->count--;
+      eth_frame_ptr = (struct eth_frame *) frame;
+      break;
+    }
+
+    long int time_left = timerms_left(&timer);
+
+    /* Recibir trama del interfaz Ethernet y procesar errores */
+    frame_len = rawnet_recv_zerocopy (iface->raw_iface, &frame, time_left);
+    if (frame_len < 0) {
+      fprintf(stderr, "eth_recv_view(): ERROR en rawnet_recv_zerocopy(): %s\n", rawnet_strerror());
+      return -1;
+    } else if (frame_len == 0) {
+      /* Timeout! */
+      return 0;
+    } else if (frame_len < ETH_HEADER_SIZE) {
+      fprintf(stderr, "eth_recv_view(): Trama de tamaño invalido: %d bytes\n", frame_len);
+      continue;
+    } else if (frame_len > ETH_FRAME_MAX_LENGTH) {
+      frame_len = ETH_FRAME_MAX_LENGTH;
+    }
+    if (rawiface_get_timestamp(iface->raw_iface, &stamp) < 0) {
+      stamp.tv_sec = 0;
+      stamp.tv_nsec = 0;
+    }
+    eth_capture_in(iface, frame, frame_len, &stamp);
+
+    /* Comprobar si es la trama que estamos buscando */
+    eth_frame_ptr = (struct eth_frame *) frame;
+    is_my_mac = (memcmp(eth_frame_ptr->dest_addr, iface->mac_address, MAC_ADDR_SIZE) == 0);
+    is_target_type = (ntohs(eth_frame_ptr->type) == type);
+    is_multicast = (eth_frame_ptr->dest_addr[0] & 0x01) == 0x01;//check que el primer octeto de la mac sea =0x01
+    //if(is_multicast) printf("ETH: MULTICAST RECEIVED\n");
+
+    if (!(is_my_mac || is_multicast)) {
+      continue;
+    }
+    if (is_target_type) {
+      break;
+    }
+
+    /* Las tramas de otros protocolos van a su manejador o a su cola */
+    eth_dispatch(iface, frame, frame_len, &stamp);
+
+  } while (1);
+  /* Trama recibida con 'tipo' indicado. La vista queda sobre sus datos */
+
+  memcpy(src, eth_frame_ptr->src_addr, MAC_ADDR_SIZE);
+  pkt_view_init(view, frame, frame_len);
+  pkt_view_pull(view, ETH_HEADER_SIZE);
+  view->stamp = stamp;
+  iface->rx_stamp = stamp;
+
+  return view->data_len;
+}
+
+
+/* int eth_recv_batch
+ * ( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[],
+ *   int count, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'eth_recv()', pero en cuanto llega la primera trama del 'Tipo'
+ *   indicado recoge también, sin esperar, las que ya estén disponibles
+ *   (hasta 'ETH_BATCH_MAX' por llamada a 'rawnet_recv_batch()'), con un
+ *   máximo de 'count'.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *     'type': Valor del campo 'Tipo' de las tramas que se desea recibir.
+ *   'frames': Array donde se devolverá la MAC origen y los datos de cada
+ *             trama. 'payload_len' indica el tamaño de cada buffer y se
+ *             sustituye por la longitud de los datos recibidos.
+ *    'count': Número máximo de tramas a recibir.
+ *  'timeout': Tiempo en milisegundos que debe esperarse a la primera trama.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas recibidas, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv_batch
+( eth_iface_t * iface, uint16_t type, eth_batch_frame_t frames[],
+  int count, long int timeout )
+{
+  /* Comprobar parámetros */
+  if (iface == NULL) {
+    fprintf(stderr, "eth_recv_batch(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  struct eth_queue * queue = eth_queue_find(iface, type);
+  if (queue == NULL) {
+    if (eth_register(iface, type) < 0) {
+      return -1;
+    }
+    queue = eth_queue_find(iface, type);
+  }
+
+  int received = 0;
+
+  /* Primero se entregan las tramas que llegaron mientras se esperaba otro
+     protocolo */
+  while (received < count && queue->count > 0) {
+    struct eth_queued_frame * queued = &queue->frames[queue->head];
+    eth_batch_copy(&frames[received++], queued->frame, queued->frame_len);
+    queue->head = (queue->head + 1) % ETH_QUEUE_LENGTH;
+    queue->count--;
+  }
+
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  /* Anillo o backend: cada trama se copia directamente de donde la dejó el
+     kernel al lote */
+  if (iface->zerocopy) {
+    while (received < count) {
+      /* Con alguna trama ya recibida sólo se recogen las que estén listas */
+      long int time_left = (received > 0) ? 0 : timerms_left(&timer);
+      unsigned char * frame;
+      struct timespec stamp;
+      int frame_len = eth_recv_next(iface, &frame, &stamp, time_left);
+      if (frame_len < 0) {
+        fprintf(stderr, "eth_recv_batch(): ERROR en rawnet_recv_zerocopy(): %s\n",
+                rawnet_strerror());
+        return (received > 0) ? received : -1;
+      } else if (frame_len == 0) {
+        /* Timeout, o no quedan más tramas */
+        break;
+      }
+      if (eth_input(iface, frame, frame_len, &stamp, type, &frames[received]) == 1) {
+        received++;
+      }
+    }
+    return received;
+  }
+
+  unsigned char * buffers[ETH_BATCH_MAX];
+  int frame_lens[ETH_BATCH_MAX];
+  struct timespec stamps[ETH_BATCH_MAX];
+  int i;
+  for (i=0; i<ETH_BATCH_MAX; i++) {
+    buffers[i] = iface->rx_frames + i * ETH_FRAME_MAX_LENGTH;
+  }
+
+  while (received < count) {
+    /* Con alguna trama ya recibida sólo se recogen las que estén listas */
+    long int time_left = (received > 0) ? 0 : timerms_left(&timer);
+    int batch_len = count - received;
+    if (batch_len > ETH_BATCH_MAX) {
+      batch_len = ETH_BATCH_MAX;
+    }
+
+    int frames_num = rawnet_recv_batch_ts(iface->raw_iface, buffers,
+                                          ETH_FRAME_MAX_LENGTH, frame_lens,
+                                          stamps, batch_len, time_left);
+    if (frames_num < 0) {
+      fprintf(stderr, "eth_recv_batch(): ERROR en rawnet_recv_batch_ts(): %s\n",
+              rawnet_strerror());
+      return (received > 0) ? received : -1;
+    } else if (frames_num == 0) {
+      /* Timeout, o no quedan más tramas */
+      break;
+    }
+
+    for (i=0; i<frames_num; i++) {
+      if (eth_input(iface, buffers[i], frame_lens[i], &stamps[i], type, &frames[received]) == 1) {
+        received++;
+      }
+    }
+
+    /* Si el lote no se ha llenado ya no hay más tramas esperando */
+    if (received > 0 && frames_num < batch_len) {
+      break;
+    }
+  }
+
+  return received;
+}
+
+
+/* int eth_poll
+ * ( eth_iface_t * ifaces[], int ifnum, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite esperar paquetes en múltiples interfaces Ethernet
+ *   simultaneamente. Cuando alguna de las interfaces indicadas reciba una
+ *   trama, la función devolverá la primera interfaz que tiene una trama
+ *   listo para ser recibida mediante la funcion 'eth_recv()'.
+ *
+ *   Esta operación puede escuchar de los interfaces Ethernet indefinidamente
+ *   o un tiempo limitado dependiento del parámetro 'timeout'.
+ *
+ * PARÁMETROS:
+ *  'ifaces': Array con los manejadores de interfaces Ethernet por los que se
+ *            quiere recibir.
+ *            Todos los interfaces deben haber sido inicializados con
+ *            'eth_open()' previamente.
+ *   'ifnum': Número de interfaces que aparecen en el array 'ifaces'.
+ * 'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
+ *            antes de retornar. Un número negativo indicará que debe
+ *            esperarse indefinidamente.
+ *
+ * VALOR DEVUELTO:
+ *   El índice del primer interfaz [0, ifnum-1] que tiene una trama lista para
+ *   ser recibida o '-2' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_poll
+( eth_iface_t * ifaces[], int ifnum, long int timeout )
+{
+  int iface_index;
+
+  /* Crear lista de interfaces hardware */
+  rawiface_t * raw_ifaces[ifnum];
+  int i;
+  for (i=0; i<ifnum; i++) {
+    raw_ifaces[i] = ifaces[i]->raw_iface;
+  }
+
+  /* Llamar a rawnet_poll() y procesar errores */
+  iface_index = rawnet_poll(raw_ifaces, ifnum, timeout);
+  if (iface_index == -1) {
+    fprintf(stderr, "eth_poll(): ERROR en rawnet_poll(): %s\n",
+            rawnet_strerror());
+    return -1;
+  } else if (iface_index == -2) {
+    /* Timeout! */
+    return -2;
+  }
+
+  return iface_index;
+}
+
+
+/* int eth_process ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee, sin esperar, todas las tramas que ya haya recibido el
+ *   interfaz y entrega cada una al manejador de su tipo, o la guarda en su
+ *   cola si el tipo no tiene manejador.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas procesadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_process ( eth_iface_t * iface )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_process(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  int processed = 0;
+
+  /* Anillo o backend: los manejadores reciben la trama en su sitio */
+  if (iface->zerocopy) {
+    do {
+      unsigned char * frame;
+      struct timespec stamp;
+      int frame_len = eth_recv_next(iface, &frame, &stamp, 0);
+      if (frame_len < 0) {
+        fprintf(stderr, "eth_process(): ERROR en rawnet_recv_zerocopy(): %s\n",
+                rawnet_strerror());
+        return -1;
+      } else if (frame_len == 0) {
+        break;
+      }
+      if (eth_input(iface, frame, frame_len, &stamp, 0, NULL) == 0) {
+        processed++;
+      }
+    } while (1);
+  } else {
+    unsigned char * buffers[ETH_BATCH_MAX];
+    int frame_lens[ETH_BATCH_MAX];
+    struct timespec stamps[ETH_BATCH_MAX];
+    int i;
+    for (i=0; i<ETH_BATCH_MAX; i++) {
+      buffers[i] = iface->rx_frames + i * ETH_FRAME_MAX_LENGTH;
+    }
+
+    int frames_num;
+    do {
+      frames_num = rawnet_recv_batch_ts(iface->raw_iface, buffers,
+                                        ETH_FRAME_MAX_LENGTH, frame_lens,
+                                        stamps, ETH_BATCH_MAX, 0);
+      if (frames_num < 0) {
+        fprintf(stderr, "eth_process(): ERROR en rawnet_recv_batch_ts(): %s\n",
+                rawnet_strerror());
+        return -1;
+      }
+
+      for (i=0; i<frames_num; i++) {
+        if (eth_input(iface, buffers[i], frame_lens[i], &stamps[i], 0, NULL) == 0) {
+          processed++;
+        }
+      }
+
+      /* Si el lote no se ha llenado ya no quedan tramas */
+    } while (frames_num == ETH_BATCH_MAX);
+  }
+
+  /* Las respuestas enviadas por los manejadores pueden haberse quedado en
+     el anillo de transmisión */
+  if (eth_flush(iface) < 0) {
+    return -1;
+  }
+
+  return processed;
+}
+
+
+/* void eth_reactor_input ( reactor_t * reactor, int fd, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Manejador del bucle de eventos para el socket del interfaz 'arg'.
+ */
+static void eth_reactor_input ( reactor_t * reactor, int fd, void * arg )
+{
+  eth_process((eth_iface_t *) arg);
+}
+
+
+/* int eth_reactor_add ( reactor_t * reactor, eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra el interfaz en el bucle de eventos 'reactor', que
+ *   llamará a 'eth_process()' cada vez que lleguen tramas.
+ *
+ * PARÁMETROS:
+ *   'reactor': Manejador del bucle de eventos.
+ *     'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el interfaz se ha registrado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_reactor_add ( reactor_t * reactor, eth_iface_t * iface )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_reactor_add(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  int fd = rawiface_getfd(iface->raw_iface);
+  if (reactor_add_fd(reactor, fd, eth_reactor_input, iface) < 0) {
+    return -1;
+  }
+
+  /* Puede haber tramas que llegaron antes de registrar el socket */
+  eth_process(iface);
+
+  return 0;
+}
+
+
+/* int eth_set_handler
+ * ( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra un manejador para las tramas con el 'Tipo'
+ *   indicado. Cuando 'eth_recv()' reciba una trama dirigida a nosotros cuyo
+ *   tipo no sea el que se está esperando, en lugar de descartarla se la
+ *   entregará al manejador registrado para ese tipo.
+ *
+ *   Si ya había un manejador para ese tipo se sustituye. Un 'handler' 'NULL'
+ *   elimina el manejador registrado.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *      'type': Valor del campo 'Tipo' de las tramas a procesar.
+ *   'handler': Función que procesará las tramas de ese tipo.
+ *       'arg': Argumento que se pasará a 'handler' junto a cada trama.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el manejador se ha registrado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL' o si ya hay
+ *   'ETH_HANDLERS_MAX' manejadores registrados.
+ */
+int eth_set_handler
+( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_set_handler(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  int i;
+  for (i=0; i<iface->handlers_num; i++) {
+    if (iface->handlers[i].type == type) {
+      break;
+    }
+  }
+
+  if (handler == NULL) {
+    /* Eliminar el manejador, moviendo el último a su hueco */
+    if (i < iface->handlers_num) {
+      iface->handlers_num--;
+      iface->handlers[i] = iface->handlers[iface->handlers_num];
+      eth_filter_update(iface);
+    }
+    return 0;
+  }
+
+  if (i == ETH_HANDLERS_MAX) {
+    fprintf(stderr, "eth_set_handler(): ERROR: Demasiados manejadores\n");
+    return -1;
+  }
+
+  iface->handlers[i].type = type;
+  iface->handlers[i].handler = handler;
+  iface->handlers[i].arg = arg;
+  if (i == iface->handlers_num) {
+    iface->handlers_num++;
+    eth_filter_update(iface);
+  }
+
+  return 0;
+}
+
+
+/* int eth_register ( eth_iface_t * iface, uint16_t type );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea la cola de recepción del protocolo 'type'. Las tramas
+ *   de ese tipo que se reciban mientras 'eth_recv()' espera tramas de otro
+ *   tipo se guardan en ella (hasta 'ETH_QUEUE_LENGTH' tramas) en lugar de
+ *   descartarse, y se entregarán en la siguiente llamada a 'eth_recv()' con
+ *   ese tipo.
+ *
+ *   'eth_recv()' registra automáticamente el tipo que recibe, pero conviene
+ *   registrarlo al abrir el protocolo para no perder las tramas que lleguen
+ *   antes de la primera recepción.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *    'type': Valor del campo 'Tipo' de las tramas a guardar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la cola se ha creado o ya existía.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL', si ya hay
+ *   'ETH_QUEUES_MAX' colas o si no hay memoria para la cola.
+ */
+int eth_register ( eth_iface_t * iface, uint16_t type )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_register(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  if (eth_queue_find(iface, type) != NULL) {
+    return 0;
+  }
+
+  if (iface->queues_num == ETH_QUEUES_MAX) {
+    fprintf(stderr, "eth_register(): ERROR: Demasiados protocolos\n");
+    return -1;
+  }
+
+  struct eth_queue * queue = malloc(sizeof(struct eth_queue));
+  if (queue == NULL) {
+    fprintf(stderr, "eth_register(): ERROR en malloc()\n");
+    return -1;
+  }
+  queue->type = type;
+  queue->head = 0;
+  queue->count = 0;
+  queue->dropped = 0;
+
+  iface->queues[iface->queues_num] = queue;
+  iface->queues_num++;
+
+  eth_filter_update(iface);
+
+  return 0;
+}
+
+
+/* int eth_filter_ipv4_port ( eth_iface_t * iface, uint8_t protocol, uint16_t port );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función restringe el filtro del kernel para que de las tramas IPv4
+ *   sólo lleguen los paquetes sin fragmentar del 'protocol' indicado (UDP o
+ *   TCP) con puerto destino 'port'. Con 'port' igual a 0 se vuelven a
+ *   aceptar todos los paquetes IPv4.
+ *
+ * PARÁMETROS:
+ *      'iface': Manejador de la interfaz Ethernet.
+ *   'protocol': Protocolo IPv4 (p.ej. 17 para UDP).
+ *       'port': Puerto destino.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha instalado el filtro.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido instalar. Las tramas se
+ *   siguen filtrando igualmente en 'eth_recv()' y las capas superiores.
+ */
+int eth_filter_ipv4_port ( eth_iface_t * iface, uint8_t protocol, uint16_t port )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_filter_ipv4_port(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  iface->filter_proto = protocol;
+  iface->filter_port = port;
+
+  return eth_filter_update(iface);
+}
+
+
+/* int eth_set_timestamps ( eth_iface_t * iface, int enable );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa (o desactiva) la marca de tiempo de llegada de las
+ *   tramas.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'enable': 1 para activarla, 0 para desactivarla.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_set_timestamps ( eth_iface_t * iface, int enable )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_set_timestamps(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  if (rawiface_set_timestamps(iface->raw_iface, enable) < 0) {
+    fprintf(stderr, "eth_set_timestamps(): ERROR en rawiface_set_timestamps(): %s\n",
+            rawnet_strerror());
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* int eth_get_timestamp ( eth_iface_t * iface, struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve en 'stamp' el instante de llegada de la última
+ *   trama entregada por el interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la trama tiene marca de tiempo.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no la tiene.
+ */
+int eth_get_timestamp ( eth_iface_t * iface, struct timespec * stamp )
+{
+  if ((iface == NULL) ||
+      ((iface->rx_stamp.tv_sec == 0) && (iface->rx_stamp.tv_nsec == 0))) {
+    return -1;
+  }
+
+  *stamp = iface->rx_stamp;
+  return 0;
+}
+
+
+/* int eth_set_capture ( eth_iface_t * iface, eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función hace que las tramas que el interfaz envíe o reciba se
+ *   copien en la captura 'capture', o deja de capturar si es 'NULL'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_set_capture ( eth_iface_t * iface, eth_capture_t * capture )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_set_capture(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  if (capture != NULL) {
+    int capture_id = eth_capture_add_iface(capture, eth_getname(iface));
+    if (capture_id < 0) {
+      return -1;
+    }
+    iface->capture_id = capture_id;
+  }
+  iface->capture = capture;
+
+  return 0;
+}
+
+
+/* int eth_close ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cierra la interfaz Ethernet especificada y libera la memoria
+ *   de su manejador.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet que se desea cerrar.
  *
  * VALOR DEVUELTO:
  *   Devuelve 0 si la interfaz Ethernet se ha cerrado correctamente.
@@ -389,6 +1748,11 @@ int eth_close ( eth_iface_t * iface )
 
   if (iface != NULL) {
     err = rawiface_close(iface->raw_iface);
+    int i;
+    for (i=0; i<iface->queues_num; i++) {
+      free(iface->queues[i]);
+    }
+    free(iface->rx_frames);
     free(iface);
   }
 
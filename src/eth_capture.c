@@ -0,0 +1,724 @@
+#include "eth_capture.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/* Tiempo (ms) que duerme el hilo cuando no hay tramas en el anillo */
+#define ETH_CAPTURE_IDLE_MS 10
+/* Tamaño del buffer de escritura de cada fichero */
+#define ETH_CAPTURE_FILE_BUFFER (1 << 20)
+/* Longitud máxima del nombre de los ficheros y de los interfaces */
+#define ETH_CAPTURE_PATH_MAX 256
+#define ETH_CAPTURE_IFNAME_MAX 64
+/* Alineamiento de los huecos del anillo (una línea de caché) */
+#define ETH_CAPTURE_SLOT_ALIGN 64
+/* Cabeceras que mira el filtro: Ethernet, IPv4 con opciones y los puertos */
+#define ETH_CAPTURE_ETH_HEADER_SIZE 14
+#define ETH_CAPTURE_PEEK_LEN (ETH_CAPTURE_ETH_HEADER_SIZE + 60 + 4)
+#define ETH_CAPTURE_IPv4_TYPE 0x0800
+#define ETH_CAPTURE_TCP 6
+#define ETH_CAPTURE_UDP 17
+
+/* Bloques y opciones de pcap-ng */
+#define PCAPNG_SHB_TYPE 0x0A0D0D0A
+#define PCAPNG_IDB_TYPE 0x00000001
+#define PCAPNG_EPB_TYPE 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET 1
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_EPB_FLAGS 2
+/* Marcas de tiempo en nanosegundos (10^-9) */
+#define PCAPNG_TSRESOL_NS 9
+/* Bytes de un EPB sin los datos: cabecera (28), 'epb_flags' (8), fin de
+   opciones (4) y longitud final (4) */
+#define PCAPNG_EPB_OVERHEAD 44
+
+/* Hueco del anillo. 'seq' dice de quién es: vale su posición en el anillo
+   mientras está libre para los productores, y la posición + 1 cuando ya
+   tiene una trama para el hilo escritor. */
+struct eth_capture_slot {
+  unsigned long seq;
+  struct timespec stamp;
+  uint32_t frame_len;     /* Longitud de la trama */
+  uint32_t cap_len;       /* Bytes guardados en 'data' */
+  uint16_t iface_id;
+  uint16_t direction;     /* 'ETH_CAPTURE_IN' o 'ETH_CAPTURE_OUT' */
+  unsigned char data[];   /* 'snaplen' bytes */
+};
+
+struct eth_capture {
+  /* Configuración: no cambia mientras se captura */
+  char path[ETH_CAPTURE_PATH_MAX];
+  int snaplen;
+  long int file_size;
+  int files;
+  uint16_t filter_type;
+  uint8_t filter_proto;
+  uint16_t filter_port;
+
+  /* Interfaces. 'ifaces_num' se publica después de escribir el nombre, para
+     que el hilo escritor nunca vea un identificador sin su nombre */
+  pthread_mutex_t ifaces_lock;
+  char ifnames[ETH_CAPTURE_IFACES_MAX][ETH_CAPTURE_IFNAME_MAX];
+  int ifaces_num;
+
+  /* Anillo de 'ETH_CAPTURE_RING_SLOTS' huecos de 'slot_size' bytes. Los
+     contadores de productores y escritor van en líneas de caché distintas */
+  unsigned char * slots;
+  size_t slot_size;
+  unsigned long enqueue_pos __attribute__((aligned(ETH_CAPTURE_SLOT_ALIGN)));
+  unsigned long dropped;
+  unsigned long dequeue_pos __attribute__((aligned(ETH_CAPTURE_SLOT_ALIGN)));
+
+  /* Hilo escritor: sólo él toca el fichero */
+  pthread_t thread;
+  int stop;
+  FILE * file;
+  char * file_buffer;
+  int file_index;
+  long int file_bytes;
+  int file_ifaces;        /* Interfaces ya descritos en el fichero actual */
+  int file_dirty;         /* Hay datos sin pasar al kernel ('fflush()') */
+  eth_capture_stats_t stats;
+};
+
+
+/* struct eth_capture_slot * eth_capture_slot
+ * ( eth_capture_t * capture, unsigned long pos );
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve el hueco del anillo de la posición 'pos'.
+ */
+static struct eth_capture_slot * eth_capture_slot
+( eth_capture_t * capture, unsigned long pos )
+{
+  return (struct eth_capture_slot *)
+    (capture->slots + (pos & (ETH_CAPTURE_RING_SLOTS - 1)) * capture->slot_size);
+}
+
+
+/* int eth_capture_write ( eth_capture_t * capture, void * data, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Escribe 'len' bytes en el fichero actual.
+ */
+static int eth_capture_write ( eth_capture_t * capture, void * data, int len )
+{
+  if (capture->file == NULL) {
+    return -1;
+  }
+  if (fwrite(data, 1, len, capture->file) != (size_t) len) {
+    __atomic_add_fetch(&capture->stats.errors, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  capture->file_bytes += len;
+  capture->file_dirty = 1;
+  __atomic_add_fetch(&capture->stats.bytes, len, __ATOMIC_RELAXED);
+  return 0;
+}
+
+
+/* int eth_capture_write_idb ( eth_capture_t * capture, int iface_id );
+ *
+ * DESCRIPCIÓN:
+ *   Escribe el bloque de descripción (IDB) del interfaz 'iface_id', con su
+ *   nombre y la resolución de las marcas de tiempo.
+ */
+static int eth_capture_write_idb ( eth_capture_t * capture, int iface_id )
+{
+  char * ifname = capture->ifnames[iface_id];
+  int name_len = strlen(ifname);
+  int name_pad = (name_len + 3) & ~3;
+
+  /* Cabecera (16), nombre (4 + name_pad), resolución (8), fin de opciones
+     (4) y longitud final (4) */
+  uint32_t block_len = 16 + 4 + name_pad + 8 + 4 + 4;
+  uint32_t block[(16 + 4 + ETH_CAPTURE_IFNAME_MAX + 8 + 4 + 4) / 4];
+  memset(block, 0, block_len);
+
+  unsigned char * p = (unsigned char *) block;
+  uint32_t * header = (uint32_t *) p;
+  header[0] = PCAPNG_IDB_TYPE;
+  header[1] = block_len;
+  *(uint16_t *) (p + 8) = PCAPNG_LINKTYPE_ETHERNET;
+  header[3] = capture->snaplen;
+  p += 16;
+
+  *(uint16_t *) p = PCAPNG_OPT_IF_NAME;
+  *(uint16_t *) (p + 2) = name_len;
+  memcpy(p + 4, ifname, name_len);
+  p += 4 + name_pad;
+
+  *(uint16_t *) p = PCAPNG_OPT_IF_TSRESOL;
+  *(uint16_t *) (p + 2) = 1;
+  p[4] = PCAPNG_TSRESOL_NS;
+  p += 8;
+
+  /* Fin de opciones (ya a cero) y longitud final */
+  p += 4;
+  *(uint32_t *) p = block_len;
+
+  return eth_capture_write(capture, block, block_len);
+}
+
+
+/* int eth_capture_file_open ( eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Abre (vaciándolo) el fichero 'file_index' de la rotación y escribe la
+ *   cabecera de sección (SHB) y los interfaces que haya hasta ahora.
+ */
+static int eth_capture_file_open ( eth_capture_t * capture )
+{
+  char filename[ETH_CAPTURE_PATH_MAX + 16];
+  if (capture->file_size > 0) {
+    snprintf(filename, sizeof(filename), "%s.%d", capture->path,
+             capture->file_index);
+  } else {
+    snprintf(filename, sizeof(filename), "%s", capture->path);
+  }
+
+  capture->file = fopen(filename, "wb");
+  if (capture->file == NULL) {
+    fprintf(stderr, "eth_capture: ERROR al abrir \"%s\": %s\n",
+            filename, strerror(errno));
+    __atomic_add_fetch(&capture->stats.errors, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  setvbuf(capture->file, capture->file_buffer, _IOFBF, ETH_CAPTURE_FILE_BUFFER);
+  capture->file_bytes = 0;
+  capture->file_ifaces = 0;
+  __atomic_add_fetch(&capture->stats.files, 1, __ATOMIC_RELAXED);
+
+  /* Cabecera de sección: nuestro orden de bytes, versión 1.0 y longitud de
+     la sección desconocida (-1) */
+  uint32_t shb[7];
+  shb[0] = PCAPNG_SHB_TYPE;
+  shb[1] = sizeof(shb);
+  shb[2] = PCAPNG_BYTE_ORDER_MAGIC;
+  ((uint16_t *) &shb[3])[0] = 1;
+  ((uint16_t *) &shb[3])[1] = 0;
+  shb[4] = 0xFFFFFFFF;
+  shb[5] = 0xFFFFFFFF;
+  shb[6] = sizeof(shb);
+  if (eth_capture_write(capture, shb, sizeof(shb)) < 0) {
+    return -1;
+  }
+
+  int ifaces_num = __atomic_load_n(&capture->ifaces_num, __ATOMIC_ACQUIRE);
+  for (; capture->file_ifaces < ifaces_num; capture->file_ifaces++) {
+    if (eth_capture_write_idb(capture, capture->file_ifaces) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+/* void eth_capture_file_close ( eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Cierra el fichero actual.
+ */
+static void eth_capture_file_close ( eth_capture_t * capture )
+{
+  if (capture->file == NULL) {
+    return;
+  }
+  if (fclose(capture->file) != 0) {
+    __atomic_add_fetch(&capture->stats.errors, 1, __ATOMIC_RELAXED);
+  }
+  capture->file = NULL;
+  capture->file_dirty = 0;
+}
+
+
+/* int eth_capture_write_epb
+ * ( eth_capture_t * capture, struct eth_capture_slot * slot );
+ *
+ * DESCRIPCIÓN:
+ *   Escribe la trama del hueco 'slot' como un bloque EPB, describiendo antes
+ *   su interfaz si todavía no está en el fichero. Si el fichero ya ha
+ *   llegado a su tamaño máximo, la trama va al siguiente (se rota al llegar
+ *   una trama, para no vaciar el fichero más antiguo sin motivo).
+ */
+static int eth_capture_write_epb
+( eth_capture_t * capture, struct eth_capture_slot * slot )
+{
+  if ((capture->file_size > 0) && (capture->file_bytes >= capture->file_size)) {
+    eth_capture_file_close(capture);
+    capture->file_index = (capture->file_index + 1) % capture->files;
+    eth_capture_file_open(capture);
+  }
+  if (capture->file == NULL) {
+    return -1;
+  }
+
+  if (slot->iface_id >= capture->file_ifaces) {
+    int ifaces_num = __atomic_load_n(&capture->ifaces_num, __ATOMIC_ACQUIRE);
+    for (; capture->file_ifaces < ifaces_num; capture->file_ifaces++) {
+      if (eth_capture_write_idb(capture, capture->file_ifaces) < 0) {
+        return -1;
+      }
+    }
+  }
+
+  uint32_t data_pad = (slot->cap_len + 3) & ~3;
+  uint32_t block_len = PCAPNG_EPB_OVERHEAD + data_pad;
+  uint64_t stamp = (uint64_t) slot->stamp.tv_sec * 1000000000ULL + slot->stamp.tv_nsec;
+
+  uint32_t header[7];
+  header[0] = PCAPNG_EPB_TYPE;
+  header[1] = block_len;
+  header[2] = slot->iface_id;
+  header[3] = (uint32_t) (stamp >> 32);
+  header[4] = (uint32_t) stamp;
+  header[5] = slot->cap_len;
+  header[6] = slot->frame_len;
+
+  /* Relleno de los datos, 'epb_flags' con el sentido, fin de opciones y
+     longitud final */
+  uint32_t trailer[4] = { 0, slot->direction, 0, block_len };
+  ((uint16_t *) &trailer[0])[0] = PCAPNG_OPT_EPB_FLAGS;
+  ((uint16_t *) &trailer[0])[1] = 4;
+  uint32_t padding = 0;
+
+  if ((eth_capture_write(capture, header, sizeof(header)) < 0) ||
+      (eth_capture_write(capture, slot->data, slot->cap_len) < 0) ||
+      ((data_pad > slot->cap_len) &&
+       (eth_capture_write(capture, &padding, data_pad - slot->cap_len) < 0)) ||
+      (eth_capture_write(capture, trailer, sizeof(trailer)) < 0)) {
+    return -1;
+  }
+  __atomic_add_fetch(&capture->stats.frames, 1, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+
+/* int eth_capture_drain ( eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Escribe todas las tramas que haya en el anillo y devuelve cuántas eran.
+ */
+static int eth_capture_drain ( eth_capture_t * capture )
+{
+  int frames = 0;
+
+  while (1) {
+    unsigned long pos = capture->dequeue_pos;
+    struct eth_capture_slot * slot = eth_capture_slot(capture, pos);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+      break;
+    }
+
+    eth_capture_write_epb(capture, slot);
+
+    /* El hueco vuelve a estar libre para la siguiente vuelta del anillo */
+    __atomic_store_n(&slot->seq, pos + ETH_CAPTURE_RING_SLOTS, __ATOMIC_RELEASE);
+    capture->dequeue_pos = pos + 1;
+    frames++;
+  }
+
+  return frames;
+}
+
+
+/* void * eth_capture_writer ( void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Hilo escritor: vacía el anillo a disco hasta que se le pida parar, y
+ *   entonces escribe lo que quede.
+ */
+static void * eth_capture_writer ( void * arg )
+{
+  eth_capture_t * capture = arg;
+  struct timespec idle = { 0, ETH_CAPTURE_IDLE_MS * 1000000L };
+
+  while (1) {
+    int stop = __atomic_load_n(&capture->stop, __ATOMIC_ACQUIRE);
+    if (eth_capture_drain(capture) > 0) {
+      continue;
+    }
+    if (stop) {
+      break;
+    }
+
+    /* Sin tramas: lo escrito pasa al fichero, para poder leerlo mientras
+       se captura */
+    if (capture->file_dirty && (capture->file != NULL)) {
+      if (fflush(capture->file) != 0) {
+        __atomic_add_fetch(&capture->stats.errors, 1, __ATOMIC_RELAXED);
+      }
+      capture->file_dirty = 0;
+    }
+    nanosleep(&idle, NULL);
+  }
+
+  return NULL;
+}
+
+
+/* eth_capture_t * eth_capture_open
+ * ( char * path, int snaplen, long int file_size, int files );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una captura que escribe en 'path' y arranca su hilo.
+ *
+ * PARÁMETROS:
+ *      'path': Nombre del fichero (o prefijo de los ficheros) de captura.
+ *   'snaplen': Bytes que se guardan de cada trama, o 0 para todos.
+ * 'file_size': Tamaño en bytes a partir del cual se rota, o 0.
+ *     'files': Número de ficheros de la rotación.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la captura.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+eth_capture_t * eth_capture_open
+( char * path, int snaplen, long int file_size, int files )
+{
+  if ((path == NULL) || (strlen(path) >= ETH_CAPTURE_PATH_MAX)) {
+    fprintf(stderr, "eth_capture_open(): ERROR: Nombre de fichero incorrecto\n");
+    return NULL;
+  }
+  if (snaplen == 0) {
+    snaplen = ETH_CAPTURE_SNAPLEN_MAX;
+  }
+  if ((snaplen < 0) || (snaplen > ETH_CAPTURE_SNAPLEN_MAX)) {
+    fprintf(stderr, "eth_capture_open(): ERROR: snaplen %d (1-%d)\n",
+            snaplen, ETH_CAPTURE_SNAPLEN_MAX);
+    return NULL;
+  }
+  if ((file_size < 0) || (files < 1) || (files > ETH_CAPTURE_FILES_MAX)) {
+    fprintf(stderr, "eth_capture_open(): ERROR: Rotación incorrecta (%ld bytes, %d ficheros)\n",
+            file_size, files);
+    return NULL;
+  }
+
+  eth_capture_t * capture = NULL;
+  if (posix_memalign((void **) &capture, ETH_CAPTURE_SLOT_ALIGN,
+                     sizeof(struct eth_capture)) != 0) {
+    fprintf(stderr, "eth_capture_open(): ERROR en posix_memalign()\n");
+    return NULL;
+  }
+  memset(capture, 0, sizeof(struct eth_capture));
+  snprintf(capture->path, ETH_CAPTURE_PATH_MAX, "%s", path);
+  capture->snaplen = snaplen;
+  capture->file_size = file_size;
+  capture->files = files;
+  pthread_mutex_init(&capture->ifaces_lock, NULL);
+
+  /* Cada hueco empieza en una línea de caché, para que dos productores no
+     escriban en la misma */
+  capture->slot_size = (sizeof(struct eth_capture_slot) + snaplen + ETH_CAPTURE_SLOT_ALIGN - 1)
+                       & ~(size_t) (ETH_CAPTURE_SLOT_ALIGN - 1);
+  capture->file_buffer = malloc(ETH_CAPTURE_FILE_BUFFER);
+  if ((capture->file_buffer == NULL) ||
+      (posix_memalign((void **) &capture->slots, ETH_CAPTURE_SLOT_ALIGN,
+                      ETH_CAPTURE_RING_SLOTS * capture->slot_size) != 0)) {
+    fprintf(stderr, "eth_capture_open(): ERROR sin memoria para el anillo\n");
+    free(capture->file_buffer);
+    free(capture);
+    return NULL;
+  }
+  unsigned long i;
+  for (i=0; i<ETH_CAPTURE_RING_SLOTS; i++) {
+    eth_capture_slot(capture, i)->seq = i;
+  }
+
+  /* El primer fichero se abre aquí, para avisar ya si no se puede */
+  if (eth_capture_file_open(capture) < 0) {
+    eth_capture_file_close(capture);
+    free(capture->slots);
+    free(capture->file_buffer);
+    free(capture);
+    return NULL;
+  }
+
+  int err = pthread_create(&capture->thread, NULL, eth_capture_writer, capture);
+  if (err != 0) {
+    fprintf(stderr, "eth_capture_open(): ERROR en pthread_create(): %s\n",
+            strerror(err));
+    eth_capture_file_close(capture);
+    free(capture->slots);
+    free(capture->file_buffer);
+    free(capture);
+    return NULL;
+  }
+
+  return capture;
+}
+
+
+/* int eth_capture_set_filter
+ * ( eth_capture_t * capture, uint16_t type, uint8_t protocol, uint16_t port );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función limita la captura a las tramas de 'Tipo' 'type' y, dentro
+ *   de IPv4, a las del protocolo 'protocol' con puerto 'port'. Un 0 no
+ *   filtra por ese campo.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado el filtro.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si 'capture' es 'NULL'.
+ */
+int eth_capture_set_filter
+( eth_capture_t * capture, uint16_t type, uint8_t protocol, uint16_t port )
+{
+  if (capture == NULL) {
+    fprintf(stderr, "eth_capture_set_filter(): ERROR: capture == NULL\n");
+    return -1;
+  }
+
+  /* Filtrar por protocolo o puerto ya implica IPv4 */
+  if ((type == 0) && ((protocol != 0) || (port != 0))) {
+    type = ETH_CAPTURE_IPv4_TYPE;
+  }
+  capture->filter_type = type;
+  capture->filter_proto = protocol;
+  capture->filter_port = port;
+
+  return 0;
+}
+
+
+/* int eth_capture_stats ( eth_capture_t * capture, eth_capture_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas de la captura.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se han copiado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si 'capture' es 'NULL'.
+ */
+int eth_capture_stats ( eth_capture_t * capture, eth_capture_stats_t * stats )
+{
+  if (capture == NULL) {
+    fprintf(stderr, "eth_capture_stats(): ERROR: capture == NULL\n");
+    return -1;
+  }
+
+  stats->frames = __atomic_load_n(&capture->stats.frames, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&capture->dropped, __ATOMIC_RELAXED);
+  stats->bytes = __atomic_load_n(&capture->stats.bytes, __ATOMIC_RELAXED);
+  stats->files = __atomic_load_n(&capture->stats.files, __ATOMIC_RELAXED);
+  stats->errors = __atomic_load_n(&capture->stats.errors, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+
+/* int eth_capture_close ( eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función detiene el hilo de la captura después de escribir las
+ *   tramas que queden en el anillo, cierra el fichero y libera la captura.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se han escrito todas las tramas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ha habido algún error de escritura.
+ */
+int eth_capture_close ( eth_capture_t * capture )
+{
+  if (capture == NULL) {
+    fprintf(stderr, "eth_capture_close(): ERROR: capture == NULL\n");
+    return -1;
+  }
+
+  __atomic_store_n(&capture->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(capture->thread, NULL);
+  eth_capture_file_close(capture);
+
+  int err = (capture->stats.errors > 0) ? -1 : 0;
+  pthread_mutex_destroy(&capture->ifaces_lock);
+  free(capture->slots);
+  free(capture->file_buffer);
+  free(capture);
+
+  return err;
+}
+
+
+/* int eth_capture_add_iface ( eth_capture_t * capture, char * ifname );
+ *
+ * DESCRIPCIÓN:
+ *   Añade el interfaz 'ifname' a los de la captura.
+ *
+ * VALOR DEVUELTO:
+ *   El identificador del interfaz en los ficheros.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ya hay 'ETH_CAPTURE_IFACES_MAX' interfaces.
+ */
+int eth_capture_add_iface ( eth_capture_t * capture, char * ifname )
+{
+  pthread_mutex_lock(&capture->ifaces_lock);
+
+  int iface_id = capture->ifaces_num;
+  if (iface_id == ETH_CAPTURE_IFACES_MAX) {
+    pthread_mutex_unlock(&capture->ifaces_lock);
+    fprintf(stderr, "eth_capture_add_iface(): ERROR: Demasiados interfaces (%d como mucho)\n",
+            ETH_CAPTURE_IFACES_MAX);
+    return -1;
+  }
+  snprintf(capture->ifnames[iface_id], ETH_CAPTURE_IFNAME_MAX, "%s", ifname);
+  __atomic_store_n(&capture->ifaces_num, iface_id + 1, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&capture->ifaces_lock);
+
+  return iface_id;
+}
+
+
+/* int eth_capture_copy
+ * ( const struct iovec * iov, int iovcnt, unsigned char * dst, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Copia en 'dst' los 'len' primeros bytes de la trama formada por los
+ *   trozos de 'iov' (o menos, si es más corta) y devuelve cuántos ha
+ *   copiado.
+ */
+static int eth_capture_copy
+( const struct iovec * iov, int iovcnt, unsigned char * dst, int len )
+{
+  int copied = 0;
+  int i;
+  for (i=0; (i<iovcnt) && (copied<len); i++) {
+    int chunk = iov[i].iov_len;
+    if (chunk > len - copied) {
+      chunk = len - copied;
+    }
+    memcpy(dst + copied, iov[i].iov_base, chunk);
+    copied += chunk;
+  }
+  return copied;
+}
+
+
+/* int eth_capture_match
+ * ( eth_capture_t * capture, const struct iovec * iov, int iovcnt );
+ *
+ * DESCRIPCIÓN:
+ *   Comprueba si la trama pasa el filtro de la captura.
+ */
+static int eth_capture_match
+( eth_capture_t * capture, const struct iovec * iov, int iovcnt )
+{
+  /* Normalmente las cabeceras están en el primer trozo; si no, se juntan */
+  unsigned char peek[ETH_CAPTURE_PEEK_LEN];
+  unsigned char * frame = iov[0].iov_base;
+  int len = iov[0].iov_len;
+  if ((len < ETH_CAPTURE_PEEK_LEN) && (iovcnt > 1)) {
+    len = eth_capture_copy(iov, iovcnt, peek, ETH_CAPTURE_PEEK_LEN);
+    frame = peek;
+  }
+
+  uint16_t type = (frame[12] << 8) | frame[13];
+  if (type != capture->filter_type) {
+    return 0;
+  }
+  if ((capture->filter_proto == 0) && (capture->filter_port == 0)) {
+    return 1;
+  }
+
+  unsigned char * ip = frame + ETH_CAPTURE_ETH_HEADER_SIZE;
+  int ip_len = len - ETH_CAPTURE_ETH_HEADER_SIZE;
+  if (ip_len < 20) {
+    return 0;
+  }
+  uint8_t proto = ip[9];
+  if ((capture->filter_proto != 0) && (proto != capture->filter_proto)) {
+    return 0;
+  }
+  if (capture->filter_port == 0) {
+    return 1;
+  }
+
+  /* Los puertos sólo están en el primer fragmento de UDP y TCP */
+  int header_len = (ip[0] & 0x0F) * 4;
+  int frag_offset = ((ip[6] & 0x1F) << 8) | ip[7];
+  if (((proto != ETH_CAPTURE_UDP) && (proto != ETH_CAPTURE_TCP)) ||
+      (frag_offset != 0) || (ip_len < header_len + 4)) {
+    return 0;
+  }
+  uint16_t src_port = (ip[header_len] << 8) | ip[header_len + 1];
+  uint16_t dst_port = (ip[header_len + 2] << 8) | ip[header_len + 3];
+  return (src_port == capture->filter_port) || (dst_port == capture->filter_port);
+}
+
+
+/* void eth_capture_frame
+ * ( eth_capture_t * capture, int iface_id, int direction,
+ *   const struct iovec * iov, int iovcnt, const struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Copia en el anillo la trama formada por los 'iovcnt' trozos de 'iov',
+ *   si pasa el filtro. Si el anillo está lleno la trama se pierde.
+ */
+void eth_capture_frame
+( eth_capture_t * capture, int iface_id, int direction,
+  const struct iovec * iov, int iovcnt, const struct timespec * stamp )
+{
+  if ((iovcnt < 1) || (iov[0].iov_len < ETH_CAPTURE_ETH_HEADER_SIZE)) {
+    return;
+  }
+  if ((capture->filter_type != 0) && !eth_capture_match(capture, iov, iovcnt)) {
+    return;
+  }
+
+  /* Reservar el siguiente hueco libre. Varios productores compiten por
+     'enqueue_pos': el que lo avanza se queda con el hueco */
+  unsigned long pos = __atomic_load_n(&capture->enqueue_pos, __ATOMIC_RELAXED);
+  struct eth_capture_slot * slot;
+  while (1) {
+    slot = eth_capture_slot(capture, pos);
+    unsigned long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    long int diff = (long int) (seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&capture->enqueue_pos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      /* Anillo lleno: el hilo escritor no ha liberado todavía este hueco */
+      __atomic_add_fetch(&capture->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      pos = __atomic_load_n(&capture->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  int frame_len = 0;
+  int i;
+  for (i=0; i<iovcnt; i++) {
+    frame_len += iov[i].iov_len;
+  }
+  slot->frame_len = frame_len;
+  slot->cap_len = eth_capture_copy(iov, iovcnt, slot->data, capture->snaplen);
+  slot->iface_id = iface_id;
+  slot->direction = direction;
+  if ((stamp != NULL) && ((stamp->tv_sec != 0) || (stamp->tv_nsec != 0))) {
+    slot->stamp = *stamp;
+  } else {
+    clock_gettime(CLOCK_REALTIME, &slot->stamp);
+  }
+
+  /* Entregar el hueco al hilo escritor */
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
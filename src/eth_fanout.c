@@ -0,0 +1,254 @@
+/* _GNU_SOURCE: pthread_setaffinity_np() */
+#define _GNU_SOURCE
+#include "eth_fanout.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* Tiempo máximo (ms) que un trabajador espera tramas antes de comprobar si
+   debe terminar */
+#define ETH_FANOUT_POLL_MS 100
+
+struct eth_fanout_worker {
+  eth_iface_t * iface;
+  pthread_t thread;
+  int running;              /* El hilo se ha arrancado */
+  int cpu;                  /* CPU a la que se fija el hilo, o -1 */
+  int * stop;               /* Indicador de parada del grupo */
+  eth_fanout_stats_t stats; /* Sólo las escribe el hilo del trabajador */
+};
+
+struct eth_fanout {
+  int workers_num;
+  int stop;
+  struct eth_fanout_worker workers[ETH_FANOUT_WORKERS_MAX];
+};
+
+/* Identificador del siguiente grupo PACKET_FANOUT de este proceso */
+static int eth_fanout_next_group = 0;
+
+
+/* void * eth_fanout_worker ( void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Hilo de un trabajador: espera tramas en su interfaz y las procesa hasta
+ *   que se le pida parar.
+ */
+static void * eth_fanout_worker ( void * arg )
+{
+  struct eth_fanout_worker * worker = arg;
+  eth_iface_t * ifaces[1] = { worker->iface };
+
+  if (worker->cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+
+  while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+    int ready = eth_poll(ifaces, 1, ETH_FANOUT_POLL_MS);
+    if (ready == -2) {
+      continue;
+    }
+    if (ready < 0) {
+      __atomic_add_fetch(&worker->stats.errors, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    __atomic_add_fetch(&worker->stats.wakeups, 1, __ATOMIC_RELAXED);
+
+    int frames = eth_process(worker->iface);
+    if (frames < 0) {
+      __atomic_add_fetch(&worker->stats.errors, 1, __ATOMIC_RELAXED);
+    } else {
+      __atomic_add_fetch(&worker->stats.frames, frames, __ATOMIC_RELAXED);
+    }
+  }
+
+  return NULL;
+}
+
+
+/* eth_fanout_t * eth_fanout_open ( char * ifname, int workers, int mode );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función abre 'workers' interfaces Ethernet sobre 'ifname', unidos a
+ *   un nuevo grupo PACKET_FANOUT.
+ *
+ * PARÁMETROS:
+ *   'ifname': Nombre de la interfaz Ethernet.
+ *  'workers': Número de trabajadores.
+ *     'mode': 'ETH_FANOUT_HASH' o 'ETH_FANOUT_CPU'.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador del grupo de trabajadores.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+eth_fanout_t * eth_fanout_open ( char * ifname, int workers, int mode )
+{
+  if ((workers < 1) || (workers > ETH_FANOUT_WORKERS_MAX)) {
+    fprintf(stderr, "eth_fanout_open(): ERROR: %d trabajadores (1-%d)\n",
+            workers, ETH_FANOUT_WORKERS_MAX);
+    return NULL;
+  }
+
+  struct eth_fanout * fanout = calloc(1, sizeof(struct eth_fanout));
+  if (fanout == NULL) {
+    fprintf(stderr, "eth_fanout_open(): ERROR en calloc()\n");
+    return NULL;
+  }
+
+  /* Los grupos son de todo el sistema: el PID los separa de los de otros
+     procesos sobre la misma interfaz */
+  int group_id = (getpid() + __atomic_fetch_add(&eth_fanout_next_group, 1, __ATOMIC_RELAXED)) & 0xFFFF;
+
+  long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i;
+  for (i=0; i<workers; i++) {
+    struct eth_fanout_worker * worker = &fanout->workers[i];
+    worker->iface = eth_open_fanout(ifname, group_id, mode);
+    if (worker->iface == NULL) {
+      eth_fanout_close(fanout);
+      return NULL;
+    }
+    worker->cpu = (i < cpus) ? i : -1;
+    worker->stop = &fanout->stop;
+    fanout->workers_num++;
+  }
+
+  return fanout;
+}
+
+
+/* eth_iface_t * eth_fanout_iface ( eth_fanout_t * fanout, int worker );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el interfaz Ethernet del trabajador 'worker'.
+ *
+ * VALOR DEVUELTO:
+ *   El interfaz del trabajador.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no existe ese trabajador.
+ */
+eth_iface_t * eth_fanout_iface ( eth_fanout_t * fanout, int worker )
+{
+  if ((fanout == NULL) || (worker < 0) || (worker >= fanout->workers_num)) {
+    fprintf(stderr, "eth_fanout_iface(): ERROR: No existe el trabajador %d\n",
+            worker);
+    return NULL;
+  }
+
+  return fanout->workers[worker].iface;
+}
+
+
+/* int eth_fanout_start ( eth_fanout_t * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función arranca un hilo por trabajador.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se han arrancado todos los hilos.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_fanout_start ( eth_fanout_t * fanout )
+{
+  if (fanout == NULL) {
+    fprintf(stderr, "eth_fanout_start(): ERROR: fanout == NULL\n");
+    return -1;
+  }
+
+  int i;
+  for (i=0; i<fanout->workers_num; i++) {
+    struct eth_fanout_worker * worker = &fanout->workers[i];
+    if (worker->running) {
+      continue;
+    }
+    int err = pthread_create(&worker->thread, NULL, eth_fanout_worker, worker);
+    if (err != 0) {
+      fprintf(stderr, "eth_fanout_start(): ERROR en pthread_create(): %s\n",
+              strerror(err));
+      return -1;
+    }
+    worker->running = 1;
+  }
+
+  return 0;
+}
+
+
+/* int eth_fanout_stats
+ * ( eth_fanout_t * fanout, int worker, eth_fanout_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas del trabajador 'worker'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si existe el trabajador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no existe ese trabajador.
+ */
+int eth_fanout_stats
+( eth_fanout_t * fanout, int worker, eth_fanout_stats_t * stats )
+{
+  if ((fanout == NULL) || (worker < 0) || (worker >= fanout->workers_num)) {
+    fprintf(stderr, "eth_fanout_stats(): ERROR: No existe el trabajador %d\n",
+            worker);
+    return -1;
+  }
+
+  eth_fanout_stats_t * worker_stats = &fanout->workers[worker].stats;
+  stats->frames = __atomic_load_n(&worker_stats->frames, __ATOMIC_RELAXED);
+  stats->wakeups = __atomic_load_n(&worker_stats->wakeups, __ATOMIC_RELAXED);
+  stats->errors = __atomic_load_n(&worker_stats->errors, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+
+/* int eth_fanout_close ( eth_fanout_t * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función detiene los trabajadores, espera a que terminen sus hilos y
+ *   cierra sus interfaces.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cerrado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_fanout_close ( eth_fanout_t * fanout )
+{
+  if (fanout == NULL) {
+    fprintf(stderr, "eth_fanout_close(): ERROR: fanout == NULL\n");
+    return -1;
+  }
+
+  __atomic_store_n(&fanout->stop, 1, __ATOMIC_RELAXED);
+
+  int err = 0;
+  int i;
+  for (i=0; i<fanout->workers_num; i++) {
+    struct eth_fanout_worker * worker = &fanout->workers[i];
+    if (worker->running) {
+      pthread_join(worker->thread, NULL);
+    }
+    if (eth_close(worker->iface) < 0) {
+      err = -1;
+    }
+  }
+  free(fanout);
+
+  return err;
+}
@@ -2,7 +2,9 @@
 #include "ipv4.h"
 #include "ipv4_config.h"
 #include "ipv4_route_table.h"
+#include "ipv4_netlink.h"
 #include "arp.h"
+#include "net_stack_state.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -13,6 +15,10 @@
 #define IPv4_MTU 1480
 /*Para rellenar el tipo de direccion software (proto_type) del paquete ARP*/
 # define IPv4_ETH_TYPE 0x0800
+/*Aprender la MAC de los vecinos a partir de los paquetes IP que nos envían (1) o no (0)*/
+#define IPv4_ARP_LEARNING 1
+/*Tiempo máximo que ipv4_open() espera a resolver las MAC de los gateways de la tabla*/
+#define IPv4_ARP_PREWARM_TIMEOUT 1000
 
 /*Estructura de un paquete ipv4*/
 typedef struct ipv4_packet {
@@ -29,11 +35,46 @@ typedef struct ipv4_packet {
 	unsigned char ip_payload[IPv4_MTU];
 } ipv4_pkt_t;
 
-/*Como variables globales tenemos a addr y netmask para no tener que cargar el fichero de conf todo el rato*/
-ipv4_addr_t my_ipv4_addr;
-ipv4_addr_t netmask;
-ipv4_route_table_t *table;
-eth_iface_t *eth_if;
+/*Interfaz de la capa IPv4: su configuración (nombre y direcciones, la principal primero) y su interfaz Ethernet*/
+typedef struct ipv4_iface {
+	ipv4_config_iface_t conf;
+	eth_iface_t * eth_if;
+	net_stack_t * stack;	//Pila a la que pertenece, para los manejadores de sus tramas
+} ipv4_iface_t;
+
+/*Bits del hash de nuestras direcciones: 2^7 = 128 huecos, el doble de las que puede haber*/
+#define IPv4_ADDR_HASH_BITS 7
+#define IPv4_ADDR_HASH_SIZE (1 << IPv4_ADDR_HASH_BITS)
+
+/*Hueco de la tabla hash (direccionamiento abierto) de nuestras direcciones*/
+struct ipv4_local_addr {
+	ipv4_addr_t addr;
+	ipv4_iface_t * iface;	//Interfaz que la tiene (NULL = hueco libre)
+};
+
+/*Manejador de un protocolo superior ('ipv4_set_handler()')*/
+struct ipv4_handler {
+	uint8_t protocol;
+	ipv4_handler_t handler;
+	void * arg;
+};
+
+/*Estado IPv4 de una pila (ver "net_stack_state.h"): los interfaces y sus direcciones, para no tener que cargar el fichero de conf todo el rato*/
+struct ipv4_state {
+	ipv4_iface_t ifaces[IPv4_IFACES_MAX];
+	eth_iface_t * eth_ifaces[IPv4_IFACES_MAX];	//Los mismos interfaces Ethernet, para 'eth_poll()'
+	int ifaces_num;
+	struct ipv4_local_addr local_addrs[IPv4_ADDR_HASH_SIZE];
+	ipv4_route_table_t * table;
+	/*Interfaz por el que llegó el último paquete entregado, y por el que se empieza a mirar en el siguiente 'ipv4_recv()'*/
+	ipv4_iface_t * rx_iface;
+	int rx_next;
+	struct ipv4_handler handlers[IPv4_HANDLERS_MAX];	//Manejadores de los protocolos superiores
+	int handlers_num;
+	/*Temporizador del bucle de eventos para las resoluciones ARP pendientes; sólo está en marcha mientras haya alguna*/
+	int arp_timer;
+	int arp_timer_armed;
+};
 
 /* Dirección IPv4 a cero: "0.0.0.0" */
 ipv4_addr_t IPv4_ZERO_ADDR = { 0, 0, 0, 0 };
@@ -62,6 +103,116 @@ int is_multicast(ipv4_addr_t ip_addr){
 	return 0;//unicast
 }
 
+/* int ipv4_on_link(ipv4_iface_t * iface, ipv4_addr_t ip_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Indica si la ip pertenece a alguna de las subredes de 'iface' (se alcanza
+ *   por ese interfaz sin pasar por un router)
+ *
+ * VALORES DEVUELTOS:
+ * El índice de la dirección del interfaz en cuya subred está, o
+ * -1 si no está en ninguna
+ */
+static int ipv4_on_link(ipv4_iface_t * iface, ipv4_addr_t ip_addr){
+	int a;
+	for(a=0; a<iface->conf.addrs_num; a++){
+		unsigned char * addr = iface->conf.addrs[a];
+		unsigned char * mask = iface->conf.netmasks[a];
+		int i;
+		for(i=0; i<IPv4_ADDR_SIZE; i++){
+			if((ip_addr[i] & mask[i]) != (addr[i] & mask[i])){
+				break;
+			}
+		}
+		if(i == IPv4_ADDR_SIZE){
+			return a;
+		}
+	}
+	return -1;
+}
+
+/* unsigned char * ipv4_iface_src(ipv4_iface_t * iface, ipv4_addr_t next_hop);
+ *
+ * DESCRIPCIÓN:
+ *   Elige la IP origen de lo que sale por 'iface' hacia 'next_hop': la
+ *   dirección del interfaz de su misma subred o, si no hay, la principal.
+ */
+static unsigned char * ipv4_iface_src(ipv4_iface_t * iface, ipv4_addr_t next_hop){
+	int a = ipv4_on_link(iface, next_hop);
+	return iface->conf.addrs[(a < 0) ? 0 : a];
+}
+
+/* ipv4_iface_t * ipv4_iface_find(struct ipv4_state * ipv4, char * ifname);
+ *
+ * DESCRIPCIÓN:
+ *   Busca el interfaz 'ifname' (el de una ruta). Si sólo hay uno, es ése
+ *   aunque la tabla de rutas lo llame de otra forma.
+ *
+ * VALORES DEVUELTOS:
+ * El interfaz, o NULL si no es ninguno de los nuestros
+ */
+static ipv4_iface_t * ipv4_iface_find(struct ipv4_state * ipv4, char * ifname){
+	if(ipv4->ifaces_num == 1){
+		return &ipv4->ifaces[0];
+	}
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(strcmp(ipv4->ifaces[i].conf.ifname, ifname) == 0){
+			return &ipv4->ifaces[i];
+		}
+	}
+	return NULL;
+}
+
+/* Hash multiplicativo de Knuth sobre los 32 bits de la IP */
+static unsigned int ipv4_addr_hash(ipv4_addr_t addr){
+	uint32_t key;
+	memcpy(&key, addr, IPv4_ADDR_SIZE);
+	return (uint32_t) (key * 2654435761u) >> (32 - IPv4_ADDR_HASH_BITS);
+}
+
+/* ipv4_iface_t * ipv4_local_lookup(struct ipv4_state * ipv4, ipv4_addr_t addr);
+ *
+ * DESCRIPCIÓN:
+ *   Busca 'addr' entre las direcciones (principales y secundarias) de todos
+ *   nuestros interfaces.
+ *
+ * VALORES DEVUELTOS:
+ * El interfaz que la tiene, o NULL si no es nuestra
+ */
+static ipv4_iface_t * ipv4_local_lookup(struct ipv4_state * ipv4, ipv4_addr_t addr){
+	unsigned int i = ipv4_addr_hash(addr);
+	//La tabla nunca se llena, así que siempre se acaba encontrando un hueco libre
+	while(ipv4->local_addrs[i].iface != NULL){
+		if(memcmp(ipv4->local_addrs[i].addr, addr, IPv4_ADDR_SIZE) == 0){
+			return ipv4->local_addrs[i].iface;
+		}
+		i = (i + 1) & (IPv4_ADDR_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
+/* int ipv4_local_add(struct ipv4_state * ipv4, ipv4_addr_t addr, ipv4_iface_t * iface);
+ *
+ * DESCRIPCIÓN:
+ *   Añade 'addr', dirección de 'iface', a la tabla hash de nuestras direcciones.
+ *
+ * VALORES DEVUELTOS:
+ * 0 si se ha añadido, -1 si ya era de algún interfaz
+ */
+static int ipv4_local_add(struct ipv4_state * ipv4, ipv4_addr_t addr, ipv4_iface_t * iface){
+	unsigned int i = ipv4_addr_hash(addr);
+	while(ipv4->local_addrs[i].iface != NULL){
+		if(memcmp(ipv4->local_addrs[i].addr, addr, IPv4_ADDR_SIZE) == 0){
+			return -1;
+		}
+		i = (i + 1) & (IPv4_ADDR_HASH_SIZE - 1);
+	}
+	memcpy(ipv4->local_addrs[i].addr, addr, IPv4_ADDR_SIZE);
+	ipv4->local_addrs[i].iface = iface;
+	return 0;
+}
+
 
 /* void ipv4_addr_str ( ipv4_addr_t addr, char* str );
  *
@@ -160,55 +311,302 @@ uint16_t ipv4_checksum ( unsigned char * data, int len )
 }
 
 /*
- * int ipv4_open(char *config, char *rtable);
+ * int ipv4_eth_recv(struct ipv4_state * ipv4, ipv4_iface_t ** iface, mac_addr_t src_mac, pkt_view_t * view, long int timeout);
  *
  * DESCRIPCIÓN:
- *   Esta función abre una conexion IPv4 para enviar paquetes.
+ *   Espera una trama IPv4 por cualquiera de nuestros interfaces. Con uno
+ *   solo se espera directamente en él. Con varios, primero se miran (sin
+ *   esperar) las tramas que ya hayan llegado a cada uno, empezando por el
+ *   siguiente al último que entregó algo para que ninguno se quede sin
+ *   atender, y si no hay ninguna se espera en todos a la vez con 'eth_poll()'.
+ *
+ * VALOR DEVUELTO:
+ *   El tamaño de la trama ('view' queda sobre ella y 'iface' es el interfaz
+ *   por el que ha llegado), o '0' si ha expirado el timeout.
+ *
+ * ERRORES:
+ *   Devuelve -1 si hay un problema con algún interfaz.
+ */
+static int ipv4_eth_recv(struct ipv4_state * ipv4, ipv4_iface_t ** iface, mac_addr_t src_mac, pkt_view_t * view, long int timeout){
+	if(ipv4->ifaces_num == 1){
+		*iface = &ipv4->ifaces[0];
+		return eth_recv_view(ipv4->ifaces[0].eth_if, src_mac, IPv4_ETH_TYPE, view, timeout);
+	}
+
+	timerms_t timer;
+	timerms_reset(&timer, timeout);
+
+	while(1){
+		int i;
+		for(i=0; i<ipv4->ifaces_num; i++){
+			int n = (ipv4->rx_next + i) % ipv4->ifaces_num;
+			int frame_len = eth_recv_view(ipv4->ifaces[n].eth_if, src_mac, IPv4_ETH_TYPE, view, 0);
+			if(frame_len != 0){
+				ipv4->rx_next = (n + 1) % ipv4->ifaces_num;
+				*iface = &ipv4->ifaces[n];
+				return frame_len;
+			}
+		}
+
+		long int timeleft = timerms_left(&timer);
+		if(timeleft == 0){
+			return 0;
+		}
+		int ready = eth_poll(ipv4->eth_ifaces, ipv4->ifaces_num, timeleft);
+		if(ready == -1){
+			return -1;
+		}
+		if(ready == -2){
+			return 0;
+		}
+	}
+}
+
+/*
+ * void ipv4_arp_input(eth_iface_t * eth_if, mac_addr_t src_mac, unsigned char * payload, int payload_len, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Manejador de las tramas ARP de un interfaz ('arg'): las pasa a
+ *   'arp_input()' con la dirección del interfaz por la que preguntan, para
+ *   responder también por las secundarias.
+ */
+static void ipv4_arp_input(eth_iface_t * eth_if, mac_addr_t src_mac, unsigned char * payload, int payload_len, void * arg){
+	ipv4_iface_t * iface = (ipv4_iface_t *) arg;
+	unsigned char * my_addr = iface->conf.addrs[0];
+
+	if(payload_len >= ARP_MSG_SIZE){
+		arp_pkt * packet = (arp_pkt *) payload;
+		if(ipv4_local_lookup(iface->stack->ipv4, packet->dst_proto_addr) == iface){
+			my_addr = packet->dst_proto_addr;
+		}
+	}
+	arp_input(iface->stack, eth_if, src_mac, payload, payload_len, my_addr);
+}
+
+/*
+ * int ipv4_close_ifaces(struct ipv4_state * ipv4);
+ *
+ * DESCRIPCIÓN:
+ *   Cierra los interfaces Ethernet abiertos y olvida nuestras direcciones.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si se han cerrado todos, '-1' si alguno ha fallado.
+ */
+static int ipv4_close_ifaces(struct ipv4_state * ipv4){
+	int err = 0;
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(ipv4->ifaces[i].eth_if != NULL && eth_close(ipv4->ifaces[i].eth_if) < 0){
+			printf("IPV4.C --> ipv4_close() --> eth_close(): No se ha podido cerrar la interfaz %s\n", ipv4->ifaces[i].conf.ifname);
+			err = -1;
+		}
+		ipv4->ifaces[i].eth_if = NULL;
+		ipv4->eth_ifaces[i] = NULL;
+	}
+	ipv4->ifaces_num = 0;
+	ipv4->rx_iface = NULL;
+	ipv4->rx_next = 0;
+	memset(ipv4->local_addrs, 0, sizeof(ipv4->local_addrs));
+	return err;
+}
+
+/*
+ * int ipv4_state_free(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Cierra los interfaces, libera la tabla de rutas y el estado IPv4 de la
+ *   pila, que queda cerrada para IPv4. Antes olvida la caché ARP, cuyas
+ *   entradas (también las copiadas del kernel) apuntan a esos interfaces.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si se han cerrado todos los interfaces, '-1' si alguno ha fallado.
+ */
+static int ipv4_state_free(net_stack_t * stack){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	cache_init(stack);
+	int err = ipv4_close_ifaces(ipv4);
+	if(ipv4->table != NULL){
+		ipv4_route_table_free(ipv4->table);
+	}
+	free(ipv4);
+	stack->ipv4 = NULL;
+	return err;
+}
+
+/*
+ * int ipv4_open(net_stack_t * stack, char *config, char *rtable);
+ *
+ * DESCRIPCIÓN:
+ *   Esta función abre una conexion IPv4 para enviar paquetes, por todos los
+ *   interfaces configurados.
  *
  * PARÁMETROS:
- *   'config': Puntero al file donde esta guardada la configuracion
- *   'rtable': Puntero al file donde esta guardada la routing table
+ *   'config': Puntero al file donde esta guardada la configuracion (uno o
+ *             varios interfaces, ver 'ipv4_config_read_ifaces()'), o
+ *             "netlink:<interfaz>[,<interfaz>...]" para tomar las IPs y
+ *             máscaras del kernel
+ *   'rtable': Puntero al file donde esta guardada la routing table, o
+ *             "netlink" para copiar las rutas del kernel por esos interfaces.
+ *             Si algo viene del kernel, su tabla de vecinos llena la caché ARP.
  * VALOR DEVUELTO:
  *   El valor es '0' si la conexion ipv4 ha sido abierta correctamente.
  *
  * ERRORES:
  *   La función devuelve -1 si no ha podido leer el archivo de configuracion
  *	 La función devuelve -2 si no ha podido leer el archivo de la routing table
- *	 La función devuelve -3 si no ha podido abrir la interfaz de eth
+ *	 o si una ruta sale por un interfaz que no está configurado
+ *	 La función devuelve -3 si no ha podido abrir alguna interfaz de eth
  */
-int ipv4_open(char *config_file, char *table_file){
-
-	char ifname[IFACE_NAME_MAX_LENGTH];
+int ipv4_open(net_stack_t * stack, char *config_file, char *table_file){
+	struct ipv4_state * ipv4;
+	ipv4_config_iface_t confs[IPv4_IFACES_MAX];
+	int confs_num = 0;
+	int from_kernel = (strncmp(config_file, IPv4_NETLINK_PREFIX, strlen(IPv4_NETLINK_PREFIX)) == 0);
+	int i;
+
+	/*1. Abrimos el fichero configuracion y cargamos los interfaces con sus direcciones
+	     Con "netlink:<interfaz>[,<interfaz>...]" se piden las IPs y máscaras al kernel en vez de leer el fichero*/
+	if(from_kernel){
+		char ifnames[IPv4_IFACES_MAX * IFACE_NAME_MAX_LENGTH];
+		snprintf(ifnames, sizeof(ifnames), "%s", config_file + strlen(IPv4_NETLINK_PREFIX));
+		char * saveptr;
+		char * ifname;
+		for(ifname = strtok_r(ifnames, ",", &saveptr); ifname != NULL; ifname = strtok_r(NULL, ",", &saveptr)){
+			if(confs_num == IPv4_IFACES_MAX){
+				printf("IPV4.C --> ipv4_open(): Demasiados interfaces (%d como mucho)\n", IPv4_IFACES_MAX);
+				return -1;
+			}
+			ipv4_config_iface_t * conf = &confs[confs_num];
+			snprintf(conf->ifname, IFACE_NAME_MAX_LENGTH, "%s", ifname);
+			conf->addrs_num = ipv4_netlink_read_addrs(ifname, conf->addrs, conf->netmasks, IPv4_IFACE_ADDRS_MAX);
+			if(conf->addrs_num < 0){
+				printf("IPV4.C --> ipv4_open() --> ipv4_netlink_read_addrs(): No se ha podido obtener la IP del interfaz %s\n", ifname);
+				return -1;
+			}
+			confs_num++;
+		}
+		if(confs_num == 0){
+			printf("IPV4.C --> ipv4_open(): Falta el interfaz en \"%s\"\n", config_file);
+			return -1;
+		}
+	}
+	else{
+		confs_num = ipv4_config_read_ifaces( config_file, confs, IPv4_IFACES_MAX );
+		if(confs_num < 0){
+			printf("IPV4.C --> ipv4_open() --> ipv4_config_read_ifaces(): No se ha podido abrir el archivo de configuracion IPv4\n");
+			return -1;
+		}
+	}
 
-	/*1. Abrimos el fichero configuracion y lo cargamos en ifname, addr y netmask (siendo estas dos ultimas variables globales)*/
-	// int ipv4_config_read( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask );
-	if(ipv4_config_read( config_file, ifname, my_ipv4_addr, netmask )<0) {
-		printf("IPV4.C --> ipv4_open() --> ipv4_config_read(): No se ha podido abrir el archivo de configuracion IPv4\n");
+	/*2. Creamos el estado IPv4 de la pila (si ya estaba abierta, se cierra antes),
+	     guardamos los interfaces y metemos todas sus direcciones en la tabla hash*/
+	if(stack->ipv4 != NULL){
+		ipv4_close(stack);
+	}
+	ipv4 = calloc(1, sizeof(struct ipv4_state));
+	if(ipv4 == NULL){
+		printf("IPV4.C --> ipv4_open(): ERROR en calloc()\n");
 		return -1;
 	}
-
-	table = ipv4_route_table_create(); // creamos una routing table
-
-	/*2. Abrimos el fichero con la configuracion de la routing table y lo cargamos en table*/
-	if(ipv4_route_table_read ( table_file, table )<0) {
+	stack->ipv4 = ipv4;
+	for(i=0; i<confs_num; i++){
+		ipv4_iface_t * iface = &ipv4->ifaces[i];
+		iface->conf = confs[i];
+		iface->eth_if = NULL;
+		iface->stack = stack;
+		int a;
+		for(a=0; a<iface->conf.addrs_num; a++){
+			if(ipv4_local_add(ipv4, iface->conf.addrs[a], iface) < 0){
+				char addr_str[IPv4_STR_MAX_LENGTH];
+				ipv4_addr_str(iface->conf.addrs[a], addr_str);
+				printf("IPV4.C --> ipv4_open(): La IP %s está configurada dos veces\n", addr_str);
+				ipv4_state_free(stack);
+				return -1;
+			}
+		}
+	}
+	ipv4->ifaces_num = confs_num;
+
+	ipv4->table = ipv4_route_table_create(); // creamos una routing table
+
+	/*3. Abrimos el fichero con la configuracion de la routing table y lo cargamos en table
+	     Con "netlink" se copian las rutas que el kernel tiene por esos interfaces*/
+	if(strncmp(table_file, "netlink", strlen("netlink")) == 0){
+		for(i=0; i<ipv4->ifaces_num; i++){
+			if(ipv4_netlink_read_routes ( ipv4->ifaces[i].conf.ifname, ipv4->table )<0) {
+				printf("IPV4.C --> ipv4_open() --> ipv4_netlink_read_routes(): No se han podido obtener las rutas del kernel\n");
+				ipv4_state_free(stack);
+				return -2;
+			}
+		}
+		from_kernel = 1;
+	}
+	else if(ipv4_route_table_read ( table_file, ipv4->table )<0) {
 		printf("IPV4.C --> ipv4_open() --> ipv4_route_table_read(): No se ha podido abrir el archivo de routing table IPv4\n");
+		ipv4_state_free(stack);
 		return -2;
 	}
 
-	/*3. Abrimos la interfaz*/
-	eth_if = eth_open ( ifname );
+	/*4. Cada ruta tiene que salir por uno de nuestros interfaces*/
+	for(i=0; i<IPv4_ROUTE_TABLE_SIZE; i++){
+		ipv4_route_t * route = ipv4_route_table_get(ipv4->table, i);
+		if(route != NULL && ipv4_iface_find(ipv4, route->iface) == NULL){
+			printf("IPV4.C --> ipv4_open(): La ruta %d sale por %s, que no está configurado\n", i, route->iface);
+			ipv4_state_free(stack);
+			return -2;
+		}
+	}
+
+	/*5. Abrimos los interfaces*/
+	for(i=0; i<ipv4->ifaces_num; i++){
+		ipv4_iface_t * iface = &ipv4->ifaces[i];
+		iface->eth_if = eth_open ( iface->conf.ifname );
 
-	if(eth_if == NULL) {
-		printf("IPV4.C --> ipv4_open() --> eth_open(): No se ha podido abrir la interfaz eth_if\n");
-		return -3;
+		if(iface->eth_if == NULL) {
+			printf("IPV4.C --> ipv4_open() --> eth_open(): No se ha podido abrir la interfaz %s\n", iface->conf.ifname);
+			ipv4_state_free(stack);
+			return -3;
+		}
+		ipv4->eth_ifaces[i] = iface->eth_if;
+
+		/*6. Las respuestas ARP que lleguen mientras esperamos IP se procesan en arp_input(),
+		     y los paquetes IP que lleguen mientras se espera otra cosa se guardan en su cola*/
+		eth_set_handler(iface->eth_if, ARP_ETH_TYPE, ipv4_arp_input, iface);
+		eth_register(iface->eth_if, IPv4_ETH_TYPE);
+
+		/*7. Anunciamos nuestras IPs con un ARP gratuito para que los vecinos no tengan que preguntar
+		     y, si la configuración viene del kernel, copiamos también sus vecinos a la caché ARP*/
+		int a;
+		for(a=0; a<iface->conf.addrs_num; a++){
+			arp_announce(iface->eth_if, iface->conf.addrs[a]);
+		}
+		if(from_kernel){
+			ipv4_netlink_read_neighbours(stack, iface->conf.ifname, iface->eth_if);
+		}
 	}
 
-	/*4.Fiheros cargados e interfaz abierta*/
+	/*8. Resolvemos a la vez las MAC de todos los gateways, para que el primer paquete no espere al ARP*/
+	int gateways = 0;
+	for(i=0; i<IPv4_ROUTE_TABLE_SIZE; i++){
+		ipv4_route_t * route = ipv4_route_table_get(ipv4->table, i);
+		if(route != NULL && ipv4_arp_prewarm(stack, route->gateway_addr) > 0){
+			gateways++;
+		}
+	}
+	if(gateways > 0){
+		timerms_t deadline;
+		timerms_reset(&deadline, IPv4_ARP_PREWARM_TIMEOUT);
+		for(i=0; i<ipv4->ifaces_num; i++){
+			arp_pending_wait(stack, ipv4->ifaces[i].eth_if, ipv4->ifaces[i].conf.addrs[0], timerms_left(&deadline));
+		}
+	}
+
+	/*9.Fiheros cargados e interfaces abiertos*/
 	return 0;
 }
 
 /*
- * int ipv4_close();
+ * int ipv4_close(net_stack_t * stack);
  *
  * DESCRIPCIÓN:
  *   Esta función cierra una conexion IPv4.
@@ -217,29 +615,221 @@ int ipv4_open(char *config_file, char *table_file){
  *   El valor es '0' si la conexion ipv4 ha sido cerrada correctamente.
  *
  * ERRORES:
- *   La función devuelve -1 si no ha podido cerrar la interfaz eth
+ *   La función devuelve -1 si no ha podido cerrar algún interfaz eth
  */
-int ipv4_close(){
-
-	/*1. Cerramos ethernet*/
-	if(eth_close(eth_if)<0){
-		printf("IPV4.C --> ipv4_close() --> eth_close(): No se ha podido cerrar la interfaz eth_if\n");
+int ipv4_close(net_stack_t * stack){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		printf("IPV4.C --> ipv4_close(): ERROR la pila no tiene IPv4 abierto\n");
 		return -1;
 	}
 
-	/*2. Liberamos la memoria que ocupaba la tabla*/
-	ipv4_route_table_free(table);
+	/*1. Damos a las resoluciones ARP en curso la oportunidad de enviar sus paquetes*/
+	while(arp_pending_queued(stack) > 0){
+		ipv4_iface_t * iface;
+		mac_addr_t src_mac;
+		pkt_view_t view;
+		if(ipv4_eth_recv(ipv4, &iface, src_mac, &view, arp_pending_timeout(stack)) < 0){
+			break;
+		}
+		arp_pending_timers(stack);
+	}
+
+	/*2. Olvidamos la caché ARP, cuyas entradas apuntan a los interfaces que vamos a cerrar,
+	     cerramos ethernet y liberamos la memoria que ocupaban la tabla y el estado*/
+	int err = ipv4_state_free(stack);
+
+	/*3. Devolvemos 0 si se han cerrado las intefaces eth correctamente*/
+	return err;
+}
 
-	/*3. Devolvemos 0 si se hacerrado la intefaz eth correctamente*/
+
+/*
+ * int ipv4_arp_prewarm(net_stack_t * stack, ipv4_addr_t next_hop);
+ *
+ * DESCRIPCIÓN:
+ *   Lanza (sin esperar) la resolución ARP de un siguiente salto de alguna de
+ *   nuestras subredes, por el interfaz que llega a ella, para que su MAC esté
+ *   en la caché cuando haya que enviarle algo. La respuesta se procesa al
+ *   recibir en 'ipv4_recv()'.
+ *
+ * PARÁMETROS:
+ *   'next_hop': IP del gateway o siguiente salto.
+ *
+ * VALOR DEVUELTO:
+ *   '1' si se ha lanzado (o ya estaba en curso) la resolución, '0' si no hace
+ *   falta: ya está en la caché, es 0.0.0.0, es nuestra IP o no es de nuestras subredes.
+ *
+ * ERRORES:
+ *   Devuelve -1 si la IP no puede resolverse ahora (ver 'arp_resolve_async()').
+ */
+int ipv4_arp_prewarm(net_stack_t * stack, ipv4_addr_t next_hop){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		return -1;
+	}
+	if(memcmp(next_hop, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE) == 0
+	   || ipv4_local_lookup(ipv4, next_hop) != NULL){
+		return 0;
+	}
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		int a = ipv4_on_link(&ipv4->ifaces[i], next_hop);
+		if(a >= 0){
+			mac_addr_t mac;
+			return arp_resolve_async(stack, ipv4->ifaces[i].eth_if, next_hop, ipv4->ifaces[i].conf.addrs[a], mac, 0, NULL, 0);
+		}
+	}
 	return 0;
 }
 
+/*
+ * int ipv4_filter_port(net_stack_t * stack, uint8_t protocol, uint16_t port);
+ *
+ * DESCRIPCIÓN:
+ *   Pide al kernel que de los paquetes IPv4 sólo nos entregue los del
+ *   'protocol' indicado con puerto destino 'port'.
+ */
+int ipv4_filter_port(net_stack_t * stack, uint8_t protocol, uint16_t port){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_filter_port(): ERROR iface == NULL\n");
+		return -1;
+	}
+	int err = 0;
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(eth_filter_ipv4_port(ipv4->ifaces[i].eth_if, protocol, port) < 0){
+			err = -1;
+		}
+	}
+	return err;
+}
+
+/*
+ * void ipv4_header_fill(ipv4_pkt_t * send_pkt, ipv4_addr_t dst_addr, uint8_t protocol, int payload_len);
+ *
+ * DESCRIPCIÓN:
+ *   Rellena la cabecera de un paquete IPv4 hacia 'dst_addr', salvo la IP
+ *   origen y el checksum, que dependen del interfaz de salida (ver
+ *   'ipv4_header_set_src()'). No toca los datos.
+ */
+static void ipv4_header_fill(ipv4_pkt_t * send_pkt, ipv4_addr_t dst_addr, uint8_t protocol, int payload_len){
+	/*1. Rellenamos el paquete que vamos a mandar */
+	//send_pkt->version_ihl = 0b01000101;
+	send_pkt->version_ihl = 0x45;						//0x45
+	send_pkt->type = 0;
+	send_pkt->length = htons(payload_len + IPv4_HEADER_SIZE);	//RFC recomienda 576
+	send_pkt->id = 0;
+	//send_pkt->flags_offset = htons(0b0100000000000000); 			// 0 obligatorio, 1 dont fragment, 0 last fragment, 0's offset;
+	send_pkt->flags_offset = htons(0x4000);
+	if(is_multicast(dst_addr)){
+		send_pkt->ttl = 1; 	     // Max linux TTL MULTICAST
+	}else{
+		send_pkt->ttl = 64; 	     // Max linux TTL UNICAST
+	}
+	send_pkt->proto = protocol;
+	send_pkt->checksum = 0;										//Ponemos el checksum a 0, lo introducimos luego
+	memcpy(send_pkt->ip_addr_dst, dst_addr, IPv4_ADDR_SIZE);		//Copiamos la IP detino
+}
+
+/*
+ * void ipv4_header_set_src(ipv4_pkt_t * send_pkt, ipv4_addr_t src_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Completa la cabecera de 'ipv4_header_fill()' con la IP origen y el
+ *   checksum.
+ */
+static void ipv4_header_set_src(ipv4_pkt_t * send_pkt, ipv4_addr_t src_addr){
+	memcpy(send_pkt->ip_addr_src, src_addr, IPv4_ADDR_SIZE); //Copiamos mi IP
+	send_pkt->checksum = 0;
+
+	int checksum = ipv4_checksum((unsigned char*) send_pkt ,IPv4_HEADER_SIZE);	//Hacemos el checksum del paquete
+	send_pkt->checksum = htons(checksum);										//Introducimos el checksum
+}
+
+/*
+ * void ipv4_group_mac(ipv4_addr_t dst_addr, mac_addr_t dst_mac_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Calcula la MAC destino de la difusión o de un grupo multicast:
+ *   ff:ff:ff:ff:ff:ff, o 01:00:5e seguido de los 23 bits bajos de la IP.
+ */
+static void ipv4_group_mac(ipv4_addr_t dst_addr, mac_addr_t dst_mac_addr){
+	if(!is_multicast(dst_addr)){
+		memset(dst_mac_addr, 0xFF, MAC_ADDR_SIZE);
+		return;
+	}
+	mac_addr_t multicast_addr = {0x01,0x00,0x5E,0x00,0x00,0x00};
+	memcpy(dst_mac_addr,multicast_addr,MAC_ADDR_SIZE);
+	dst_mac_addr[3] = dst_addr[1] & 0x7f;
+	dst_mac_addr[4] = dst_addr[2];
+	dst_mac_addr[5] = dst_addr[3];
+}
+
+/*
+ * int ipv4_is_flood(struct ipv4_state * ipv4, ipv4_addr_t dst_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Indica si 'dst_addr' es la difusión o un grupo multicast sin ruta por
+ *   ninguno de nuestros interfaces: entonces sale por todos.
+ */
+static int ipv4_is_flood(struct ipv4_state * ipv4, ipv4_addr_t dst_addr){
+	if(memcmp(dst_addr,broadcast_ip,IPv4_ADDR_SIZE)!=0 && !is_multicast(dst_addr)){
+		return 0;
+	}
+	ipv4_route_t * route = ipv4_route_table_lookup(ipv4->table, dst_addr);
+	return (route == NULL || ipv4_iface_find(ipv4, route->iface) == NULL);
+}
+
+/*
+ * int ipv4_send_flood(struct ipv4_state * ipv4, ipv4_addr_t dst_addr, pkt_buf_t * bufs[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Envía 'count' paquetes de difusión o multicast sin ruta (con la cabecera
+ *   IPv4 ya delante) por todos los interfaces, cada vez con la IP origen
+ *   del interfaz por el que salen. Así, por ejemplo, los anuncios RIP a
+ *   224.0.0.9 llegan a todos los enlaces de un router.
+ *
+ * VALOR DEVUELTO:
+ *   0 si han salido por todos los interfaces, -2 si por alguno no.
+ */
+static int ipv4_send_flood(struct ipv4_state * ipv4, ipv4_addr_t dst_addr, pkt_buf_t * bufs[], int count){
+	mac_addr_t dst_mac;
+	ipv4_group_mac(dst_addr, dst_mac);
+
+	unsigned char * ip_data[count];
+	int ip_len[count];
+	int j;
+	for(j=0; j<count; j++){
+		ip_data[j] = bufs[j]->data;
+		ip_len[j] = bufs[j]->len;
+	}
+
+	int result = 0;
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		ipv4_iface_t * iface = &ipv4->ifaces[i];
+		for(j=0; j<count; j++){
+			/* La cabecera Ethernet de la vuelta anterior se descarta */
+			bufs[j]->data = ip_data[j];
+			bufs[j]->len = ip_len[j];
+			ipv4_header_set_src((ipv4_pkt_t *) ip_data[j], ipv4_iface_src(iface, dst_addr));
+		}
+		if(eth_send_buf_batch(iface->eth_if, dst_mac, IPv4_ETH_TYPE, bufs, count) < count){
+			printf("IPV4.C --> ipv4_send_flood() --> eth_send_buf_batch(): No se pueden enviar todos los paquetes por %s\n", iface->conf.ifname);
+			result = -2;
+		}
+	}
+	return result;
+}
 
 /*
- * int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len );
+ * int ipv4_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len );
  *
  * DESCRIPCIÓN:
- *   Esta función envia un paquete IPv4.
+ *   Esta función envia un paquete IPv4. La difusión y el multicast sin ruta
+ *   salen por todos los interfaces, cada uno con su IP origen.
  *
  * PARÁMETROS:
  *   'dst_addr': Ip destino
@@ -248,60 +838,68 @@ int ipv4_close(){
  * 	 'payload_len': Tamaño de los datos a enviar
  *
  * VALOR DEVUELTO:
- * 		Devuelve 0 si el paquete ha sido creado, arp_resolve y enviado por ethernet correctamente
+ * 		Devuelve 0 si el paquete ha sido creado y enviado por ethernet correctamente, o si
+ * 		ha quedado encolado a la espera de resolver la MAC del siguiente salto.
  *
  *
  * ERRORES:
- *		Devuelve -1, si hay problemas con arp_resolve
+ *		Devuelve -1, si hay problemas con arp_resolve_async
  *		Devuelve -2, si hay problemas con eth_send
  */
-int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len ){
-
-	ipv4_pkt_t send_pkt;
+int ipv4_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, int payload_len ){
+
+	//Única copia de los datos: las cabeceras se añaden delante en el propio buffer
+	pkt_buf_t buf;
+	pkt_buf_init(&buf);
+	unsigned char * data = pkt_buf_put(&buf, payload_len);
+	if(data == NULL){
+		printf("IPV4.C --> ipv4_send(): Paquete demasiado grande (%d bytes)\n", payload_len);
+		return -1;
+	}
+	memcpy(data, payload, payload_len);
 
-	/* Estructura del paquete IP (COMENTADO)
-	uint8_t version_ihl ---> version+ihl= 8bits
-		ihl=5 para eth
-		version=4 ipv4
-			01000101
-	uint8_t type;---> QoS a 0
-	uint8_t length;
-	uint16_t id;
-	uint16_t flags_offset; ---> flags+offset= 16 bits
-	uint8_t ttl;
-	uint8_t proto;       ---> protocol
-	uint16_t checksum;
-	ipv4_addr_t ip_addr_src;
-	ipv4_addr_t ip_addr_dst;
-	unsigned char ip_payload[IPv4_MTU];
+	return ipv4_send_buf(stack, dst_addr, protocol, &buf);
+}
 
-	*/
+/*
+ * int ipv4_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * buf);
+ *
+ * DESCRIPCIÓN:
+ *   Envia un paquete IPv4 con los datos de 'buf', escribiendo la cabecera
+ *   delante de ellos en el espacio reservado.
+ *
+ * PARÁMETROS:
+ *   'dst_addr': Ip destino
+ *   'protocol': Protocolo utilizado
+ *	 'buf': Datos a enviar, con espacio reservado para las cabeceras
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve 0 si el paquete ha sido enviado por ethernet correctamente, o si
+ * 		ha quedado encolado a la espera de resolver la MAC del siguiente salto.
+ *
+ * ERRORES:
+ *		Devuelve -1, si hay problemas con arp_resolve_async o con 'buf'
+ *		Devuelve -2, si hay problemas con eth_send_buf
+ */
+int ipv4_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * buf){
 
-	/*1. Rellenamos el paquete que vamos a mandar */
-	//send_pkt.version_ihl = 0b01000101;
-	send_pkt.version_ihl = 0x45;						//0x45
-	send_pkt.type = 0;
-	send_pkt.length = htons(payload_len + IPv4_HEADER_SIZE);	//RFC recomienda 576
-	send_pkt.id = 0;
-	//send_pkt.flags_offset = htons(0b0100000000000000); 			// 0 obligatorio, 1 dont fragment, 0 last fragment, 0's offset;
-	send_pkt.flags_offset = htons(0x4000);
-	if(is_multicast(dst_addr)){
-		send_pkt.ttl = 1; 	     // Max linux TTL MULTICAST
-	}else{
-		send_pkt.ttl = 64; 	     // Max linux TTL UNICAST
+	int payload_len = buf->len;
+	ipv4_pkt_t * send_pkt = (ipv4_pkt_t *) pkt_buf_push(buf, IPv4_HEADER_SIZE);
+	if(send_pkt == NULL){
+		printf("IPV4.C --> ipv4_send_buf(): Sin espacio para la cabecera\n");
+		return -1;
 	}
-	send_pkt.proto = protocol;
-	send_pkt.checksum = 0;										//Ponemos el checksum a 0, lo introducimos luego
-	memcpy(send_pkt.ip_addr_src, my_ipv4_addr, IPv4_ADDR_SIZE); //Copiamos mi IP
-	memcpy(send_pkt.ip_addr_dst, dst_addr, IPv4_ADDR_SIZE);		//Copiamos la IP detino
-	memcpy(send_pkt.ip_payload, payload, payload_len);			//Copiamos la carga(datos)
+	ipv4_header_fill(send_pkt, dst_addr, protocol, payload_len);
 
-	int checksum = ipv4_checksum((unsigned char*) &send_pkt ,IPv4_HEADER_SIZE);	//Hacemos el checksum del paquete
-	send_pkt.checksum = htons(checksum);										//Introducimos el checksum
+	if(stack->ipv4 != NULL && ipv4_is_flood(stack->ipv4, dst_addr)){
+		return ipv4_send_flood(stack->ipv4, dst_addr, &buf, 1);
+	}
 
 	mac_addr_t next_hop_mac;
-	int err = ip_resolve(eth_if,my_ipv4_addr,dst_addr,next_hop_mac);
+	eth_iface_t * out_if;
+	int err = ip_resolve(stack, dst_addr,&out_if,next_hop_mac,buf->data, buf->len);
 	if (err==-1) return -1;
+	if (err==1) return 0; // Encolado, se enviará al llegar el ARP REPLY
 
 	/*4. Mandamos el paquete por ethernet*/
 
@@ -309,18 +907,438 @@ int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, in
 	ipv4_addr_str(dst_addr, ip_str);
 	printf(" ENVIANDO A: %s\n",ip_str);
 
-	int eth_res = eth_send ( eth_if, next_hop_mac, IPv4_ETH_TYPE, (unsigned char *)&send_pkt, payload_len + IPv4_HEADER_SIZE );
+	int eth_res = eth_send_buf ( out_if, next_hop_mac, IPv4_ETH_TYPE, buf );
 
 	if(eth_res <0){
-		printf("IPV4.C --> ipv4_send() --> eth_send(): No se pede enviar paquete\n");
+		printf("IPV4.C --> ipv4_send_buf() --> eth_send_buf(): No se pede enviar paquete\n");
 		return -2;
 	}
 
 	return 0;
 }
 
+
 /*
- * int ipv4_recv(ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout );
+ * int ipv4_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, unsigned char * payloads[], int payload_lens[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'ipv4_send()' pero para 'count' paquetes al mismo destino:
+ *   copia los datos de cada uno una vez a un 'pkt_buf_t' y los envía con
+ *   'ipv4_send_buf_batch()'.
+ *
+ * VALOR DEVUELTO:
+ * 		Igual que 'ipv4_send_buf_batch()': el número de paquetes enviados o
+ * 		encolados a la espera de resolver la MAC del siguiente salto.
+ *
+ * ERRORES:
+ *		Igual que 'ipv4_send_buf_batch()'. Devuelve también -1 sin memoria.
+ */
+int ipv4_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, unsigned char * payloads[], int payload_lens[], int count){
+
+	if(count <= 0){
+		return 0;
+	}
+	int i;
+	for(i=0; i<count; i++){
+		if(payload_lens[i] < 0 || payload_lens[i] > IPv4_MTU){
+			printf("IPV4.C --> ipv4_send_batch(): Paquete %d demasiado grande (%d bytes)\n", i, payload_lens[i]);
+			return -1;
+		}
+	}
+
+	pkt_buf_t * bufs = malloc(count * sizeof(pkt_buf_t));
+	pkt_buf_t ** buf_ptrs = malloc(count * sizeof(pkt_buf_t *));
+	if(bufs == NULL || buf_ptrs == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_send_batch(): ERROR sin memoria para %d paquetes\n", count);
+		free(bufs);
+		free(buf_ptrs);
+		return -1;
+	}
+	for(i=0; i<count; i++){
+		pkt_buf_init(&bufs[i]);
+		memcpy(pkt_buf_put(&bufs[i], payload_lens[i]), payloads[i], payload_lens[i]);
+		buf_ptrs[i] = &bufs[i];
+	}
+
+	int result = ipv4_send_buf_batch(stack, dst_addr, protocol, buf_ptrs, count);
+
+	free(bufs);
+	free(buf_ptrs);
+	return result;
+}
+
+/*
+ * int ipv4_send_buf_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * bufs[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Envía 'count' paquetes IPv4 al mismo destino con los datos ya en 'bufs':
+ *   la cabecera IPv4 se escribe delante de los datos de cada uno, el
+ *   siguiente salto se resuelve una sola vez y todos salen juntos con
+ *   'eth_send_buf_batch()', sin copiar los datos.
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve el número de paquetes enviados, o encolados a la espera de
+ * 		resolver la MAC del siguiente salto. Si es menor que 'count' el resto
+ * 		se ha descartado (por ejemplo, por tener llena la cola del vecino).
+ *
+ * ERRORES:
+ *		Devuelve -1, si hay problemas con arp_resolve_async, si algún paquete
+ *		supera la MTU IPv4 o no tiene espacio reservado, o si no se ha podido
+ *		enviar ninguno
+ *		Devuelve -2, si una difusión no ha salido por todos los interfaces
+ */
+int ipv4_send_buf_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint8_t protocol, pkt_buf_t * bufs[], int count){
+
+	if(count <= 0){
+		return 0;
+	}
+	int i;
+	for(i=0; i<count; i++){
+		if(bufs[i]->len > IPv4_MTU){
+			printf("IPV4.C --> ipv4_send_buf_batch(): Paquete %d demasiado grande (%d bytes)\n", i, bufs[i]->len);
+			return -1;
+		}
+		if(bufs[i]->data - bufs[i]->buffer < IPv4_HEADER_SIZE){
+			printf("IPV4.C --> ipv4_send_buf_batch(): Sin espacio para la cabecera\n");
+			return -1;
+		}
+	}
+	for(i=0; i<count; i++){
+		int payload_len = bufs[i]->len;
+		ipv4_pkt_t * send_pkt = (ipv4_pkt_t *) pkt_buf_push(bufs[i], IPv4_HEADER_SIZE);
+		ipv4_header_fill(send_pkt, dst_addr, protocol, payload_len);
+	}
+
+	if(stack->ipv4 != NULL && ipv4_is_flood(stack->ipv4, dst_addr)){
+		return (ipv4_send_flood(stack->ipv4, dst_addr, bufs, count) == 0) ? count : -2;
+	}
+
+	/* El siguiente salto es el mismo para todos: se resuelve con el primero */
+	mac_addr_t next_hop_mac;
+	eth_iface_t * out_if;
+	int err = ip_resolve(stack, dst_addr,&out_if,next_hop_mac,bufs[0]->data, bufs[0]->len);
+	if(err == -1){
+		return -1;
+	}
+	if(err == 1){
+		/* El primero ha quedado encolado, el resto espera también al ARP REPLY.
+		   Con la cola del vecino llena los siguientes se descartan */
+		int queued = 1;
+		for(i=1; i<count; i++){
+			if(ip_resolve(stack, dst_addr,&out_if,next_hop_mac,bufs[i]->data, bufs[i]->len) == 1){
+				queued++;
+			}
+		}
+		if(queued < count){
+			printf("IPV4.C --> ipv4_send_buf_batch(): Encolados %d de %d paquetes a la espera del ARP REPLY\n", queued, count);
+		}
+		return queued;
+	}
+
+	ipv4_pkt_t * first = (ipv4_pkt_t *) bufs[0]->data;
+	for(i=1; i<count; i++){
+		ipv4_header_set_src((ipv4_pkt_t *) bufs[i]->data, first->ip_addr_src);
+	}
+	int sent = eth_send_buf_batch(out_if, next_hop_mac, IPv4_ETH_TYPE, bufs, count);
+	if(sent < count){
+		printf("IPV4.C --> ipv4_send_buf_batch() --> eth_send_buf_batch(): No se pueden enviar todos los paquetes\n");
+		return (sent > 0) ? sent : -1;
+	}
+
+	return count;
+}
+
+/*
+ * int ipv4_packet_len(ipv4_pkt_t * recv_packet, int len);
+ *
+ * DESCRIPCIÓN:
+ *   Comprueba la cabecera de un paquete recibido en 'len' bytes: versión 4,
+ *   cabecera de 20 bytes (sin opciones, que no sabemos tratar) y una
+ *   longitud total que cabe en lo recibido.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud total del paquete, sin el relleno Ethernet que pueda haber
+ *   tras él, o -1 si el paquete no es válido.
+ */
+static int ipv4_packet_len(ipv4_pkt_t * recv_packet, int len){
+	if(len < IPv4_HEADER_SIZE || recv_packet->version_ihl != 0x45){
+		return -1;
+	}
+	int total_len = ntohs(recv_packet->length);
+	if(total_len < IPv4_HEADER_SIZE || total_len > len){
+		return -1;
+	}
+	return total_len;
+}
+
+/*
+ * int ipv4_dispatch(struct ipv4_state * ipv4, ipv4_pkt_t * recv_packet, int packet_len);
+ *
+ * DESCRIPCIÓN:
+ *   Entrega un paquete dirigido a nosotros al manejador de su protocolo.
+ *
+ * VALOR DEVUELTO:
+ *   1 si algún manejador lo ha recibido, 0 si nadie lo espera.
+ */
+static int ipv4_dispatch(struct ipv4_state * ipv4, ipv4_pkt_t * recv_packet, int packet_len){
+	int i;
+	for(i=0; i<ipv4->handlers_num; i++){
+		if(ipv4->handlers[i].protocol == recv_packet->proto){
+			ipv4->handlers[i].handler(recv_packet->ip_addr_src, recv_packet->ip_payload,
+			                          packet_len - IPv4_HEADER_SIZE, ipv4->handlers[i].arg);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * void ipv4_input(eth_iface_t * eth_if, mac_addr_t src_mac, unsigned char * payload, int payload_len, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Manejador de las tramas IPv4 de un interfaz ('arg', ver
+ *   'eth_set_handler()'): hace las mismas comprobaciones que 'ipv4_recv()' y
+ *   entrega el paquete a su protocolo.
+ */
+static void ipv4_input(eth_iface_t * eth_if, mac_addr_t src_mac, unsigned char * payload, int payload_len, void * arg){
+	ipv4_iface_t * iface = (ipv4_iface_t *) arg;
+	net_stack_t * stack = iface->stack;
+	struct ipv4_state * ipv4 = stack->ipv4;
+	ipv4_pkt_t * recv_packet = (ipv4_pkt_t *) payload;
+	payload_len = ipv4_packet_len(recv_packet, payload_len);
+	if(payload_len < 0){
+		return;
+	}
+	int is_my_ip = (ipv4_local_lookup(ipv4, recv_packet->ip_addr_dst) != NULL);
+
+#if IPv4_ARP_LEARNING
+	if(is_my_ip && ipv4_on_link(iface, recv_packet->ip_addr_src) >= 0){
+		arp_learn(stack, eth_if, recv_packet->ip_addr_src, src_mac);
+	}
+#endif
+
+	if(is_my_ip || is_multicast(recv_packet->ip_addr_dst)){
+		ipv4->rx_iface = iface;
+		ipv4_dispatch(ipv4, recv_packet, payload_len);
+	}
+}
+
+/*
+ * int ipv4_set_handler(net_stack_t * stack, uint8_t protocol, ipv4_handler_t handler, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Registra 'handler' para los paquetes del 'protocol' indicado. Un
+ *   'handler' 'NULL' elimina el manejador.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el manejador se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o ya hay IPv4_HANDLERS_MAX
+ *   manejadores.
+ */
+int ipv4_set_handler(net_stack_t * stack, uint8_t protocol, ipv4_handler_t handler, void * arg){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_set_handler(): ERROR iface == NULL\n");
+		return -1;
+	}
+
+	int i;
+	for(i=0; i<ipv4->handlers_num; i++){
+		if(ipv4->handlers[i].protocol == protocol){
+			break;
+		}
+	}
+
+	if(handler == NULL){
+		if(i < ipv4->handlers_num){
+			ipv4->handlers_num--;
+			ipv4->handlers[i] = ipv4->handlers[ipv4->handlers_num];
+		}
+	}else{
+		if(i == IPv4_HANDLERS_MAX){
+			fprintf(stderr, "IPV4.C --> ipv4_set_handler(): ERROR demasiados manejadores\n");
+			return -1;
+		}
+		ipv4->handlers[i].protocol = protocol;
+		ipv4->handlers[i].handler = handler;
+		ipv4->handlers[i].arg = arg;
+		if(i == ipv4->handlers_num){
+			ipv4->handlers_num++;
+		}
+	}
+
+	//Con algún manejador, las tramas IPv4 que no espera 'ipv4_recv()' se procesan al llegar
+	int err = 0;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(eth_set_handler(ipv4->ifaces[i].eth_if, IPv4_ETH_TYPE, (ipv4->handlers_num > 0) ? ipv4_input : NULL, &ipv4->ifaces[i]) < 0){
+			err = -1;
+		}
+	}
+	return err;
+}
+
+/*
+ * void ipv4_arp_timer(reactor_t * reactor, int timer, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Temporizador del bucle de eventos que reintenta (o abandona) las
+ *   resoluciones ARP pendientes de la pila 'arg'. Es de un solo disparo: lo
+ *   vuelve a programar 'ipv4_reactor_prepare()' si sigue quedando alguna.
+ */
+static void ipv4_arp_timer(reactor_t * reactor, int timer, void * arg){
+	net_stack_t * stack = (net_stack_t *) arg;
+	if(stack->ipv4 == NULL){
+		return;
+	}
+	stack->ipv4->arp_timer_armed = 0;
+	arp_pending_timers(stack);
+}
+
+/*
+ * void ipv4_reactor_prepare(reactor_t * reactor, int fd, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Se llama antes de cada espera del bucle de eventos: vacía los anillos de
+ *   transmisión de la pila 'arg' y programa el temporizador ARP si hay
+ *   resoluciones pendientes y no estaba ya en marcha.
+ */
+static void ipv4_reactor_prepare(reactor_t * reactor, int fd, void * arg){
+	net_stack_t * stack = (net_stack_t *) arg;
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		return;
+	}
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		eth_flush(ipv4->ifaces[i].eth_if);
+	}
+	if(!ipv4->arp_timer_armed){
+		long int timeout = arp_pending_timeout(stack);
+		if(timeout >= 0 && reactor_set_timer(reactor, ipv4->arp_timer, timeout, 0) == 0){
+			ipv4->arp_timer_armed = 1;
+		}
+	}
+}
+
+/*
+ * int ipv4_reactor_add(net_stack_t * stack, reactor_t * reactor);
+ *
+ * DESCRIPCIÓN:
+ *   Registra los interfaces en el bucle de eventos 'reactor', junto a un
+ *   temporizador que reintenta las resoluciones ARP pendientes (parado
+ *   mientras no haya ninguna) y una función que vacía los anillos de
+ *   transmisión al final de cada vuelta.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o falla el registro.
+ */
+int ipv4_reactor_add(net_stack_t * stack, reactor_t * reactor){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_reactor_add(): ERROR iface == NULL\n");
+		return -1;
+	}
+	int timer = reactor_add_timer(reactor, -1, 0, ipv4_arp_timer, stack);
+	if(timer < 0){
+		return -1;
+	}
+	ipv4->arp_timer = timer;
+	ipv4->arp_timer_armed = 0;
+	if(reactor_add_prepare(reactor, ipv4_reactor_prepare, stack) < 0){
+		reactor_del_timer(reactor, timer);
+		return -1;
+	}
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(eth_reactor_add(reactor, ipv4->ifaces[i].eth_if) < 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * int ipv4_set_timestamps(net_stack_t * stack, int enable);
+ *
+ * DESCRIPCIÓN:
+ *   Activa (o desactiva) la marca de tiempo de llegada de los paquetes.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o no se puede cambiar.
+ */
+int ipv4_set_timestamps(net_stack_t * stack, int enable){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_set_timestamps(): ERROR iface == NULL\n");
+		return -1;
+	}
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(eth_set_timestamps(ipv4->ifaces[i].eth_if, enable) < 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * int ipv4_set_capture(net_stack_t * stack, eth_capture_t * capture);
+ *
+ * DESCRIPCIÓN:
+ *   Captura en 'capture' las tramas de todos los interfaces, o deja de
+ *   capturarlas si es 'NULL'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o no se puede cambiar.
+ */
+int ipv4_set_capture(net_stack_t * stack, eth_capture_t * capture){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_set_capture(): ERROR iface == NULL\n");
+		return -1;
+	}
+	int i;
+	for(i=0; i<ipv4->ifaces_num; i++){
+		if(eth_set_capture(ipv4->ifaces[i].eth_if, capture) < 0){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * int ipv4_get_timestamp(net_stack_t * stack, struct timespec * stamp);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve en 'stamp' el instante de llegada del último paquete entregado.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el paquete tiene marca de tiempo.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no la tiene.
+ */
+int ipv4_get_timestamp(net_stack_t * stack, struct timespec * stamp){
+	struct ipv4_state * ipv4 = stack->ipv4;
+	if(ipv4 == NULL || ipv4->rx_iface == NULL){
+		return -1;
+	}
+	return eth_get_timestamp(ipv4->rx_iface->eth_if, stamp);
+}
+
+/*
+ * int ipv4_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout );
  *
  * DESCRIPCIÓN:
  *   Esta función recibe un paquete IPv4.
@@ -338,19 +1356,59 @@ int ipv4_send(ipv4_addr_t dst_addr,uint8_t protocol, unsigned char * payload, in
  * ERRORES:
  *	 devuelve '-1' si hay un problema con la interfaz
  */
-int ipv4_recv(ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout ){
+int ipv4_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, int buffer_len, long int timeout ){
+
+	pkt_view_t view;
+	int payload_len = ipv4_recv_view(stack, src_addr, protocol, &view, timeout);
+	if(payload_len <= 0){
+		return payload_len;
+	}
+
+	if(payload_len > buffer_len){ //Si la payload es mayor que el buffer, copiamos lo que quepa
+		memcpy(buffer, pkt_view_data(&view), buffer_len);
+	}
+	else{							//Sino copiamos los datos
+		memcpy(buffer, pkt_view_data(&view), payload_len);
+	}
+
+	return payload_len; //Tamaño de los datos
+}
+
+/*
+ * int ipv4_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, pkt_view_t * view, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Recibe un paquete IPv4 sin copiarlo: 'view' queda sobre la trama
+ *   recibida por 'eth_recv_view()', con la cabecera IPv4 consumida. Se
+ *   recibe por todos los interfaces a la vez.
+ *
+ * PARÁMETROS:
+ *   'src_addr': IP origen del paquete recibido
+ *   'protocol': Protocolo utilizado
+ *	 'view': Vista donde se devuelve el paquete
+ *	 'timeout': timer que indica el tiempo que estaremos escuchando a recibir paquetes
+ *
+ * VALOR DEVUELTO:
+ *   El tamaño de los datos del paquete, o '0' si ha expirado el timeout.
+ *
+ * ERRORES:
+ *	 devuelve '-1' si hay un problema con la interfaz
+ */
+int ipv4_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint8_t protocol, pkt_view_t * view, long int timeout ){
+	struct ipv4_state * ipv4 = stack->ipv4;
 
 	//Declaramos variables
 	int payload_len = 0;
 	ipv4_pkt_t * recv_packet = NULL;
+	ipv4_iface_t * iface = NULL;
 	mac_addr_t src_mac;
 	timerms_t timer;
 
 	int is_my_proto;
 	int is_my_ip;
 
-	if(eth_if == NULL){
-		fprintf(stderr, "IPV4.C --> ipv4_recv(): ERROR iface == NULL\n");
+	if(ipv4 == NULL){
+		fprintf(stderr, "IPV4.C --> ipv4_recv_view(): ERROR iface == NULL\n");
 		return -1;
 	}
 
@@ -359,19 +1417,50 @@ int ipv4_recv(ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, in
 	do{//Estará activo mientras el protocolo coincida con el deseado y la ip destino sea la nuestra
 
 		long int timeleft = timerms_left(&timer);//Calcula el tiempo restante del timer
-		unsigned char ip_buffer[ETH_MTU];
 
-		//Nos ponemos a escuchar en ethernet
-		payload_len = eth_recv(eth_if,src_mac,IPv4_ETH_TYPE, ip_buffer,ETH_MTU,timeleft);
-		if(payload_len==0) {
-			return 0;// no se ha recibido nada
+		//Si hay resoluciones ARP en curso, nos despertamos a tiempo para reintentarlas
+		long int arp_timeleft = arp_pending_timeout(stack);
+		if(arp_timeleft >= 0 && (timeleft < 0 || arp_timeleft < timeleft)){
+			timeleft = arp_timeleft;
 		}
 
-		//Casting de los datos recibidos a la estructura de un paquete IP
-    	recv_packet = (ipv4_pkt_t *) ip_buffer;
+		//Nos ponemos a escuchar en todos los interfaces ethernet
+		payload_len = ipv4_eth_recv(ipv4, &iface,src_mac,view,timeleft);
+		if(payload_len < 0) {
+			return -1;
+		}
+		if(payload_len==0) {
+			arp_pending_timers(stack);
+			if(timerms_left(&timer) == 0) {
+				return 0;// no se ha recibido nada
+			}
+			is_my_proto = 0;
+			continue;
+		}
+		//Casting de los datos recibidos a la estructura de un paquete IP, sin copiarlos
+		recv_packet = (ipv4_pkt_t *) pkt_view_data(view);
+		payload_len = ipv4_packet_len(recv_packet, payload_len);
+		if(payload_len < 0) {
+			is_my_proto = 0;
+			continue;
+		}
 		//printf("Recibo datagrama IP. Proto: %d\n", recv_packet->proto);
 		is_my_proto = (recv_packet->proto==protocol);
-		is_my_ip = (memcmp(recv_packet->ip_addr_dst, my_ipv4_addr, IPv4_ADDR_SIZE)==0);
+		//Cualquiera de nuestras direcciones (principales o secundarias) se busca en la tabla hash
+		is_my_ip = (ipv4_local_lookup(ipv4, recv_packet->ip_addr_dst) != NULL);
+
+#if IPv4_ARP_LEARNING
+		//Si el paquete es para nosotros y viene de la subred del interfaz, ya sabemos la MAC del emisor
+		if(is_my_ip && ipv4_on_link(iface, recv_packet->ip_addr_src) >= 0){
+			arp_learn(stack, iface->eth_if, recv_packet->ip_addr_src, src_mac);
+		}
+#endif
+
+		//Los paquetes de otros protocolos van a su manejador, si lo tienen
+		if(!is_my_proto && (is_my_ip || is_multicast(recv_packet->ip_addr_dst))){
+			ipv4->rx_iface = iface;
+			ipv4_dispatch(ipv4, recv_packet, payload_len);
+		}
 
 		/*if(is_multicast(recv_packet->ip_addr_dst)){
 			char ip_str[IPv4_STR_MAX_LENGTH];  //Ip origen
@@ -383,98 +1472,105 @@ int ipv4_recv(ipv4_addr_t src_addr, uint8_t protocol, unsigned char * buffer, in
 
 	//Guardamos la Ip origen del paquete recibido
 	memcpy(src_addr, recv_packet->ip_addr_src,IPv4_ADDR_SIZE);
+	ipv4->rx_iface = iface;
 
-	if(payload_len - IPv4_HEADER_SIZE > buffer_len){ //Si la payload es mayor que el buffer, copiamos lo que quepa
-		memcpy(buffer, recv_packet->ip_payload,buffer_len);
-	}
-	else{											//Sino copiamos los datos
-		memcpy(buffer, recv_packet->ip_payload,payload_len - IPv4_HEADER_SIZE);
-	}
+	//La vista pasa a los datos del paquete, sin el relleno Ethernet que pueda haber tras ellos
+	view->l3_offset = view->data_offset;
+	pkt_view_pull(view, IPv4_HEADER_SIZE);
+	pkt_view_trim(view, payload_len - IPv4_HEADER_SIZE);
 
-	return payload_len - IPv4_HEADER_SIZE; //Tamaño de los datos
+	return view->data_len; //Tamaño de los datos
 }
 
 /*
- * int ip_resolve(eth_iface_t * eth_if, ipv4_addr_t src_ip_addr, ipv4_addr_t dst_ip_addr,mac_addr_t dst_mac_addr){
+ * int ip_resolve(net_stack_t * stack, ipv4_addr_t dst_ip_addr, eth_iface_t ** eth_if, mac_addr_t dst_mac_addr,
+ *                unsigned char * packet, int packet_len);
  *
  * DESCRIPCIÓN:
  *   Esta función se encarga del routing y de encontrar la mac asociada a la IP del siguiente salto.
+ *	 La tabla de rutas decide el interfaz de salida; la difusión y el multicast sin ruta
+ *	 salen por el primer interfaz ('ipv4_send()' los envía antes por todos). La IP origen del paquete es la dirección de ese interfaz
+ *	 de la subred del siguiente salto (o su principal), y se escribe en 'packet' con el checksum.
  *	 Distingue si es una IP multicast o no:
  *		Si es multicast: Calcula la MAC multicast
  *		Si no es multicast: Busca en la tabla de rutas
  *			Si el gateway es 0.0.0.0 -> Envia a la MAC de destino.
  *			Si el gateway no es 0.0.0.0 -> Envia a la MAC del siguiente salto
+ *	 Si la MAC del siguiente salto no está en la caché ARP del interfaz no se espera a
+ *	 resolverla: el paquete se encola en el vecino y se enviará cuando llegue el ARP REPLY.
  *
  * PARÁMETROS:
- *   'eth_if': Interfaz que usamos
- *   'src_ip_addr': Nuetra IP
  *	 'dst_ip_addr': IP a donde queremos enviar el datagrama
- * 	 'mac_addr_t': MAC que queremos averiguar
+ *   'eth_if': Donde se devuelve el interfaz de salida
+ * 	 'dst_mac_addr': MAC que queremos averiguar
+ *	 'packet': Paquete IPv4 con la cabecera rellena salvo la IP origen y el checksum
+ *	 'packet_len': Longitud del paquete
  *
  * VALOR DEVUELTO:
- *   payload_len - IPv4_HEADER_SIZE = tamaño de los datos de info sin el header de IPv4
+ *   0 si se conoce la MAC del siguiente salto (se copia en 'dst_mac_addr')
+ *   1 si el paquete se ha encolado a la espera de la respuesta ARP
  *
  * ERRORES:
- *	 devuelve '-1' si ARP no ha sido capaz de encontrar dicha IP
- */
-int ip_resolve(eth_iface_t * eth_if, ipv4_addr_t src_ip_addr, ipv4_addr_t dst_ip_addr,mac_addr_t dst_mac_addr){
-
-	/*CASO 1: es broadcast*/
-	if(memcmp(dst_ip_addr,broadcast_ip,IPv4_ADDR_SIZE)==0){
-     //printf("Broadcast addr detected\n");
-     mac_addr_t broadcast_addr = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-     memcpy(dst_mac_addr,broadcast_addr,MAC_ADDR_SIZE);
-     return 0;
-   }
-
-	/*CASO 2: es multicast*/
-   if(dst_ip_addr[0]>=224 && dst_ip_addr[0]<=239){
-     /*
-     una MAC multicast es: 0x01,0x00,0x5E,0..[23 bytes de la IP multicast]
-     mac = multicast_addr OR (ip_addr AND multicast_mask)
-      OR -> Pone a 1 los bits a 1
-      AND -> Pone a 0 los bist a 0
-      ipv4_addr_t multicast_mask = {0x00,01111111,0xFF,0xFF};
-     */
-     mac_addr_t multicast_addr = {0x01,0x00,0x5E,0x00,0x00,0x00};
-     //mac_addr[4] = ip_addr[2] & 0b01111111;
-     memcpy(dst_mac_addr,multicast_addr,MAC_ADDR_SIZE);
-     dst_mac_addr[3] = dst_ip_addr[1] & 0x7f;
-     dst_mac_addr[4] = dst_ip_addr[2];
-     dst_mac_addr[5] = dst_ip_addr[3];
-     /*char mac_str[MAC_STR_LENGTH];
-     mac_addr_str(mac_addr, mac_str);
-     /printf("IP Multicast, MAC: %s\n",mac_str);*/
-     return 0;
-   }
-
-   /*CASO 3. es unicast*/
-   //buscamos la mejor ruta
-	ipv4_route_t * prefered_route;
-	prefered_route = ipv4_route_table_lookup ( table, dst_ip_addr );
+ *	 devuelve '-1' si no hay ruta o si el paquete se ha tenido que descartar
+ */
+int ip_resolve(net_stack_t * stack, ipv4_addr_t dst_ip_addr, eth_iface_t ** eth_if, mac_addr_t dst_mac_addr,
+               unsigned char * packet, int packet_len){
+	struct ipv4_state * ipv4 = stack->ipv4;
 
-	// Si la gateway es 0.0.0.0 -> Busca la IP destino
-	if(memcmp(prefered_route->gateway_addr, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE)==0){
-		int arp_res = arp_resolve(eth_if,dst_ip_addr,src_ip_addr,dst_mac_addr);
-		if(arp_res < 0){
+	if(ipv4 == NULL){
+		printf("IPV4.C --> ip_resolve(): ERROR iface == NULL\n");
+		return -1;
+	}
+
+	int is_broadcast = (memcmp(dst_ip_addr,broadcast_ip,IPv4_ADDR_SIZE)==0);
+	int is_mcast = is_multicast(dst_ip_addr);
+
+	//buscamos la mejor ruta, que dice por qué interfaz sale
+	ipv4_route_t * prefered_route;
+	prefered_route = ipv4_route_table_lookup ( ipv4->table, dst_ip_addr );
+	ipv4_iface_t * iface = NULL;
+	if(prefered_route != NULL){
+		iface = ipv4_iface_find(ipv4, prefered_route->iface);
+	}
+	if(iface == NULL){
+		if(!is_broadcast && !is_mcast){
 			char addr_str[IPv4_STR_MAX_LENGTH];
 			ipv4_addr_str(dst_ip_addr, addr_str);
-			printf("IPV4.C --> ipv4_send() --> arp_resolve(): Imposible resolver la IP %s\n",addr_str);
+			printf("IPV4.C --> ip_resolve(): No hay ruta hacia %s\n",addr_str);
 			return -1;
 		}
+		iface = &ipv4->ifaces[0];
 	}
+	*eth_if = iface->eth_if;
 
+	// Si la gateway es 0.0.0.0 -> Busca la IP destino
 	// Si existe una gateway valida, envia el paquete a su MAC. La gateway reenviará el paquete al PC destino
-	else{
-		int arp_res = arp_resolve(eth_if,prefered_route->gateway_addr,src_ip_addr,dst_mac_addr);
-		if(arp_res < 0){
-			char addr_str[IPv4_STR_MAX_LENGTH];
-			ipv4_addr_str(prefered_route->gateway_addr, addr_str);
-			printf("IPV4.C --> ipv4_send() --> arp_resolve(): Imposible resolver la IP %s\n",addr_str);
-			return -1;
-		}
+	unsigned char * next_hop = dst_ip_addr;
+	if(!is_broadcast && !is_mcast && memcmp(prefered_route->gateway_addr, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE)!=0){
+		next_hop = prefered_route->gateway_addr;
 	}
-	
-	return 0;
+
+	ipv4_pkt_t * ip_packet = (ipv4_pkt_t *) packet;
+	ipv4_header_set_src(ip_packet, ipv4_iface_src(iface, next_hop));
+
+	/*CASO 1: es broadcast o multicast*/
+	if(is_broadcast || is_mcast){
+		ipv4_group_mac(dst_ip_addr, dst_mac_addr);
+		return 0;
+	}
+
+   /*CASO 2. es unicast*/
+   //Aprovechamos para reintentar (o dar por perdidas) las resoluciones ARP vencidas
+   arp_pending_timers(stack);
+
+	int arp_res = arp_resolve_async(stack, iface->eth_if,next_hop,ip_packet->ip_addr_src,dst_mac_addr,IPv4_ETH_TYPE,packet,packet_len);
+	if(arp_res < 0){
+		char addr_str[IPv4_STR_MAX_LENGTH];
+		ipv4_addr_str(next_hop, addr_str);
+		printf("IPV4.C --> ipv4_send() --> arp_resolve_async(): Descartado paquete hacia %s\n",addr_str);
+		return -1;
+	}
+
+	return arp_res;
 
 }
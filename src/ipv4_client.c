@@ -67,7 +67,11 @@ int main ( int argc, char * argv[] )
 	}
 
 	/* Abriendo IP */
-	err = ipv4_open(argv[1], argv[2]);
+	net_stack_t * stack = net_stack_create();
+	if(stack == NULL){
+		exit(-1);
+	}
+	err = ipv4_open(stack, argv[1], argv[2]);
 	if(err < 0){
 		fprintf(stderr, "%s: ERROR en ipv4_open\n", myself);
 		exit(-1);
@@ -77,7 +81,7 @@ int main ( int argc, char * argv[] )
 	printf("Enviando %d bytes al Servidor IP (%s):\n",payload_len, destination_ip);
 	print_pkt(payload, payload_len, 0);
 
-	err = ipv4_send(destination_ip,type, payload, payload_len);
+	err = ipv4_send(stack, destination_ip,type, payload, payload_len);
 	if (err < 0) {
 		fprintf(stderr, "%s: ERROR en ipv4_send()\n", myself);
 		exit(-1);
@@ -87,7 +91,7 @@ int main ( int argc, char * argv[] )
 	long int timeout = 2000;
 	ipv4_addr_t src_addr;
 
-	len = ipv4_recv(src_addr, type, buffer, ETH_MTU, timeout );
+	len = ipv4_recv(stack, src_addr, type, buffer, ETH_MTU, timeout );
 
 	// Si ipv4_recv nos devuelve <0 es que ha habido algun error
 	if (len < 0) {
@@ -109,7 +113,8 @@ int main ( int argc, char * argv[] )
 	/* Cerrar interfaz Ethernet */
 	printf("Cerrando interfaz IP.\n");
 
-	ipv4_close();
+	ipv4_close(stack);
+	net_stack_destroy(stack);
 
 	return 0;
 }
@@ -16,6 +16,9 @@
  *   sido reservada previamente. Deben reservarse al menos 'IFACE_NAME_MAX_LENGTH'
  *   bytes para almacenar el nombre del interfaz.
  *
+ *   Si el fichero configura varios interfaces (ver 'ipv4_config_read_ifaces()')
+ *   se devuelve el primero, con su dirección principal.
+ *
  * PARÁMETROS:
  *    'filename': Nombre del fichero de configuración que se desea leer.
  *      'ifname': Variable donde se copiará el nombre de la interfaz leida del
@@ -35,6 +38,50 @@
  */
 int ipv4_config_read
 ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask )
+{
+  ipv4_config_iface_t ifaces[IPv4_IFACES_MAX];
+
+  /* Init output parameters, just in case */
+  ifname[0] = '\0';
+  memset(addr, 0x00, IPv4_ADDR_SIZE);
+  memset(netmask, 0x00, IPv4_ADDR_SIZE);
+
+  if (ipv4_config_read_ifaces(filename, ifaces, IPv4_IFACES_MAX) < 0) {
+    return -1;
+  }
+
+  strcpy(ifname, ifaces[0].ifname);
+  memcpy(addr, ifaces[0].addrs[0], IPv4_ADDR_SIZE);
+  memcpy(netmask, ifaces[0].netmasks[0], IPv4_ADDR_SIZE);
+
+  return 0;
+}
+
+
+/* int ipv4_config_read_ifaces
+ * ( char* filename, ipv4_config_iface_t ifaces[], int max );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee el fichero de configuración IPv4 especificado, que
+ *   puede configurar varios interfaces. Cada línea 'Interface' empieza un
+ *   interfaz nuevo, y las líneas 'IPv4Address' y 'SubnetMask' que la siguen
+ *   son suyas: la primera dirección es la principal y el resto secundarias.
+ *   La máscara n-ésima de un interfaz es la de su dirección n-ésima.
+ *
+ * PARÁMETROS:
+ *    'filename': Nombre del fichero de configuración que se desea leer.
+ *      'ifaces': Array donde se copiarán los interfaces leidos.
+ *         'max': Número de elementos del array 'ifaces'.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de interfaces leidos.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error al leer el
+ *   fichero de configuración.
+ */
+int ipv4_config_read_ifaces
+( char* filename, ipv4_config_iface_t ifaces[], int max )
 {
   int err = 0;
 
@@ -45,15 +92,16 @@ int ipv4_config_read
             filename, strerror(errno));
     return -1;
   }
-  
-  int ifname_read = 0;
-  int addr_read = 0;
-  int netmask_read = 0;
+
+  /* Interface being read. Addresses found before the first 'Interface' line
+     belong to it too */
+  int ifaces_num = 1;
+  ipv4_config_iface_t * iface = &ifaces[0];
+  int netmasks_num[max];
 
   /* Init output parameters, just in case */
-  ifname[0] = '\0';
-  memset(addr, 0x00, IPv4_ADDR_SIZE);
-  memset(netmask, 0x00, IPv4_ADDR_SIZE);
+  memset(ifaces, 0x00, sizeof(ipv4_config_iface_t) * max);
+  memset(netmasks_num, 0x00, sizeof(netmasks_num));
 
   int linenum = 0;
   char line_buf[1024];
@@ -89,24 +137,61 @@ int ipv4_config_read
 
       /* Parse read name/value pair */
       if (strcasecmp(name_str, "Interface") == 0) {
-        strcpy(ifname, value_str);
-        ifname_read = 1;
         err = 0;
-      } else if (strcasecmp(name_str, "IPv4Address") == 0) {
-        err = ipv4_str_addr(value_str, addr);
-        if (err != 0) {
-          fprintf(stderr, "%s:%d: Invalid 'IPv4Address' value: '%s'\n", 
+        int i;
+        for (i=0; i<ifaces_num; i++) {
+          if (strcmp(ifaces[i].ifname, value_str) == 0) {
+            fprintf(stderr, "%s:%d: Interface '%s' configured twice\n",
+                    filename, linenum, value_str);
+            err = -1;
+          }
+        }
+        if (strlen(value_str) >= IFACE_NAME_MAX_LENGTH) {
+          fprintf(stderr, "%s:%d: Interface name too long: '%s'\n",
                   filename, linenum, value_str);
+          err = -1;
+        }
+        if ((err == 0) && (iface->ifname[0] != '\0')) {
+          if (ifaces_num == max) {
+            fprintf(stderr, "%s:%d: Too many interfaces (%d max)\n",
+                    filename, linenum, max);
+            err = -1;
+          } else {
+            iface = &ifaces[ifaces_num];
+            ifaces_num++;
+          }
+        }
+        if (err == 0) {
+          strcpy(iface->ifname, value_str);
+        }
+      } else if (strcasecmp(name_str, "IPv4Address") == 0) {
+        if (iface->addrs_num == IPv4_IFACE_ADDRS_MAX) {
+          fprintf(stderr, "%s:%d: Too many 'IPv4Address' values (%d max)\n",
+                  filename, linenum, IPv4_IFACE_ADDRS_MAX);
+          err = -1;
         } else {
-          addr_read = 1;
+          err = ipv4_str_addr(value_str, iface->addrs[iface->addrs_num]);
+          if (err != 0) {
+            fprintf(stderr, "%s:%d: Invalid 'IPv4Address' value: '%s'\n", 
+                    filename, linenum, value_str);
+          } else {
+            iface->addrs_num++;
+          }
         }
       } else if (strcasecmp(name_str, "SubnetMask") == 0) {
-        err = ipv4_str_addr(value_str, netmask);
-        if (err != 0) {
-          fprintf(stderr, "%s:%d: Invalid 'SubnetMask' value: '%s'\n",
-                  filename, linenum, value_str);
+        int * mask_num = &netmasks_num[iface - ifaces];
+        if (*mask_num == IPv4_IFACE_ADDRS_MAX) {
+          fprintf(stderr, "%s:%d: Too many 'SubnetMask' values (%d max)\n",
+                  filename, linenum, IPv4_IFACE_ADDRS_MAX);
+          err = -1;
         } else {
-          netmask_read = 1;
+          err = ipv4_str_addr(value_str, iface->netmasks[*mask_num]);
+          if (err != 0) {
+            fprintf(stderr, "%s:%d: Invalid 'SubnetMask' value: '%s'\n",
+                    filename, linenum, value_str);
+          } else {
+            (*mask_num)++;
+          }
         }
       } else {
         fprintf(stderr, "%s:%d: Unknown variable: '%s'\n", 
@@ -117,22 +202,29 @@ int ipv4_config_read
   }
 
   if (err == 0) {
-    if (ifname_read == 0) {
-      fprintf(stderr, "%s: Missing 'Interface' value\n", filename);
-      err = -1;
-    }
-    if (addr_read == 0) {
-      fprintf(stderr, "%s: Missing 'IPv4Address' value\n", filename);
-      err = -1;
-    }
-    if (netmask_read == 0) {
-      fprintf(stderr, "%s: Missing 'SubnetMask' value\n", filename);
-      err = -1;
+    int i;
+    for (i=0; i<ifaces_num; i++) {
+      if (ifaces[i].ifname[0] == '\0') {
+        fprintf(stderr, "%s: Missing 'Interface' value\n", filename);
+        err = -1;
+      }
+      if (ifaces[i].addrs_num == 0) {
+        fprintf(stderr, "%s: Missing 'IPv4Address' value\n", filename);
+        err = -1;
+      }
+      if (netmasks_num[i] != ifaces[i].addrs_num) {
+        fprintf(stderr, "%s: Missing 'SubnetMask' value\n", filename);
+        err = -1;
+      }
     }
   }
 
   /* Close IPv4 Configuration file */
   fclose(conf_file);
 
-  return err;
+  if (err < 0) {
+    return -1;
+  }
+
+  return ifaces_num;
 }
@@ -0,0 +1,398 @@
+#include "ipv4_netlink.h"
+#include "arp.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+/* Size of the buffer used to receive each part of a netlink dump */
+#define NETLINK_BUFFER_SIZE 32768
+
+/* Called for every message of a dump. Returns 0 to go on, -1 to abort */
+typedef int (*netlink_cb_t) ( struct nlmsghdr * msg, int ifindex, void * arg );
+
+/* Result of the RTM_GETADDR dump */
+struct netlink_addrs {
+  int found;
+  int max;
+  ipv4_addr_t * addrs;
+  ipv4_addr_t * netmasks;
+};
+
+/* Arguments of the RTM_GETROUTE dump */
+struct netlink_routes {
+  ipv4_route_table_t * table;
+  char * ifname;
+  int count;
+};
+
+/* Arguments of the RTM_GETNEIGH dump */
+struct netlink_neighbours {
+  net_stack_t * stack;
+  eth_iface_t * iface;
+  int count;
+};
+
+
+/* Converts a prefix length (0-32) into a netmask */
+static void prefix_to_mask ( int prefix_len, ipv4_addr_t mask )
+{
+  int i;
+  for (i=0; i<IPv4_ADDR_SIZE; i++) {
+    int bits = prefix_len - (i * 8);
+    if (bits >= 8) {
+      mask[i] = 0xFF;
+    } else if (bits > 0) {
+      mask[i] = (unsigned char) (0xFF << (8 - bits));
+    } else {
+      mask[i] = 0x00;
+    }
+  }
+}
+
+
+/* int netlink_dump ( uint16_t type, int hdr_len, char * ifname,
+ *                    netlink_cb_t callback, void * arg );
+ *
+ * Sends a NLM_F_DUMP request of the given type for AF_INET and calls
+ * 'callback' for every message of the answer. 'hdr_len' is the size of the
+ * family header (ifaddrmsg, rtmsg, ndmsg), all of which start with the
+ * address family.
+ */
+static int netlink_dump
+( uint16_t type, int hdr_len, char * ifname, netlink_cb_t callback, void * arg )
+{
+  int ifindex = if_nametoindex(ifname);
+  if (ifindex == 0) {
+    fprintf(stderr, "netlink: Unknown interface \"%s\": %s\n",
+            ifname, strerror(errno));
+    return -1;
+  }
+
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd == -1) {
+    fprintf(stderr, "netlink: Cannot create netlink socket: %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  /* Build request: netlink header + zeroed family header */
+  struct {
+    struct nlmsghdr hdr;
+    unsigned char family_hdr[64];
+  } req;
+  memset(&req, 0, sizeof(req));
+  req.hdr.nlmsg_len = NLMSG_LENGTH(hdr_len);
+  req.hdr.nlmsg_type = type;
+  req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  req.hdr.nlmsg_seq = 1;
+  req.family_hdr[0] = AF_INET;
+
+  if (send(fd, &req, req.hdr.nlmsg_len, 0) == -1) {
+    fprintf(stderr, "netlink: Cannot send dump request: %s\n",
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  /* Not static: several stacks may dump from different threads */
+  unsigned char buffer[NETLINK_BUFFER_SIZE];
+  int err = 0;
+  int done = 0;
+  while (!done && (err == 0)) {
+    int len = recv(fd, buffer, sizeof(buffer), 0);
+    if (len == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "netlink: Cannot receive dump: %s\n", strerror(errno));
+      err = -1;
+      break;
+    }
+
+    struct nlmsghdr * msg = (struct nlmsghdr *) buffer;
+    for (; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+      if (msg->nlmsg_type == NLMSG_DONE) {
+        done = 1;
+        break;
+      }
+      if (msg->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr * nlerr = (struct nlmsgerr *) NLMSG_DATA(msg);
+        fprintf(stderr, "netlink: Dump request failed: %s\n",
+                strerror(-nlerr->error));
+        err = -1;
+        break;
+      }
+      if (callback(msg, ifindex, arg) < 0) {
+        err = -1;
+        break;
+      }
+    }
+  }
+
+  close(fd);
+  return err;
+}
+
+
+/* RTM_NEWADDR callback: keeps the first 'max' addresses of the interface,
+   primary first (the kernel dumps them in that order) */
+static int addr_cb ( struct nlmsghdr * msg, int ifindex, void * arg )
+{
+  struct netlink_addrs * result = (struct netlink_addrs *) arg;
+
+  if (msg->nlmsg_type != RTM_NEWADDR) {
+    return 0;
+  }
+  struct ifaddrmsg * ifa = (struct ifaddrmsg *) NLMSG_DATA(msg);
+  if ((ifa->ifa_family != AF_INET) || ((int) ifa->ifa_index != ifindex)) {
+    return 0;
+  }
+  /* No room for more addresses */
+  if (result->found == result->max) {
+    return 0;
+  }
+
+  int has_addr = 0;
+  int has_local = 0;
+  struct rtattr * rta = IFA_RTA(ifa);
+  int rta_len = IFA_PAYLOAD(msg);
+  for (; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+    /* IFA_LOCAL is our address; IFA_ADDRESS is the peer on p2p links */
+    if ((rta->rta_type == IFA_LOCAL) ||
+        ((rta->rta_type == IFA_ADDRESS) && (has_local == 0))) {
+      memcpy(result->addrs[result->found], RTA_DATA(rta), IPv4_ADDR_SIZE);
+      prefix_to_mask(ifa->ifa_prefixlen, result->netmasks[result->found]);
+      has_local |= (rta->rta_type == IFA_LOCAL);
+      has_addr = 1;
+    }
+  }
+  /* Count it once the whole message has been parsed, and only if it
+     carried an address */
+  if (has_addr) {
+    result->found++;
+  }
+  return 0;
+}
+
+
+/* RTM_NEWROUTE callback: adds unicast routes of the main table via 'ifindex' */
+static int route_cb ( struct nlmsghdr * msg, int ifindex, void * arg )
+{
+  struct netlink_routes * routes = (struct netlink_routes *) arg;
+
+  if (msg->nlmsg_type != RTM_NEWROUTE) {
+    return 0;
+  }
+  struct rtmsg * rtm = (struct rtmsg *) NLMSG_DATA(msg);
+  if ((rtm->rtm_family != AF_INET) || (rtm->rtm_table != RT_TABLE_MAIN) ||
+      (rtm->rtm_type != RTN_UNICAST)) {
+    return 0;
+  }
+
+  ipv4_addr_t subnet;
+  ipv4_addr_t mask;
+  ipv4_addr_t gw;
+  memset(subnet, 0, IPv4_ADDR_SIZE);
+  memset(gw, 0, IPv4_ADDR_SIZE);
+  prefix_to_mask(rtm->rtm_dst_len, mask);
+  int oif = -1;
+
+  struct rtattr * rta = RTM_RTA(rtm);
+  int rta_len = RTM_PAYLOAD(msg);
+  for (; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+    switch (rta->rta_type) {
+    case RTA_DST:
+      memcpy(subnet, RTA_DATA(rta), IPv4_ADDR_SIZE);
+      break;
+    case RTA_GATEWAY:
+      memcpy(gw, RTA_DATA(rta), IPv4_ADDR_SIZE);
+      break;
+    case RTA_OIF:
+      oif = *((int *) RTA_DATA(rta));
+      break;
+    }
+  }
+  if (oif != ifindex) {
+    return 0;
+  }
+
+  ipv4_route_t * route = ipv4_route_create(subnet, mask, routes->ifname, gw);
+  if (route == NULL) {
+    return -1;
+  }
+  if (ipv4_route_table_add(routes->table, route) < 0) {
+    fprintf(stderr, "netlink: Route table is full\n");
+    ipv4_route_free(route);
+    return -1;
+  }
+  routes->count++;
+  return 0;
+}
+
+
+/* RTM_NEWNEIGH callback: learns valid IPv4 neighbours of 'ifindex' */
+static int neigh_cb ( struct nlmsghdr * msg, int ifindex, void * arg )
+{
+  struct netlink_neighbours * neighbours = (struct netlink_neighbours *) arg;
+
+  if (msg->nlmsg_type != RTM_NEWNEIGH) {
+    return 0;
+  }
+  struct ndmsg * ndm = (struct ndmsg *) NLMSG_DATA(msg);
+  if ((ndm->ndm_family != AF_INET) || (ndm->ndm_ifindex != ifindex)) {
+    return 0;
+  }
+  if ((ndm->ndm_state & (NUD_REACHABLE | NUD_STALE | NUD_DELAY |
+                         NUD_PROBE | NUD_PERMANENT)) == 0) {
+    return 0;
+  }
+
+  unsigned char * ip_addr = NULL;
+  unsigned char * mac_addr = NULL;
+
+  struct rtattr * rta = (struct rtattr *) ((char *) ndm + NLMSG_ALIGN(sizeof(struct ndmsg)));
+  int rta_len = msg->nlmsg_len - NLMSG_LENGTH(sizeof(struct ndmsg));
+  for (; RTA_OK(rta, rta_len); rta = RTA_NEXT(rta, rta_len)) {
+    if ((rta->rta_type == NDA_DST) && (RTA_PAYLOAD(rta) == IPv4_ADDR_SIZE)) {
+      ip_addr = RTA_DATA(rta);
+    } else if ((rta->rta_type == NDA_LLADDR) && (RTA_PAYLOAD(rta) == MAC_ADDR_SIZE)) {
+      mac_addr = RTA_DATA(rta);
+    }
+  }
+
+  if ((ip_addr != NULL) && (mac_addr != NULL)) {
+    arp_learn(neighbours->stack, neighbours->iface, ip_addr, mac_addr);
+    neighbours->count++;
+  }
+  return 0;
+}
+
+
+/* int ipv4_netlink_read_addr
+ * ( char* ifname, ipv4_addr_t addr, ipv4_addr_t netmask );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETADDR por rtnetlink) la primera
+ *   dirección IPv4 configurada en el interfaz 'ifname' y su máscara.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve '0' si se ha obtenido la dirección.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta o el interfaz no tiene
+ *   ninguna dirección IPv4.
+ */
+int ipv4_netlink_read_addr
+( char* ifname, ipv4_addr_t addr, ipv4_addr_t netmask )
+{
+  ipv4_addr_t addrs[1];
+  ipv4_addr_t netmasks[1];
+
+  if (ipv4_netlink_read_addrs(ifname, addrs, netmasks, 1) < 0) {
+    return -1;
+  }
+
+  memcpy(addr, addrs[0], IPv4_ADDR_SIZE);
+  memcpy(netmask, netmasks[0], IPv4_ADDR_SIZE);
+  return 0;
+}
+
+
+/* int ipv4_netlink_read_addrs
+ * ( char* ifname, ipv4_addr_t addrs[], ipv4_addr_t netmasks[], int max );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETADDR) hasta 'max' direcciones IPv4
+ *   del interfaz 'ifname', la primaria primero, con sus máscaras.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de direcciones obtenidas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta o el interfaz no tiene
+ *   ninguna dirección IPv4.
+ */
+int ipv4_netlink_read_addrs
+( char* ifname, ipv4_addr_t addrs[], ipv4_addr_t netmasks[], int max )
+{
+  struct netlink_addrs result;
+  result.found = 0;
+  result.max = max;
+  result.addrs = addrs;
+  result.netmasks = netmasks;
+
+  if (netlink_dump(RTM_GETADDR, sizeof(struct ifaddrmsg), ifname,
+                   addr_cb, &result) < 0) {
+    return -1;
+  }
+  if (!result.found) {
+    fprintf(stderr, "netlink: Interface \"%s\" has no IPv4 address\n", ifname);
+    return -1;
+  }
+
+  return result.found;
+}
+
+
+/* int ipv4_netlink_read_routes ( char* ifname, ipv4_route_table_t * table );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETROUTE) las rutas IPv4 unicast de la
+ *   tabla principal que salen por 'ifname' y las añade a 'table'.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de rutas añadidas a la tabla.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta.
+ */
+int ipv4_netlink_read_routes ( char* ifname, ipv4_route_table_t * table )
+{
+  struct netlink_routes routes;
+  routes.table = table;
+  routes.ifname = ifname;
+  routes.count = 0;
+
+  if (netlink_dump(RTM_GETROUTE, sizeof(struct rtmsg), ifname,
+                   route_cb, &routes) < 0) {
+    return -1;
+  }
+  return routes.count;
+}
+
+
+/* int ipv4_netlink_read_neighbours ( net_stack_t * stack, char* ifname,
+ *                                    eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función pide al kernel (RTM_GETNEIGH) su tabla de vecinos IPv4 del
+ *   interfaz 'ifname' y guarda las entradas válidas en la caché ARP de
+ *   'iface' de la pila 'stack'.
+ *
+ * VALOR DEVUELTO:
+ *   La función devuelve el número de vecinos añadidos a la caché ARP.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si falla la consulta.
+ */
+int ipv4_netlink_read_neighbours ( net_stack_t * stack, char* ifname,
+                                   eth_iface_t * iface )
+{
+  struct netlink_neighbours neighbours;
+  neighbours.stack = stack;
+  neighbours.iface = iface;
+  neighbours.count = 0;
+
+  if (netlink_dump(RTM_GETNEIGH, sizeof(struct ndmsg), ifname,
+                   neigh_cb, &neighbours) < 0) {
+    return -1;
+  }
+  return neighbours.count;
+}
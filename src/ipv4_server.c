@@ -45,7 +45,11 @@ int main ( int argc, char * argv[] )
   uint8_t type = (uint8_t) type_int;
 
   /* Abriendo IP */
-  int err = ipv4_open(argv[1], argv[2]);
+  net_stack_t * stack = net_stack_create();
+  if(stack == NULL){
+    exit(-1);
+  }
+  int err = ipv4_open(stack, argv[1], argv[2]);
   if(err < 0){
     fprintf(stderr, "%s: ERROR en ipv4_open\n", myself);
     exit(-1);
@@ -61,7 +65,7 @@ int main ( int argc, char * argv[] )
     long int timeout = -1;
 
     printf("Escuchando tramas IP (tipo=0x%04x) ...\n", type);
-    int payload_len = ipv4_recv(src_addr, type, buffer, ETH_MTU, timeout );
+    int payload_len = ipv4_recv(stack, src_addr, type, buffer, ETH_MTU, timeout );
     if (payload_len == -1) {
       fprintf(stderr, "%s: ERROR en ipv4_recv()\n", myself);
       exit(-1);
@@ -77,7 +81,7 @@ int main ( int argc, char * argv[] )
     printf("Enviando %d bytes al Cliente IP (%s):\n",payload_len, src_addr_str);
     print_pkt(buffer, payload_len, 0);
 
-    int len = ipv4_send(src_addr,type, buffer, payload_len);
+    int len = ipv4_send(stack, src_addr,type, buffer, payload_len);
     if (len == -1) {
       fprintf(stderr, "%s: ERROR en ipv4_send()\n", myself);
     }
@@ -86,7 +90,8 @@ int main ( int argc, char * argv[] )
   /* Cerrar interfaz Ethernet */
   printf("Cerrando interfaz IP.\n");
 
-  ipv4_close();
+  ipv4_close(stack);
+  net_stack_destroy(stack);
 
   return 0;
 }
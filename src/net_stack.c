@@ -0,0 +1,60 @@
+#include "net_stack_state.h"
+#include "arp.h"
+#include "ipv4.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+
+/* net_stack_t * net_stack_create ();
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una pila vacía, con la caché ARP vacía y sin ningún
+ *   interfaz abierto.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la pila.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+net_stack_t * net_stack_create ()
+{
+  net_stack_t * stack = calloc(1, sizeof(net_stack_t));
+  if (stack == NULL) {
+    fprintf(stderr, "net_stack_create(): ERROR en calloc()\n");
+    return NULL;
+  }
+
+  if (arp_init(stack) < 0) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+
+
+/* void net_stack_destroy ( net_stack_t * stack );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cierra las capas que sigan abiertas y libera la pila.
+ *
+ * PARÁMETROS:
+ *   'stack': Manejador de la pila.
+ */
+void net_stack_destroy ( net_stack_t * stack )
+{
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->ipv4 != NULL) {
+    ipv4_close(stack);
+  }
+  /* El estado UDP no tiene recursos propios ('udp_close()' lo libera) */
+  free(stack->udp);
+  arp_close(stack);
+
+  free(stack);
+}
@@ -0,0 +1,135 @@
+#include "pkt.h"
+
+#include <stdlib.h>
+
+/* void pkt_view_init
+ * ( pkt_view_t * view, unsigned char * frame, int frame_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicializa 'view' sobre la trama completa 'frame', sin
+ *   ninguna cabecera procesada todavía.
+ */
+void pkt_view_init ( pkt_view_t * view, unsigned char * frame, int frame_len )
+{
+  view->frame = frame;
+  view->frame_len = frame_len;
+  view->l3_offset = -1;
+  view->l4_offset = -1;
+  view->data_offset = 0;
+  view->data_len = frame_len;
+  view->stamp.tv_sec = 0;
+  view->stamp.tv_nsec = 0;
+}
+
+
+/* unsigned char * pkt_view_data ( pkt_view_t * view );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve un puntero a los datos de la capa actual, dentro
+ *   de la trama.
+ */
+unsigned char * pkt_view_data ( pkt_view_t * view )
+{
+  return view->frame + view->data_offset;
+}
+
+
+/* unsigned char * pkt_view_pull ( pkt_view_t * view, int header_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función consume una cabecera de 'header_len' bytes al comienzo de
+ *   los datos de la capa actual.
+ *
+ * VALOR DEVUELTO:
+ *   Un puntero a la cabecera consumida.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si los datos son más cortos que la cabecera.
+ */
+unsigned char * pkt_view_pull ( pkt_view_t * view, int header_len )
+{
+  if (view->data_len < header_len) {
+    return NULL;
+  }
+
+  unsigned char * header = view->frame + view->data_offset;
+  view->data_offset += header_len;
+  view->data_len -= header_len;
+
+  return header;
+}
+
+
+/* void pkt_view_trim ( pkt_view_t * view, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función limita los datos de la capa actual a 'len' bytes.
+ */
+void pkt_view_trim ( pkt_view_t * view, int len )
+{
+  if (len >= 0 && len < view->data_len) {
+    view->data_len = len;
+  }
+}
+
+
+/* void pkt_buf_init ( pkt_buf_t * buf );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función vacía 'buf', dejando 'PKT_HEADROOM' bytes libres delante
+ *   para las cabeceras.
+ */
+void pkt_buf_init ( pkt_buf_t * buf )
+{
+  buf->data = buf->buffer + PKT_HEADROOM;
+  buf->len = 0;
+}
+
+
+/* unsigned char * pkt_buf_put ( pkt_buf_t * buf, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade 'len' bytes al final del paquete.
+ *
+ * VALOR DEVUELTO:
+ *   Un puntero a los bytes añadidos.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no caben.
+ */
+unsigned char * pkt_buf_put ( pkt_buf_t * buf, int len )
+{
+  unsigned char * tail = buf->data + buf->len;
+  if (len < 0 || tail + len > buf->buffer + sizeof(buf->buffer)) {
+    return NULL;
+  }
+
+  buf->len += len;
+
+  return tail;
+}
+
+
+/* unsigned char * pkt_buf_push ( pkt_buf_t * buf, int header_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade una cabecera de 'header_len' bytes delante del
+ *   paquete, en el espacio reservado.
+ *
+ * VALOR DEVUELTO:
+ *   Un puntero a la cabecera.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si ya no queda espacio reservado.
+ */
+unsigned char * pkt_buf_push ( pkt_buf_t * buf, int header_len )
+{
+  if (header_len < 0 || buf->data - header_len < buf->buffer) {
+    return NULL;
+  }
+
+  buf->data -= header_len;
+  buf->len += header_len;
+
+  return buf->data;
+}
@@ -16,7 +16,10 @@
  * License along with librawnet.  If not, see
  * <http://www.gnu.org/licenses/>.
  */
+/* sendmmsg() and recvmmsg() */
+#define _GNU_SOURCE
 #include "rawnet.h"
+#include "rawnet_backend.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -24,30 +27,485 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <stdarg.h>
 
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <net/if.h>
 #include <net/ethernet.h>     /* layer 2 protocols */
 #include <netinet/in.h>
 
-/* Requires GLIBC >= 2.1 */
-#include <netpacket/packet.h>
+/* struct sockaddr_ll and TPACKET_V3 ring definitions (Linux >= 3.2).
+   Replaces <netpacket/packet.h>, both cannot be included together */
+#include <linux/if_packet.h>
+#include <linux/filter.h>
 
 /* Import error code variable from <errno.h> */
 extern int errno;
 
 #define RAWNET_ERROR_LENGTH 1024
-static char rawnet_error[RAWNET_ERROR_LENGTH];
+#define RAWNET_NO_ERROR "No error, everything has gone OK"
+
+/* Error state of the calling thread. Failures only record what went wrong
+   (and the errno, if any): the message is built in rawnet_strerror(), so
+   the send and receive paths do no string work when they succeed */
+static __thread const char * rawnet_err_what;  /* NULL: no error */
+static __thread int rawnet_err_errno;
+static __thread char rawnet_err_detail[RAWNET_ERROR_LENGTH];
+static __thread char rawnet_err_msg[RAWNET_ERROR_LENGTH];
+
+#define rawnet_clear_error() (rawnet_err_what = NULL)
+
+/* Interface name prefix that enables the memory-mapped RX and TX rings */
+#define RAWNET_MMAP_PREFIX "mmap:"
+/* Longest name of a backend without a system interface (e.g. a file) */
+#define RAWNET_IFNAME_MAX 256
+
+/* Other backends, selected by their own interface name prefix */
+static const struct rawnet_backend * rawnet_backends[] = {
+  &rawnet_xdp_backend,
+  &rawnet_uring_backend,
+  &rawnet_pcap_backend,
+  &rawnet_tap_backend,
+  &rawnet_shm_backend,
+  NULL
+};
+
+/* TPACKET_V3 RX ring geometry: 64 blocks of 64 KiB (4 MiB). A block is
+   handed to user space when it fills up or after RAWNET_RING_BLOCK_TOV ms */
+#define RAWNET_RING_BLOCK_SIZE (1 << 16)
+#define RAWNET_RING_BLOCK_NR 64
+#define RAWNET_RING_FRAME_SIZE 2048
+#define RAWNET_RING_BLOCK_TOV 1
+
+/* TPACKET_V3 TX ring geometry: 256 slots of 2 KiB, mapped right after RX */
+#define RAWNET_TX_BLOCK_SIZE (1 << 16)
+#define RAWNET_TX_BLOCK_NR 8
+#define RAWNET_TX_FRAME_SIZE 2048
+#define RAWNET_TX_FRAME_NR ((RAWNET_TX_BLOCK_SIZE / RAWNET_TX_FRAME_SIZE) * RAWNET_TX_BLOCK_NR)
+/* Maximum time a blocking flush waits for a free TX slot */
+#define RAWNET_TX_WAIT_MS 1000
+/* Times send() waits for room in a full socket buffer before giving up */
+#define RAWNET_SEND_RETRIES 3
+/* Offset of the frame data inside a TX slot */
+#define RAWNET_TX_DATA_OFFSET (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+/* Memory-mapped TPACKET_V3 RX and TX rings */
+struct rawring {
+  unsigned char * map;          /* mmap()ed rings: RX blocks, then TX slots */
+  size_t map_len;
+  unsigned int block_size;
+  unsigned int block_nr;
+  unsigned int block_idx;       /* Block being read (or waited for) */
+  unsigned int frames_left;     /* Frames not yet read in current block */
+  struct tpacket3_hdr * frame;  /* Next frame to read in current block */
+  unsigned char * tx_map;       /* First TX slot */
+  unsigned int tx_idx;          /* Next TX slot to fill */
+  unsigned int tx_pending;      /* Slots filled since the last flush */
+};
 
 struct rawiface {
-  char ifname[IF_NAMESIZE];
+  char ifname[RAWNET_IFNAME_MAX];
   int ifindex;
-  int socket_fd;
+  int socket_fd;            /* -1 if the backend has no system interface */
+  struct rawring * rx_ring; /* NULL unless opened as "mmap:<ifname>" */
+  unsigned char * rx_buffer; /* Frame returned by rawnet_recv_zerocopy() */
+  /* Backend that moves the frames, or NULL for the AF_PACKET socket. The
+     socket is opened whenever there is a system interface: some backends
+     use it, the others only for the ioctl()s (and then it receives
+     nothing) */
+  const struct rawnet_backend * backend;
+  void * backend_state;
+  int timestamps;             /* Arrival timestamps enabled */
+  int rx_stamp_valid;         /* The last frame returned had a timestamp */
+  struct timespec rx_stamp;   /* Arrival time of the last frame returned */
 };
 
+/* Room for the SCM_TIMESTAMPNS control message */
+#define RAWNET_CMSG_SIZE CMSG_SPACE(sizeof(struct timespec))
+
+
+/* Record a failure: 'sys_errno' is the errno that caused it, or 0. Constant
+   messages are kept by reference, the others formatted once here */
+static void vrawnet_fail ( int sys_errno, const char * format, va_list args )
+{
+  if (strchr(format, '%') == NULL) {
+    rawnet_err_what = format;
+  } else {
+    vsnprintf(rawnet_err_detail, RAWNET_ERROR_LENGTH, format, args);
+    rawnet_err_what = rawnet_err_detail;
+  }
+  rawnet_err_errno = sys_errno;
+}
+
+static void rawnet_fail ( int sys_errno, const char * format, ... )
+{
+  va_list args;
+  va_start(args, format);
+  vrawnet_fail(sys_errno, format, args);
+  va_end(args);
+}
+
+/* Set the message returned by rawnet_strerror() */
+void rawnet_seterror ( const char * format, ... )
+{
+  va_list args;
+  va_start(args, format);
+  vrawnet_fail(0, format, args);
+  va_end(args);
+}
+
+/* Parse a "xx:xx:xx:xx:xx:xx" Ethernet address */
+int rawnet_parse_mac ( const char * str, unsigned char mac[] )
+{
+  unsigned int bytes[6];
+  char end;
+  if (sscanf(str, "%x:%x:%x:%x:%x:%x%c", &bytes[0], &bytes[1], &bytes[2],
+             &bytes[3], &bytes[4], &bytes[5], &end) != 6) {
+    return -1;
+  }
+  int i;
+  for (i=0; i<6; i++) {
+    if (bytes[i] > 0xFF) {
+      return -1;
+    }
+    mac[i] = bytes[i];
+  }
+  return 0;
+}
+
+/* Take the SCM_TIMESTAMPNS of a received message as the arrival time of
+   the frame, if timestamps are enabled */
+static void rawnet_msg_stamp ( rawiface_t * iface, struct msghdr * msg )
+{
+  iface->rx_stamp_valid = 0;
+  if (!iface->timestamps) {
+    return;
+  }
+  struct cmsghdr * cmsg;
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+      memcpy(&iface->rx_stamp, CMSG_DATA(cmsg), sizeof(struct timespec));
+      iface->rx_stamp_valid = 1;
+      return;
+    }
+  }
+}
+
+/* Backends get no kernel timestamp: use the one the backend recorded (e.g.
+   in a pcap file) or else the time the frame is picked up */
+static void rawnet_backend_stamp ( rawiface_t * iface )
+{
+  iface->rx_stamp_valid = iface->timestamps;
+  if (iface->timestamps &&
+      ((iface->backend->getstamp == NULL) ||
+       (iface->backend->getstamp(iface->backend_state, &iface->rx_stamp) < 0))) {
+    clock_gettime(CLOCK_REALTIME, &iface->rx_stamp);
+  }
+}
+
+/* Copy the arrival time of the last frame to 'stamp' (zero if none) */
+static void rawnet_copy_stamp ( rawiface_t * iface, struct timespec * stamp )
+{
+  if (iface->rx_stamp_valid) {
+    *stamp = iface->rx_stamp;
+  } else {
+    stamp->tv_sec = 0;
+    stamp->tv_nsec = 0;
+  }
+}
+
+
+/* Current monotonic time in milliseconds */
+static long int rawnet_now_ms ()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000L) + (ts.tv_nsec / 1000000L);
+}
+
+/* Block descriptor of the given ring block */
+static struct tpacket_block_desc * rawring_block ( struct rawring * ring, unsigned int idx )
+{
+  return (struct tpacket_block_desc *) (ring->map + (idx * ring->block_size));
+}
+
+/* TX slot of the given index */
+static struct tpacket3_hdr * rawring_tx_slot ( struct rawring * ring, unsigned int idx )
+{
+  return (struct tpacket3_hdr *) (ring->tx_map + (idx * RAWNET_TX_FRAME_SIZE));
+}
+
+/* Set up TPACKET_V3 RX and TX rings on the socket. Returns NULL on error */
+static struct rawring * rawring_open ( int socket_fd )
+{
+  int version = TPACKET_V3;
+  if (setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION,
+                 &version, sizeof(version)) == -1) {
+    rawnet_fail(errno, "Cannot select TPACKET_V3");
+    return NULL;
+  }
+
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = RAWNET_RING_BLOCK_SIZE;
+  req.tp_block_nr = RAWNET_RING_BLOCK_NR;
+  req.tp_frame_size = RAWNET_RING_FRAME_SIZE;
+  req.tp_frame_nr = (RAWNET_RING_BLOCK_SIZE / RAWNET_RING_FRAME_SIZE) * RAWNET_RING_BLOCK_NR;
+  req.tp_retire_blk_tov = RAWNET_RING_BLOCK_TOV;
+  if (setsockopt(socket_fd, SOL_PACKET, PACKET_RX_RING,
+                 &req, sizeof(req)) == -1) {
+    rawnet_fail(errno, "Cannot create PACKET_RX_RING");
+    return NULL;
+  }
+
+  struct tpacket_req3 tx_req;
+  memset(&tx_req, 0, sizeof(tx_req));
+  tx_req.tp_block_size = RAWNET_TX_BLOCK_SIZE;
+  tx_req.tp_block_nr = RAWNET_TX_BLOCK_NR;
+  tx_req.tp_frame_size = RAWNET_TX_FRAME_SIZE;
+  tx_req.tp_frame_nr = RAWNET_TX_FRAME_NR;
+  if (setsockopt(socket_fd, SOL_PACKET, PACKET_TX_RING,
+                 &tx_req, sizeof(tx_req)) == -1) {
+    rawnet_fail(errno, "Cannot create PACKET_TX_RING");
+    return NULL;
+  }
+
+  struct rawring * ring = malloc(sizeof(struct rawring));
+  if (ring == NULL) {
+    rawnet_fail(0, "Cannot allocate memory for a new 'struct rawring'");
+    return NULL;
+  }
+  ring->map_len = ((size_t) req.tp_block_size * req.tp_block_nr) +
+                  ((size_t) tx_req.tp_block_size * tx_req.tp_block_nr);
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_LOCKED, socket_fd, 0);
+  if (ring->map == MAP_FAILED) {
+    /* MAP_LOCKED may exceed RLIMIT_MEMLOCK, retry without it */
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, socket_fd, 0);
+  }
+  if (ring->map == MAP_FAILED) {
+    rawnet_fail(errno, "Cannot mmap() PACKET_RX_RING/PACKET_TX_RING");
+    free(ring);
+    return NULL;
+  }
+  ring->block_size = req.tp_block_size;
+  ring->block_nr = req.tp_block_nr;
+  ring->block_idx = 0;
+  ring->frames_left = 0;
+  ring->frame = NULL;
+  ring->tx_map = ring->map + ((size_t) req.tp_block_size * req.tp_block_nr);
+  ring->tx_idx = 0;
+  ring->tx_pending = 0;
+
+  return ring;
+}
+
+/* Unmap and free the RX ring */
+static void rawring_close ( struct rawring * ring )
+{
+  if (ring != NULL) {
+    munmap(ring->map, ring->map_len);
+    free(ring);
+  }
+}
+
+/* Whether a frame can be read from the ring without waiting */
+static int rawring_ready ( struct rawring * ring )
+{
+  if ((ring->frame != NULL) && (ring->frames_left > 0)) {
+    return 1;
+  }
+  unsigned int idx = ring->block_idx;
+  if ((ring->frame != NULL) && (ring->frames_left == 0)) {
+    idx = (idx + 1) % ring->block_nr;
+  }
+  struct tpacket_block_desc * block = rawring_block(ring, idx);
+  return (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) != 0;
+}
+
+/* Return the current block to the kernel once all its frames have been read */
+static void rawring_release ( struct rawring * ring )
+{
+  if ((ring->frame != NULL) && (ring->frames_left == 0)) {
+    struct tpacket_block_desc * block = rawring_block(ring, ring->block_idx);
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    ring->block_idx = (ring->block_idx + 1) % ring->block_nr;
+    ring->frame = NULL;
+  }
+}
+
+/* int rawring_next ( rawiface_t * iface, unsigned char ** frame, int * frame_len, long int timeout );
+ *
+ * Points 'frame' to the next frame in the RX ring, waiting at most 'timeout'
+ * ms (<0 forever) for a block to be handed over. The frame stays valid until
+ * the next call. Returns the captured length, 0 on timeout or -1 on error.
+ * 'frame_len' gets the original length of the frame.
+ */
+static int rawring_next
+( rawiface_t * iface, unsigned char ** frame, int * frame_len, long int timeout )
+{
+  struct rawring * ring = iface->rx_ring;
+
+  /* Batch release: a block goes back to the kernel only when fully read */
+  rawring_release(ring);
+
+  long int deadline = (timeout > 0) ? rawnet_now_ms() + timeout : timeout;
+
+  while (ring->frame == NULL) {
+    struct tpacket_block_desc * block = rawring_block(ring, ring->block_idx);
+    uint32_t status = __atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+    if (status & TP_STATUS_USER) {
+      ring->frames_left = block->hdr.bh1.num_pkts;
+      ring->frame = (struct tpacket3_hdr *)
+        ((unsigned char *) block + block->hdr.bh1.offset_to_first_pkt);
+      if (ring->frames_left == 0) {
+        /* Empty block retired by timeout */
+        rawring_release(ring);
+      }
+      continue;
+    }
+
+    /* Wait until the kernel hands the next block over */
+    long int wait_ms = -1;
+    if (timeout == 0) {
+      return 0;
+    } else if (timeout > 0) {
+      wait_ms = deadline - rawnet_now_ms();
+      if (wait_ms <= 0) {
+        return 0;
+      }
+    }
+    struct pollfd pollfd;
+    pollfd.fd = iface->socket_fd;
+    pollfd.events = POLLIN | POLLERR;
+    pollfd.revents = 0;
+    int err = poll(&pollfd, 1, wait_ms);
+    if (err == -1) {
+      rawnet_fail(errno, "Cannot wait for next raw frame");
+      return -1;
+    }
+  }
+
+  struct tpacket3_hdr * hdr = ring->frame;
+  *frame = (unsigned char *) hdr + hdr->tp_mac;
+  *frame_len = hdr->tp_len;
+  int snap_len = hdr->tp_snaplen;
+  /* The ring always carries the kernel timestamp */
+  iface->rx_stamp.tv_sec = hdr->tp_sec;
+  iface->rx_stamp.tv_nsec = hdr->tp_nsec;
+  iface->rx_stamp_valid = iface->timestamps;
+
+  ring->frames_left--;
+  if (ring->frames_left > 0) {
+    ring->frame = (struct tpacket3_hdr *) ((unsigned char *) hdr + hdr->tp_next_offset);
+  }
+
+  return snap_len;
+}
+
+
+/* Wait until the socket can send (or, with a TX ring, until the next slot
+   is free again). Returns 1 if it can, 0 on timeout and -1 on error */
+static int rawnet_wait_writable ( rawiface_t * iface, long int timeout )
+{
+  struct pollfd pollfd;
+  pollfd.fd = iface->socket_fd;
+  pollfd.events = POLLOUT;
+  pollfd.revents = 0;
+  int err = poll(&pollfd, 1, timeout);
+  if (err == -1) {
+    rawnet_fail(errno, "Cannot wait to send Raw Packets");
+  }
+  return err;
+}
+
+/* Kick the kernel to transmit every filled TX slot and, if 'wait', wait for
+   the next slot to be free again. The socket is non-blocking, so send()
+   itself never waits. If the kick fails because the queues are full the
+   slots stay pending, so that the next flush tries again. Returns the number
+   of frames handed over or -1 */
+static int rawring_flush ( rawiface_t * iface, int wait )
+{
+  struct rawring * ring = iface->rx_ring;
+  int frames = ring->tx_pending;
+  if (frames > 0) {
+    if (send(iface->socket_fd, NULL, 0, MSG_DONTWAIT) == -1) {
+      if ((errno != EAGAIN) && (errno != ENOBUFS)) {
+        rawnet_fail(errno, "Cannot flush PACKET_TX_RING");
+        return -1;
+      }
+      frames = 0;
+    } else {
+      ring->tx_pending = 0;
+    }
+  }
+  if (wait && (rawnet_wait_writable(iface, RAWNET_TX_WAIT_MS) == -1)) {
+    return -1;
+  }
+  return frames;
+}
+
+/* Copy a frame, given in 'iovcnt' pieces, into the next TX slot. Returns
+   its length, -2 if the ring is full even after kicking the kernel, or -1 on
+   error */
+static int rawring_sendv ( rawiface_t * iface, const struct iovec * iov, int iovcnt )
+{
+  struct rawring * ring = iface->rx_ring;
+
+  int i;
+  int pkt_len = 0;
+  for (i=0; i<iovcnt; i++) {
+    pkt_len += iov[i].iov_len;
+  }
+
+  if (pkt_len > (int) (RAWNET_TX_FRAME_SIZE - RAWNET_TX_DATA_OFFSET)) {
+    rawnet_fail(0, "Raw Packet too long for the TX ring (%d bytes)", pkt_len);
+    return -1;
+  }
+
+  struct tpacket3_hdr * slot = rawring_tx_slot(ring, ring->tx_idx);
+  uint32_t status = __atomic_load_n(&slot->tp_status, __ATOMIC_ACQUIRE);
+  if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+    /* Ring full: let the kernel drain what is already queued */
+    if (rawring_flush(iface, 0) < 0) {
+      return -1;
+    }
+    status = __atomic_load_n(&slot->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+      rawnet_fail(0, "PACKET_TX_RING is full, call rawnet_flush()");
+      return -2;
+    }
+  }
+
+  unsigned char * data = (unsigned char *) slot + RAWNET_TX_DATA_OFFSET;
+  for (i=0; i<iovcnt; i++) {
+    memcpy(data, iov[i].iov_base, iov[i].iov_len);
+    data += iov[i].iov_len;
+  }
+  slot->tp_len = pkt_len;
+  slot->tp_snaplen = pkt_len;
+  slot->tp_next_offset = 0;
+  __atomic_store_n(&slot->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+  ring->tx_idx = (ring->tx_idx + 1) % RAWNET_TX_FRAME_NR;
+  ring->tx_pending++;
+  return pkt_len;
+}
+
+/* Copy a contiguous frame into the next TX slot (see rawring_sendv()) */
+static int rawring_send ( rawiface_t * iface, unsigned char * packet, int pkt_len )
+{
+  struct iovec iov = { packet, pkt_len };
+  return rawring_sendv(iface, &iov, 1);
+}
+
 
 /* rawiface_t * rawiface_open ( char* ifname );
  *
@@ -77,19 +535,44 @@ rawiface_t * rawiface_open ( char* ifname )
 {
   struct rawiface * iface;
   int err;
+  int use_ring = 0;
+  const struct rawnet_backend * backend = NULL;
 
   /* Check 'ifname' parameter */
   if (ifname == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Raw Interface name cannot be 'NULL'");
+    rawnet_fail(0, "Raw Interface name cannot be 'NULL'");
     return NULL;
 
   } else {
+    /* "mmap:<ifname>" receives through a memory-mapped ring */
+    if (strncmp(ifname, RAWNET_MMAP_PREFIX, strlen(RAWNET_MMAP_PREFIX)) == 0) {
+      ifname += strlen(RAWNET_MMAP_PREFIX);
+      use_ring = 1;
+    }
+    int i;
+    for (i=0; rawnet_backends[i] != NULL; i++) {
+      const char * prefix = rawnet_backends[i]->prefix;
+      if (strncmp(ifname, prefix, strlen(prefix)) == 0) {
+        ifname += strlen(prefix);
+        backend = rawnet_backends[i];
+        break;
+      }
+    }
+
+    int system_iface = (backend == NULL) || backend->system_iface;
+    if (use_ring && !system_iface) {
+      rawnet_fail(0,
+                  "\"%s%s\" has no memory-mapped ring", RAWNET_MMAP_PREFIX,
+                  backend->prefix);
+      return NULL;
+    }
+
     int ifname_len = strlen(ifname);
-    if (ifname_len >= IF_NAMESIZE) {
-      snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-               "Invalid Raw Interface name \"%s\": Too long (%d >= %d)",
-               ifname, ifname_len, IF_NAMESIZE);
+    int ifname_max = system_iface ? IF_NAMESIZE : RAWNET_IFNAME_MAX;
+    if (ifname_len >= ifname_max) {
+      rawnet_fail(0,
+                  "Invalid Raw Interface name \"%s\": Too long (%d >= %d)",
+                  ifname, ifname_len, ifname_max);
       return NULL;
     }
   }
@@ -97,65 +580,173 @@ rawiface_t * rawiface_open ( char* ifname )
   /* Create a new struct rawiface  */
   iface = malloc(sizeof(struct rawiface));
   if (iface == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot allocate memory for a new 'struct rawiface'");
+    rawnet_fail(0, "Cannot allocate memory for a new 'struct rawiface'");
     return NULL;
   }
   strcpy(iface->ifname, ifname);
   iface->ifindex = -1;
   iface->socket_fd = -1;
+  iface->rx_ring = NULL;
+  iface->rx_buffer = NULL;
+  iface->backend = backend;
+  iface->backend_state = NULL;
+  iface->timestamps = 0;
+  iface->rx_stamp_valid = 0;
+
+  /* Backends without a system interface need no socket at all */
+  if ((backend != NULL) && !backend->system_iface) {
+    iface->backend_state = backend->open(iface->ifname, -1, -1);
+    if (iface->backend_state == NULL) {
+      free(iface);
+      return NULL;
+    }
+    rawnet_clear_error();
+    return iface;
+  }
 
   /* Create a raw packet socket. See PACKET(7)
      - Needed now for ioctl() operations, bind() later to the appropriate
        interface.
-     - Using ETH_P_ALL to support any L2 protocol. */
-  int socket_fd = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+     - Using ETH_P_ALL to support any L2 protocol, or no protocol at all
+       when a backend receives the frames by other means. */
+  int protocol = ((backend == NULL) || backend->packet_socket) ? htons(ETH_P_ALL) : 0;
+  int socket_fd = socket(PF_PACKET, SOCK_RAW, protocol);
   if (socket_fd == -1) {
-    char* err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot create a Raw Packet Socket: %s.\nNo superuser or CAP_NET_RAW capability?",
-             err_str);
+    int err_no = errno;
+    rawnet_fail(err_no,
+                "Cannot create a Raw Packet Socket (no superuser or CAP_NET_RAW capability?)");
     free(iface);
     return NULL;
   }
   iface->socket_fd = socket_fd;
 
+  /* The socket stays in non-blocking mode: rawnet_recv() waits with poll()
+     and callers can add it to their own poll()/epoll() loops */
+  if (fcntl(socket_fd, F_SETFL, O_NONBLOCK) == -1) {
+    rawnet_fail(errno, "Cannot put Raw Packet Socket in non-blocking mode");
+    goto fail;
+  }
+
   /* Get interface index from interface name. See NETDEVICE(7)*/
   struct ifreq iface_ifreq;
 
   strcpy(iface_ifreq.ifr_name, iface->ifname);
   err = ioctl(iface->socket_fd, SIOCGIFINDEX, &iface_ifreq);
   if (err == -1) {
-    char* err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot obtain index of Raw Interface \"%s\": %s",
-             ifname, err_str);
-    free(iface);
-    return NULL;
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot obtain index of Raw Interface \"%s\"", ifname);
+    goto fail;
   }
   iface->ifindex = iface_ifreq.ifr_ifindex;
 
+  /* Set up the RX ring before bind(), so no frame is queued outside it */
+  if (use_ring) {
+    iface->rx_ring = rawring_open(iface->socket_fd);
+    if (iface->rx_ring == NULL) {
+      goto fail;
+    }
+  }
+
   /* Bind packet socket to appropriate interface. See PACKET(7) */
   struct sockaddr_ll iface_sockaddr;
 
   iface_sockaddr.sll_family = PF_PACKET;
-  iface_sockaddr.sll_protocol = htons(ETH_P_ALL);
+  iface_sockaddr.sll_protocol = protocol;
   iface_sockaddr.sll_ifindex = iface->ifindex;
 
   err = bind(iface->socket_fd, (struct sockaddr*) &iface_sockaddr,
              sizeof(struct sockaddr_ll));
   if (err != 0) {
-    char * err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot bind() Raw Packet Socket to \"%s\" interface: %s",
-             iface->ifname, err_str);
-    free(iface);
+    int err_no = errno;
+    rawnet_fail(err_no,
+                "Cannot bind() Raw Packet Socket to \"%s\" interface",
+                iface->ifname);
+    goto fail;
+  }
+
+  if (backend != NULL) {
+    iface->backend_state = backend->open(iface->ifname, iface->ifindex,
+                                         iface->socket_fd);
+    if (iface->backend_state == NULL) {
+      goto fail;
+    }
+  }
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return iface;
+
+ fail:
+  /* Everything acquired after socket(); the error is already recorded */
+  rawring_close(iface->rx_ring);
+  close(iface->socket_fd);
+  free(iface);
+  return NULL;
+}
+
+
+/* rawiface_t * rawiface_open_fanout ( char* ifname, int group_id, int mode );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawiface_open()', pero el socket se une al grupo PACKET_FANOUT
+ *   'group_id' de la interfaz, que reparte los paquetes recibidos entre
+ *   todos los sockets del grupo.
+ *
+ * PARÁMETROS:
+ *   'ifname' : Nombre de la interfaz, como en 'rawiface_open()'.
+ * 'group_id' : Identificador del grupo (0-65535).
+ *     'mode' : 'RAWNET_FANOUT_HASH' o 'RAWNET_FANOUT_CPU'.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador de la interfaz hardware inicializada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+rawiface_t * rawiface_open_fanout ( char* ifname, int group_id, int mode )
+{
+  int fanout_type;
+  if (mode == RAWNET_FANOUT_HASH) {
+    /* Reassemble IP fragments first, so they follow the rest of the flow */
+    fanout_type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+  } else if (mode == RAWNET_FANOUT_CPU) {
+    fanout_type = PACKET_FANOUT_CPU;
+  } else {
+    rawnet_fail(0, "Invalid fanout mode %d", mode);
+    return NULL;
+  }
+  if ((group_id < 0) || (group_id > 0xFFFF)) {
+    rawnet_fail(0, "Invalid fanout group %d", group_id);
     return NULL;
   }
 
-  /* Clear error message */
-  snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-           "No error, everything has gone OK");
+  rawiface_t * iface = rawiface_open(ifname);
+  if (iface == NULL) {
+    return NULL;
+  }
+  if ((iface->backend != NULL) && !iface->backend->packet_socket) {
+    /* Multi-queue devices already spread the flows among their queues */
+    if (iface->backend->multiqueue && (mode == RAWNET_FANOUT_HASH)) {
+      return iface;
+    }
+    rawnet_fail(0,
+                "PACKET_FANOUT needs a Raw Packet Socket, not \"%s\"", ifname);
+    rawiface_close(iface);
+    return NULL;
+  }
+
+  /* The socket must be bound to the interface before joining the group */
+  int fanout_arg = group_id | (fanout_type << 16);
+  if (setsockopt(iface->socket_fd, SOL_PACKET, PACKET_FANOUT,
+                 &fanout_arg, sizeof(fanout_arg)) == -1) {
+    int err_no = errno;
+    rawiface_close(iface);
+    rawnet_fail(err_no, "Cannot join PACKET_FANOUT group %d", group_id);
+    return NULL;
+  }
 
   return iface;
 }
@@ -178,165 +769,604 @@ rawiface_t * rawiface_open ( char* ifname )
  *   La función devuelve 'NULL' si la interfaz no ha sido inicializada
  *   correctamente.
  */
-char* rawiface_getname ( rawiface_t * iface )
+char* rawiface_getname ( rawiface_t * iface )
+{
+  char* ifname = NULL;
+
+  if (iface != NULL) {
+    ifname = iface->ifname;
+  }
+
+  return ifname;
+}
+
+/* int rawiface_getfd ( rawiface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el descriptor del socket de la interfaz, que está
+ *   siempre en modo no bloqueante, para poder esperar paquetes con
+ *   'poll()' o 'epoll()' junto a otros descriptores. Cuando esté listo hay
+ *   que leer con 'rawnet_recv()' (o similares) y timeout 0 hasta que no
+ *   queden paquetes.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor del socket.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL'.
+ */
+int rawiface_getfd ( rawiface_t * iface )
+{
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
+  if (iface->backend != NULL) {
+    return iface->backend->getfd(iface->backend_state);
+  }
+  return iface->socket_fd;
+}
+
+
+/* int rawiface_getaddr ( rawiface_t * iface, char addr[] );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite obtener la dirección hardware de la interfaz
+ *   indicada.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz de la que se quiere obtener su dirección.
+ *            La interfaz debe haber sido inicializada con 'rawiface_open()'
+ *            previamente.
+ *    'addr': Array donde se copiará la dirección hardware de la interfaz.
+ *            Las direcciones hardware pueden ocupar hasta 'HW_ADDR_MAX_SIZE'
+ *            bytes.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud en bytes de la dirección hardware devuelta.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawiface_getaddr ( rawiface_t * iface, unsigned char addr[] )
+{
+  int halen;
+
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
+  if ((iface->backend != NULL) && !iface->backend->system_iface) {
+    return iface->backend->getaddr(iface->backend_state, addr);
+  }
+
+  struct sockaddr_ll iface_sockaddr;
+  socklen_t iface_sockaddr_len = sizeof(struct sockaddr_ll);
+  int err = getsockname
+    (iface->socket_fd, (struct sockaddr *) &iface_sockaddr, &iface_sockaddr_len);
+  if (err != 0) {
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot obtain Raw Interface HW address");
+    return -1;
+  }
+  halen = iface_sockaddr.sll_halen;
+  memcpy(addr, iface_sockaddr.sll_addr, halen);
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return halen;
+}
+
+/* int rawiface_getmtu ( rawiface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la Maximum Transmission Unit (MTU) permitida por
+ *   esta interfaz.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz de la que se quiere obtener su MTU.
+ *            La interfaz debe haber sido inicializada con 'rawiface_open()'
+ *            previamente.
+ *
+ * VALOR DEVUELTO:
+ *   El tamaño máximo de los datos de la trama que puede enviarse por esta
+ *   interfaz.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawiface_getmtu ( rawiface_t * iface )
+{
+  int mtu;
+
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
+  if ((iface->backend != NULL) && !iface->backend->system_iface) {
+    return iface->backend->getmtu(iface->backend_state);
+  }
+
+  /* Get MTU. See NETDEVICE(7) */
+  struct ifreq iface_ifreq;
+  strcpy(iface_ifreq.ifr_name, iface->ifname);
+
+  int err = ioctl(iface->socket_fd, SIOCGIFMTU, &iface_ifreq);
+  if (err == -1) {
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot obtain Raw Interface MTU");
+    return -1;
+  }
+  mtu = iface_ifreq.ifr_mtu;
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return mtu;
+}
+
+
+/* int rawiface_is_zerocopy ( rawiface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función indica si 'rawnet_recv_zerocopy()' entrega los paquetes en
+ *   su sitio, sin copiarlos: en el anillo de "mmap:<ifname>" o en la memoria
+ *   de un backend. Con el socket normal cada paquete se copia a un buffer
+ *   de la interfaz, y es mejor recibirlos por lotes ('rawnet_recv_batch()').
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   1 si los paquetes se reciben sin copiarlos, 0 si no.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz es 'NULL'.
+ */
+int rawiface_is_zerocopy ( rawiface_t * iface )
+{
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
+  return (iface->rx_ring != NULL) || (iface->backend != NULL);
+}
+
+
+/* int rawiface_set_timestamps ( rawiface_t * iface, int enable );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa (o desactiva) la marca de tiempo de llegada de los
+ *   paquetes recibidos.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz.
+ *   'enable': 1 para activarla, 0 para desactivarla.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawiface_set_timestamps ( rawiface_t * iface, int enable )
+{
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
+
+  /* Only frames read with recvmsg() need the socket option: the ring
+     always has them and the backends cannot get them */
+  if ((iface->rx_ring == NULL) && (iface->backend == NULL)) {
+    int on = (enable != 0);
+    if (setsockopt(iface->socket_fd, SOL_SOCKET, SO_TIMESTAMPNS,
+                   &on, sizeof(on)) == -1) {
+      int err_no = errno;
+      rawnet_fail(err_no, "Cannot set SO_TIMESTAMPNS");
+      return -1;
+    }
+  }
+  iface->timestamps = (enable != 0);
+  iface->rx_stamp_valid = 0;
+
+  return 0;
+}
+
+
+/* int rawiface_get_timestamp ( rawiface_t * iface, struct timespec * stamp );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve en 'stamp' el instante de llegada del último
+ *   paquete devuelto por 'rawnet_recv()' o 'rawnet_recv_zerocopy()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si hay marca de tiempo.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no hay marca de tiempo.
+ */
+int rawiface_get_timestamp ( rawiface_t * iface, struct timespec * stamp )
+{
+  if ((iface == NULL) || !iface->rx_stamp_valid) {
+    rawnet_fail(0, "No arrival timestamp for the last Raw Packet");
+    return -1;
+  }
+
+  *stamp = iface->rx_stamp;
+  return 0;
+}
+
+
+/* int rawnet_set_filter
+ * ( rawiface_t * iface, struct sock_filter * code, int code_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función instala en el kernel un filtro BPF clásico
+ *   ('SO_ATTACH_FILTER') en el socket de la interfaz, de forma que sólo
+ *   llegan a 'rawnet_recv()' los paquetes que acepte el programa. Sustituye
+ *   al filtro anterior, si lo había.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz.
+ *     'code': Instrucciones del programa BPF (ver <linux/filter.h>). Si es
+ *             'NULL' se elimina el filtro y se vuelven a recibir todos los
+ *             paquetes.
+ * 'code_len': Número de instrucciones de 'code'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el filtro se ha instalado (o eliminado) correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_set_filter
+( rawiface_t * iface, struct sock_filter * code, int code_len )
+{
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
+
+  /* Other backends only deliver what their own program selected */
+  if ((iface->backend != NULL) && !iface->backend->packet_socket) {
+    return 0;
+  }
+
+  int err;
+  if (code == NULL) {
+    int dummy = 0;
+    err = setsockopt(iface->socket_fd, SOL_SOCKET, SO_DETACH_FILTER,
+                     &dummy, sizeof(dummy));
+    if ((err == -1) && (errno == ENOENT)) {
+      /* There was no filter attached */
+      err = 0;
+    }
+  } else {
+    struct sock_fprog prog;
+    prog.len = code_len;
+    prog.filter = code;
+    err = setsockopt(iface->socket_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                     &prog, sizeof(prog));
+  }
+  if (err == -1) {
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot set socket filter (%d instructions)", code_len);
+    return -1;
+  }
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return 0;
+}
+
+
+/* int rawnet_send
+ * ( rawiface_t * iface, unsigned char * packet, int flen );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite enviar un paquete a través de la interfaz indicada.
+ *
+ *   Si la interfaz se abrió como "mmap:<ifname>" el paquete sólo se copia al
+ *   anillo de transmisión y sale al llamar a 'rawnet_flush()' (o al recibir).
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se quiere enviar el paquete.
+ *             La interfaz debe haber sido inicializada con
+ *             'rawiface_open()' previamente.
+ *   'packet': Puntero al contenido del paquete que se quiere enviar. Debe
+ *             incluir las cabeceras de nivel 2 y superiores.
+ *  'pkt_len': Longitud en bytes del paquete a enviar.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes que han podido ser enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-2' si el anillo de transmisión está lleno: hay que
+ *   llamar a 'rawnet_flush()' y volver a intentarlo.
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_send ( rawiface_t * iface, unsigned char * packet, int pkt_len )
 {
-  char* ifname = NULL;
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
 
-  if (iface != NULL) {
-    ifname = iface->ifname;
+  /* Memory-mapped ring: queue the frame, it is sent on the next flush */
+  if (iface->rx_ring != NULL) {
+    return rawring_send(iface, packet, pkt_len);
+  }
+  if (iface->backend != NULL) {
+    struct iovec iov;
+    iov.iov_base = packet;
+    iov.iov_len = pkt_len;
+    return iface->backend->sendv(iface->backend_state, &iov, 1);
   }
 
-  return ifname;
+  int flags = 0;
+  int err = send(iface->socket_fd, packet, pkt_len, flags);
+  int tries = 0;
+  while ((err == -1) && (errno == EAGAIN) && (tries < RAWNET_SEND_RETRIES)) {
+    /* Full socket buffer: wait for room as a blocking socket would. A full
+       device queue (ENOBUFS) is returned as is, since poll() would not wait
+       for it */
+    int ready = rawnet_wait_writable(iface, RAWNET_TX_WAIT_MS);
+    if (ready == -1) {
+      return -1;
+    } else if (ready == 0) {
+      errno = EAGAIN;
+      break;
+    }
+    err = send(iface->socket_fd, packet, pkt_len, flags);
+    tries++;
+  }
+  if (err == -1) {
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot send Raw Packet (%d bytes)", pkt_len);
+    return -1;
+  }
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return err;
 }
 
-/* int rawiface_getaddr ( rawiface_t * iface, char addr[] );
+
+/* int rawnet_sendv
+ * ( rawiface_t * iface, const struct iovec * iov, int iovcnt );
  *
  * DESCRIPCIÓN:
- *   Esta función permite obtener la dirección hardware de la interfaz
- *   indicada.
+ *   Igual que 'rawnet_send()', pero el paquete se indica en 'iovcnt' trozos
+ *   y se envía con 'sendmsg()' sin juntarlos antes. En el anillo de
+ *   transmisión los trozos se copian directamente al hueco de la trama.
  *
  * PARÁMETROS:
- *   'iface': Manejador de la interfaz de la que se quiere obtener su dirección.
- *            La interfaz debe haber sido inicializada con 'rawiface_open()'
- *            previamente.
- *    'addr': Array donde se copiará la dirección hardware de la interfaz.
- *            Las direcciones hardware pueden ocupar hasta 'HW_ADDR_MAX_SIZE'
- *            bytes.
+ *    'iface': Manejador de la interfaz por la que se quiere enviar el paquete.
+ *      'iov': Trozos del paquete, en orden, empezando por la cabecera de
+ *             nivel 2.
+ *   'iovcnt': Número de trozos.
  *
  * VALOR DEVUELTO:
- *   La longitud en bytes de la dirección hardware devuelta.
+ *   El número de bytes que han podido ser enviados.
  *
  * ERRORES:
- *   La función devuelve '-1' si se ha producido algún error.
- *   La descripción completa del error puede obtenerse a través de la función
- *   'rawnet_strerror()'.
+ *   Igual que 'rawnet_send()'.
  */
-int rawiface_getaddr ( rawiface_t * iface, unsigned char addr[] )
+int rawnet_sendv
+( rawiface_t * iface, const struct iovec * iov, int iovcnt )
 {
-  int halen;
-
   if (iface == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Raw Interface has not been initialized or it is 'NULL'");
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
     return -1;
   }
 
-  struct sockaddr_ll iface_sockaddr;
-  socklen_t iface_sockaddr_len = sizeof(struct sockaddr_ll);
-  int err = getsockname
-    (iface->socket_fd, (struct sockaddr *) &iface_sockaddr, &iface_sockaddr_len);
-  if (err != 0) {
-    char * err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot obtain Raw Interface HW address: %s", err_str);
+  if (iface->rx_ring != NULL) {
+    return rawring_sendv(iface, iov, iovcnt);
+  }
+  if (iface->backend != NULL) {
+    return iface->backend->sendv(iface->backend_state, iov, iovcnt);
+  }
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = (struct iovec *) iov;
+  msg.msg_iovlen = iovcnt;
+
+  int err = sendmsg(iface->socket_fd, &msg, 0);
+  int tries = 0;
+  while ((err == -1) && (errno == EAGAIN) && (tries < RAWNET_SEND_RETRIES)) {
+    int ready = rawnet_wait_writable(iface, RAWNET_TX_WAIT_MS);
+    if (ready == -1) {
+      return -1;
+    } else if (ready == 0) {
+      errno = EAGAIN;
+      break;
+    }
+    err = sendmsg(iface->socket_fd, &msg, 0);
+    tries++;
+  }
+  if (err == -1) {
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot send Raw Packet (%d pieces)", iovcnt);
     return -1;
   }
-  halen = iface_sockaddr.sll_halen;
-  memcpy(addr, iface_sockaddr.sll_addr, halen);
 
-  /* Clear error message */
-  snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-           "No error, everything has gone OK");
+  /* Clear error state */
+  rawnet_clear_error();
 
-  return halen;
+  return err;
 }
 
-/* int rawiface_getmtu ( rawiface_t * iface );
+
+/* int rawnet_flush ( rawiface_t * iface );
  *
  * DESCRIPCIÓN:
- *   Esta función devuelve la Maximum Transmission Unit (MTU) permitida por
- *   esta interfaz.
+ *   Si la interfaz se abrió como "mmap:<ifname>", 'rawnet_send()' sólo copia
+ *   los paquetes al anillo de transmisión. Esta función pide al kernel que
+ *   envíe todos los encolados con una única llamada al sistema y espera a
+ *   que los haya transmitido. 'rawnet_recv()', 'rawnet_poll()' y
+ *   'rawiface_close()' también vacían el anillo antes de esperar.
+ *
+ *   Sin anillo de transmisión no hace nada.
  *
  * PARÁMETROS:
- *   'iface': Manejador de la interfaz de la que se quiere obtener su MTU.
- *            La interfaz debe haber sido inicializada con 'rawiface_open()'
- *            previamente.
+ *    'iface': Manejador de la interfaz.
  *
  * VALOR DEVUELTO:
- *   El tamaño máximo de los datos de la trama que puede enviarse por esta
- *   interfaz.
+ *   El número de paquetes enviados.
  *
  * ERRORES:
  *   La función devuelve '-1' si se ha producido algún error.
  *   La descripción completa del error puede obtenerse a través de la función
  *   'rawnet_strerror()'.
  */
-int rawiface_getmtu ( rawiface_t * iface )
+int rawnet_flush ( rawiface_t * iface )
 {
-  int mtu;
-
   if (iface == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Raw Interface has not been initialized or it is 'NULL'");
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
     return -1;
   }
-
-  /* Get MTU. See NETDEVICE(7) */
-  struct ifreq iface_ifreq;
-  strcpy(iface_ifreq.ifr_name, iface->ifname);
-
-  int err = ioctl(iface->socket_fd, SIOCGIFMTU, &iface_ifreq);
-  if (err == -1) {
-    char * err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot obtain Raw Interface MTU: %s", err_str);
-    return -1;
+  if (iface->backend != NULL) {
+    return iface->backend->flush(iface->backend_state);
   }
-  mtu = iface_ifreq.ifr_mtu;
-
-  /* Clear error message */
-  snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-           "No error, everything has gone OK");
-
-  return mtu;
+  if (iface->rx_ring == NULL) {
+    return 0;
+  }
+  return rawring_flush(iface, 1);
 }
 
 
-/* int rawnet_send
- * ( rawiface_t * iface, unsigned char * packet, int flen );
+/* int rawnet_send_batch
+ * ( rawiface_t * iface, unsigned char * packets[], int pkt_lens[], int count );
  *
  * DESCRIPCIÓN:
- *   Esta función permite enviar un paquete a través de la interfaz indicada.
+ *   Esta función envía 'count' paquetes por la interfaz indicada con una
+ *   sola llamada al sistema ('sendmmsg()'), en lugar de una por paquete.
  *
+ *   Si la interfaz se abrió como "mmap:<ifname>" los paquetes se copian al
+ *   anillo de transmisión y se envían con un único 'rawnet_flush()'.
  *
  * PARÁMETROS:
- *    'iface': Manejador de la interfaz por la que se quiere enviar el paquete.
- *             La interfaz debe haber sido inicializada con
- *             'rawiface_open()' previamente.
- *   'packet': Puntero al contenido del paquete que se quiere enviar. Debe
- *             incluir las cabeceras de nivel 2 y superiores.
- *  'pkt_len': Longitud en bytes del paquete a enviar.
+ *    'iface': Manejador de la interfaz por la que se quieren enviar.
+ *  'packets': Array con los paquetes a enviar, incluyendo las cabeceras de
+ *             nivel 2 y superiores.
+ * 'pkt_lens': Longitud en bytes de cada paquete.
+ *    'count': Número de paquetes.
  *
  * VALOR DEVUELTO:
- *   El número de bytes que han podido ser enviados.
+ *   El número de paquetes enviados.
  *
  * ERRORES:
- *   La función devuelve '-1' si se ha producido algún error.
+ *   La función devuelve '-1' si no se ha podido enviar ningún paquete.
  *   La descripción completa del error puede obtenerse a través de la función
  *   'rawnet_strerror()'.
  */
-int rawnet_send ( rawiface_t * iface, unsigned char * packet, int pkt_len )
+int rawnet_send_batch
+( rawiface_t * iface, unsigned char * packets[], int pkt_lens[], int count )
 {
   if (iface == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Raw Interface has not been initialized or it is 'NULL'");
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
     return -1;
   }
+  if (count <= 0) {
+    return 0;
+  }
 
-  int flags = 0;
-  int err = send(iface->socket_fd, packet, pkt_len, flags);
-  if (err == -1) {
-    char * err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot send Raw Packet (%d bytes): %s", pkt_len, err_str);
-    return -1;
+  int sent = 0;
+
+  /* Memory-mapped ring: fill as many slots as needed, then one send() */
+  if (iface->rx_ring != NULL) {
+    while (sent < count) {
+      int err = rawring_send(iface, packets[sent], pkt_lens[sent]);
+      if (err == -2) {
+        /* Wait once for a free slot, then give up */
+        if (rawring_flush(iface, 1) >= 0) {
+          err = rawring_send(iface, packets[sent], pkt_lens[sent]);
+        }
+      }
+      if (err < 0) {
+        break;
+      }
+      sent++;
+    }
+    if (rawring_flush(iface, 1) < 0) {
+      return -1;
+    }
+    return (sent > 0) ? sent : -1;
+  }
+  if (iface->backend != NULL) {
+    while (sent < count) {
+      struct iovec iov;
+      iov.iov_base = packets[sent];
+      iov.iov_len = pkt_lens[sent];
+      if (iface->backend->sendv(iface->backend_state, &iov, 1) < 0) {
+        break;
+      }
+      sent++;
+    }
+    if (iface->backend->flush(iface->backend_state) < 0) {
+      return -1;
+    }
+    return (sent > 0) ? sent : -1;
   }
 
-  /* Clear error message */
-  snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-           "No error, everything has gone OK");
+  struct iovec iovs[count];
+  struct mmsghdr msgs[count];
+  memset(msgs, 0, sizeof(msgs));
+  int i;
+  for (i=0; i<count; i++) {
+    iovs[i].iov_base = packets[i];
+    iovs[i].iov_len = pkt_lens[i];
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-  return err;
+  /* sendmmsg() may stop early (e.g. full socket buffer), keep going */
+  int tries = 0;
+  while (sent < count) {
+    int err = sendmmsg(iface->socket_fd, &msgs[sent], count - sent, 0);
+    if (err == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      /* As in rawnet_send(), only a full socket buffer is waited for */
+      if ((errno == EAGAIN) && (tries < RAWNET_SEND_RETRIES)) {
+        tries++;
+        int ready = rawnet_wait_writable(iface, RAWNET_TX_WAIT_MS);
+        if (ready > 0) {
+          continue;
+        } else if (ready == 0) {
+          errno = EAGAIN;
+        }
+      }
+      int err_no = errno;
+      rawnet_fail(err_no, "Cannot send %d Raw Packets", count - sent);
+      return (sent > 0) ? sent : -1;
+    }
+    sent += err;
+  }
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return sent;
 }
 
 
@@ -384,74 +1414,343 @@ int rawnet_recv
   int packet_len;
 
   if (iface == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Raw Interface has not been initialized or it is 'NULL'");
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
     return -1;
   }
 
-  /* First put socket in blocking/non-blocking mode according to timeout */
+  /* Memory-mapped ring: copy the next frame out of it */
+  if (iface->rx_ring != NULL) {
+    unsigned char * frame;
+    /* Whatever has been queued must go out before we wait for an answer */
+    if (rawring_flush(iface, 0) < 0) {
+      return -1;
+    }
+    int snap_len = rawring_next(iface, &frame, &packet_len, timeout);
+    if (snap_len <= 0) {
+      return snap_len;
+    }
+    memcpy(buffer, frame, (snap_len < buf_len) ? snap_len : buf_len);
+    return packet_len;
+  }
+  if (iface->backend != NULL) {
+    unsigned char * frame;
+    if (iface->backend->flush(iface->backend_state) < 0) {
+      return -1;
+    }
+    int snap_len = iface->backend->recv(iface->backend_state, &frame,
+                                        &packet_len, timeout);
+    if (snap_len <= 0) {
+      return snap_len;
+    }
+    rawnet_backend_stamp(iface);
+    memcpy(buffer, frame, (snap_len < buf_len) ? snap_len : buf_len);
+    return packet_len;
+  }
+
+  /* The socket is always non-blocking (see rawiface_open()): use poll() to
+     implement the timer (or to wait forever) and then read */
+  do {
+    if (timeout != 0) {
+      struct pollfd pollfd;
+      pollfd.fd = iface->socket_fd;
+      pollfd.events = POLLIN | POLLPRI;
+      pollfd.revents = 0;
+      int pollfd_num = 1;
+
+      int err = poll(&pollfd, pollfd_num, timeout);
+      if (err == -1) {
+        int err_no = errno;
+        rawnet_fail(err_no, "Cannot wait for next raw frame");
+        return -1;
+
+      } else if (err == 0) {
+
+        /* Timeout has expired, return inmediately */
+        return 0;
+      }
+    }
+
+    /* Receive Raw Packet from the interface, and its timestamp */
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = buf_len;
+    unsigned char control[RAWNET_CMSG_SIZE];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (iface->timestamps) {
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+    }
+    int flags = MSG_TRUNC;
+    packet_len = recvmsg(iface->socket_fd, &msg, flags);
+    if (packet_len > 0) {
+      rawnet_msg_stamp(iface, &msg);
+    }
+    if (packet_len == -1) {
+
+      if (errno == EAGAIN) {
+        /* Nothing to read: timeout, unless we must wait forever */
+        packet_len = 0;
+      } else {
+        int err_no = errno;
+        rawnet_fail(err_no, "Cannot receive Raw Packet");
+        return -1;
+      }
+    }
+  } while ((packet_len == 0) && (timeout < 0));
+
+  /* Clear error state */
+  rawnet_clear_error();
+
+  return packet_len;
+}
+
+
+/* int rawnet_recv_zerocopy
+ * ( rawiface_t * iface, unsigned char ** frame, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawnet_recv()', pero en vez de copiar el paquete devuelve en
+ *   'frame' un puntero a él. Si la interfaz se abrió como "mmap:<ifname>" el
+ *   puntero apunta directamente al anillo compartido con el kernel; si no,
+ *   a un buffer interno de la interfaz.
+ *
+ *   El paquete sólo es válido hasta la siguiente llamada a 'rawnet_recv()' o
+ *   'rawnet_recv_zerocopy()' sobre la misma interfaz. Los bloques del anillo
+ *   se devuelven al kernel cuando se han leido todos sus paquetes.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se desea recibir un paquete.
+ *    'frame': Puntero donde se devolverá la dirección del paquete recibido.
+ *  'timeout': Igual que en 'rawnet_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes accesibles en 'frame', o '0' si ha expirado el
+ *   temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_recv_zerocopy
+( rawiface_t * iface, unsigned char ** frame, long int timeout )
+{
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
+    return -1;
+  }
 
-  int nonblock_mode = 0;
-  if (timeout >= 0) {
-    nonblock_mode = O_NONBLOCK;
+  if (iface->rx_ring != NULL) {
+    int frame_len;
+    if (rawring_flush(iface, 0) < 0) {
+      return -1;
+    }
+    return rawring_next(iface, frame, &frame_len, timeout);
+  }
+  if (iface->backend != NULL) {
+    int frame_len;
+    if (iface->backend->flush(iface->backend_state) < 0) {
+      return -1;
+    }
+    int len = iface->backend->recv(iface->backend_state, frame, &frame_len, timeout);
+    if (len > 0) {
+      rawnet_backend_stamp(iface);
+    }
+    return len;
   }
 
-  int fd_mode = fcntl(iface->socket_fd, F_SETFL, nonblock_mode);
-  if (fd_mode == -1) {
-    if (nonblock_mode == 0) {
-      snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-               "Cannot put Raw Packet Socket in blocking mode");
-    } else {
-      snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-               "Cannot put Raw Packet Socket in non-blocking mode");
+  /* No ring: receive into the interface's own buffer */
+  if (iface->rx_buffer == NULL) {
+    iface->rx_buffer = malloc(RAWNET_RING_FRAME_SIZE);
+    if (iface->rx_buffer == NULL) {
+      rawnet_fail(0, "Cannot allocate memory for the receive buffer");
+      return -1;
     }
+  }
+  int len = rawnet_recv(iface, iface->rx_buffer, RAWNET_RING_FRAME_SIZE, timeout);
+  if (len > RAWNET_RING_FRAME_SIZE) {
+    len = RAWNET_RING_FRAME_SIZE;
+  }
+  *frame = iface->rx_buffer;
+  return len;
+}
+
+
+/* int rawnet_recv_batch
+ * ( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+ *   int pkt_lens[], int count, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera como 'rawnet_recv()' a que llegue un paquete y
+ *   recoge con una sola llamada al sistema ('recvmmsg()') hasta 'count'
+ *   paquetes que ya estén disponibles, sin esperar a los demás.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz por la que se desea recibir.
+ *  'buffers': Array de 'count' buffers donde se copiarán los paquetes.
+ *  'buf_len': Longitud de cada buffer en bytes.
+ * 'pkt_lens': Longitud de cada paquete recibido, que puede ser mayor que
+ *             'buf_len' (igual que en 'rawnet_recv()').
+ *    'count': Número máximo de paquetes a recibir.
+ *  'timeout': Tiempo en milisegundos que debe esperarse al primer paquete.
+ *             Un número negativo indicará que debe esperarse
+ *             indefinidamente, y un '0' que no debe esperarse.
+ *
+ * VALOR DEVUELTO:
+ *   El número de paquetes recibidos, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_recv_batch
+( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+  int pkt_lens[], int count, long int timeout )
+{
+  return rawnet_recv_batch_ts(iface, buffers, buf_len, pkt_lens, NULL,
+                              count, timeout);
+}
+
+
+/* int rawnet_recv_batch_ts
+ * ( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+ *   int pkt_lens[], struct timespec * stamps, int count, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Igual que 'rawnet_recv_batch()', pero además devuelve en 'stamps' (si no
+ *   es NULL) el instante de llegada de cada paquete, o cero si no lo tiene.
+ *
+ * VALOR DEVUELTO:
+ *   El número de paquetes recibidos, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ *   La descripción completa del error puede obtenerse a través de la función
+ *   'rawnet_strerror()'.
+ */
+int rawnet_recv_batch_ts
+( rawiface_t * iface, unsigned char * buffers[], int buf_len,
+  int pkt_lens[], struct timespec * stamps, int count, long int timeout )
+{
+  if (iface == NULL) {
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
     return -1;
   }
+  if (count <= 0) {
+    return 0;
+  }
 
-  if (timeout > 0) {
+  /* Memory-mapped ring: the frames are already there, just copy them */
+  if (iface->rx_ring != NULL) {
+    if (rawring_flush(iface, 0) < 0) {
+      return -1;
+    }
+    int received = 0;
+    while (received < count) {
+      unsigned char * frame;
+      int snap_len = rawring_next(iface, &frame, &pkt_lens[received],
+                                  (received == 0) ? timeout : 0);
+      if (snap_len < 0) {
+        return (received > 0) ? received : -1;
+      } else if (snap_len == 0) {
+        break;
+      }
+      memcpy(buffers[received], frame, (snap_len < buf_len) ? snap_len : buf_len);
+      if (stamps != NULL) {
+        rawnet_copy_stamp(iface, &stamps[received]);
+      }
+      received++;
+    }
+    return received;
+  }
+  if (iface->backend != NULL) {
+    if (iface->backend->flush(iface->backend_state) < 0) {
+      return -1;
+    }
+    int received = 0;
+    while (received < count) {
+      unsigned char * frame;
+      int snap_len = iface->backend->recv(iface->backend_state, &frame,
+                                          &pkt_lens[received],
+                                          (received == 0) ? timeout : 0);
+      if (snap_len < 0) {
+        return (received > 0) ? received : -1;
+      } else if (snap_len == 0) {
+        break;
+      }
+      rawnet_backend_stamp(iface);
+      memcpy(buffers[received], frame, (snap_len < buf_len) ? snap_len : buf_len);
+      if (stamps != NULL) {
+        rawnet_copy_stamp(iface, &stamps[received]);
+      }
+      received++;
+    }
+    return received;
+  }
 
-    /* Use poll() to implement the timer */
+  /* Wait for the first packet with poll(), then take all of them at once */
+  if (timeout != 0) {
     struct pollfd pollfd;
     pollfd.fd = iface->socket_fd;
     pollfd.events = POLLIN | POLLPRI;
     pollfd.revents = 0;
-    int pollfd_num = 1;
 
-    int err = poll(&pollfd, pollfd_num, timeout);
+    int err = poll(&pollfd, 1, timeout);
     if (err == -1) {
-      char * err_str = strerror(errno);
-      snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-               "Cannot wait for next raw frame: %s", err_str);
+      int err_no = errno;
+      rawnet_fail(err_no, "Cannot wait for next raw frame");
       return -1;
-
     } else if (err == 0) {
-
       /* Timeout has expired, return inmediately */
       return 0;
     }
   }
 
-  /* Receive Raw Packet from the interface */
-  int flags = MSG_TRUNC;
-  packet_len = recv(iface->socket_fd, buffer, buf_len, flags);
-  if (packet_len == -1) {
+  struct iovec iovs[count];
+  struct mmsghdr msgs[count];
+  int with_stamps = (stamps != NULL) && iface->timestamps;
+  unsigned char controls[with_stamps ? count : 1][RAWNET_CMSG_SIZE];
+  memset(msgs, 0, sizeof(msgs));
+  int i;
+  for (i=0; i<count; i++) {
+    iovs[i].iov_base = buffers[i];
+    iovs[i].iov_len = buf_len;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (with_stamps) {
+      msgs[i].msg_hdr.msg_control = controls[i];
+      msgs[i].msg_hdr.msg_controllen = RAWNET_CMSG_SIZE;
+    }
+  }
 
-    if ((errno == EAGAIN) && (nonblock_mode == O_NONBLOCK)) {
-      /* Timeout has expired */
-      packet_len = 0;
-    } else {
-      char * err_str = strerror(errno);
-      snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-               "Cannot receive Raw Packet: %s", err_str);
-      return -1;
+  /* MSG_TRUNC: msg_len is the real packet length, as in rawnet_recv() */
+  int received = recvmmsg(iface->socket_fd, msgs, count,
+                          MSG_DONTWAIT | MSG_TRUNC, NULL);
+  if (received == -1) {
+    if ((errno == EAGAIN) || (errno == EINTR)) {
+      /* Nothing left (or interrupted): same as a timeout */
+      return 0;
+    }
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot receive Raw Packets");
+    return -1;
+  }
+  for (i=0; i<received; i++) {
+    pkt_lens[i] = msgs[i].msg_len;
+    if (stamps != NULL) {
+      rawnet_msg_stamp(iface, &msgs[i].msg_hdr);
+      rawnet_copy_stamp(iface, &stamps[i]);
     }
   }
 
-  /* Clear error message */
-  snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-           "No error, everything has gone OK");
+  /* Clear error state */
+  rawnet_clear_error();
 
-  return packet_len;
+  return received;
 }
 
 
@@ -492,28 +1791,44 @@ int rawnet_poll
   int iface_index;
 
   if (ifnum < 1) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "At least one Raw Interface must be specified (ifnum=%d)",
-             ifnum);
+    rawnet_fail(0,
+                "At least one Raw Interface must be specified (ifnum=%d)",
+                ifnum);
     return -1;
   }
 
+  /* Flush queued TX frames. Frames already handed over in a memory-mapped
+     ring need no poll() */
+  int i;
+  for (i=0; i<ifnum; i++) {
+    if ((ifaces[i]->rx_ring != NULL) && (rawring_flush(ifaces[i], 0) < 0)) {
+      return -1;
+    }
+    if ((ifaces[i]->backend != NULL) &&
+        (ifaces[i]->backend->flush(ifaces[i]->backend_state) < 0)) {
+      return -1;
+    }
+  }
+  for (i=0; i<ifnum; i++) {
+    if ((ifaces[i]->rx_ring != NULL) && rawring_ready(ifaces[i]->rx_ring)) {
+      return i;
+    }
+  }
+
   /* Use poll() to listen all interfaces */
   int pollfds_num = ifnum;
   struct pollfd pollfds[pollfds_num];
 
-  int i;
   for (i=0; i<pollfds_num; i++) {
-    pollfds[i].fd = ifaces[i]->socket_fd;
+    pollfds[i].fd = rawiface_getfd(ifaces[i]);
     pollfds[i].events = POLLIN | POLLPRI;
     pollfds[i].revents = 0;
   }
 
   int err = poll(pollfds, pollfds_num, timeout);
   if (err < 0) {
-    char * err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot wait for next Raw Packet: %s", err_str);
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot wait for next Raw Packet");
     return -1;
 
   } else if (err == 0) {
@@ -535,15 +1850,13 @@ int rawnet_poll
     }
 
     if (iface_index == -1) {
-      snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-               "No Raw Interface has any available data !?!");
+      rawnet_fail(0, "No Raw Interface has any available data !?!");
       return -1;
     }
   }
 
-  /* Clear error message */
-  snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-           "No error, everything has gone OK");
+  /* Clear error state */
+  rawnet_clear_error();
 
   return iface_index;
 }
@@ -568,19 +1881,26 @@ int rawnet_poll
 int rawiface_close ( rawiface_t * iface )
 {
   if (iface == NULL) {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Raw Interface has not been initialized or it is 'NULL'");
+    rawnet_fail(0, "Raw Interface has not been initialized or it is 'NULL'");
     return -1;
   }
 
-  int err = close(iface->socket_fd);
+  if (iface->rx_ring != NULL) {
+    rawring_flush(iface, 1);
+  }
+  rawring_close(iface->rx_ring);
+  free(iface->rx_buffer);
+  if (iface->backend != NULL) {
+    iface->backend->flush(iface->backend_state);
+    iface->backend->close(iface->backend_state);
+  }
+
+  int err = (iface->socket_fd != -1) ? close(iface->socket_fd) : 0;
   if (err != 0) {
-    char * err_str = strerror(errno);
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "Cannot close Raw Packet Socket of Interface: %s", err_str);
+    int err_no = errno;
+    rawnet_fail(err_no, "Cannot close Raw Packet Socket of Interface");
   } else {
-    snprintf(rawnet_error, RAWNET_ERROR_LENGTH,
-             "No error, everything went OK");
+    rawnet_clear_error();
   }
 
   free(iface);
@@ -592,16 +1912,49 @@ int rawiface_close ( rawiface_t * iface )
  *
  * DESCRIPCIÓN:
  *   Esta función devuelve el último mensaje de error generado por alguna
- *   función de esta librería.
+ *   función de esta librería en el hilo que la llama. Cada hilo tiene su
+ *   propio estado de error.
  *
  *   Hay funciones que no actualizan este mensaje de error, consulte la
  *   definición de la función.
  *
  * VALOR DEVUELTO:
  *   Cadena de texto con los detalles del último error producido por esta
- *   librería.
+ *   librería. Es válida hasta la siguiente llamada a esta función desde el
+ *   mismo hilo.
  */
 char* rawnet_strerror()
 {
-  return rawnet_error;
+  if (rawnet_err_what == NULL) {
+    return RAWNET_NO_ERROR;
+  }
+  if (rawnet_err_errno == 0) {
+    return (char *) rawnet_err_what;
+  }
+
+  /* GNU strerror_r() may return a static string instead of filling 'buf' */
+  char buf[RAWNET_ERROR_LENGTH];
+  char * err_str = strerror_r(rawnet_err_errno, buf, sizeof(buf));
+  snprintf(rawnet_err_msg, RAWNET_ERROR_LENGTH, "%s: %s",
+           rawnet_err_what, err_str);
+  return rawnet_err_msg;
+}
+
+
+/* int rawnet_errno();
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el código 'errno' del último error generado por
+ *   alguna función de esta librería en el hilo que la llama.
+ *
+ * VALOR DEVUELTO:
+ *   El código 'errno' del último error, o 0 si no se ha producido ningún
+ *   error o éste no se debió a una llamada al sistema.
+ */
+int rawnet_errno()
+{
+  if (rawnet_err_what == NULL) {
+    return 0;
+  }
+  return rawnet_err_errno;
 }
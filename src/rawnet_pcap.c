@@ -0,0 +1,523 @@
+/* Capture file backend for rawnet ("pcap:<file>[,<option>...]").
+ *
+ * There is no network interface: received frames are read from a pcap
+ * capture file and transmitted frames are appended to another one, so the
+ * whole stack can be driven by recorded traffic without privileges and
+ * with repeatable results.
+ *
+ * Options, separated by commas after the input file:
+ *  - "out=<file>": write the transmitted frames to this pcap file (by
+ *    default they are discarded).
+ *  - "fast": deliver the frames as fast as they are read, instead of at
+ *    the pace they were recorded.
+ *  - "mac=<xx:xx:xx:xx:xx:xx>": hardware address of the interface (by
+ *    default RAWNET_PCAP_DEFAULT_MAC). It should be the address of the
+ *    host the capture was taken on, or unicast frames to it are dropped.
+ *
+ * The descriptor returned to the reactor is a timerfd armed at the time
+ * the next frame is due, so it only becomes readable when there is a frame
+ * to read. At the end of the file the link just goes quiet.
+ *
+ * Only classic pcap files with Ethernet frames are read (microsecond or
+ * nanosecond timestamps, either byte order), not pcapng.
+ */
+#include "rawnet_backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+/* Magic numbers of the pcap file header, as read in our byte order */
+#define RAWNET_PCAP_MAGIC_US 0xA1B2C3D4
+#define RAWNET_PCAP_MAGIC_NS 0xA1B23C4D
+#define RAWNET_PCAP_MAGIC_US_SWAPPED 0xD4C3B2A1
+#define RAWNET_PCAP_MAGIC_NS_SWAPPED 0x4D3CB2A1
+/* LINKTYPE_ETHERNET */
+#define RAWNET_PCAP_LINKTYPE_ETHERNET 1
+/* Snapshot length written in the output file */
+#define RAWNET_PCAP_OUT_SNAPLEN 65535
+/* Limits on the record buffer, whatever the input file header says */
+#define RAWNET_PCAP_BUF_MIN 2048
+#define RAWNET_PCAP_BUF_MAX 262144
+/* MTU reported for the interface */
+#define RAWNET_PCAP_MTU 1500
+/* Hardware address used without the "mac=" option (locally administered) */
+#define RAWNET_PCAP_DEFAULT_MAC { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }
+#define RAWNET_PCAP_SPEC_MAX 256
+
+struct pcap_file_header {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct pcap_record_header {
+  uint32_t ts_sec;
+  uint32_t ts_frac;     /* Microseconds, or nanoseconds */
+  uint32_t incl_len;    /* Bytes saved in the file */
+  uint32_t orig_len;    /* Bytes of the frame on the wire */
+};
+
+/* A frame read from the input file */
+struct pcap_frame {
+  unsigned char * data;
+  int len;              /* Bytes in 'data' (the record's incl_len) */
+  struct timespec ts;   /* Recorded arrival time */
+};
+
+struct rawnet_pcap {
+  FILE * in;
+  FILE * out;           /* NULL if transmitted frames are discarded */
+  int swapped;          /* The input file is in the other byte order */
+  int nanoseconds;      /* The input timestamps are in nanoseconds */
+  int buf_size;
+  int fast;
+  unsigned char mac[6];
+  int timer_fd;
+  /* 'next' is the frame the timer is armed for ('eof' once there are no
+     more), 'last' the one returned by the previous recv() */
+  struct pcap_frame next;
+  struct pcap_frame last;
+  int eof;
+  /* Recorded time of the first frame and when it was delivered, to keep
+     the recorded pace */
+  int started;
+  struct timespec first_ts;
+  struct timespec start;
+  int tx_pending;       /* Frames written since the last flush */
+};
+
+
+static uint32_t pcap_u32 ( struct rawnet_pcap * pcap, uint32_t value )
+{
+  return pcap->swapped ? __builtin_bswap32(value) : value;
+}
+
+
+/* Read the next record of the input file into 'pcap->next'. Empty records
+   are skipped, since a frame of 0 bytes would read as a timeout. Returns 1,
+   0 at the end of the file or -1. */
+static int pcap_read_next ( struct rawnet_pcap * pcap )
+{
+  struct pcap_record_header rec;
+  int incl_len;
+  do {
+    size_t n = fread(&rec, 1, sizeof(rec), pcap->in);
+    if (n == 0) {
+      return 0;
+    }
+    if (n < sizeof(rec)) {
+      rawnet_seterror("Truncated record header in pcap file");
+      return -1;
+    }
+    incl_len = pcap_u32(pcap, rec.incl_len);
+  } while (incl_len == 0);
+
+  if ((incl_len < 0) || (incl_len > pcap->buf_size)) {
+    rawnet_seterror("Invalid pcap record length %d (max %d)",
+                    incl_len, pcap->buf_size);
+    return -1;
+  }
+  if (fread(pcap->next.data, 1, incl_len, pcap->in) < (size_t) incl_len) {
+    rawnet_seterror("Truncated record in pcap file");
+    return -1;
+  }
+
+  pcap->next.len = incl_len;
+  pcap->next.ts.tv_sec = pcap_u32(pcap, rec.ts_sec);
+  long int frac = pcap_u32(pcap, rec.ts_frac);
+  pcap->next.ts.tv_nsec = pcap->nanoseconds ? frac : frac * 1000;
+
+  return 1;
+}
+
+
+/* Arm the timer for 'pcap->next', or disarm it at the end of the file */
+static int pcap_arm_timer ( struct rawnet_pcap * pcap )
+{
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+
+  if (!pcap->eof) {
+    if (!pcap->started) {
+      pcap->started = 1;
+      pcap->first_ts = pcap->next.ts;
+      clock_gettime(CLOCK_MONOTONIC, &pcap->start);
+    }
+    if (pcap->fast) {
+      /* Any time in the past: already expired */
+      its.it_value.tv_nsec = 1;
+    } else {
+      long int sec = pcap->next.ts.tv_sec - pcap->first_ts.tv_sec;
+      long int nsec = pcap->next.ts.tv_nsec - pcap->first_ts.tv_nsec;
+      /* Out of order records are delivered at once */
+      if ((sec < 0) || ((sec == 0) && (nsec < 0))) {
+        sec = 0;
+        nsec = 0;
+      }
+      its.it_value.tv_sec = pcap->start.tv_sec + sec;
+      its.it_value.tv_nsec = pcap->start.tv_nsec + nsec;
+      while (its.it_value.tv_nsec >= 1000000000L) {
+        its.it_value.tv_sec++;
+        its.it_value.tv_nsec -= 1000000000L;
+      }
+      while (its.it_value.tv_nsec < 0) {
+        its.it_value.tv_sec--;
+        its.it_value.tv_nsec += 1000000000L;
+      }
+      if ((its.it_value.tv_sec == 0) && (its.it_value.tv_nsec == 0)) {
+        its.it_value.tv_nsec = 1;
+      }
+    }
+  }
+
+  if (timerfd_settime(pcap->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+    rawnet_seterror("Cannot arm pcap timer: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+
+/* Load the next frame and arm the timer for it */
+static int pcap_advance ( struct rawnet_pcap * pcap )
+{
+  int err = pcap_read_next(pcap);
+  if (err < 0) {
+    return -1;
+  }
+  pcap->eof = (err == 0);
+  return pcap_arm_timer(pcap);
+}
+
+
+/* Open the input file and check its header */
+static int pcap_open_input ( struct rawnet_pcap * pcap, const char * path )
+{
+  pcap->in = fopen(path, "rb");
+  if (pcap->in == NULL) {
+    rawnet_seterror("Cannot open pcap file \"%s\": %s", path, strerror(errno));
+    return -1;
+  }
+
+  struct pcap_file_header hdr;
+  if (fread(&hdr, 1, sizeof(hdr), pcap->in) < sizeof(hdr)) {
+    rawnet_seterror("\"%s\" is not a pcap file: too short", path);
+    return -1;
+  }
+  switch (hdr.magic) {
+  case RAWNET_PCAP_MAGIC_US:
+    break;
+  case RAWNET_PCAP_MAGIC_NS:
+    pcap->nanoseconds = 1;
+    break;
+  case RAWNET_PCAP_MAGIC_US_SWAPPED:
+    pcap->swapped = 1;
+    break;
+  case RAWNET_PCAP_MAGIC_NS_SWAPPED:
+    pcap->swapped = 1;
+    pcap->nanoseconds = 1;
+    break;
+  default:
+    rawnet_seterror("\"%s\" is not a pcap file (magic 0x%08x; pcapng is not supported)",
+                    path, hdr.magic);
+    return -1;
+  }
+  if (pcap_u32(pcap, hdr.linktype) != RAWNET_PCAP_LINKTYPE_ETHERNET) {
+    rawnet_seterror("pcap file \"%s\" does not hold Ethernet frames (link type %u)",
+                    path, pcap_u32(pcap, hdr.linktype));
+    return -1;
+  }
+
+  uint32_t snaplen = pcap_u32(pcap, hdr.snaplen);
+  if (snaplen < RAWNET_PCAP_BUF_MIN) {
+    snaplen = RAWNET_PCAP_BUF_MIN;
+  } else if (snaplen > RAWNET_PCAP_BUF_MAX) {
+    snaplen = RAWNET_PCAP_BUF_MAX;
+  }
+  pcap->buf_size = snaplen;
+
+  return 0;
+}
+
+
+/* Create the output file and write its header */
+static int pcap_open_output ( struct rawnet_pcap * pcap, const char * path )
+{
+  pcap->out = fopen(path, "wb");
+  if (pcap->out == NULL) {
+    rawnet_seterror("Cannot create pcap file \"%s\": %s", path, strerror(errno));
+    return -1;
+  }
+
+  struct pcap_file_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = RAWNET_PCAP_MAGIC_US;
+  hdr.version_major = 2;
+  hdr.version_minor = 4;
+  hdr.snaplen = RAWNET_PCAP_OUT_SNAPLEN;
+  hdr.linktype = RAWNET_PCAP_LINKTYPE_ETHERNET;
+  if (fwrite(&hdr, sizeof(hdr), 1, pcap->out) != 1) {
+    rawnet_seterror("Cannot write pcap file \"%s\": %s", path, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+static void rawnet_pcap_close ( void * state )
+{
+  struct rawnet_pcap * pcap = state;
+  if (pcap == NULL) {
+    return;
+  }
+
+  if (pcap->in != NULL) {
+    fclose(pcap->in);
+  }
+  if (pcap->out != NULL) {
+    fclose(pcap->out);
+  }
+  if (pcap->timer_fd != -1) {
+    close(pcap->timer_fd);
+  }
+  free(pcap->next.data);
+  free(pcap->last.data);
+  free(pcap);
+}
+
+
+static void * rawnet_pcap_open ( const char * spec, int ifindex, int socket_fd )
+{
+  char spec_buf[RAWNET_PCAP_SPEC_MAX];
+  if (strlen(spec) >= sizeof(spec_buf)) {
+    rawnet_seterror("pcap specification too long: \"%s\"", spec);
+    return NULL;
+  }
+  strcpy(spec_buf, spec);
+
+  struct rawnet_pcap * pcap = calloc(1, sizeof(struct rawnet_pcap));
+  if (pcap == NULL) {
+    rawnet_seterror("Cannot allocate memory for pcap backend");
+    return NULL;
+  }
+  pcap->timer_fd = -1;
+  unsigned char default_mac[6] = RAWNET_PCAP_DEFAULT_MAC;
+  memcpy(pcap->mac, default_mac, sizeof(pcap->mac));
+
+  /* "<input>[,out=<output>][,fast][,mac=<address>]" */
+  char * saveptr;
+  char * input = strtok_r(spec_buf, ",", &saveptr);
+  char * output = NULL;
+  char * option;
+  while ((option = strtok_r(NULL, ",", &saveptr)) != NULL) {
+    if (strncmp(option, "out=", 4) == 0) {
+      output = option + 4;
+    } else if (strcmp(option, "fast") == 0) {
+      pcap->fast = 1;
+    } else if (strncmp(option, "mac=", 4) == 0) {
+      if (rawnet_parse_mac(option + 4, pcap->mac) < 0) {
+        rawnet_seterror("Invalid pcap \"mac=\" address \"%s\"", option + 4);
+        rawnet_pcap_close(pcap);
+        return NULL;
+      }
+    } else {
+      rawnet_seterror("Unknown pcap option \"%s\"", option);
+      rawnet_pcap_close(pcap);
+      return NULL;
+    }
+  }
+  if (input == NULL) {
+    rawnet_seterror("Missing pcap input file");
+    rawnet_pcap_close(pcap);
+    return NULL;
+  }
+
+  if ((pcap_open_input(pcap, input) < 0) ||
+      ((output != NULL) && (pcap_open_output(pcap, output) < 0))) {
+    rawnet_pcap_close(pcap);
+    return NULL;
+  }
+
+  pcap->next.data = malloc(pcap->buf_size);
+  pcap->last.data = malloc(pcap->buf_size);
+  if ((pcap->next.data == NULL) || (pcap->last.data == NULL)) {
+    rawnet_seterror("Cannot allocate memory for pcap frames");
+    rawnet_pcap_close(pcap);
+    return NULL;
+  }
+
+  pcap->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (pcap->timer_fd == -1) {
+    rawnet_seterror("Cannot create pcap timer: %s", strerror(errno));
+    rawnet_pcap_close(pcap);
+    return NULL;
+  }
+
+  /* The recorded pace starts with the first frame, right now */
+  if (pcap_advance(pcap) < 0) {
+    rawnet_pcap_close(pcap);
+    return NULL;
+  }
+
+  return pcap;
+}
+
+
+static int rawnet_pcap_getfd ( void * state )
+{
+  struct rawnet_pcap * pcap = state;
+  return pcap->timer_fd;
+}
+
+
+static int rawnet_pcap_recv
+( void * state, unsigned char ** frame, int * pkt_len, long int timeout )
+{
+  struct rawnet_pcap * pcap = state;
+
+  /* Wait for the next frame to be due. At the end of the file the timer
+     is disarmed and this just waits for 'timeout'. */
+  struct pollfd pollfd;
+  pollfd.fd = pcap->timer_fd;
+  pollfd.events = POLLIN;
+  int ready = poll(&pollfd, 1, (timeout < 0) ? -1 : (int) timeout);
+  if (ready == -1) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    rawnet_seterror("Cannot wait for pcap frames: %s", strerror(errno));
+    return -1;
+  }
+  if ((ready == 0) || pcap->eof) {
+    return 0;
+  }
+
+  uint64_t expirations;
+  if (read(pcap->timer_fd, &expirations, sizeof(expirations)) == -1) {
+    if (errno == EAGAIN) {
+      return 0;
+    }
+    rawnet_seterror("Cannot read pcap timer: %s", strerror(errno));
+    return -1;
+  }
+
+  /* Hand out 'next' and read the following one into the old buffer */
+  struct pcap_frame tmp = pcap->last;
+  pcap->last = pcap->next;
+  pcap->next = tmp;
+  if (pcap_advance(pcap) < 0) {
+    return -1;
+  }
+
+  /* A record saved with a snaplen holds only 'incl_len' bytes of the frame:
+     report those, never the length on the wire, so callers do not read past
+     the data (pcap_read_next() keeps it within 'buf_size') */
+  *frame = pcap->last.data;
+  *pkt_len = pcap->last.len;
+  return pcap->last.len;
+}
+
+
+static int rawnet_pcap_sendv
+( void * state, const struct iovec * iov, int iovcnt )
+{
+  struct rawnet_pcap * pcap = state;
+
+  int len = 0;
+  int i;
+  for (i=0; i<iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  if (pcap->out == NULL) {
+    return len;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  struct pcap_record_header rec;
+  rec.ts_sec = now.tv_sec;
+  rec.ts_frac = now.tv_nsec / 1000;
+  rec.incl_len = (len > RAWNET_PCAP_OUT_SNAPLEN) ? RAWNET_PCAP_OUT_SNAPLEN : len;
+  rec.orig_len = len;
+
+  int err = (fwrite(&rec, sizeof(rec), 1, pcap->out) != 1);
+  int left = rec.incl_len;
+  for (i=0; (i<iovcnt) && (left > 0) && !err; i++) {
+    int chunk = ((int) iov[i].iov_len < left) ? (int) iov[i].iov_len : left;
+    err = (fwrite(iov[i].iov_base, 1, chunk, pcap->out) != (size_t) chunk);
+    left -= chunk;
+  }
+  if (err) {
+    rawnet_seterror("Cannot write to pcap file: %s", strerror(errno));
+    return -1;
+  }
+  pcap->tx_pending++;
+
+  return len;
+}
+
+
+static int rawnet_pcap_flush ( void * state )
+{
+  struct rawnet_pcap * pcap = state;
+
+  int pending = pcap->tx_pending;
+  pcap->tx_pending = 0;
+  if ((pcap->out != NULL) && (fflush(pcap->out) != 0)) {
+    rawnet_seterror("Cannot write to pcap file: %s", strerror(errno));
+    return -1;
+  }
+  return pending;
+}
+
+
+static int rawnet_pcap_getaddr ( void * state, unsigned char addr[] )
+{
+  struct rawnet_pcap * pcap = state;
+  memcpy(addr, pcap->mac, sizeof(pcap->mac));
+  return sizeof(pcap->mac);
+}
+
+
+static int rawnet_pcap_getmtu ( void * state )
+{
+  return RAWNET_PCAP_MTU;
+}
+
+
+/* The frame arrived when the capture recorded it, not when it is replayed */
+static int rawnet_pcap_getstamp ( void * state, struct timespec * stamp )
+{
+  struct rawnet_pcap * pcap = state;
+  *stamp = pcap->last.ts;
+  return 0;
+}
+
+
+const struct rawnet_backend rawnet_pcap_backend = {
+  "pcap:",
+  0,
+  0,
+  0,
+  rawnet_pcap_open,
+  rawnet_pcap_getfd,
+  rawnet_pcap_recv,
+  rawnet_pcap_sendv,
+  rawnet_pcap_flush,
+  rawnet_pcap_close,
+  rawnet_pcap_getaddr,
+  rawnet_pcap_getmtu,
+  rawnet_pcap_getstamp,
+};
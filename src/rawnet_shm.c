@@ -0,0 +1,425 @@
+/* Shared memory link backend for rawnet ("shm:<link>[,mac=<address>]").
+ *
+ * A link is a point-to-point virtual Ethernet cable between two rawnet
+ * interfaces, in the same process or in different ones: the first
+ * rawiface_open() of "shm:<link>" takes one end and the second one the
+ * other. There is no kernel interface, so many stacks can be wired
+ * together on one machine at memory speed.
+ *
+ * The link is a POSIX shared memory object ("/rawnet-<link>") holding one
+ * ring per direction. Each ring has a single sender and a single receiver,
+ * so it needs no locks: the sender only writes 'tail' and the receiver
+ * only writes 'head'. Frames are copied into fixed size slots and become
+ * visible to the other end on the next flush, which also rings the other
+ * end's doorbell: a FIFO ("/dev/shm/rawnet-<link>.<end>") that is the
+ * descriptor returned to the reactor.
+ *
+ * The object is created zero-filled, which is a valid empty link, so both
+ * ends can race to create it. It is removed when the last end is closed.
+ * An end whose process died can be taken again.
+ *
+ * Each end's address is derived from the link name, so it is stable
+ * across runs and different on every link end.
+ */
+#include "rawnet_backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define RAWNET_SHM_NAME_PREFIX "/rawnet-"
+/* Where the FIFOs go: the same tmpfs as the shared memory objects */
+#define RAWNET_SHM_DIR "/dev/shm"
+#define RAWNET_SHM_LINK_MAX 200
+/* Slots per ring (a power of 2) and size of each one */
+#define RAWNET_SHM_SLOTS 128
+#define RAWNET_SHM_SLOT_SIZE 2048
+#define RAWNET_SHM_MTU 1500
+#define RAWNET_SHM_CACHELINE 64
+
+struct shm_slot {
+  uint32_t len;
+  unsigned char data[RAWNET_SHM_SLOT_SIZE - sizeof(uint32_t)];
+};
+
+struct shm_ring {
+  /* Next slot to read, only written by the receiver */
+  uint32_t head __attribute__((aligned(RAWNET_SHM_CACHELINE)));
+  /* Next slot to fill, only written by the sender */
+  uint32_t tail __attribute__((aligned(RAWNET_SHM_CACHELINE)));
+  struct shm_slot slots[RAWNET_SHM_SLOTS] __attribute__((aligned(RAWNET_SHM_CACHELINE)));
+};
+
+/* Layout of the shared memory object. End 'i' sends on 'rings[i]'. */
+struct shm_link {
+  pid_t owner[2];       /* Process holding each end, or 0 */
+  struct shm_ring rings[2];
+};
+
+struct rawnet_shm {
+  char link_name[RAWNET_SHM_LINK_MAX + 1];
+  int end;
+  struct shm_link * link;
+  struct shm_ring * tx;
+  struct shm_ring * rx;
+  uint32_t tx_tail;     /* Slots filled, published on the next flush */
+  int rx_held;          /* The last frame returned still holds its slot */
+  int rx_fd;            /* Our doorbell */
+  int peer_fd;          /* The other end's doorbell */
+  unsigned char mac[6];
+};
+
+
+static void shm_fifo_path ( const char * link_name, int end, char path[], int path_len )
+{
+  snprintf(path, path_len, "%s%s%s.%d", RAWNET_SHM_DIR, RAWNET_SHM_NAME_PREFIX,
+           link_name, end);
+}
+
+
+/* Take a free end of the link, or one left by a process that died */
+static int shm_claim_end ( struct shm_link * link )
+{
+  pid_t self = getpid();
+  int end;
+  for (end=0; end<2; end++) {
+    pid_t owner = 0;
+    if (__atomic_compare_exchange_n(&link->owner[end], &owner, self, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return end;
+    }
+    if ((owner != self) && (kill(owner, 0) == -1) && (errno == ESRCH) &&
+        __atomic_compare_exchange_n(&link->owner[end], &owner, self, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return end;
+    }
+  }
+  return -1;
+}
+
+
+/* Open (creating it if needed) the doorbell FIFO of 'end'. O_RDWR never
+   blocks nor fails for lack of a reader. */
+static int shm_open_fifo ( const char * link_name, int end )
+{
+  char path[sizeof(RAWNET_SHM_DIR) + sizeof(RAWNET_SHM_NAME_PREFIX) + RAWNET_SHM_LINK_MAX + 8];
+  shm_fifo_path(link_name, end, path, sizeof(path));
+  if ((mkfifo(path, 0600) == -1) && (errno != EEXIST)) {
+    rawnet_seterror("Cannot create FIFO \"%s\": %s", path, strerror(errno));
+    return -1;
+  }
+  int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    rawnet_seterror("Cannot open FIFO \"%s\": %s", path, strerror(errno));
+  }
+  return fd;
+}
+
+
+/* Empty our doorbell */
+static void shm_drain ( struct rawnet_shm * shm )
+{
+  char buf[64];
+  while (read(shm->rx_fd, buf, sizeof(buf)) > 0) {
+  }
+}
+
+
+static void rawnet_shm_close ( void * state )
+{
+  struct rawnet_shm * shm = state;
+  if (shm == NULL) {
+    return;
+  }
+
+  if (shm->rx_fd != -1) {
+    close(shm->rx_fd);
+  }
+  if (shm->peer_fd != -1) {
+    close(shm->peer_fd);
+  }
+  if (shm->link != NULL) {
+    if (shm->end >= 0) {
+      __atomic_store_n(&shm->link->owner[shm->end], 0, __ATOMIC_RELEASE);
+      /* The last end out removes the link */
+      if (__atomic_load_n(&shm->link->owner[1 - shm->end], __ATOMIC_ACQUIRE) == 0) {
+        char name[sizeof(RAWNET_SHM_NAME_PREFIX) + RAWNET_SHM_LINK_MAX];
+        snprintf(name, sizeof(name), "%s%s", RAWNET_SHM_NAME_PREFIX, shm->link_name);
+        shm_unlink(name);
+        int end;
+        for (end=0; end<2; end++) {
+          char path[sizeof(RAWNET_SHM_DIR) + sizeof(RAWNET_SHM_NAME_PREFIX) + RAWNET_SHM_LINK_MAX + 8];
+          shm_fifo_path(shm->link_name, end, path, sizeof(path));
+          unlink(path);
+        }
+      }
+    }
+    munmap(shm->link, sizeof(struct shm_link));
+  }
+  free(shm);
+}
+
+
+static void * rawnet_shm_open ( const char * spec, int ifindex, int socket_fd )
+{
+  struct rawnet_shm * shm = calloc(1, sizeof(struct rawnet_shm));
+  if (shm == NULL) {
+    rawnet_seterror("Cannot allocate memory for shm backend");
+    return NULL;
+  }
+  shm->end = -1;
+  shm->rx_fd = -1;
+  shm->peer_fd = -1;
+
+  /* "<link>[,mac=<address>]" */
+  const char * mac = NULL;
+  const char * comma = strchr(spec, ',');
+  size_t name_len = (comma != NULL) ? (size_t) (comma - spec) : strlen(spec);
+  if (comma != NULL) {
+    if (strncmp(comma + 1, "mac=", 4) != 0) {
+      rawnet_seterror("Unknown shm option \"%s\"", comma + 1);
+      rawnet_shm_close(shm);
+      return NULL;
+    }
+    mac = comma + 5;
+  }
+  if ((name_len == 0) || (name_len > RAWNET_SHM_LINK_MAX) ||
+      (memchr(spec, '/', name_len) != NULL)) {
+    rawnet_seterror("Invalid shm link name \"%s\"", spec);
+    rawnet_shm_close(shm);
+    return NULL;
+  }
+  memcpy(shm->link_name, spec, name_len);
+  shm->link_name[name_len] = '\0';
+
+  char name[sizeof(RAWNET_SHM_NAME_PREFIX) + RAWNET_SHM_LINK_MAX];
+  snprintf(name, sizeof(name), "%s%s", RAWNET_SHM_NAME_PREFIX, shm->link_name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    rawnet_seterror("Cannot open shared memory \"%s\": %s", name, strerror(errno));
+    rawnet_shm_close(shm);
+    return NULL;
+  }
+  /* Growing it zero-fills it: a new link is ready as it is */
+  struct stat st;
+  if ((fstat(fd, &st) == -1) ||
+      ((st.st_size < (off_t) sizeof(struct shm_link)) &&
+       (ftruncate(fd, sizeof(struct shm_link)) == -1))) {
+    rawnet_seterror("Cannot size shared memory \"%s\": %s", name, strerror(errno));
+    close(fd);
+    rawnet_shm_close(shm);
+    return NULL;
+  }
+  void * map = mmap(NULL, sizeof(struct shm_link), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    rawnet_seterror("Cannot map shared memory \"%s\": %s", name, strerror(errno));
+    rawnet_shm_close(shm);
+    return NULL;
+  }
+  shm->link = map;
+
+  shm->end = shm_claim_end(shm->link);
+  if (shm->end < 0) {
+    rawnet_seterror("Both ends of shm link \"%s\" are in use", shm->link_name);
+    rawnet_shm_close(shm);
+    return NULL;
+  }
+  shm->tx = &shm->link->rings[shm->end];
+  shm->rx = &shm->link->rings[1 - shm->end];
+
+  /* Frames left by a previous owner of this end are dropped */
+  shm->tx_tail = __atomic_load_n(&shm->tx->tail, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&shm->rx->head, __atomic_load_n(&shm->rx->tail, __ATOMIC_ACQUIRE),
+                   __ATOMIC_RELEASE);
+
+  shm->rx_fd = shm_open_fifo(shm->link_name, shm->end);
+  shm->peer_fd = shm_open_fifo(shm->link_name, 1 - shm->end);
+  if ((shm->rx_fd == -1) || (shm->peer_fd == -1)) {
+    rawnet_shm_close(shm);
+    return NULL;
+  }
+  shm_drain(shm);
+
+  if (mac != NULL) {
+    if (rawnet_parse_mac(mac, shm->mac) < 0) {
+      rawnet_seterror("Invalid shm \"mac=\" address \"%s\"", mac);
+      rawnet_shm_close(shm);
+      return NULL;
+    }
+  } else {
+    /* 02:<FNV-1a hash of the link name>:<end + 1> */
+    uint32_t hash = 2166136261U;
+    size_t i;
+    for (i=0; i<name_len; i++) {
+      hash = (hash ^ (unsigned char) shm->link_name[i]) * 16777619U;
+    }
+    shm->mac[0] = 0x02;
+    shm->mac[1] = hash >> 24;
+    shm->mac[2] = hash >> 16;
+    shm->mac[3] = hash >> 8;
+    shm->mac[4] = hash;
+    shm->mac[5] = shm->end + 1;
+  }
+
+  return shm;
+}
+
+
+static int rawnet_shm_getfd ( void * state )
+{
+  struct rawnet_shm * shm = state;
+  return shm->rx_fd;
+}
+
+
+static int rawnet_shm_recv
+( void * state, unsigned char ** frame, int * pkt_len, long int timeout )
+{
+  struct rawnet_shm * shm = state;
+  struct shm_ring * rx = shm->rx;
+
+  uint32_t head = rx->head;
+  if (shm->rx_held) {
+    head++;
+    __atomic_store_n(&rx->head, head, __ATOMIC_RELEASE);
+    shm->rx_held = 0;
+  }
+
+  /* Empty the doorbell before looking at the ring, so a frame published
+     after looking still leaves it readable */
+  int drained = 0;
+  while (__atomic_load_n(&rx->tail, __ATOMIC_ACQUIRE) == head) {
+    if (!drained) {
+      shm_drain(shm);
+      drained = 1;
+      continue;
+    }
+    if (timeout == 0) {
+      return 0;
+    }
+    struct pollfd pollfd;
+    pollfd.fd = shm->rx_fd;
+    pollfd.events = POLLIN;
+    int ready = poll(&pollfd, 1, (timeout < 0) ? -1 : (int) timeout);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        return 0;
+      }
+      rawnet_seterror("Cannot wait for shm frames: %s", strerror(errno));
+      return -1;
+    }
+    if (ready == 0) {
+      return 0;
+    }
+    shm_drain(shm);
+    /* Only wait once */
+    timeout = 0;
+  }
+
+  struct shm_slot * slot = &rx->slots[head & (RAWNET_SHM_SLOTS - 1)];
+  shm->rx_held = 1;
+  /* The peer writes the length: read it once and never trust it beyond the
+     slot, since rawnet_recv() copies that many bytes out of it */
+  uint32_t len = __atomic_load_n(&slot->len, __ATOMIC_RELAXED);
+  if (len > sizeof(slot->data)) {
+    len = sizeof(slot->data);
+  }
+  *frame = slot->data;
+  *pkt_len = len;
+  return len;
+}
+
+
+static int rawnet_shm_sendv
+( void * state, const struct iovec * iov, int iovcnt )
+{
+  struct rawnet_shm * shm = state;
+  struct shm_ring * tx = shm->tx;
+
+  uint32_t head = __atomic_load_n(&tx->head, __ATOMIC_ACQUIRE);
+  if (shm->tx_tail - head >= RAWNET_SHM_SLOTS) {
+    rawnet_seterror("shm link \"%s\" is full, call rawnet_flush()",
+                    shm->link_name);
+    return -2;
+  }
+
+  struct shm_slot * slot = &tx->slots[shm->tx_tail & (RAWNET_SHM_SLOTS - 1)];
+  size_t len = 0;
+  int i;
+  for (i=0; i<iovcnt; i++) {
+    if (len + iov[i].iov_len > sizeof(slot->data)) {
+      rawnet_seterror("Frame too long for shm link (%d bytes max)",
+                      (int) sizeof(slot->data));
+      return -1;
+    }
+    memcpy(slot->data + len, iov[i].iov_base, iov[i].iov_len);
+    len += iov[i].iov_len;
+  }
+  slot->len = len;
+  shm->tx_tail++;
+
+  return len;
+}
+
+
+static int rawnet_shm_flush ( void * state )
+{
+  struct rawnet_shm * shm = state;
+
+  int pending = shm->tx_tail - shm->tx->tail;
+  if (pending == 0) {
+    return 0;
+  }
+  __atomic_store_n(&shm->tx->tail, shm->tx_tail, __ATOMIC_RELEASE);
+
+  /* A full FIFO has already woken the other end up */
+  char bell = 1;
+  if ((write(shm->peer_fd, &bell, 1) == -1) && (errno != EAGAIN)) {
+    rawnet_seterror("Cannot signal shm link \"%s\": %s",
+                    shm->link_name, strerror(errno));
+    return -1;
+  }
+  return pending;
+}
+
+
+static int rawnet_shm_getaddr ( void * state, unsigned char addr[] )
+{
+  struct rawnet_shm * shm = state;
+  memcpy(addr, shm->mac, sizeof(shm->mac));
+  return sizeof(shm->mac);
+}
+
+
+static int rawnet_shm_getmtu ( void * state )
+{
+  return RAWNET_SHM_MTU;
+}
+
+
+const struct rawnet_backend rawnet_shm_backend = {
+  "shm:",
+  0,
+  0,
+  0,
+  rawnet_shm_open,
+  rawnet_shm_getfd,
+  rawnet_shm_recv,
+  rawnet_shm_sendv,
+  rawnet_shm_flush,
+  rawnet_shm_close,
+  rawnet_shm_getaddr,
+  rawnet_shm_getmtu,
+  NULL,
+};
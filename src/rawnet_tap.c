@@ -0,0 +1,303 @@
+/* TAP device backend for rawnet ("tap:<ifname>[,mac=<address>]").
+ *
+ * Frames are read from and written to a TAP device (/dev/net/tun with
+ * IFF_TAP | IFF_NO_PI) instead of an AF_PACKET socket: the kernel is the
+ * other end of a private virtual link, and no CAP_NET_RAW is needed. The
+ * device is normally created beforehand and given to the user running the
+ * stack, e.g.
+ *
+ *   ip tuntap add dev tap0 mode tap user <user> multi_queue
+ *   ip addr add 10.0.1.1/24 dev tap0 && ip link set tap0 up
+ *
+ * (creating it here needs CAP_NET_ADMIN, and it would still have to be
+ * configured and brought up).
+ *
+ * Queues are attached with IFF_MULTI_QUEUE when the device allows it: each
+ * rawiface_open() of the same device is then a new queue, and the kernel
+ * spreads the flows it sends among them, so PACKET_FANOUT style workers
+ * can share a TAP device. Single queue devices are opened without it.
+ *
+ * The interface address is the one at the other end of the link: by
+ * default the TAP device address with the last byte changed, since the
+ * device address belongs to the kernel.
+ */
+#include "rawnet_backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#define RAWNET_TAP_DEVICE "/dev/net/tun"
+/* Room for the Ethernet header (and a VLAN tag) on top of the MTU */
+#define RAWNET_TAP_HEADROOM 18
+#define RAWNET_TAP_BUF_MIN 2048
+#define RAWNET_TAP_SPEC_MAX 64
+/* Byte XORed into the last byte of the device address for ours */
+#define RAWNET_TAP_MAC_XOR 0x01
+
+struct rawnet_tap {
+  int fd;
+  int ctl_fd;           /* AF_INET socket for the ioctl()s */
+  char ifname[IFNAMSIZ];
+  unsigned char mac[6];
+  unsigned char * rx_buf;
+  int rx_buf_size;
+};
+
+
+static void rawnet_tap_close ( void * state )
+{
+  struct rawnet_tap * tap = state;
+  if (tap == NULL) {
+    return;
+  }
+
+  if (tap->fd != -1) {
+    close(tap->fd);
+  }
+  if (tap->ctl_fd != -1) {
+    close(tap->ctl_fd);
+  }
+  free(tap->rx_buf);
+  free(tap);
+}
+
+
+/* Attach to (or create) the TAP device 'ifname', as one more queue if it
+   is a multi-queue device */
+static int tap_attach ( struct rawnet_tap * tap )
+{
+  tap->fd = open(RAWNET_TAP_DEVICE, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (tap->fd == -1) {
+    rawnet_seterror("Cannot open %s: %s", RAWNET_TAP_DEVICE, strerror(errno));
+    return -1;
+  }
+
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strcpy(ifr.ifr_name, tap->ifname);
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_MULTI_QUEUE;
+  if (ioctl(tap->fd, TUNSETIFF, &ifr) == -1) {
+    /* An existing single queue device rejects IFF_MULTI_QUEUE */
+    if (errno != EINVAL) {
+      rawnet_seterror("Cannot attach to TAP device \"%s\": %s",
+                      tap->ifname, strerror(errno));
+      return -1;
+    }
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    if (ioctl(tap->fd, TUNSETIFF, &ifr) == -1) {
+      rawnet_seterror("Cannot attach to TAP device \"%s\": %s",
+                      tap->ifname, strerror(errno));
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+static void * rawnet_tap_open ( const char * spec, int ifindex, int socket_fd )
+{
+  char spec_buf[RAWNET_TAP_SPEC_MAX];
+  if (strlen(spec) >= sizeof(spec_buf)) {
+    rawnet_seterror("TAP specification too long: \"%s\"", spec);
+    return NULL;
+  }
+  strcpy(spec_buf, spec);
+
+  struct rawnet_tap * tap = calloc(1, sizeof(struct rawnet_tap));
+  if (tap == NULL) {
+    rawnet_seterror("Cannot allocate memory for TAP backend");
+    return NULL;
+  }
+  tap->fd = -1;
+  tap->ctl_fd = -1;
+
+  /* "<ifname>[,mac=<address>]" */
+  char * saveptr;
+  char * ifname = strtok_r(spec_buf, ",", &saveptr);
+  char * mac = NULL;
+  char * option;
+  while ((option = strtok_r(NULL, ",", &saveptr)) != NULL) {
+    if (strncmp(option, "mac=", 4) == 0) {
+      mac = option + 4;
+    } else {
+      rawnet_seterror("Unknown TAP option \"%s\"", option);
+      rawnet_tap_close(tap);
+      return NULL;
+    }
+  }
+  if ((ifname == NULL) || (strlen(ifname) >= IFNAMSIZ)) {
+    rawnet_seterror("Invalid TAP device name \"%s\"", spec);
+    rawnet_tap_close(tap);
+    return NULL;
+  }
+  strcpy(tap->ifname, ifname);
+
+  if (tap_attach(tap) < 0) {
+    rawnet_tap_close(tap);
+    return NULL;
+  }
+
+  /* The ioctl()s on the device need no privileges on any socket */
+  tap->ctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (tap->ctl_fd == -1) {
+    rawnet_seterror("Cannot create socket: %s", strerror(errno));
+    rawnet_tap_close(tap);
+    return NULL;
+  }
+
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strcpy(ifr.ifr_name, tap->ifname);
+  if (mac != NULL) {
+    if (rawnet_parse_mac(mac, tap->mac) < 0) {
+      rawnet_seterror("Invalid TAP \"mac=\" address \"%s\"", mac);
+      rawnet_tap_close(tap);
+      return NULL;
+    }
+  } else {
+    if (ioctl(tap->ctl_fd, SIOCGIFHWADDR, &ifr) == -1) {
+      rawnet_seterror("Cannot obtain TAP device HW address: %s",
+                      strerror(errno));
+      rawnet_tap_close(tap);
+      return NULL;
+    }
+    memcpy(tap->mac, ifr.ifr_hwaddr.sa_data, sizeof(tap->mac));
+    tap->mac[5] ^= RAWNET_TAP_MAC_XOR;
+  }
+
+  int mtu = 0;
+  if (ioctl(tap->ctl_fd, SIOCGIFMTU, &ifr) == 0) {
+    mtu = ifr.ifr_mtu;
+  }
+  tap->rx_buf_size = mtu + RAWNET_TAP_HEADROOM;
+  if (tap->rx_buf_size < RAWNET_TAP_BUF_MIN) {
+    tap->rx_buf_size = RAWNET_TAP_BUF_MIN;
+  }
+  tap->rx_buf = malloc(tap->rx_buf_size);
+  if (tap->rx_buf == NULL) {
+    rawnet_seterror("Cannot allocate memory for TAP frames");
+    rawnet_tap_close(tap);
+    return NULL;
+  }
+
+  return tap;
+}
+
+
+static int rawnet_tap_getfd ( void * state )
+{
+  struct rawnet_tap * tap = state;
+  return tap->fd;
+}
+
+
+static int rawnet_tap_recv
+( void * state, unsigned char ** frame, int * pkt_len, long int timeout )
+{
+  struct rawnet_tap * tap = state;
+
+  ssize_t len = read(tap->fd, tap->rx_buf, tap->rx_buf_size);
+  if ((len == -1) && (errno == EAGAIN) && (timeout != 0)) {
+    struct pollfd pollfd;
+    pollfd.fd = tap->fd;
+    pollfd.events = POLLIN;
+    int ready = poll(&pollfd, 1, (timeout < 0) ? -1 : (int) timeout);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        return 0;
+      }
+      rawnet_seterror("Cannot wait for TAP frames: %s", strerror(errno));
+      return -1;
+    }
+    if (ready == 0) {
+      return 0;
+    }
+    len = read(tap->fd, tap->rx_buf, tap->rx_buf_size);
+  }
+  if (len == -1) {
+    if ((errno == EAGAIN) || (errno == EINTR)) {
+      return 0;
+    }
+    rawnet_seterror("Cannot read from TAP device: %s", strerror(errno));
+    return -1;
+  }
+
+  *frame = tap->rx_buf;
+  *pkt_len = len;
+  return len;
+}
+
+
+static int rawnet_tap_sendv
+( void * state, const struct iovec * iov, int iovcnt )
+{
+  struct rawnet_tap * tap = state;
+
+  ssize_t len = writev(tap->fd, iov, iovcnt);
+  if (len == -1) {
+    if (errno == EAGAIN) {
+      return -2;
+    }
+    rawnet_seterror("Cannot write to TAP device: %s", strerror(errno));
+    return -1;
+  }
+  return len;
+}
+
+
+/* Every frame is written at once */
+static int rawnet_tap_flush ( void * state )
+{
+  return 0;
+}
+
+
+static int rawnet_tap_getaddr ( void * state, unsigned char addr[] )
+{
+  struct rawnet_tap * tap = state;
+  memcpy(addr, tap->mac, sizeof(tap->mac));
+  return sizeof(tap->mac);
+}
+
+
+static int rawnet_tap_getmtu ( void * state )
+{
+  struct rawnet_tap * tap = state;
+
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strcpy(ifr.ifr_name, tap->ifname);
+  if (ioctl(tap->ctl_fd, SIOCGIFMTU, &ifr) == -1) {
+    rawnet_seterror("Cannot obtain TAP device MTU: %s", strerror(errno));
+    return -1;
+  }
+  return ifr.ifr_mtu;
+}
+
+
+const struct rawnet_backend rawnet_tap_backend = {
+  "tap:",
+  0,
+  0,
+  1,
+  rawnet_tap_open,
+  rawnet_tap_getfd,
+  rawnet_tap_recv,
+  rawnet_tap_sendv,
+  rawnet_tap_flush,
+  rawnet_tap_close,
+  rawnet_tap_getaddr,
+  rawnet_tap_getmtu,
+  NULL,
+};
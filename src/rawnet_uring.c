@@ -0,0 +1,624 @@
+/* io_uring backend for rawnet ("uring:<ifname>").
+ *
+ * The AF_PACKET socket of rawnet is driven through an io_uring instead of
+ * one system call per frame:
+ *  - A single multishot recv keeps receiving into a ring of provided
+ *    buffers, so there is no poll()+recv() pair per frame.
+ *  - Frames are sent with WRITE_FIXED from a registered buffer area. They
+ *    are only queued as SQEs and submitted together on the next flush or
+ *    wait, in the same io_uring_enter() that reaps the completions.
+ *  - Waits use the io_uring_enter() timeout (IORING_ENTER_EXT_ARG).
+ *
+ * The descriptor returned to the reactor is an eventfd registered with the
+ * ring, which is also signalled when frames reaped while sending are left
+ * waiting to be read.
+ *
+ * No liburing: the ring is set up and used with the raw system calls.
+ */
+#include "rawnet_backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Submission queue entries; the completion queue is twice as large */
+#define RAWNET_URING_ENTRIES 256
+/* Provided receive buffers (a power of 2) and registered send buffers */
+#define RAWNET_URING_RX_BUF_NR 256
+#define RAWNET_URING_TX_BUF_NR 128
+#define RAWNET_URING_BUF_SIZE 2048
+/* Buffer group of the receive buffers */
+#define RAWNET_URING_BGID 0
+/* Maximum time sendv() waits for a send buffer to be completed */
+#define RAWNET_URING_TX_WAIT_MS 1000
+
+/* user_data of the SQEs: kind in the upper half, send buffer in the lower */
+#define RAWNET_URING_TAG_RX 1ULL
+#define RAWNET_URING_TAG_TX 2ULL
+#define RAWNET_URING_TAG(user_data) ((user_data) >> 32)
+#define RAWNET_URING_INDEX(user_data) ((int) ((user_data) & 0xFFFFFFFF))
+
+/* A received frame not read yet */
+struct uring_rx_frame {
+  uint16_t bid;
+  int len;
+};
+
+struct rawnet_uring {
+  int ring_fd;
+  int socket_fd;
+  int event_fd;
+  /* Submission queue */
+  void * sq_map;
+  size_t sq_map_len;
+  uint32_t * sq_head;
+  uint32_t * sq_tail;
+  uint32_t sq_mask;
+  uint32_t sq_entries;
+  uint32_t * sq_array;
+  struct io_uring_sqe * sqes;
+  size_t sqes_len;
+  unsigned int sq_pending;       /* SQEs not submitted yet */
+  unsigned int tx_pending;       /* Of those, the frames to send */
+  /* Completion queue */
+  void * cq_map;
+  size_t cq_map_len;
+  uint32_t * cq_head;
+  uint32_t * cq_tail;
+  uint32_t cq_mask;
+  struct io_uring_cqe * cqes;
+  /* Receive side */
+  struct io_uring_buf_ring * buf_ring;
+  size_t buf_ring_len;
+  unsigned char * rx_bufs;
+  int rx_armed;                  /* The multishot recv is active */
+  int rx_error;                  /* errno of a failed recv, or 0 */
+  int rx_held;                   /* Buffer returned by the last recv(), or -1 */
+  struct uring_rx_frame rx_ready[RAWNET_URING_RX_BUF_NR];
+  int rx_ready_head;
+  int rx_ready_num;
+  /* Send side */
+  unsigned char * tx_bufs;
+  int tx_len[RAWNET_URING_TX_BUF_NR];
+  int tx_free[RAWNET_URING_TX_BUF_NR];
+  int tx_free_num;
+  unsigned int tx_dropped;       /* Frames dropped on a full socket buffer */
+};
+
+
+static int uring_setup ( unsigned int entries, struct io_uring_params * params )
+{
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_register
+( int ring_fd, unsigned int opcode, void * arg, unsigned int nr_args )
+{
+  return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static long int uring_now_ms ()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000L) + (ts.tv_nsec / 1000000L);
+}
+
+/* Submit the queued SQEs and, if 'wait' is set, wait up to 'timeout' ms
+   (negative: forever) for at least one completion. Returns 0 or -1 */
+static int uring_enter ( struct rawnet_uring * uring, int wait, long int timeout )
+{
+  unsigned int flags = 0;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  void * argp = NULL;
+  size_t argsz = 0;
+
+  if (wait) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout >= 0) {
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000L;
+      memset(&arg, 0, sizeof(arg));
+      arg.ts = (uint64_t) (unsigned long) &ts;
+      flags |= IORING_ENTER_EXT_ARG;
+      argp = &arg;
+      argsz = sizeof(arg);
+    }
+  } else if (uring->sq_pending == 0) {
+    return 0;
+  }
+
+  int err = syscall(__NR_io_uring_enter, uring->ring_fd, uring->sq_pending,
+                    wait ? 1 : 0, flags, argp, argsz);
+  if (err == -1) {
+    if ((errno == ETIME) || (errno == EINTR) ||
+        (errno == EAGAIN) || (errno == EBUSY)) {
+      /* Timeout, signal or completion queue to be reaped first */
+      return 0;
+    }
+    rawnet_seterror("Cannot enter io_uring: %s", strerror(errno));
+    return -1;
+  }
+  uring->sq_pending -= (err < (int) uring->sq_pending) ? err : uring->sq_pending;
+  /* SQEs go in order, so the unsubmitted frames are the last ones queued */
+  if (uring->tx_pending > uring->sq_pending) {
+    uring->tx_pending = uring->sq_pending;
+  }
+
+  return 0;
+}
+
+/* Next free SQE, already placed in the submission queue, or NULL if full */
+static struct io_uring_sqe * uring_get_sqe ( struct rawnet_uring * uring )
+{
+  uint32_t head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  uint32_t tail = *uring->sq_tail;
+  if (tail - head >= uring->sq_entries) {
+    return NULL;
+  }
+
+  uint32_t idx = tail & uring->sq_mask;
+  struct io_uring_sqe * sqe = &uring->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  uring->sq_array[idx] = idx;
+  return sqe;
+}
+
+/* Publish the SQE obtained with uring_get_sqe() */
+static void uring_commit_sqe ( struct rawnet_uring * uring )
+{
+  __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+  uring->sq_pending++;
+}
+
+/* Queue the multishot recv that fills the provided buffers */
+static int uring_arm_rx ( struct rawnet_uring * uring )
+{
+  struct io_uring_sqe * sqe = uring_get_sqe(uring);
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = uring->socket_fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = RAWNET_URING_BGID;
+  sqe->user_data = RAWNET_URING_TAG_RX << 32;
+  uring_commit_sqe(uring);
+  uring->rx_armed = 1;
+  return 0;
+}
+
+/* Queue the frame in send buffer 'idx' */
+static int uring_queue_tx ( struct rawnet_uring * uring, int idx )
+{
+  struct io_uring_sqe * sqe = uring_get_sqe(uring);
+  if (sqe == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = uring->socket_fd;
+  sqe->addr = (uint64_t) (unsigned long) (uring->tx_bufs + (idx * RAWNET_URING_BUF_SIZE));
+  sqe->len = uring->tx_len[idx];
+  sqe->off = 0;
+  sqe->buf_index = 0;
+  sqe->user_data = (RAWNET_URING_TAG_TX << 32) | idx;
+  uring_commit_sqe(uring);
+  uring->tx_pending++;
+  return 0;
+}
+
+/* Give receive buffer 'bid' back to the kernel */
+static void uring_rx_recycle ( struct rawnet_uring * uring, int bid )
+{
+  uint16_t tail = uring->buf_ring->tail;
+  struct io_uring_buf * buf =
+    &uring->buf_ring->bufs[tail & (RAWNET_URING_RX_BUF_NR - 1)];
+  buf->addr = (uint64_t) (unsigned long) (uring->rx_bufs + (bid * RAWNET_URING_BUF_SIZE));
+  buf->len = RAWNET_URING_BUF_SIZE;
+  buf->bid = bid;
+  __atomic_store_n(&uring->buf_ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Consume every completion: free the send buffers and queue the received
+   frames in 'rx_ready'. Returns the number of frames queued */
+static int uring_reap ( struct rawnet_uring * uring )
+{
+  int frames = 0;
+  uint32_t head = *uring->cq_head;
+  uint32_t tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe * cqe = &uring->cqes[head & uring->cq_mask];
+
+    if (RAWNET_URING_TAG(cqe->user_data) == RAWNET_URING_TAG_TX) {
+      int idx = RAWNET_URING_INDEX(cqe->user_data);
+      /* An interrupted send is tried again. On a full socket buffer
+         resubmitting at once would only spin until the device drains, so
+         the frame is dropped as a full queue would */
+      if ((cqe->res == -EINTR) && (uring_queue_tx(uring, idx) == 0)) {
+        head++;
+        continue;
+      } else if (cqe->res == -EAGAIN) {
+        uring->tx_dropped++;
+      }
+      uring->tx_free[uring->tx_free_num++] = idx;
+
+    } else {
+      if ((cqe->flags & IORING_CQE_F_BUFFER) && (cqe->res <= 0)) {
+        /* An empty frame would read as a timeout: give the buffer back */
+        uring_rx_recycle(uring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      } else if (cqe->flags & IORING_CQE_F_BUFFER) {
+        int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        int pos = (uring->rx_ready_head + uring->rx_ready_num) % RAWNET_URING_RX_BUF_NR;
+        uring->rx_ready[pos].bid = bid;
+        uring->rx_ready[pos].len = cqe->res;
+        uring->rx_ready_num++;
+        frames++;
+      } else if ((cqe->res < 0) && (cqe->res != -ENOBUFS)) {
+        /* Out of buffers just stops the recv until some are returned */
+        uring->rx_error = -cqe->res;
+      }
+      if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        uring->rx_armed = 0;
+      }
+    }
+    head++;
+  }
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+  return frames;
+}
+
+static void rawnet_uring_close ( void * state )
+{
+  struct rawnet_uring * uring = state;
+  if (uring == NULL) {
+    return;
+  }
+
+  /* Let queued frames go out before the ring (and its requests) go away */
+  if (uring->event_fd != -1) {
+    long int deadline = uring_now_ms() + RAWNET_URING_TX_WAIT_MS;
+    uring_enter(uring, 0, 0);
+    while ((uring->tx_free_num < RAWNET_URING_TX_BUF_NR) &&
+           (uring_now_ms() < deadline)) {
+      if (uring_enter(uring, 1, deadline - uring_now_ms()) == -1) {
+        break;
+      }
+      uring_reap(uring);
+      /* Nobody reads the frames anymore */
+      while (uring->rx_ready_num > 0) {
+        uring_rx_recycle(uring, uring->rx_ready[uring->rx_ready_head].bid);
+        uring->rx_ready_head = (uring->rx_ready_head + 1) % RAWNET_URING_RX_BUF_NR;
+        uring->rx_ready_num--;
+      }
+    }
+  }
+
+  if (uring->ring_fd != -1) {
+    close(uring->ring_fd);
+  }
+  if (uring->event_fd != -1) {
+    close(uring->event_fd);
+  }
+  if (uring->sqes != NULL) {
+    munmap(uring->sqes, uring->sqes_len);
+  }
+  if ((uring->cq_map != NULL) && (uring->cq_map != uring->sq_map)) {
+    munmap(uring->cq_map, uring->cq_map_len);
+  }
+  if (uring->sq_map != NULL) {
+    munmap(uring->sq_map, uring->sq_map_len);
+  }
+  if (uring->buf_ring != NULL) {
+    munmap(uring->buf_ring, uring->buf_ring_len);
+  }
+  free(uring->rx_bufs);
+  free(uring->tx_bufs);
+  free(uring);
+}
+
+static void * rawnet_uring_open ( const char * ifname, int ifindex, int socket_fd )
+{
+  struct rawnet_uring * uring = calloc(1, sizeof(struct rawnet_uring));
+  if (uring == NULL) {
+    rawnet_seterror("Cannot allocate memory for the io_uring");
+    return NULL;
+  }
+  uring->ring_fd = -1;
+  uring->event_fd = -1;
+  uring->socket_fd = socket_fd;
+  uring->rx_held = -1;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  uring->ring_fd = uring_setup(RAWNET_URING_ENTRIES, &params);
+  if (uring->ring_fd == -1) {
+    rawnet_seterror("Cannot create io_uring: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+
+  /* Map the rings (a single mapping for both on any recent kernel) */
+  uring->sq_map_len = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+  uring->cq_map_len = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (uring->cq_map_len > uring->sq_map_len) {
+      uring->sq_map_len = uring->cq_map_len;
+    }
+  }
+  uring->sq_map = mmap(NULL, uring->sq_map_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+  if (uring->sq_map == MAP_FAILED) {
+    uring->sq_map = NULL;
+    rawnet_seterror("Cannot mmap() io_uring: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    uring->cq_map = uring->sq_map;
+  } else {
+    uring->cq_map = mmap(NULL, uring->cq_map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_CQ_RING);
+    if (uring->cq_map == MAP_FAILED) {
+      uring->cq_map = NULL;
+      rawnet_seterror("Cannot mmap() io_uring: %s", strerror(errno));
+      rawnet_uring_close(uring);
+      return NULL;
+    }
+  }
+  uring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = mmap(NULL, uring->sqes_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+  if (uring->sqes == MAP_FAILED) {
+    uring->sqes = NULL;
+    rawnet_seterror("Cannot mmap() io_uring: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+
+  unsigned char * sq = uring->sq_map;
+  uring->sq_head = (uint32_t *) (sq + params.sq_off.head);
+  uring->sq_tail = (uint32_t *) (sq + params.sq_off.tail);
+  uring->sq_mask = *(uint32_t *) (sq + params.sq_off.ring_mask);
+  uring->sq_entries = *(uint32_t *) (sq + params.sq_off.ring_entries);
+  uring->sq_array = (uint32_t *) (sq + params.sq_off.array);
+  unsigned char * cq = uring->cq_map;
+  uring->cq_head = (uint32_t *) (cq + params.cq_off.head);
+  uring->cq_tail = (uint32_t *) (cq + params.cq_off.tail);
+  uring->cq_mask = *(uint32_t *) (cq + params.cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+  /* Receive buffers, provided to the kernel through a buffer ring */
+  uring->rx_bufs = malloc(RAWNET_URING_RX_BUF_NR * RAWNET_URING_BUF_SIZE);
+  uring->tx_bufs = malloc(RAWNET_URING_TX_BUF_NR * RAWNET_URING_BUF_SIZE);
+  if ((uring->rx_bufs == NULL) || (uring->tx_bufs == NULL)) {
+    rawnet_seterror("Cannot allocate memory for the io_uring buffers");
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+  uring->buf_ring_len = RAWNET_URING_RX_BUF_NR * sizeof(struct io_uring_buf);
+  uring->buf_ring = mmap(NULL, uring->buf_ring_len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (uring->buf_ring == MAP_FAILED) {
+    uring->buf_ring = NULL;
+    rawnet_seterror("Cannot allocate io_uring buffer ring: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+  struct io_uring_buf_reg buf_reg;
+  memset(&buf_reg, 0, sizeof(buf_reg));
+  buf_reg.ring_addr = (uint64_t) (unsigned long) uring->buf_ring;
+  buf_reg.ring_entries = RAWNET_URING_RX_BUF_NR;
+  buf_reg.bgid = RAWNET_URING_BGID;
+  if (uring_register(uring->ring_fd, IORING_REGISTER_PBUF_RING, &buf_reg, 1) == -1) {
+    rawnet_seterror("Cannot register io_uring buffer ring: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+  int i;
+  for (i=0; i<RAWNET_URING_RX_BUF_NR; i++) {
+    uring_rx_recycle(uring, i);
+  }
+
+  /* Send buffers, registered once instead of mapped on every send */
+  struct iovec tx_iov;
+  tx_iov.iov_base = uring->tx_bufs;
+  tx_iov.iov_len = RAWNET_URING_TX_BUF_NR * RAWNET_URING_BUF_SIZE;
+  if (uring_register(uring->ring_fd, IORING_REGISTER_BUFFERS, &tx_iov, 1) == -1) {
+    rawnet_seterror("Cannot register io_uring send buffers: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+  for (i=0; i<RAWNET_URING_TX_BUF_NR; i++) {
+    uring->tx_free[i] = i;
+  }
+  uring->tx_free_num = RAWNET_URING_TX_BUF_NR;
+
+  /* Descriptor for poll()/epoll(), signalled on every completion */
+  uring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((uring->event_fd == -1) ||
+      (uring_register(uring->ring_fd, IORING_REGISTER_EVENTFD, &uring->event_fd, 1) == -1)) {
+    rawnet_seterror("Cannot register io_uring eventfd: %s", strerror(errno));
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+
+  /* Start receiving now, so no frame is lost before the first recv() */
+  if ((uring_arm_rx(uring) == -1) || (uring_enter(uring, 0, 0) == -1)) {
+    rawnet_uring_close(uring);
+    return NULL;
+  }
+
+  return uring;
+}
+
+static int rawnet_uring_getfd ( void * state )
+{
+  struct rawnet_uring * uring = state;
+  return uring->event_fd;
+}
+
+static int rawnet_uring_recv
+( void * state, unsigned char ** frame, int * pkt_len, long int timeout )
+{
+  struct rawnet_uring * uring = state;
+
+  /* The previous frame is no longer in use */
+  if (uring->rx_held != -1) {
+    uring_rx_recycle(uring, uring->rx_held);
+    uring->rx_held = -1;
+  }
+
+  long int deadline = (timeout > 0) ? uring_now_ms() + timeout : 0;
+  while (1) {
+    if (uring->rx_ready_num == 0) {
+      uring_reap(uring);
+    }
+    if (uring->rx_ready_num > 0) {
+      struct uring_rx_frame * next = &uring->rx_ready[uring->rx_ready_head];
+      uring->rx_ready_head = (uring->rx_ready_head + 1) % RAWNET_URING_RX_BUF_NR;
+      uring->rx_ready_num--;
+      uring->rx_held = next->bid;
+      *frame = uring->rx_bufs + (next->bid * RAWNET_URING_BUF_SIZE);
+      *pkt_len = next->len;
+      return next->len;
+    }
+
+    if (uring->rx_error != 0) {
+      rawnet_seterror("Cannot receive Raw Packet: %s", strerror(uring->rx_error));
+      uring->rx_error = 0;
+      return -1;
+    }
+    if (!uring->rx_armed && (uring_arm_rx(uring) == -1)) {
+      uring_enter(uring, 0, 0);
+      continue;
+    }
+
+    /* Nothing left: clear the eventfd before waiting, completions posted
+       from now on signal it again */
+    uint64_t events;
+    if ((read(uring->event_fd, &events, sizeof(events)) > 0) &&
+        (uring_reap(uring) > 0)) {
+      continue;
+    }
+
+    long int wait = timeout;
+    if (timeout > 0) {
+      wait = deadline - uring_now_ms();
+      if (wait < 0) {
+        wait = 0;
+      }
+    }
+    if ((timeout == 0) || ((timeout > 0) && (wait == 0))) {
+      /* Submit what is pending and look once more */
+      if (uring_enter(uring, 0, 0) == -1) {
+        return -1;
+      }
+      if (uring_reap(uring) > 0) {
+        continue;
+      }
+      return 0;
+    }
+    if (uring_enter(uring, 1, wait) == -1) {
+      return -1;
+    }
+  }
+}
+
+static int rawnet_uring_flush ( void * state )
+{
+  struct rawnet_uring * uring = state;
+
+  /* Only frames count, not the RX re-arm that may be pending too */
+  unsigned int tx_before = uring->tx_pending;
+  if (uring_enter(uring, 0, 0) == -1) {
+    return -1;
+  }
+  int frames = tx_before - uring->tx_pending;
+  /* Frames received meanwhile wait in 'rx_ready': keep the eventfd up */
+  if ((uring_reap(uring) > 0) || (uring->rx_ready_num > 0)) {
+    uint64_t one = 1;
+    if (write(uring->event_fd, &one, sizeof(one)) == -1) {
+      /* The counter cannot overflow with these values */
+    }
+  }
+
+  return frames;
+}
+
+static int rawnet_uring_sendv
+( void * state, const struct iovec * iov, int iovcnt )
+{
+  struct rawnet_uring * uring = state;
+
+  int i;
+  int pkt_len = 0;
+  for (i=0; i<iovcnt; i++) {
+    pkt_len += iov[i].iov_len;
+  }
+  if (pkt_len > RAWNET_URING_BUF_SIZE) {
+    rawnet_seterror("Raw Packet too long (%d bytes)", pkt_len);
+    return -1;
+  }
+
+  if (uring->tx_free_num == 0) {
+    /* Every buffer in flight: submit and wait for a completion */
+    long int deadline = uring_now_ms() + RAWNET_URING_TX_WAIT_MS;
+    while ((uring->tx_free_num == 0) && (uring_now_ms() < deadline)) {
+      if (uring_enter(uring, 1, deadline - uring_now_ms()) == -1) {
+        return -1;
+      }
+      rawnet_uring_flush(uring);
+    }
+    if (uring->tx_free_num == 0) {
+      rawnet_seterror("io_uring send queue is full, call rawnet_flush()");
+      return -2;
+    }
+  }
+
+  int idx = uring->tx_free[--uring->tx_free_num];
+  unsigned char * data = uring->tx_bufs + (idx * RAWNET_URING_BUF_SIZE);
+  for (i=0; i<iovcnt; i++) {
+    memcpy(data, iov[i].iov_base, iov[i].iov_len);
+    data += iov[i].iov_len;
+  }
+  uring->tx_len[idx] = pkt_len;
+
+  if (uring_queue_tx(uring, idx) == -1) {
+    /* Submission queue full: make room */
+    if ((rawnet_uring_flush(uring) == -1) || (uring_queue_tx(uring, idx) == -1)) {
+      uring->tx_free[uring->tx_free_num++] = idx;
+      rawnet_seterror("io_uring submission queue is full");
+      return -2;
+    }
+  }
+
+  return pkt_len;
+}
+
+const struct rawnet_backend rawnet_uring_backend = {
+  "uring:",
+  1,
+  1,
+  0,
+  rawnet_uring_open,
+  rawnet_uring_getfd,
+  rawnet_uring_recv,
+  rawnet_uring_sendv,
+  rawnet_uring_flush,
+  rawnet_uring_close,
+  NULL,
+  NULL,
+  NULL,
+};
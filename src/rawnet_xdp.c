@@ -0,0 +1,568 @@
+/* AF_XDP backend for rawnet ("xdp:<ifname>").
+ *
+ * Frames are exchanged with the kernel through a UMEM area shared with four
+ * rings (fill, RX, TX and completion). A small XDP program attached to the
+ * interface redirects into our socket only the ARP and IPv4 frames sent to
+ * our MAC address (or to a group address); everything else keeps going up
+ * the kernel stack. The program is attached in native (driver) mode when
+ * the driver supports it, and in generic (SKB) mode otherwise, so it also
+ * works on veth pairs and ordinary NICs.
+ *
+ * No libbpf/libxdp: the program is assembled here and loaded with bpf(2).
+ */
+#include "rawnet_backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* UMEM geometry: half of the frames are lent to the kernel for RX through
+   the fill ring, the other half are used to transmit */
+#define RAWNET_XDP_FRAME_SIZE 2048
+#define RAWNET_XDP_FRAME_NR 4096
+#define RAWNET_XDP_RING_SIZE (RAWNET_XDP_FRAME_NR / 2)
+/* Only the first queue of the interface is bound */
+#define RAWNET_XDP_QUEUE 0
+/* Maximum time sendv() waits for a TX frame to be completed */
+#define RAWNET_XDP_TX_WAIT_MS 1000
+/* Size of the verifier log returned when the program is rejected */
+#define RAWNET_XDP_LOG_SIZE 4096
+
+#define RAWNET_XDP_ETH_HEADER 14
+#define RAWNET_XDP_ETH_ARP 0x0806
+#define RAWNET_XDP_ETH_IPv4 0x0800
+
+/* One of the four rings shared with the kernel */
+struct xdp_ring {
+  uint32_t * producer;
+  uint32_t * consumer;
+  uint32_t * flags;
+  void * descs;
+  uint32_t mask;
+  void * map;
+  size_t map_len;
+};
+
+struct rawnet_xdp {
+  int xsk_fd;
+  int map_fd;              /* XSKMAP the program redirects to */
+  int prog_fd;
+  int link_fd;             /* Attachment of the program to the interface */
+  unsigned char * umem;
+  struct xdp_ring fill;
+  struct xdp_ring comp;
+  struct xdp_ring rx;
+  struct xdp_ring tx;
+  uint64_t rx_held;        /* Frame returned by the last recv() */
+  int rx_holding;
+  uint64_t tx_free[RAWNET_XDP_RING_SIZE]; /* TX frames not in flight */
+  int tx_free_num;
+  unsigned int tx_pending; /* Descriptors queued since the last kick */
+};
+
+
+static int xdp_bpf ( int cmd, union bpf_attr * attr )
+{
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static long int xdp_now_ms ()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000L) + (ts.tv_nsec / 1000000L);
+}
+
+static struct bpf_insn xdp_insn
+( uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm )
+{
+  struct bpf_insn insn;
+  memset(&insn, 0, sizeof(insn));
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+/* Load the XDP program that redirects our ARP and IPv4 frames to 'map_fd'.
+   Returns the program fd or -1 */
+static int xdp_prog_load ( int map_fd, const unsigned char mac[6] )
+{
+  uint32_t mac_lo;
+  uint16_t mac_hi;
+  /* Packet loads are in host byte order, compare against the same bytes */
+  memcpy(&mac_lo, mac, sizeof(mac_lo));
+  memcpy(&mac_hi, mac + 4, sizeof(mac_hi));
+
+  struct bpf_insn prog[] = {
+    /* 0: r6 = ctx; r2 = data; r3 = data_end */
+    xdp_insn(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),
+    xdp_insn(BPF_LDX | BPF_W | BPF_MEM, 2, 1, offsetof(struct xdp_md, data), 0),
+    xdp_insn(BPF_LDX | BPF_W | BPF_MEM, 3, 1, offsetof(struct xdp_md, data_end), 0),
+    /* 3: whole Ethernet header present? */
+    xdp_insn(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+    xdp_insn(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, RAWNET_XDP_ETH_HEADER),
+    xdp_insn(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 16, 0),            /* -> 22 */
+    /* 6: group address, or our MAC */
+    xdp_insn(BPF_LDX | BPF_B | BPF_MEM, 5, 2, 0, 0),
+    xdp_insn(BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, 0x01),
+    xdp_insn(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 4, 0),             /* -> 13 */
+    xdp_insn(BPF_LDX | BPF_W | BPF_MEM, 5, 2, 0, 0),
+    xdp_insn(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, 11, (int32_t) mac_lo), /* -> 22 */
+    xdp_insn(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 4, 0),
+    xdp_insn(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, 9, mac_hi),      /* -> 22 */
+    /* 13: ARP or IPv4 */
+    xdp_insn(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 12, 0),
+    xdp_insn(BPF_JMP32 | BPF_JEQ | BPF_K, 5, 0, 1, htons(RAWNET_XDP_ETH_ARP)), /* -> 16 */
+    xdp_insn(BPF_JMP32 | BPF_JNE | BPF_K, 5, 0, 6, htons(RAWNET_XDP_ETH_IPv4)), /* -> 22 */
+    /* 16: return bpf_redirect_map(map, rx_queue_index, XDP_PASS) */
+    xdp_insn(BPF_LDX | BPF_W | BPF_MEM, 2, 6, offsetof(struct xdp_md, rx_queue_index), 0),
+    xdp_insn(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+    xdp_insn(0, 0, 0, 0, 0),
+    xdp_insn(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),
+    xdp_insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+    xdp_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    /* 22: not for us, let the kernel have it */
+    xdp_insn(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),
+    xdp_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+  };
+
+  static char log[RAWNET_XDP_LOG_SIZE];
+  log[0] = '\0';
+
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uint64_t) (unsigned long) prog;
+  attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+  attr.license = (uint64_t) (unsigned long) "GPL";
+  attr.log_buf = (uint64_t) (unsigned long) log;
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+
+  int prog_fd = xdp_bpf(BPF_PROG_LOAD, &attr);
+  if (prog_fd == -1) {
+    rawnet_seterror("Cannot load XDP program: %s\n%s", strerror(errno), log);
+  }
+  return prog_fd;
+}
+
+/* Attach the program, natively if the driver can, else in generic mode.
+   Sets '*generic' accordingly. Returns the link fd or -1 */
+static int xdp_prog_attach ( int prog_fd, int ifindex, int * generic )
+{
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+
+  *generic = 0;
+  int link_fd = xdp_bpf(BPF_LINK_CREATE, &attr);
+  if (link_fd == -1) {
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    *generic = 1;
+    link_fd = xdp_bpf(BPF_LINK_CREATE, &attr);
+  }
+  if (link_fd == -1) {
+    rawnet_seterror("Cannot attach XDP program: %s", strerror(errno));
+  }
+  return link_fd;
+}
+
+static int xdp_ring_map
+( struct xdp_ring * ring, int fd, struct xdp_ring_offset * off,
+  size_t desc_size, off_t pgoff )
+{
+  ring->map_len = off->desc + (RAWNET_XDP_RING_SIZE * desc_size);
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    rawnet_seterror("Cannot mmap() AF_XDP ring: %s", strerror(errno));
+    return -1;
+  }
+  unsigned char * base = ring->map;
+  ring->producer = (uint32_t *) (base + off->producer);
+  ring->consumer = (uint32_t *) (base + off->consumer);
+  ring->flags = (uint32_t *) (base + off->flags);
+  ring->descs = base + off->desc;
+  ring->mask = RAWNET_XDP_RING_SIZE - 1;
+  return 0;
+}
+
+static void xdp_ring_unmap ( struct xdp_ring * ring )
+{
+  if (ring->map != NULL) {
+    munmap(ring->map, ring->map_len);
+    ring->map = NULL;
+  }
+}
+
+/* Give 'addr' back to the kernel for receiving */
+static void xdp_fill ( struct rawnet_xdp * xdp, uint64_t addr )
+{
+  uint32_t prod = *xdp->fill.producer;
+  ((uint64_t *) xdp->fill.descs)[prod & xdp->fill.mask] = addr;
+  __atomic_store_n(xdp->fill.producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+/* Collect the TX frames the kernel has finished with */
+static void xdp_tx_reclaim ( struct rawnet_xdp * xdp )
+{
+  uint32_t cons = *xdp->comp.consumer;
+  uint32_t prod = __atomic_load_n(xdp->comp.producer, __ATOMIC_ACQUIRE);
+  while (cons != prod) {
+    xdp->tx_free[xdp->tx_free_num++] =
+      ((uint64_t *) xdp->comp.descs)[cons & xdp->comp.mask];
+    cons++;
+  }
+  __atomic_store_n(xdp->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+static void rawnet_xdp_close ( void * state )
+{
+  struct rawnet_xdp * xdp = state;
+  if (xdp == NULL) {
+    return;
+  }
+  /* Closing the link detaches the program from the interface */
+  if (xdp->link_fd != -1) {
+    close(xdp->link_fd);
+  }
+  if (xdp->prog_fd != -1) {
+    close(xdp->prog_fd);
+  }
+  if (xdp->map_fd != -1) {
+    close(xdp->map_fd);
+  }
+  xdp_ring_unmap(&xdp->rx);
+  xdp_ring_unmap(&xdp->tx);
+  xdp_ring_unmap(&xdp->fill);
+  xdp_ring_unmap(&xdp->comp);
+  if (xdp->xsk_fd != -1) {
+    close(xdp->xsk_fd);
+  }
+  if (xdp->umem != NULL) {
+    munmap(xdp->umem, RAWNET_XDP_FRAME_NR * RAWNET_XDP_FRAME_SIZE);
+  }
+  free(xdp);
+}
+
+static void * rawnet_xdp_open ( const char * ifname, int ifindex, int socket_fd )
+{
+  struct rawnet_xdp * xdp = calloc(1, sizeof(struct rawnet_xdp));
+  if (xdp == NULL) {
+    rawnet_seterror("Cannot allocate memory for the AF_XDP socket");
+    return NULL;
+  }
+  xdp->xsk_fd = -1;
+  xdp->map_fd = -1;
+  xdp->prog_fd = -1;
+  xdp->link_fd = -1;
+
+  /* Our MAC address, for the program */
+  unsigned char mac[6];
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, ifname, IF_NAMESIZE - 1);
+  int ctl_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if ((ctl_fd == -1) || (ioctl(ctl_fd, SIOCGIFHWADDR, &ifr) == -1)) {
+    rawnet_seterror("Cannot obtain HW address of \"%s\": %s",
+                    ifname, strerror(errno));
+    if (ctl_fd != -1) {
+      close(ctl_fd);
+    }
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+  close(ctl_fd);
+  memcpy(mac, ifr.ifr_hwaddr.sa_data, sizeof(mac));
+
+  /* UMEM shared with the kernel */
+  size_t umem_len = RAWNET_XDP_FRAME_NR * RAWNET_XDP_FRAME_SIZE;
+  xdp->umem = mmap(NULL, umem_len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (xdp->umem == MAP_FAILED) {
+    xdp->umem = NULL;
+    rawnet_seterror("Cannot allocate AF_XDP UMEM: %s", strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  xdp->xsk_fd = socket(AF_XDP, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (xdp->xsk_fd == -1) {
+    rawnet_seterror("Cannot create AF_XDP socket: %s", strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  struct xdp_umem_reg umem_reg;
+  memset(&umem_reg, 0, sizeof(umem_reg));
+  umem_reg.addr = (uint64_t) (unsigned long) xdp->umem;
+  umem_reg.len = umem_len;
+  umem_reg.chunk_size = RAWNET_XDP_FRAME_SIZE;
+  umem_reg.headroom = 0;
+
+  int ring_size = RAWNET_XDP_RING_SIZE;
+  if ((setsockopt(xdp->xsk_fd, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)) == -1) ||
+      (setsockopt(xdp->xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) == -1) ||
+      (setsockopt(xdp->xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) == -1) ||
+      (setsockopt(xdp->xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) == -1) ||
+      (setsockopt(xdp->xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) == -1)) {
+    rawnet_seterror("Cannot set up AF_XDP UMEM and rings: %s", strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  struct xdp_mmap_offsets off;
+  socklen_t off_len = sizeof(off);
+  if (getsockopt(xdp->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &off_len) == -1) {
+    rawnet_seterror("Cannot get AF_XDP ring offsets: %s", strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+  if ((xdp_ring_map(&xdp->fill, xdp->xsk_fd, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) == -1) ||
+      (xdp_ring_map(&xdp->comp, xdp->xsk_fd, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) == -1) ||
+      (xdp_ring_map(&xdp->rx, xdp->xsk_fd, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) == -1) ||
+      (xdp_ring_map(&xdp->tx, xdp->xsk_fd, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) == -1)) {
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  /* First half of the UMEM receives, the second half transmits */
+  int i;
+  for (i=0; i<RAWNET_XDP_RING_SIZE; i++) {
+    xdp_fill(xdp, (uint64_t) i * RAWNET_XDP_FRAME_SIZE);
+    xdp->tx_free[i] = (uint64_t) (RAWNET_XDP_RING_SIZE + i) * RAWNET_XDP_FRAME_SIZE;
+  }
+  xdp->tx_free_num = RAWNET_XDP_RING_SIZE;
+
+  /* Program and the map it redirects to */
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint32_t);
+  attr.max_entries = RAWNET_XDP_QUEUE + 1;
+  xdp->map_fd = xdp_bpf(BPF_MAP_CREATE, &attr);
+  if (xdp->map_fd == -1) {
+    rawnet_seterror("Cannot create XSKMAP: %s", strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+  xdp->prog_fd = xdp_prog_load(xdp->map_fd, mac);
+  if (xdp->prog_fd == -1) {
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+  int generic;
+  xdp->link_fd = xdp_prog_attach(xdp->prog_fd, ifindex, &generic);
+  if (xdp->link_fd == -1) {
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  /* Generic mode can only copy; natively let the kernel pick zero-copy */
+  struct sockaddr_xdp sxdp;
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = ifindex;
+  sxdp.sxdp_queue_id = RAWNET_XDP_QUEUE;
+  sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | (generic ? XDP_COPY : 0);
+  if (bind(xdp->xsk_fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) == -1) {
+    rawnet_seterror("Cannot bind() AF_XDP socket to \"%s\" queue %d: %s",
+                    ifname, RAWNET_XDP_QUEUE, strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  uint32_t key = RAWNET_XDP_QUEUE;
+  uint32_t value = xdp->xsk_fd;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = xdp->map_fd;
+  attr.key = (uint64_t) (unsigned long) &key;
+  attr.value = (uint64_t) (unsigned long) &value;
+  if (xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) == -1) {
+    rawnet_seterror("Cannot add AF_XDP socket to XSKMAP: %s", strerror(errno));
+    rawnet_xdp_close(xdp);
+    return NULL;
+  }
+
+  return xdp;
+}
+
+static int rawnet_xdp_getfd ( void * state )
+{
+  struct rawnet_xdp * xdp = state;
+  return xdp->xsk_fd;
+}
+
+static int rawnet_xdp_recv
+( void * state, unsigned char ** frame, int * pkt_len, long int timeout )
+{
+  struct rawnet_xdp * xdp = state;
+
+  /* The previous frame is no longer in use */
+  if (xdp->rx_holding) {
+    xdp_fill(xdp, xdp->rx_held);
+    xdp->rx_holding = 0;
+  }
+
+  long int deadline = (timeout > 0) ? xdp_now_ms() + timeout : 0;
+  while (1) {
+    uint32_t cons = *xdp->rx.consumer;
+    uint32_t prod = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE);
+    if (cons != prod) {
+      struct xdp_desc * desc =
+        &((struct xdp_desc *) xdp->rx.descs)[cons & xdp->rx.mask];
+      xdp->rx_held = desc->addr;
+      xdp->rx_holding = 1;
+      *frame = xdp->umem + desc->addr;
+      *pkt_len = desc->len;
+      __atomic_store_n(xdp->rx.consumer, cons + 1, __ATOMIC_RELEASE);
+      return desc->len;
+    }
+
+    /* Nothing yet: poll() also wakes the kernel up to refill */
+    long int wait = timeout;
+    if (timeout > 0) {
+      wait = deadline - xdp_now_ms();
+      if (wait < 0) {
+        wait = 0;
+      }
+    }
+    struct pollfd pollfd;
+    pollfd.fd = xdp->xsk_fd;
+    pollfd.events = POLLIN;
+    pollfd.revents = 0;
+    int err = poll(&pollfd, 1, wait);
+    if (err == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      rawnet_seterror("Cannot wait for next AF_XDP frame: %s", strerror(errno));
+      return -1;
+    } else if (err == 0) {
+      return 0;
+    }
+  }
+}
+
+static int rawnet_xdp_flush ( void * state )
+{
+  struct rawnet_xdp * xdp = state;
+
+  int frames = xdp->tx_pending;
+  if (frames > 0) {
+    /* Generic/copy mode transmits from this system call */
+    if (__atomic_load_n(xdp->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) {
+      if ((sendto(xdp->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0) == -1) &&
+          (errno != EAGAIN) && (errno != EBUSY) && (errno != ENOBUFS)) {
+        rawnet_seterror("Cannot kick AF_XDP TX ring: %s", strerror(errno));
+        return -1;
+      }
+    }
+    xdp->tx_pending = 0;
+  }
+  xdp_tx_reclaim(xdp);
+
+  return frames;
+}
+
+static int rawnet_xdp_sendv
+( void * state, const struct iovec * iov, int iovcnt )
+{
+  struct rawnet_xdp * xdp = state;
+
+  int i;
+  int pkt_len = 0;
+  for (i=0; i<iovcnt; i++) {
+    pkt_len += iov[i].iov_len;
+  }
+  if (pkt_len > RAWNET_XDP_FRAME_SIZE) {
+    rawnet_seterror("Raw Packet too long for AF_XDP (%d bytes)", pkt_len);
+    return -1;
+  }
+
+  xdp_tx_reclaim(xdp);
+  if (xdp->tx_free_num == 0) {
+    /* All frames in flight: push them out and wait for one to complete */
+    if (rawnet_xdp_flush(xdp) == -1) {
+      return -1;
+    }
+    long int deadline = xdp_now_ms() + RAWNET_XDP_TX_WAIT_MS;
+    while ((xdp->tx_free_num == 0) && (xdp_now_ms() < deadline)) {
+      struct pollfd pollfd;
+      pollfd.fd = xdp->xsk_fd;
+      pollfd.events = POLLOUT;
+      pollfd.revents = 0;
+      poll(&pollfd, 1, 1);
+      sendto(xdp->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+      xdp_tx_reclaim(xdp);
+    }
+    if (xdp->tx_free_num == 0) {
+      rawnet_seterror("AF_XDP TX ring is full, call rawnet_flush()");
+      return -2;
+    }
+  }
+
+  uint64_t addr = xdp->tx_free[--xdp->tx_free_num];
+  unsigned char * data = xdp->umem + addr;
+  for (i=0; i<iovcnt; i++) {
+    memcpy(data, iov[i].iov_base, iov[i].iov_len);
+    data += iov[i].iov_len;
+  }
+
+  uint32_t prod = *xdp->tx.producer;
+  struct xdp_desc * desc =
+    &((struct xdp_desc *) xdp->tx.descs)[prod & xdp->tx.mask];
+  desc->addr = addr;
+  desc->len = pkt_len;
+  desc->options = 0;
+  __atomic_store_n(xdp->tx.producer, prod + 1, __ATOMIC_RELEASE);
+  xdp->tx_pending++;
+
+  return pkt_len;
+}
+
+const struct rawnet_backend rawnet_xdp_backend = {
+  "xdp:",
+  0,
+  1,
+  0,
+  rawnet_xdp_open,
+  rawnet_xdp_getfd,
+  rawnet_xdp_recv,
+  rawnet_xdp_sendv,
+  rawnet_xdp_flush,
+  rawnet_xdp_close,
+  NULL,
+  NULL,
+  NULL,
+};
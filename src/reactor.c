@@ -0,0 +1,465 @@
+#include "reactor.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/* Descriptor (o temporizador) registrado en el bucle */
+struct reactor_source {
+  int fd;
+  int is_timer;
+  reactor_handler_t handler;      /* NULL si se ha eliminado */
+  void * arg;
+  struct reactor_source * next;
+};
+
+/* Función a la que se llama antes de cada espera */
+struct reactor_prepare {
+  reactor_handler_t handler;
+  void * arg;
+  struct reactor_prepare * next;
+};
+
+/* Estructura del manejador del bucle de eventos */
+struct reactor {
+  int epoll_fd;
+  volatile sig_atomic_t running;
+  int dispatching;                  /* Dentro de 'reactor_run()' */
+  struct reactor_source * sources;  /* Fuentes registradas */
+  struct reactor_source * removed;  /* Eliminadas durante la vuelta actual,
+                                       se liberan al terminarla */
+  struct reactor_prepare * prepares;  /* Ver 'reactor_add_prepare()' */
+};
+
+
+/* reactor_t * reactor_create ();
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un bucle de eventos vacío.
+ *
+ * VALOR DEVUELTO:
+ *   Manejador del bucle de eventos.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+reactor_t * reactor_create ()
+{
+  struct reactor * reactor = malloc(sizeof(struct reactor));
+  if (reactor == NULL) {
+    fprintf(stderr, "reactor_create(): ERROR en malloc()\n");
+    return NULL;
+  }
+
+  reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (reactor->epoll_fd == -1) {
+    fprintf(stderr, "reactor_create(): ERROR en epoll_create1(): %s\n",
+            strerror(errno));
+    free(reactor);
+    return NULL;
+  }
+  reactor->running = 0;
+  reactor->dispatching = 0;
+  reactor->sources = NULL;
+  reactor->removed = NULL;
+  reactor->prepares = NULL;
+
+  return reactor;
+}
+
+
+/* int reactor_add_source
+ * ( reactor_t * reactor, int fd, int is_timer,
+ *   reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Añade 'fd' al conjunto de epoll y a la lista de fuentes.
+ */
+static int reactor_add_source
+( reactor_t * reactor, int fd, int is_timer, reactor_handler_t handler, void * arg )
+{
+  struct reactor_source * source = malloc(sizeof(struct reactor_source));
+  if (source == NULL) {
+    fprintf(stderr, "reactor_add_source(): ERROR en malloc()\n");
+    return -1;
+  }
+  source->fd = fd;
+  source->is_timer = is_timer;
+  source->handler = handler;
+  source->arg = arg;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = source;
+  if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    fprintf(stderr, "reactor_add_source(): ERROR en epoll_ctl(%d): %s\n",
+            fd, strerror(errno));
+    free(source);
+    return -1;
+  }
+
+  source->next = reactor->sources;
+  reactor->sources = source;
+
+  return 0;
+}
+
+
+/* int reactor_del_source ( reactor_t * reactor, int fd, int is_timer );
+ *
+ * DESCRIPCIÓN:
+ *   Quita 'fd' del conjunto de epoll y de la lista de fuentes. Si se está
+ *   atendiendo una vuelta la fuente no se libera todavía, porque puede haber
+ *   eventos suyos pendientes en esa misma vuelta.
+ */
+static int reactor_del_source ( reactor_t * reactor, int fd, int is_timer )
+{
+  struct reactor_source ** prev = &reactor->sources;
+  while ((*prev != NULL) &&
+         (((*prev)->fd != fd) || ((*prev)->is_timer != is_timer))) {
+    prev = &(*prev)->next;
+  }
+  struct reactor_source * source = *prev;
+  if (source == NULL) {
+    return -1;
+  }
+  *prev = source->next;
+
+  epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  if (is_timer) {
+    close(fd);
+  }
+
+  source->handler = NULL;
+  if (reactor->dispatching) {
+    source->next = reactor->removed;
+    reactor->removed = source;
+  } else {
+    free(source);
+  }
+
+  return 0;
+}
+
+
+/* int reactor_add_fd
+ * ( reactor_t * reactor, int fd, reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra el descriptor 'fd' para que se llame a 'handler'
+ *   cada vez que tenga datos para leer.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el descriptor se ha registrado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_add_fd
+( reactor_t * reactor, int fd, reactor_handler_t handler, void * arg )
+{
+  if ((reactor == NULL) || (handler == NULL)) {
+    fprintf(stderr, "reactor_add_fd(): ERROR: reactor o handler == NULL\n");
+    return -1;
+  }
+  return reactor_add_source(reactor, fd, 0, handler, arg);
+}
+
+
+/* int reactor_del_fd ( reactor_t * reactor, int fd );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función deja de vigilar el descriptor 'fd'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el descriptor se ha eliminado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el descriptor no estaba registrado.
+ */
+int reactor_del_fd ( reactor_t * reactor, int fd )
+{
+  if (reactor == NULL) {
+    return -1;
+  }
+  return reactor_del_source(reactor, fd, 0);
+}
+
+
+/* int reactor_set_timer
+ * ( reactor_t * reactor, int timer, long int timeout, long int period );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función vuelve a programar el temporizador 'timer'. Un 'timeout'
+ *   negativo lo para.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el temporizador se ha programado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_set_timer
+( reactor_t * reactor, int timer, long int timeout, long int period )
+{
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (timeout >= 0) {
+    spec.it_value.tv_sec = timeout / 1000;
+    spec.it_value.tv_nsec = (timeout % 1000) * 1000000;
+    if (timeout == 0) {
+      /* Un valor 0 pararía el temporizador: expirar cuanto antes */
+      spec.it_value.tv_nsec = 1;
+    }
+  }
+  if (period > 0) {
+    spec.it_interval.tv_sec = period / 1000;
+    spec.it_interval.tv_nsec = (period % 1000) * 1000000;
+  }
+
+  if (timerfd_settime(timer, 0, &spec, NULL) == -1) {
+    fprintf(stderr, "reactor_set_timer(): ERROR en timerfd_settime(): %s\n",
+            strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+
+/* int reactor_add_timer
+ * ( reactor_t * reactor, long int timeout, long int period,
+ *   reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un temporizador (timerfd) que llamará a 'handler'
+ *   dentro de 'timeout' milisegundos y, si 'period' es mayor que 0, cada
+ *   'period' milisegundos a partir de entonces.
+ *
+ * VALOR DEVUELTO:
+ *   El identificador del temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_add_timer
+( reactor_t * reactor, long int timeout, long int period,
+  reactor_handler_t handler, void * arg )
+{
+  if ((reactor == NULL) || (handler == NULL)) {
+    fprintf(stderr, "reactor_add_timer(): ERROR: reactor o handler == NULL\n");
+    return -1;
+  }
+
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer == -1) {
+    fprintf(stderr, "reactor_add_timer(): ERROR en timerfd_create(): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  if ((reactor_set_timer(reactor, timer, timeout, period) == -1) ||
+      (reactor_add_source(reactor, timer, 1, handler, arg) == -1)) {
+    close(timer);
+    return -1;
+  }
+
+  return timer;
+}
+
+
+/* int reactor_del_timer ( reactor_t * reactor, int timer );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina el temporizador 'timer'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el temporizador se ha eliminado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el temporizador no existe.
+ */
+int reactor_del_timer ( reactor_t * reactor, int timer )
+{
+  if (reactor == NULL) {
+    return -1;
+  }
+  return reactor_del_source(reactor, timer, 1);
+}
+
+
+/* int reactor_add_prepare
+ * ( reactor_t * reactor, reactor_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra 'handler' para que se le llame (con 'fd' -1) al
+ *   comienzo de cada vuelta, antes de esperar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si la función se ha registrado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_add_prepare
+( reactor_t * reactor, reactor_handler_t handler, void * arg )
+{
+  if ((reactor == NULL) || (handler == NULL)) {
+    fprintf(stderr, "reactor_add_prepare(): ERROR: reactor o handler == NULL\n");
+    return -1;
+  }
+
+  struct reactor_prepare * prepare = malloc(sizeof(struct reactor_prepare));
+  if (prepare == NULL) {
+    fprintf(stderr, "reactor_add_prepare(): ERROR en malloc()\n");
+    return -1;
+  }
+  prepare->handler = handler;
+  prepare->arg = arg;
+  prepare->next = reactor->prepares;
+  reactor->prepares = prepare;
+
+  return 0;
+}
+
+
+/* int reactor_run ( reactor_t * reactor, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera hasta 'timeout' milisegundos a que algún descriptor
+ *   o temporizador esté listo y llama a los manejadores de todos los que lo
+ *   estén.
+ *
+ * VALOR DEVUELTO:
+ *   El número de eventos atendidos, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_run ( reactor_t * reactor, long int timeout )
+{
+  if (reactor == NULL) {
+    fprintf(stderr, "reactor_run(): ERROR: reactor == NULL\n");
+    return -1;
+  }
+
+  /* Lo que haya dejado pendiente la vuelta anterior (o el programa antes de
+     entrar en el bucle) se completa antes de dormir */
+  struct reactor_prepare * prepare;
+  for (prepare = reactor->prepares; prepare != NULL; prepare = prepare->next) {
+    prepare->handler(reactor, -1, prepare->arg);
+  }
+
+  struct epoll_event events[REACTOR_EVENTS_MAX];
+  int events_num = epoll_wait(reactor->epoll_fd, events, REACTOR_EVENTS_MAX,
+                              (timeout < 0) ? -1 : (int) timeout);
+  if (events_num == -1) {
+    if (errno == EINTR) {
+      /* Una señal (p.ej. la que llama a 'reactor_stop()') */
+      return 0;
+    }
+    fprintf(stderr, "reactor_run(): ERROR en epoll_wait(): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  reactor->dispatching = 1;
+  int i;
+  for (i=0; i<events_num; i++) {
+    struct reactor_source * source = events[i].data.ptr;
+    if (source->handler == NULL) {
+      /* Eliminada por un manejador anterior de esta misma vuelta */
+      continue;
+    }
+    if (source->is_timer) {
+      /* Hay que leer las expiraciones para que deje de estar listo */
+      uint64_t expirations;
+      if (read(source->fd, &expirations, sizeof(expirations)) == -1) {
+        continue;
+      }
+    }
+    source->handler(reactor, source->fd, source->arg);
+  }
+  reactor->dispatching = 0;
+
+  while (reactor->removed != NULL) {
+    struct reactor_source * source = reactor->removed;
+    reactor->removed = source->next;
+    free(source);
+  }
+
+  return events_num;
+}
+
+
+/* int reactor_loop ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función atiende eventos hasta que se llame a 'reactor_stop()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 cuando se ha parado el bucle.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_loop ( reactor_t * reactor )
+{
+  if (reactor == NULL) {
+    fprintf(stderr, "reactor_loop(): ERROR: reactor == NULL\n");
+    return -1;
+  }
+
+  reactor->running = 1;
+  while (reactor->running) {
+    if (reactor_run(reactor, -1) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+/* void reactor_stop ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función hace que 'reactor_loop()' termine al acabar la vuelta
+ *   actual.
+ */
+void reactor_stop ( reactor_t * reactor )
+{
+  if (reactor != NULL) {
+    reactor->running = 0;
+  }
+}
+
+
+/* void reactor_destroy ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina el bucle de eventos y todos sus temporizadores.
+ */
+void reactor_destroy ( reactor_t * reactor )
+{
+  if (reactor == NULL) {
+    return;
+  }
+
+  while (reactor->sources != NULL) {
+    reactor_del_source(reactor, reactor->sources->fd,
+                       reactor->sources->is_timer);
+  }
+  while (reactor->prepares != NULL) {
+    struct reactor_prepare * prepare = reactor->prepares;
+    reactor->prepares = prepare->next;
+    free(prepare);
+  }
+  close(reactor->epoll_fd);
+  free(reactor);
+}
@@ -29,7 +29,6 @@ void print_ripv2_msg(ripv2_msg_t *packet,int size){
 
 ipv4_addr_t ip_addr;
 int err;
-unsigned char buffer[ETH_MTU];
 
 int main(int argc,char *argv[]){
 
@@ -46,7 +45,11 @@ int main(int argc,char *argv[]){
     }
 
     // abrimos socket UDP
-    err = udp_open(IP_CONFIG_FILE, ROUTE_CONFIG_FILE,0);
+    net_stack_t * stack = net_stack_create();
+    if(stack == NULL){
+        exit(-1);
+    }
+    err = udp_open(stack, IP_CONFIG_FILE, ROUTE_CONFIG_FILE,0);
     if(err < 0){
         printf("ERROR  abriendo puerto\n");
         exit(-1);
@@ -60,7 +63,7 @@ int main(int argc,char *argv[]){
     rip_req_pkt.entries[0].metric = htonl(16);
 
     // Enviamos paquete RIP
-    err = udp_send(ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE);
+    err = udp_send(stack, ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE);
     if (err < 0) {
         fprintf(stderr,"ERROR enviando\n");
         exit(-1);
@@ -68,11 +71,11 @@ int main(int argc,char *argv[]){
 
     ipv4_addr_t src_addr;
     uint16_t src_port = 0;
-    bzero(&buffer,ETH_MTU); //La MAC de la IP por la que preguntamos ha de ir a 0 para que se rellene
+    pkt_view_t view; //El mensaje se lee directamente de la trama recibida, sin copiarlo
 
-    int len = udp_recv(src_addr, &src_port, buffer, ETH_MTU, UDP_RCV_TIMEOUT );
+    int len = udp_recv_view(stack, src_addr, &src_port, &view, UDP_RCV_TIMEOUT );
 	if (len < 0) {
-		fprintf(stderr, "ERROR en udp_recv()\n");
+		fprintf(stderr, "ERROR en udp_recv_view()\n");
 	}
 	if (len == 0) {
 		fprintf(stderr, "ERROR: No hay respuesta del Servidor RIP\n");
@@ -83,7 +86,7 @@ int main(int argc,char *argv[]){
 		printf("Recibidos %d bytes del Servidor RIP(%s)\n", len, src_addr_str);
 		//print_pkt(buffer, len, 0);
 		ripv2_msg_t *reply_packet; 	  // Puntero al paquete de reply
-		reply_packet = (ripv2_msg_t *) buffer;
+		reply_packet = (ripv2_msg_t *) pkt_view_data(&view);
 		print_ripv2_msg(reply_packet,get_entries_size(len));
 
 	}
@@ -91,7 +94,8 @@ int main(int argc,char *argv[]){
 	// Cerrar interfaz UDP
 	printf("Cerrando interfaz UDP.\n");
 
-	udp_close();
+	udp_close(stack);
+	net_stack_destroy(stack);
 
 
     return 0;
@@ -55,7 +55,11 @@ int main(int argc,char *argv[]){
     }
 
     // abrimos socket UDP
-    err = udp_open(IP_CONFIG_FILE, ROUTE_CONFIG_FILE,0);
+    net_stack_t * stack = net_stack_create();
+    if(stack == NULL){
+        exit(-1);
+    }
+    err = udp_open(stack, IP_CONFIG_FILE, ROUTE_CONFIG_FILE,0);
     if(err < 0){
         printf("ERROR  abriendo puerto\n");
         exit(-1);
@@ -100,7 +104,7 @@ int main(int argc,char *argv[]){
 
 
     // Enviamos paquete RIP
-    err = udp_send(ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE*3);
+    err = udp_send(stack, ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE*3);
     if (err < 0) {
         fprintf(stderr,"ERROR enviando\n");
         exit(-1);
@@ -135,7 +139,7 @@ int main(int argc,char *argv[]){
 
 
     // Enviamos paquete RIP
-    err = udp_send(ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE*3);
+    err = udp_send(stack, ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE*3);
     if (err < 0) {
         fprintf(stderr,"ERROR enviando\n");
         exit(-1);
@@ -145,7 +149,8 @@ int main(int argc,char *argv[]){
   // Cerrar interfaz UDP
   printf("Cerrando interfaz UDP.\n");
 
-  udp_close();
+  udp_close(stack);
+  net_stack_destroy(stack);
 
 
     return 0;
@@ -181,7 +186,7 @@ int main(int argc,char *argv[]){
     rip_req_pkt.entries[2].addr_id=htons(0x02);
 
     // Enviamos paquete RIP
-    err = udp_send(ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE*3);
+    err = udp_send(stack, ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE*3);
     if (err < 0) {
         fprintf(stderr,"ERROR enviando\n");
         exit(-1);
@@ -191,7 +196,7 @@ int main(int argc,char *argv[]){
     uint16_t src_port = 0;
     bzero(&buffer,ETH_MTU); //La MAC de la IP por la que preguntamos ha de ir a 0 para que se rellene
 
-    int len = udp_recv(src_addr, &src_port, buffer, ETH_MTU, UDP_RCV_TIMEOUT );
+    int len = udp_recv(stack, src_addr, &src_port, buffer, ETH_MTU, UDP_RCV_TIMEOUT );
   if (len < 0) {
     fprintf(stderr, "ERROR en udp_recv()\n");
   }
@@ -212,7 +217,8 @@ int main(int argc,char *argv[]){
   // Cerrar interfaz UDP
   printf("Cerrando interfaz UDP.\n");
 
-  udp_close();
+  udp_close(stack);
+  net_stack_destroy(stack);
 
 
     return 0;
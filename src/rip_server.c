@@ -6,9 +6,11 @@
 ipv4_addr_t ip_addr;
 int err;
 
-unsigned char buffer[ETH_MTU]; // Reservamos más espacio para curarnos en salud.
 ripv2_route_table_t *rip_table;
-timerms_t update_timer;
+reactor_t *reactor;
+net_stack_t *stack;
+int update_timer;
+int table_timer;
 
 unsigned char triggered_update = 0;
 
@@ -22,12 +24,19 @@ int get_entries_size(int size){
 
 void free_and_exit(){
   printf("\nCerrando interfaz UDP.\n");
-  udp_close();
+  udp_close(stack);
+  net_stack_destroy(stack);
   printf("Liberando Memoria.\n");
   ripv2_route_table_free( rip_table );
+  reactor_destroy( reactor );
   exit(0);
 }
 
+/* Microsegundos transcurridos entre 'from' y 'to' */
+long rip_elapsed_us(struct timespec *from, struct timespec *to){
+  return (to->tv_sec - from->tv_sec) * 1000000L + (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
 void print_ripv2_msg(ripv2_msg_t *packet,int size){
   if(packet->command==RIP_REQUEST){
     printf("\tCOMMAND: REQUEST\n");
@@ -81,39 +90,62 @@ ripv2_entry_t rip_get_entry(ripv2_route_t *rip_route) {
   return entry;
 }
 
+/* int send_table(ripv2_route_table_t *table, uint16_t src_port, ipv4_addr_t src_addr);
+ *
+ * DESCRIPCIÓN:
+ *   Envía la tabla completa en mensajes RESPONSE de hasta RIPv2_MAX_ENTRIES
+ *   entradas. Todos los mensajes salen juntos con 'udp_send_batch()'.
+ */
 int send_table(ripv2_route_table_t *table, uint16_t src_port, ipv4_addr_t src_addr){
 
-  ripv2_msg_t rip_req_pkt;
-  bzero(&rip_req_pkt,RIPv2_PACKET_SIZE); //La MAC de la IP por la que preguntamos ha de ir a 0 para que se rellene
-  rip_req_pkt.command = RIP_RESPONSE;
-  rip_req_pkt.version = RIP_VERSION;
-
-   // calculamos el total de entradas que quedan
   int total_entries = ripv2_length(table);
-  if(total_entries>RIPv2_MAX_ENTRIES){
-    total_entries=RIPv2_MAX_ENTRIES;
+  int msgs_num = (total_entries + RIPv2_MAX_ENTRIES - 1) / RIPv2_MAX_ENTRIES;
+  if(msgs_num == 0){
+    msgs_num = 1;
   }
-  int i = 0;
 
-  for (i= 0; i<total_entries; i++){
-       ripv2_route_t *route_i = ripv2_route_table_get(table,i);
-       if(route_i==NULL) {
+  ripv2_msg_t * rip_msgs = malloc(msgs_num * sizeof(ripv2_msg_t));
+  if(rip_msgs == NULL){
+    fprintf(stderr, "send_table: sin memoria para %d mensajes\n", msgs_num);
+    return -1;
+  }
+  unsigned char * payloads[msgs_num];
+  int payload_lens[msgs_num];
+
+  int m;
+  int i = 0;
+  for (m = 0; m < msgs_num; m++){
+    ripv2_msg_t * rip_req_pkt = &rip_msgs[m];
+    bzero(rip_req_pkt,RIPv2_PACKET_SIZE);
+    rip_req_pkt->command = RIP_RESPONSE;
+    rip_req_pkt->version = RIP_VERSION;
+
+    int entries = 0;
+    for (; i < total_entries && entries < RIPv2_MAX_ENTRIES; i++, entries++){
+      ripv2_route_t *route_i = ripv2_route_table_get(table,i);
+      if(route_i==NULL) {
         printf("ripv2_route_table_get da null");
+        free(rip_msgs);
         return -1;
-        }
+      }
       ripv2_entry_t current_entry= rip_get_entry(route_i);
       if(current_entry.route_tag!=0) {
         printf("rip_get_entry da null");
+        free(rip_msgs);
         return -1;
       }
 
-      memcpy(&(rip_req_pkt.entries[i]), &current_entry, RIPv2_ENTRY_SIZE);
-  }
+      memcpy(&(rip_req_pkt->entries[entries]), &current_entry, RIPv2_ENTRY_SIZE);
+    }
 
-  print_ripv2_msg(&rip_req_pkt,total_entries*RIPv2_ENTRY_SIZE+RIPv2_HEADER_SIZE);
+    payloads[m] = (unsigned char *) rip_req_pkt;
+    payload_lens[m] = entries*RIPv2_ENTRY_SIZE + RIPv2_HEADER_SIZE;
+    print_ripv2_msg(rip_req_pkt, payload_lens[m]);
+  }
 
-  int err = udp_send(src_addr, src_port, (uint8_t *)&rip_req_pkt, total_entries*RIPv2_ENTRY_SIZE + RIPv2_HEADER_SIZE);
+  int err = udp_send_batch(stack, src_addr, src_port, payloads, payload_lens, msgs_num);
 
+  free(rip_msgs);
   return err;
 }
 
@@ -127,306 +159,371 @@ void send_request(ipv4_addr_t ip_addr){
   rip_req_pkt.entries[0].metric = htonl(16);
 
   // Enviamos paquete RIP
-  err = udp_send(ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE);
+  err = udp_send(stack, ip_addr, RIPv2_UDP_PORT, (uint8_t *)&rip_req_pkt, RIPv2_HEADER_SIZE + RIPv2_ENTRY_SIZE);
   if (err < 0) {
       fprintf(stderr,"ERROR enviando REQUEST\n");
   }
 }
 
 
-int main(int argc,char *argv[]){
+/* void rip_input(ipv4_addr_t src_addr, uint16_t src_port, unsigned char *payload, int len, void *arg);
+ *
+ * DESCRIPCIÓN:
+ *   Procesa un mensaje RIP recibido (ver 'udp_set_handler()'): contesta a los
+ *   REQUEST, aplica los RESPONSE a la tabla y envía el triggered update si
+ *   alguna ruta ha cambiado.
+ */
+void rip_input(ipv4_addr_t src_addr, uint16_t src_port, unsigned char *payload, int len, void *arg){
 
-    signal (SIGINT, free_and_exit); // Registramos la señal para cerrar el servidor
+  // Etapas para RIP_LATENCY: llegada al kernel, inicio del proceso, tabla actualizada y triggered update enviado
+  struct timespec t_arrival, t_start, t_table, t_sent;
+  int has_arrival = RIP_LATENCY && (udp_get_timestamp(stack, &t_arrival) == 0);
+  if(has_arrival){
+    clock_gettime(CLOCK_REALTIME, &t_start);
+  }
 
-    srand(time(NULL));  // To initialize the updated jitter
+  if (len>=24) {//si el paquete lleva carga
+    int i = 0;
+    /*Declaramos variables para gestionar el paquete*/
+			  char src_addr_str[IPv4_STR_MAX_LENGTH];  //Ip origen
+			  ipv4_addr_str(src_addr, src_addr_str);
+			  printf("Recibidos %d bytes del Servidor RIP : %s\n", len, src_addr_str);
 
-    rip_table =  ripv2_route_table_create();
-    // Si el usuario ha metido algo, suponemos que es una tabla rip y la cargamos.
-    if (argc == 2) {
-      // Copiamos la IP y comprobamos consistencia
-      err = ripv2_route_table_read ( argv[1], rip_table );
-      if(err==0){
-          fprintf(stderr, "ERROR: Archivo de rutas incorrecto '%s'\n",argv[1]);
-          return -1;
-      }
-      else{
-        printf("%d rutas importadas\n",err);
-        ripv2_route_table_print(rip_table);
+			  ripv2_msg_t *rip_message; 	  // Puntero al paquete de reply
+			  rip_message = (ripv2_msg_t *) payload; //casting de la trama recibida a la estructura de rip, sin copiarla
+    print_ripv2_msg(rip_message,len);
+
+			  //print_ripv2_msg(rip_message,get_entries_size(len));         /*Imprime el paquete*/
+
+    if(rip_message->command==RIP_REQUEST && (ripv2_length(rip_table)!=0) ){
+	         printf("Respondiendo a un RIP REQUEST de toda la tabla\n");
+      int entries_number = get_entries_size(len);
+      //1. check si hay una unica entrada a merica 16
+      if ((len == RIPv2_ENTRY_SIZE + RIPv2_HEADER_SIZE) && (ntohl(rip_message->entries[0].metric) == 16) && (ntohl(rip_message->entries[0].addr_id==0x00))){
+          //enviar nuestra tabla entera desde el port 520 a la ip/port origen
+        printf("Enviando toda la tabla\n");
+        int err = send_table(rip_table,src_port,src_addr);
+        if(err < 0){
+            printf("ERROR contestando al request de tabla entera\n");
+          exit(-1);
+        }
 
       }
+      else{           //2. Si se trata de rutas concretas ir rellenado el paquete y luego cambiarlo a tipo response
+	    printf("Respondiendo a un RIP REQUEST : %d entries\n",entries_number);
+        for(i=0;i<entries_number;i++){
+        //checkear cada ruta si la tenemos y cambiar la metrica del paquete
+          int index= ripv2_route_table_find(rip_table, rip_message->entries[i].ip_addr, rip_message->entries[i].subnet_mask);
+          if (index != -1){
+            ripv2_route_t *ruta = ripv2_route_table_get ( rip_table, index );
+            rip_message->entries[i].metric= htonl(ruta->metric);
+          }
+          else{
+            rip_message->entries[i].metric= htonl(16);
+          }
 
-    }
 
-    if(argc>2){
-      printf("Use: %s [routetable]\n", argv[0]);
-      return -1;
-    }
+        }
+        //cambiar el command a RIP_RESPONSE
+        rip_message->command=RIP_RESPONSE;
+          err = udp_send(stack, src_addr,src_port, (uint8_t *)rip_message, len );
+          if(err < 0){
+            printf("ERROR  contestando al request\n");
+          exit(-1);
+          }
 
-    // abrimos socket UDP
-    err = udp_open(IP_CONFIG_FILE, ROUTE_CONFIG_FILE,RIPv2_UDP_PORT);//puerto 520 es el que usan los ruters rip
-    if(err < 0){
-        printf("ERROR  abriendo puerto\n");
-        exit(-1);
+      }
     }
 
-    send_request(IPv4_MULTICAST_ADDR);
+    /*
+    Es nueva?
+      Si -> Añado
+      No -|
+        Es de mi padre?
+          Si -> Actualizo
+          No -|
+            Tiene menor metrica?
+              Si -> Actualiza
+              No -> Nada
+    */
+    if(rip_message->command==RIP_RESPONSE){
 
-    timerms_reset(&update_timer, RIPv2_UPDATE);
-    while(1){//Escucha todos los paquetes
+      int i = 0;
+      for(i = 0 ;i<get_entries_size(len); i++){
 
-		  ipv4_addr_t src_addr;
-		  uint16_t src_port = 0;
-		  bzero(&buffer,ETH_MTU); //La MAC de la IP por la que preguntamos ha de ir a 0 para que se rellene
+        int new_metric = ntohl(rip_message->entries[i].metric)+1;
 
-      //Calcula el siguiente momento en el que habrá que revisat la tabla
-      long int timeout = ripv2_get_min_timer(rip_table);
-      if(timerms_left(&update_timer) < timeout){
-        timeout = timerms_left(&update_timer);
-      }
-		  int len = udp_recv(src_addr, &src_port, buffer, ETH_MTU, timeout );
+        if (new_metric>=16){
+          new_metric = 16;
+        }
 
+        long long int route_timeout = RIPv2_TIMEOUT;
+        if(new_metric == 16) route_timeout = RIPv2_GARBAGE_TIMEOUT;
 
-      if (len < 0) {
-			 fprintf(stderr, "ERROR en udp_recv()\n");
-       exit(-1);
-		  }
+        int index= ripv2_route_table_find(rip_table, rip_message->entries[i].ip_addr, rip_message->entries[i].subnet_mask);
+          if (index != -1){
 
-      if (len == 0) {
-        ripv2_clear_table(rip_table);
+            ripv2_route_t * rip_route = ripv2_route_table_get (rip_table, index);
 
-        if (timerms_left(&update_timer) == 0) {
+            // SI VIENE DE PADRE
+            if(memcmp(src_addr,rip_route->next_hop,IPv4_ADDR_SIZE)==0){
+              //printf("Proviene de root, actualizando\n");
 
-          if(ripv2_length(rip_table)!= 0){
-            printf("Enviando Update:\n");
-            send_table(rip_table,RIPv2_UDP_PORT,IPv4_MULTICAST_ADDR);
-          }
+              ripv2_route_t *viejaruta = ripv2_route_table_remove ( rip_table, index );
 
-          int jittered_time = RIPv2_UPDATE +rand()%15000;
-          timerms_reset(&update_timer,jittered_time);
-          printf("Proximo update en %d secs\n",jittered_time/1000);
-        }
-        ripv2_route_table_print(rip_table);
-		  }
+              if(viejaruta->metric == 16 && new_metric==16){
+                route_timeout = timerms_left(&viejaruta->timer);
+              }
 
-      if (len>=24) {//si el paquete lleva carga
-        int i = 0;
-        /*Declaramos variables para gestionar el paquete*/
-			  char src_addr_str[IPv4_STR_MAX_LENGTH];  //Ip origen
-			  ipv4_addr_str(src_addr, src_addr_str);
-			  printf("Recibidos %d bytes del Servidor RIP : %s\n", len, src_addr_str);
+              if(new_metric!=viejaruta->metric){
+                triggered_update = 1;
+              }
 
-			  ripv2_msg_t *rip_message; 	  // Puntero al paquete de reply
-			  rip_message = (ripv2_msg_t *) buffer; //casting del buffer a la estructura de rip
-        print_ripv2_msg(rip_message,len);
+              ripv2_route_t *nuevaruta;
+
+              if(memcmp(rip_message->entries[i].next_hop,IPv4_ZERO_ADDR,IPv4_ADDR_SIZE)!=0){
+                nuevaruta = ripv2_route_create(
+                  rip_message->entries[i].ip_addr,
+                  rip_message->entries[i].subnet_mask,
+                  rip_message->entries[i].next_hop,
+                  new_metric,
+                  route_timeout
+                );
+              }else{  //the next_hop ==0.0.0.0
+                nuevaruta = ripv2_route_create(
+                  rip_message->entries[i].ip_addr,
+                  rip_message->entries[i].subnet_mask,
+                  src_addr,
+                  new_metric,
+                  route_timeout
+                );
+              }
 
-			  //print_ripv2_msg(rip_message,get_entries_size(len));         /*Imprime el paquete*/
+              int err = ripv2_route_table_add ( rip_table, nuevaruta );
+              if(err < 0){
+                printf("ERROR  añadiendo la ruta a la tabla de rip\n");
+              }else{
+                ipv4_arp_prewarm(stack, nuevaruta->next_hop); //Resolvemos ya su MAC, sin esperar
+              }
 
-        if(rip_message->command==RIP_REQUEST && (ripv2_length(rip_table)!=0) ){
-	         printf("Respondiendo a un RIP REQUEST de toda la tabla\n");
-          int entries_number = get_entries_size(len);
-          //1. check si hay una unica entrada a merica 16
-          if ((len == RIPv2_ENTRY_SIZE + RIPv2_HEADER_SIZE) && (ntohl(rip_message->entries[0].metric) == 16) && (ntohl(rip_message->entries[0].addr_id==0x00))){
-              //enviar nuestra tabla entera desde el port 520 a la ip/port origen
-            printf("Enviando toda la tabla\n");
-            int err = send_table(rip_table,src_port,src_addr);
-            if(err < 0){
-                printf("ERROR contestando al request de tabla entera\n");
-              exit(-1);
             }
+            // SI NO VIENE DE PADRE
+            else{
+              if(new_metric < rip_route->metric){
+                //printf("Mejor métrica, actualizando\n");
+
+                ripv2_route_table_remove ( rip_table, index );
+
+                ripv2_route_t *nuevaruta;
+
+                if(memcmp(rip_message->entries[i].next_hop,IPv4_ZERO_ADDR,IPv4_ADDR_SIZE)!=0){
+                  nuevaruta = ripv2_route_create(
+                    rip_message->entries[i].ip_addr,
+                    rip_message->entries[i].subnet_mask,
+                    rip_message->entries[i].next_hop,
+                    new_metric,
+                    route_timeout
+                  );
+                }
+                else{
+                  nuevaruta = ripv2_route_create(
+                    rip_message->entries[i].ip_addr,
+                    rip_message->entries[i].subnet_mask,
+                    src_addr,
+                    new_metric,
+                    route_timeout
+                  );
+                }
+
+                int err = ripv2_route_table_add ( rip_table, nuevaruta );
+                if(err < 0){
+                  printf("ERROR  añadiendo la ruta a la tabla de rip\n");
+                  exit(-1);
+                }
+                ipv4_arp_prewarm(stack, nuevaruta->next_hop); //Resolvemos ya su MAC, sin esperar
+                triggered_update = 1;
 
-          }
-          else{           //2. Si se trata de rutas concretas ir rellenado el paquete y luego cambiarlo a tipo response
-	    printf("Respondiendo a un RIP REQUEST : %d entries\n",entries_number);
-            for(i=0;i<entries_number;i++){
-            //checkear cada ruta si la tenemos y cambiar la metrica del paquete
-              int index= ripv2_route_table_find(rip_table, rip_message->entries[i].ip_addr, rip_message->entries[i].subnet_mask);
-              if (index != -1){
-                ripv2_route_t *ruta = ripv2_route_table_get ( rip_table, index );
-                rip_message->entries[i].metric= htonl(ruta->metric);
               }
               else{
-                rip_message->entries[i].metric= htonl(16);
+                //printf("La ruta no es mejor, idle\n");
+                //Refresco los timers
               }
+            }
 
+          }
+          // ES UNA NUEVA RUTA
+          else{
+              //printf("La ruta es nueva, añadiendo\n");
+
+              ripv2_route_t *nuevaruta;
+
+              if(memcmp(rip_message->entries[i].next_hop,IPv4_ZERO_ADDR,IPv4_ADDR_SIZE)!=0){
+                nuevaruta = ripv2_route_create(
+                  rip_message->entries[i].ip_addr,
+                  rip_message->entries[i].subnet_mask,
+                  rip_message->entries[i].next_hop,
+                  new_metric,
+                  route_timeout
+                  );
+              }else{
+                nuevaruta = ripv2_route_create(
+                  rip_message->entries[i].ip_addr,
+                  rip_message->entries[i].subnet_mask,
+                  src_addr,
+                  new_metric,
+                  route_timeout
+                  );
+              }
 
-            }
-            //cambiar el command a RIP_RESPONSE
-            rip_message->command=RIP_RESPONSE;
-              err = udp_send(src_addr,src_port, (uint8_t *)rip_message, len );
+              int err = ripv2_route_table_add ( rip_table, nuevaruta );
               if(err < 0){
-                printf("ERROR  contestando al request\n");
-              exit(-1);
+                printf("ERROR  añadiendo la ruta a la tabla de rip\n");
+              }else{
+                ipv4_arp_prewarm(stack, nuevaruta->next_hop); //Resolvemos ya su MAC, sin esperar
               }
 
           }
-        }
 
-        /*
-        Es nueva?
-          Si -> Añado
-          No -|
-            Es de mi padre?
-              Si -> Actualizo
-              No -|
-                Tiene menor metrica?
-                  Si -> Actualiza
-                  No -> Nada
-        */
-        if(rip_message->command==RIP_RESPONSE){
-
-          int i = 0;
-          for(i = 0 ;i<get_entries_size(len); i++){
-
-            int new_metric = ntohl(rip_message->entries[i].metric)+1;
-
-            if (new_metric>=16){
-              new_metric = 16;
-            }
+      }
+    }
+    //1. validar el origen
+      //2. actualizar la metrica "metric = MIN (metric + cost, infinity)"
+      //3. check si ya estaba esa ruta expirando
+      //4. añadir ruta: set addr, set metric, set net hop, initialize timeout, set route change flag, trigger if needed
+      //4.1 si existia la ruta comparar y quedarnos la mejor (mirar RFC)
+  }
 
-            long long int route_timeout = RIPv2_TIMEOUT;
-            if(new_metric == 16) route_timeout = RIPv2_GARBAGE_TIMEOUT;
-
-            int index= ripv2_route_table_find(rip_table, rip_message->entries[i].ip_addr, rip_message->entries[i].subnet_mask);
-              if (index != -1){
-
-                ripv2_route_t * rip_route = ripv2_route_table_get (rip_table, index);
-
-                // SI VIENE DE PADRE
-                if(memcmp(src_addr,rip_route->next_hop,IPv4_ADDR_SIZE)==0){
-                  //printf("Proviene de root, actualizando\n");
-
-                  ripv2_route_t *viejaruta = ripv2_route_table_remove ( rip_table, index );
-
-                  if(viejaruta->metric == 16 && new_metric==16){
-                    route_timeout = timerms_left(&viejaruta->timer);
-                  }
-
-                  if(new_metric!=viejaruta->metric){
-                    triggered_update = 1;
-                  }
-
-                  ripv2_route_t *nuevaruta;
-
-                  if(memcmp(rip_message->entries[i].next_hop,IPv4_ZERO_ADDR,IPv4_ADDR_SIZE)!=0){
-                    nuevaruta = ripv2_route_create(
-                      rip_message->entries[i].ip_addr,
-                      rip_message->entries[i].subnet_mask,
-                      rip_message->entries[i].next_hop,
-                      new_metric,
-                      route_timeout
-                    );
-                  }else{  //the next_hop ==0.0.0.0
-                    nuevaruta = ripv2_route_create(
-                      rip_message->entries[i].ip_addr,
-                      rip_message->entries[i].subnet_mask,
-                      src_addr,
-                      new_metric,
-                      route_timeout
-                    );
-                  }
-
-                  int err = ripv2_route_table_add ( rip_table, nuevaruta );
-                  if(err < 0){
-                    printf("ERROR  añadiendo la ruta a la tabla de rip\n");
-                  }
+  if(has_arrival){
+    clock_gettime(CLOCK_REALTIME, &t_table);
+  }
 
-                }
-                // SI NO VIENE DE PADRE
-                else{
-                  if(new_metric < rip_route->metric){
-                    //printf("Mejor métrica, actualizando\n");
-
-                    ripv2_route_table_remove ( rip_table, index );
-
-                    ripv2_route_t *nuevaruta;
-
-                    if(memcmp(rip_message->entries[i].next_hop,IPv4_ZERO_ADDR,IPv4_ADDR_SIZE)!=0){
-                      nuevaruta = ripv2_route_create(
-                        rip_message->entries[i].ip_addr,
-                        rip_message->entries[i].subnet_mask,
-                        rip_message->entries[i].next_hop,
-                        new_metric,
-                        route_timeout
-                      );
-                    }
-                    else{
-                      nuevaruta = ripv2_route_create(
-                        rip_message->entries[i].ip_addr,
-                        rip_message->entries[i].subnet_mask,
-                        src_addr,
-                        new_metric,
-                        route_timeout
-                      );
-                    }
-
-                    int err = ripv2_route_table_add ( rip_table, nuevaruta );
-                    if(err < 0){
-                      printf("ERROR  añadiendo la ruta a la tabla de rip\n");
-                      exit(-1);
-                    }
-                    triggered_update = 1;
-
-                  }
-                  else{
-                    //printf("La ruta no es mejor, idle\n");
-                    //Refresco los timers
-                  }
-                }
+  /*
+    TRIGGERED UPDATES
+  */
+  int triggered = triggered_update;
+  if(triggered_update){
+    printf("Enviando Triggered Update\n");
+    triggered_update = 0;
+    send_table(rip_table,RIPv2_UDP_PORT,IPv4_MULTICAST_ADDR);
+    if(has_arrival){
+      clock_gettime(CLOCK_REALTIME, &t_sent);
+    }
+    ripv2_route_table_print(rip_table);
 
-              }
-              // ES UNA NUEVA RUTA
-              else{
-                  //printf("La ruta es nueva, añadiendo\n");
-
-                  ripv2_route_t *nuevaruta;
-
-                  if(memcmp(rip_message->entries[i].next_hop,IPv4_ZERO_ADDR,IPv4_ADDR_SIZE)!=0){
-                    nuevaruta = ripv2_route_create(
-                      rip_message->entries[i].ip_addr,
-                      rip_message->entries[i].subnet_mask,
-                      rip_message->entries[i].next_hop,
-                      new_metric,
-                      route_timeout
-                      );
-                  }else{
-                    nuevaruta = ripv2_route_create(
-                      rip_message->entries[i].ip_addr,
-                      rip_message->entries[i].subnet_mask,
-                      src_addr,
-                      new_metric,
-                      route_timeout
-                      );
-                  }
-
-                  int err = ripv2_route_table_add ( rip_table, nuevaruta );
-                  if(err < 0){
-                    printf("ERROR  añadiendo la ruta a la tabla de rip\n");
-                  }
+  }
 
-              }
+  if(has_arrival){
+    printf("Latencia: cola %ld us, tabla %ld us", rip_elapsed_us(&t_arrival, &t_start), rip_elapsed_us(&t_start, &t_table));
+    if(triggered){
+      printf(", triggered update %ld us, total %ld us", rip_elapsed_us(&t_table, &t_sent), rip_elapsed_us(&t_arrival, &t_sent));
+    }
+    printf("\n");
+  }
 
-          }
-        }
-        //1. validar el origen
-          //2. actualizar la metrica "metric = MIN (metric + cost, infinity)"
-          //3. check si ya estaba esa ruta expirando
-          //4. añadir ruta: set addr, set metric, set net hop, initialize timeout, set route change flag, trigger if needed
-          //4.1 si existia la ruta comparar y quedarnos la mejor (mirar RFC)
-      }
+  //Las rutas nuevas o actualizadas pueden haber adelantado la próxima revisión de la tabla
+  reactor_set_timer(reactor, table_timer, ripv2_get_min_timer(rip_table), 0);
+}
+
+/* void rip_update(reactor_t *r, int timer, void *arg);
+ *
+ * DESCRIPCIÓN:
+ *   Temporizador del update periódico: anuncia la tabla y vuelve a programarse
+ *   con un jitter aleatorio.
+ */
+void rip_update(reactor_t *r, int timer, void *arg){
+  ripv2_clear_table(rip_table);
+
+  if(ripv2_length(rip_table)!= 0){
+    printf("Enviando Update:\n");
+    send_table(rip_table,RIPv2_UDP_PORT,IPv4_MULTICAST_ADDR);
+  }
+
+  int jittered_time = RIPv2_UPDATE +rand()%15000;
+  reactor_set_timer(r, timer, jittered_time, 0);
+  printf("Proximo update en %d secs\n",jittered_time/1000);
+  ripv2_route_table_print(rip_table);
+}
+
+/* void rip_table_check(reactor_t *r, int timer, void *arg);
+ *
+ * DESCRIPCIÓN:
+ *   Temporizador de la tabla: caduca las rutas expiradas, borra las que
+ *   estaban en garbage y se programa para la siguiente que vaya a expirar.
+ */
+void rip_table_check(reactor_t *r, int timer, void *arg){
+  ripv2_clear_table(rip_table);
+  ripv2_route_table_print(rip_table);
+  reactor_set_timer(r, timer, ripv2_get_min_timer(rip_table), 0);
+}
+
+int main(int argc,char *argv[]){
+
+    signal (SIGINT, free_and_exit); // Registramos la señal para cerrar el servidor
+
+    srand(time(NULL));  // To initialize the updated jitter
 
-      /*
-        TRIGGERED UPDATES
-      */
-      if(triggered_update){
-        printf("Enviando Triggered Update\n");
-        triggered_update = 0;
-        send_table(rip_table,RIPv2_UDP_PORT,IPv4_MULTICAST_ADDR);
+    rip_table =  ripv2_route_table_create();
+    // Si el usuario ha metido algo, suponemos que es una tabla rip y la cargamos.
+    if (argc == 2) {
+      // Copiamos la IP y comprobamos consistencia
+      err = ripv2_route_table_read ( argv[1], rip_table );
+      if(err==0){
+          fprintf(stderr, "ERROR: Archivo de rutas incorrecto '%s'\n",argv[1]);
+          return -1;
+      }
+      else{
+        printf("%d rutas importadas\n",err);
         ripv2_route_table_print(rip_table);
 
       }
 
-      
-	}
+    }
+
+    if(argc>2){
+      printf("Use: %s [routetable]\n", argv[0]);
+      return -1;
+    }
+
+    // abrimos socket UDP
+    stack = net_stack_create();
+    if(stack == NULL){
+        exit(-1);
+    }
+    err = udp_open(stack, IP_CONFIG_FILE, ROUTE_CONFIG_FILE,RIPv2_UDP_PORT);//puerto 520 es el que usan los ruters rip
+    if(err < 0){
+        printf("ERROR  abriendo puerto\n");
+        exit(-1);
+    }
+
+    if(RIP_LATENCY && udp_set_timestamps(stack, 1) < 0){
+        printf("AVISO: no se puede marcar la llegada de los mensajes\n");
+    }
+
+    // Bucle de eventos: los mensajes llegan a rip_input() y los timers a rip_update()/rip_table_check()
+    reactor = reactor_create();
+    if(reactor == NULL){
+        printf("ERROR creando el bucle de eventos\n");
+        exit(-1);
+    }
+    // Los temporizadores van antes que el puerto: rip_input() puede ejecutarse en cuanto se registra
+    update_timer = reactor_add_timer(reactor, RIPv2_UPDATE, 0, rip_update, NULL);
+    table_timer = reactor_add_timer(reactor, ripv2_get_min_timer(rip_table), 0, rip_table_check, NULL);
+    if(update_timer < 0 || table_timer < 0){
+        printf("ERROR creando los temporizadores\n");
+        exit(-1);
+    }
+    err = udp_set_handler(stack, rip_input, NULL);
+    if(err == 0){
+        err = udp_reactor_add(stack, reactor);
+    }
+    if(err < 0){
+        printf("ERROR registrando el puerto en el bucle de eventos\n");
+        exit(-1);
+    }
+
+    send_request(IPv4_MULTICAST_ADDR);
+
+    reactor_loop(reactor);
 
   free_and_exit();
 
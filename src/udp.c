@@ -1,185 +1,466 @@
-#include "udp.h"
-
-/*Valor para que sea trafico de tipo UDP*/
-#define UDP_IPv4_TYPE 17
-/*Valor maximo del puerto random de conexion que calculamos*/
-#define MAX_RAND_PORT 9000
-
-/*Estructura basica de un header datagrama UDP*/
-typedef struct udp_datagram {
-	uint16_t port_src; 		//valor a 0 por default, salvo que calculemos uno
-	uint16_t port_dst;
-	uint16_t length; 		// longitud en octetos de este datagrama incluyendo este header y los datos (minimum value=8)
-	uint16_t checksum; 		//¿tenemos funcion para esto?
-	unsigned char udp_payload[UDP_MAX_LENGTH];
-} udp_dtg_t;
-
-/*Estructura de un pseudoheader datagrama UDP*/
-typedef struct udp_pseudoheader{
-	ipv4_addr_t source_ip;
-	ipv4_addr_t destination_ip;
-	uint8_t zeros;
-	uint8_t proto;
-	uint8_t udp_length;
-	udp_dtg_t udp_header;
-} udp_pseudoh_t;
-
-/*variables globales*/
-uint16_t my_port;
-
-
-/*
- * int udp_open(char *config, char *rtable,uint16_t port);
- *
- * DESCRIPCIÓN:
- *   Esta función abre una conexion UDP para enviar paquetes.
- *
- * PARÁMETROS:
- *   'config': Puntero al file donde esta guardada la configuracion
- *   'rtable': Puntero al file donde esta guardada la routing table
- *	 'port': Puerto que queda a la escucha. Si el argumento es 0 se genera uno aleatorio.
- * VALOR DEVUELTO:
- *   El valor es '0' si la conexion udp ha sido abierta correctamente.
- *
- * ERRORES:
- *   La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
- */
-
-int udp_open(char *config, char *rtable,uint16_t port){
-
-	unsigned int seed = time(NULL);
-	srand(seed);
-
-	int err_code = ipv4_open(config, rtable);
-
-	if(port == 0){
-		my_port = get_rnd_port();
-	}
-	else{
-		my_port = port;
-	}
-	printf("Abierta interfaz UDP.\n");
-	return err_code;
-}
-
-
-/*
- * int udp_close();
- *
- * DESCRIPCIÓN:
- *   Esta función cierra una conexion UDP.
- *
- * VALOR DEVUELTO:
- *   El valor es '0' si la conexion udp ha sido cerrada correctamente.
- *
- * ERRORES:
- *   La función devuelve -1 si no ha podido cerrar la interfaz eth o ipv4.
- */
-int udp_close(){
-	return ipv4_close();
-}
-
-
-/*
- * int udp_send(ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len);
- *
- * DESCRIPCIÓN:
- *   Esta función envia un paquete UDP.
- *
- * PARÁMETROS:
- *   'dst_addr': Ip destino
- *   'port': Puerto utilizado para enviar
- *	 'payload': Puntero a los datos a enviar
- * 	 'payload_len': Tamaño de los datos a enviar
- *
- * VALOR DEVUELTO:
- * 		Devuelve 0 si el paquete ha sido creado, y enviado por a ipv4 correctamente
- *
- * ERRORES:
- *		La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
- */
-int udp_send(ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len ){
-	/*1. Declaramos y rellenamos el paquete UDP*/
-	//Declaramos
-	udp_dtg_t sent_pkt;
-	//Rellenamos
-	sent_pkt.port_src = htons(my_port);
-	printf("Se enviará al puerto %d, desde el puerto %d\n", port, my_port);
-	sent_pkt.port_dst = htons(port);
-	sent_pkt.length = htons(UDP_HEADER_SIZE + payload_len);
-	sent_pkt.checksum = htons(0); //lo ponemos a 0 porque asi no mira el pseudoheader
-	memcpy(sent_pkt.udp_payload, payload, payload_len);
-
-	//Lo mandamos a IPv4send
-	int err_code = ipv4_send(dst_addr,UDP_IPv4_TYPE, (unsigned char *)&sent_pkt, UDP_HEADER_SIZE + payload_len );
-	return err_code;
-}
-
-
-/*
- * int udp_recv(ipv4_addr_t src_addr, uint16_t port, unsigned char * buffer, int buffer_len, long int timeout )
- *
- * DESCRIPCIÓN:
- *   Esta función recibe un paquete UDP.
- *
- * PARÁMETROS:
- *   'src_addr': Ip source, nuestra IP
- *   'port': ARGUMENTO DE SALIDA : Develve el puerto de origen
- *	 'buffer': Puntero a al buffer donde se almacenan los datos recibidos
- * 	 'buffer_len': Tamaño de los datos recibidos
- *	 'timeout': timer que indica el tiempo que estaremos escuchando a recibir paquetes
- *
- * VALOR DEVUELTO:
- *   payload_len - UDP_HEADER_SIZE = tamaño de los datos de info sin el header de UDP
- *
- * ERRORES:
- *	 devuelve '-1' si hay un problema con la interfaz
- *   Devuelve '0' si no se ha recibido nada de payload
- */
-int udp_recv(ipv4_addr_t src_addr, uint16_t *port, unsigned char * buffer, int buffer_len, long int timeout ){
-
-		int payload_len = 0;
-		udp_dtg_t * recv_packet = NULL;
-		timerms_t timer;
-		timerms_reset(&timer, timeout); //Ponemos el primer temporizador para que la escucha no sea eterna.
-
-		do{ //Mientras que el puerto del que recibimos sea el deseado y el timer siga activo
-			long int timeleft = timerms_left(&timer);//Calcula el tiempo restante del timer
-			unsigned char udp_buffer[ETH_MTU];
-
-			//Enviamos a IPv4
-			payload_len = ipv4_recv(src_addr, UDP_IPv4_TYPE, udp_buffer,ETH_MTU, timeleft);
-			//Comprobamos la carga
-			if(payload_len==0) {
-				return 0;// no se ha recibido nada
-			}
-
-		//Hacemos un casting de los datos recibidos a la estructura de una cabecera UDP
-	  	recv_packet = (udp_dtg_t *) udp_buffer;
-
-		}while(!(ntohs(recv_packet->port_dst) == my_port) );// para que no nos traguemos todos los paquetes de la red
-
-		// "devolvemos" el puerto desde donde ha venido la información
-		*port = ntohs(recv_packet->port_src);
-
-		memcpy(buffer, recv_packet->udp_payload,payload_len - UDP_HEADER_SIZE); //Guardamos los datos recibidos
-
-		return payload_len - UDP_HEADER_SIZE;
-}
-
-/*
-* int get_rnd_port()
-*
-* DESCRIPCION
-*   Genera un puerto aleatorio (un numero entre 1025 y MAX_RAND_PORT)
-*
-* VALOR DEVUELTO
-*   Devuelve el valor generado
-*/
-int get_rnd_port(){
-	/* Generar número aleatorio entre 0 y RAND_MAX */
-	int dice = rand();
-	/* Número entero aleatorio entre 1 y RAND_MAX Para el puerto de conexion*/
-	int rnd_numb = 1025 + (int) (10.0 * dice / (MAX_RAND_PORT));
-	return rnd_numb;
-}
+#include "udp.h"
+#include "net_stack_state.h"
+
+/*Valor para que sea trafico de tipo UDP*/
+#define UDP_IPv4_TYPE 17
+/*Valor maximo del puerto random de conexion que calculamos*/
+#define MAX_RAND_PORT 9000
+
+/*Estructura basica de un header datagrama UDP*/
+typedef struct udp_datagram {
+	uint16_t port_src; 		//valor a 0 por default, salvo que calculemos uno
+	uint16_t port_dst;
+	uint16_t length; 		// longitud en octetos de este datagrama incluyendo este header y los datos (minimum value=8)
+	uint16_t checksum; 		//¿tenemos funcion para esto?
+	unsigned char udp_payload[UDP_MAX_LENGTH];
+} udp_dtg_t;
+
+/*Estructura de un pseudoheader datagrama UDP*/
+typedef struct udp_pseudoheader{
+	ipv4_addr_t source_ip;
+	ipv4_addr_t destination_ip;
+	uint8_t zeros;
+	uint8_t proto;
+	uint8_t udp_length;
+	udp_dtg_t udp_header;
+} udp_pseudoh_t;
+
+/*Estado UDP de una pila (ver "net_stack_state.h")*/
+struct udp_state {
+	uint16_t port;				//puerto en el que escuchamos
+	udp_handler_t handler;		//manejador de 'udp_set_handler()'
+	void * handler_arg;
+	unsigned int seed;			//semilla de 'get_rnd_port()', propia de cada pila
+};
+
+/*
+ * int udp_dtg_len(udp_dtg_t * recv_packet, int len);
+ *
+ * DESCRIPCIÓN:
+ *   Comprueba que la longitud de la cabecera de un datagrama recibido en
+ *   'len' bytes (los datos del paquete IPv4) es válida y cabe en ellos.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud del datagrama, cabecera incluida, o -1 si no es válido.
+ */
+static int udp_dtg_len(udp_dtg_t * recv_packet, int len){
+	if(len < UDP_HEADER_SIZE){
+		return -1;
+	}
+	int dtg_len = ntohs(recv_packet->length);
+	if(dtg_len < UDP_HEADER_SIZE || dtg_len > len){
+		return -1;
+	}
+	return dtg_len;
+}
+
+
+/*
+ * int udp_open(net_stack_t * stack, char *config, char *rtable,uint16_t port);
+ *
+ * DESCRIPCIÓN:
+ *   Esta función abre una conexion UDP para enviar paquetes.
+ *
+ * PARÁMETROS:
+ *   'config': Puntero al file donde esta guardada la configuracion
+ *   'rtable': Puntero al file donde esta guardada la routing table
+ *	 'port': Puerto que queda a la escucha. Si el argumento es 0 se genera uno aleatorio.
+ * VALOR DEVUELTO:
+ *   El valor es '0' si la conexion udp ha sido abierta correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
+ */
+
+int udp_open(net_stack_t * stack, char *config, char *rtable,uint16_t port){
+
+	if(stack->udp == NULL){
+		stack->udp = calloc(1, sizeof(struct udp_state));
+		if(stack->udp == NULL){
+			printf("UDP.C --> udp_open(): ERROR en calloc()\n");
+			return -1;
+		}
+	}
+	struct udp_state * udp = stack->udp;
+	//Cada pila tiene su semilla: 'rand()' compartiría la suya entre hilos
+	udp->seed = time(NULL) ^ (uintptr_t) stack;
+
+	int err_code = ipv4_open(stack, config, rtable);
+
+	if(port == 0){
+		udp->port = get_rnd_port(stack);
+	}
+	else{
+		udp->port = port;
+	}
+	if(err_code == 0){
+		//Los datagramas a otros puertos se descartan ya en el kernel
+		ipv4_filter_port(stack, UDP_IPv4_TYPE, udp->port);
+	}
+	printf("Abierta interfaz UDP.\n");
+	return err_code;
+}
+
+
+/*
+ * int udp_close(net_stack_t * stack);
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cierra una conexion UDP.
+ *
+ * VALOR DEVUELTO:
+ *   El valor es '0' si la conexion udp ha sido cerrada correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve -1 si no ha podido cerrar la interfaz eth o ipv4.
+ */
+int udp_close(net_stack_t * stack){
+	int err_code = ipv4_close(stack);
+	free(stack->udp);
+	stack->udp = NULL;
+	return err_code;
+}
+
+
+/*
+ * int udp_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len);
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envia un paquete UDP.
+ *
+ * PARÁMETROS:
+ *   'dst_addr': Ip destino
+ *   'port': Puerto utilizado para enviar
+ *	 'payload': Puntero a los datos a enviar
+ * 	 'payload_len': Tamaño de los datos a enviar
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve 0 si el paquete ha sido creado, y enviado por a ipv4 correctamente
+ *
+ * ERRORES:
+ *		La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
+ */
+int udp_send(net_stack_t * stack, ipv4_addr_t dst_addr,uint16_t port, unsigned char * payload, int payload_len ){
+	/*1. Copiamos los datos una única vez, dejando sitio delante para las cabeceras*/
+	pkt_buf_t buf;
+	pkt_buf_init(&buf);
+	unsigned char * data = pkt_buf_put(&buf, payload_len);
+	if(data == NULL){
+		printf("Datagrama demasiado grande (%d bytes)\n", payload_len);
+		return -1;
+	}
+	memcpy(data, payload, payload_len);
+
+	return udp_send_buf(stack, dst_addr, port, &buf);
+}
+
+/*
+ * int udp_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, pkt_buf_t * buf);
+ *
+ * DESCRIPCIÓN:
+ *   Envia un paquete UDP con los datos de 'buf', escribiendo la cabecera
+ *   delante de ellos en el espacio reservado.
+ *
+ * PARÁMETROS:
+ *   'dst_addr': Ip destino
+ *   'port': Puerto utilizado para enviar
+ *	 'buf': Datos a enviar, con espacio reservado para las cabeceras
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve 0 si el paquete ha sido creado, y enviado por a ipv4 correctamente
+ *
+ * ERRORES:
+ *		La función devuelve err_code que sera !=0 si algo no ha ocurrido como lo esperado
+ */
+int udp_send_buf(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, pkt_buf_t * buf){
+	int payload_len = buf->len;
+	udp_dtg_t * sent_pkt = (udp_dtg_t *) pkt_buf_push(buf, UDP_HEADER_SIZE);
+	if(sent_pkt == NULL){
+		printf("Sin espacio para la cabecera UDP\n");
+		return -1;
+	}
+	if(stack->udp == NULL){
+		printf("Conexion UDP no abierta\n");
+		return -1;
+	}
+	uint16_t my_port = stack->udp->port;
+	//Rellenamos la cabecera
+	sent_pkt->port_src = htons(my_port);
+	printf("Se enviará al puerto %d, desde el puerto %d\n", port, my_port);
+	sent_pkt->port_dst = htons(port);
+	sent_pkt->length = htons(UDP_HEADER_SIZE + payload_len);
+	sent_pkt->checksum = htons(0); //lo ponemos a 0 porque asi no mira el pseudoheader
+
+	//Lo mandamos a IPv4, que añade su cabecera delante de la nuestra
+	int err_code = ipv4_send_buf(stack, dst_addr,UDP_IPv4_TYPE, buf);
+	return err_code;
+}
+
+
+/*
+ * int udp_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, unsigned char * payloads[], int payload_lens[], int count);
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envia 'count' paquetes UDP al mismo destino de una vez.
+ *
+ * PARÁMETROS:
+ *   'dst_addr': Ip destino
+ *   'port': Puerto utilizado para enviar
+ *	 'payloads': Array con los datos de cada paquete
+ * 	 'payload_lens': Tamaño de los datos de cada paquete
+ * 	 'count': Número de paquetes
+ *
+ * VALOR DEVUELTO:
+ * 		Devuelve el número de datagramas enviados o encolados a la espera del
+ * 		ARP REPLY; si es menor que 'count' el resto se ha descartado
+ *
+ * ERRORES:
+ *		La función devuelve err_code que sera negativo si algo no ha ocurrido como lo esperado
+ *		Devuelve -1 si algún paquete supera UDP_MAX_LENGTH (y no envía ninguno)
+ */
+int udp_send_batch(net_stack_t * stack, ipv4_addr_t dst_addr, uint16_t port, unsigned char * payloads[], int payload_lens[], int count){
+	if(count <= 0){
+		return 0;
+	}
+	int i;
+	for(i=0; i<count; i++){
+		if(payload_lens[i] < 0 || payload_lens[i] > UDP_MAX_LENGTH){
+			printf("Datagrama %d demasiado grande (%d bytes)\n", i, payload_lens[i]);
+			return -1;
+		}
+	}
+	if(stack->udp == NULL){
+		printf("Conexion UDP no abierta\n");
+		return -1;
+	}
+	uint16_t my_port = stack->udp->port;
+
+	printf("Se enviarán %d paquetes al puerto %d, desde el puerto %d\n", count, port, my_port);
+	//Cada datagrama se copia una única vez, dejando sitio delante para las cabeceras
+	pkt_buf_t * bufs = malloc(count * sizeof(pkt_buf_t));
+	pkt_buf_t ** buf_ptrs = malloc(count * sizeof(pkt_buf_t *));
+	if(bufs == NULL || buf_ptrs == NULL){
+		fprintf(stderr, "udp_send_batch(): ERROR sin memoria para %d paquetes\n", count);
+		free(bufs);
+		free(buf_ptrs);
+		return -1;
+	}
+
+	for(i=0; i<count; i++){
+		pkt_buf_init(&bufs[i]);
+		memcpy(pkt_buf_put(&bufs[i], payload_lens[i]), payloads[i], payload_lens[i]);
+		udp_dtg_t * sent_pkt = (udp_dtg_t *) pkt_buf_push(&bufs[i], UDP_HEADER_SIZE);
+		sent_pkt->port_src = htons(my_port);
+		sent_pkt->port_dst = htons(port);
+		sent_pkt->length = htons(UDP_HEADER_SIZE + payload_lens[i]);
+		sent_pkt->checksum = htons(0);
+		buf_ptrs[i] = &bufs[i];
+	}
+
+	//IPv4 y Ethernet añaden sus cabeceras delante de la nuestra
+	int err_code = ipv4_send_buf_batch(stack, dst_addr, UDP_IPv4_TYPE, buf_ptrs, count);
+	free(bufs);
+	free(buf_ptrs);
+	return err_code;
+}
+
+
+/*
+ * int udp_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t port, unsigned char * buffer, int buffer_len, long int timeout )
+ *
+ * DESCRIPCIÓN:
+ *   Esta función recibe un paquete UDP.
+ *
+ * PARÁMETROS:
+ *   'src_addr': Ip source, nuestra IP
+ *   'port': ARGUMENTO DE SALIDA : Develve el puerto de origen
+ *	 'buffer': Puntero a al buffer donde se almacenan los datos recibidos
+ * 	 'buffer_len': Tamaño de los datos recibidos
+ *	 'timeout': timer que indica el tiempo que estaremos escuchando a recibir paquetes
+ *
+ * VALOR DEVUELTO:
+ *   payload_len - UDP_HEADER_SIZE = tamaño de los datos de info sin el header de UDP
+ *
+ * ERRORES:
+ *	 devuelve '-1' si hay un problema con la interfaz
+ *   Devuelve '0' si no se ha recibido nada de payload
+ */
+int udp_recv(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t *port, unsigned char * buffer, int buffer_len, long int timeout ){
+
+		pkt_view_t view;
+		int payload_len = udp_recv_view(stack, src_addr, port, &view, timeout);
+		if(payload_len <= 0) {
+			return payload_len;
+		}
+
+		if(payload_len > buffer_len) { //Copiamos lo que quepa
+			payload_len = buffer_len;
+		}
+		memcpy(buffer, pkt_view_data(&view), payload_len); //Guardamos los datos recibidos
+
+		return payload_len;
+}
+
+/*
+ * int udp_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t *port, pkt_view_t * view, long int timeout )
+ *
+ * DESCRIPCIÓN:
+ *   Recibe un datagrama UDP sin copiarlo: 'view' queda sobre la trama
+ *   recibida por 'ipv4_recv_view()', con la cabecera UDP consumida.
+ *
+ * PARÁMETROS:
+ *   'src_addr': IP de donde ha VENIDO el paquete
+ *   'port': Puerto de donde ha VENIDO el paquete
+ *	 'view': Vista donde se devuelve el datagrama
+ *	 'timeout': timer que indica el tiempo que estaremos escuchando a recibir paquetes
+ *
+ * VALOR DEVUELTO:
+ *   El tamaño de los datos del datagrama, o '0' si ha expirado el timeout.
+ *
+ * ERRORES:
+ *	 devuelve '-1' si hay un problema con la interfaz
+ */
+int udp_recv_view(net_stack_t * stack, ipv4_addr_t src_addr, uint16_t *port, pkt_view_t * view, long int timeout ){
+
+		if(stack->udp == NULL){
+			printf("Conexion UDP no abierta\n");
+			return -1;
+		}
+		uint16_t my_port = stack->udp->port;
+		int payload_len = 0;
+		udp_dtg_t * recv_packet = NULL;
+		timerms_t timer;
+		timerms_reset(&timer, timeout); //Ponemos el primer temporizador para que la escucha no sea eterna.
+
+		do{ //Mientras que el puerto del que recibimos sea el deseado y el timer siga activo
+			long int timeleft = timerms_left(&timer);//Calcula el tiempo restante del timer
+
+			//Enviamos a IPv4
+			payload_len = ipv4_recv_view(stack, src_addr, UDP_IPv4_TYPE, view, timeleft);
+			//Comprobamos la carga
+			if(payload_len<0) {
+				return -1;
+			}
+			if(payload_len==0) {
+				return 0;// no se ha recibido nada
+			}
+
+		//Hacemos un casting de los datos recibidos a la estructura de una cabecera UDP, sin copiarlos
+	  	recv_packet = (udp_dtg_t *) pkt_view_data(view);
+		payload_len = udp_dtg_len(recv_packet, payload_len);
+
+		}while(payload_len < 0 || !(ntohs(recv_packet->port_dst) == my_port) );// para que no nos traguemos todos los paquetes de la red
+
+		// "devolvemos" el puerto desde donde ha venido la información
+		*port = ntohs(recv_packet->port_src);
+
+		view->l4_offset = view->data_offset;
+		pkt_view_pull(view, UDP_HEADER_SIZE);
+		pkt_view_trim(view, payload_len - UDP_HEADER_SIZE);
+
+		return view->data_len;
+}
+
+/*
+ * void udp_input(ipv4_addr_t src_addr, unsigned char * payload, int payload_len, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Manejador de los paquetes IPv4 de tipo UDP (ver 'ipv4_set_handler()'):
+ *   entrega al manejador de la pila 'arg' los que van a su puerto.
+ */
+static void udp_input(ipv4_addr_t src_addr, unsigned char * payload, int payload_len, void * arg){
+	struct udp_state * udp = ((net_stack_t *) arg)->udp;
+	udp_dtg_t * recv_packet = (udp_dtg_t *) payload;
+	payload_len = udp_dtg_len(recv_packet, payload_len);
+	if(payload_len < 0 || ntohs(recv_packet->port_dst) != udp->port){
+		return;
+	}
+	udp->handler(src_addr, ntohs(recv_packet->port_src), recv_packet->udp_payload,
+	             payload_len - UDP_HEADER_SIZE, udp->handler_arg);
+}
+
+/*
+ * int udp_set_handler(net_stack_t * stack, udp_handler_t handler, void * arg);
+ *
+ * DESCRIPCIÓN:
+ *   Registra 'handler' para los datagramas que lleguen a nuestro puerto.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el manejador se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto la conexion.
+ */
+int udp_set_handler(net_stack_t * stack, udp_handler_t handler, void * arg){
+	if(stack->udp == NULL){
+		return -1;
+	}
+	stack->udp->handler = handler;
+	stack->udp->handler_arg = arg;
+	return ipv4_set_handler(stack, UDP_IPv4_TYPE, (handler != NULL) ? udp_input : NULL, stack);
+}
+
+/*
+ * int udp_reactor_add(net_stack_t * stack, reactor_t * reactor);
+ *
+ * DESCRIPCIÓN:
+ *   Registra la conexion en el bucle de eventos 'reactor'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha registrado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si falla el registro.
+ */
+int udp_reactor_add(net_stack_t * stack, reactor_t * reactor){
+	return ipv4_reactor_add(stack, reactor);
+}
+
+/*
+ * int udp_set_timestamps(net_stack_t * stack, int enable);
+ *
+ * DESCRIPCIÓN:
+ *   Activa (o desactiva) la marca de tiempo de llegada de los datagramas.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si se ha cambiado.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no se ha abierto el interfaz o no se puede cambiar.
+ */
+int udp_set_timestamps(net_stack_t * stack, int enable){
+	return ipv4_set_timestamps(stack, enable);
+}
+
+/*
+ * int udp_get_timestamp(net_stack_t * stack, struct timespec * stamp);
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve en 'stamp' el instante de llegada del último datagrama.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve 0 si el datagrama tiene marca de tiempo.
+ *
+ * ERRORES:
+ *   Devuelve -1 si no la tiene.
+ */
+int udp_get_timestamp(net_stack_t * stack, struct timespec * stamp){
+	return ipv4_get_timestamp(stack, stamp);
+}
+
+/*
+* int get_rnd_port(net_stack_t * stack)
+*
+* DESCRIPCION
+*   Genera un puerto aleatorio (un numero entre 1025 y MAX_RAND_PORT)
+*
+* VALOR DEVUELTO
+*   Devuelve el valor generado
+*/
+int get_rnd_port(net_stack_t * stack){
+	/* Generar número aleatorio entre 0 y RAND_MAX */
+	int dice = rand_r(&stack->udp->seed);
+	/* Número entero aleatorio entre 1 y RAND_MAX Para el puerto de conexion*/
+	int rnd_numb = 1025 + (int) (10.0 * dice / (MAX_RAND_PORT));
+	return rnd_numb;
+}
@@ -61,7 +61,11 @@ int main ( int argc, char * argv[] )
 	}
 
 	/* Abriendo udp */
-	err = udp_open(argv[1], argv[2],0);
+	net_stack_t * stack = net_stack_create();
+	if(stack == NULL){
+		exit(-1);
+	}
+	err = udp_open(stack, argv[1], argv[2],0);
 	if(err < 0){
 		fprintf(stderr, "%s: ERROR en udp_open\n", myself);
 		exit(-1);
@@ -71,7 +75,7 @@ int main ( int argc, char * argv[] )
 	printf("Enviando %d bytes al Servidor UDP (%s):\n",payload_len, argv[3]);
 	print_pkt(payload, payload_len, 0);
 
-	err = udp_send(destination_ip, port, payload, payload_len);
+	err = udp_send(stack, destination_ip, port, payload, payload_len);
 	if (err < 0) {
 		fprintf(stderr, "%s: ERROR en udp_sends()\n", myself);
 		exit(-1);
@@ -82,7 +86,7 @@ int main ( int argc, char * argv[] )
 	ipv4_addr_t src_addr;
 	uint16_t src_port = 0;
 
-	len = udp_recv(src_addr, &src_port, buffer, ETH_MTU, timeout );
+	len = udp_recv(stack, src_addr, &src_port, buffer, ETH_MTU, timeout );
 	if (len < 0) {
 		fprintf(stderr, "%s: ERROR en udp_recv()\n", myself);
 	}
@@ -99,7 +103,8 @@ int main ( int argc, char * argv[] )
 	// Cerrar interfaz UDP
 	printf("Cerrando interfaz UDP.\n");
 
-	udp_close();
+	udp_close(stack);
+	net_stack_destroy(stack);
 
 	return 0;
 }
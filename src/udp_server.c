@@ -37,7 +37,11 @@ int main ( int argc, char * argv[] )
   uint16_t port = atoi(argv[3]);
 
   /* Abriendo udp */
-  int err = udp_open(argv[1], argv[2], port);
+  net_stack_t * stack = net_stack_create();
+  if(stack == NULL){
+    return -1;
+  }
+  int err = udp_open(stack, argv[1], argv[2], port);
 
   if(err < 0){
     fprintf(stderr, "%s: ERROR en udp_open\n", myself);
@@ -55,7 +59,7 @@ int main ( int argc, char * argv[] )
     printf("Escuchando tramas udp (puerto %d) ...\n", port);
     ipv4_addr_t src_addr;
     uint16_t src_port = 0;
-    int payload_len = udp_recv(src_addr, &src_port, buffer, ETH_MTU, timeout );
+    int payload_len = udp_recv(stack, src_addr, &src_port, buffer, ETH_MTU, timeout );
     if (payload_len == -1) {
       fprintf(stderr, "%s: ERROR en udp_recv()\n", myself);
       exit(-1);
@@ -71,7 +75,7 @@ int main ( int argc, char * argv[] )
     printf("Enviando %d bytes al Cliente udp (%s:%d):\n",payload_len, src_addr_str,src_port);
     print_pkt(buffer, payload_len, 0);
 
-    int len = udp_send(src_addr,src_port, buffer, payload_len);
+    int len = udp_send(stack, src_addr,src_port, buffer, payload_len);
     if (len == -1) {
       fprintf(stderr, "%s: ERROR en udp_send()\n", myself);
     }
@@ -80,7 +84,8 @@ int main ( int argc, char * argv[] )
   /* Cerrar interfaz udp */
   printf("Cerrando interfaz udp.\n");
 
-  udp_close();
+  udp_close(stack);
+  net_stack_destroy(stack);
 
   return 0;
 }